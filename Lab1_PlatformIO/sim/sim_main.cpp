@@ -0,0 +1,267 @@
+// ============================================
+// LED Switch - native button test
+// ============================================
+// Feeds the firmware's ButtonDecoder (shared_lib/ButtonInput) synthetic
+// switch contacts on a 0.1 ms virtual clock and checks the decoded events
+// and their latency. Every contact change bounces: the level flips at
+// random for the bounce time before it settles.
+//
+//   pio run -e native && .pio/build/native/program [--seed S] [--runs N]
+//
+// The driver is modelled the way the board runs it: every edge posts the
+// button task, which services the decoder after SIM_WAKE_MS (light sleep
+// exit) and again at the deadline poll() returned. "missed edges" delivers
+// no edges at all, only the pin wake, as if the interrupt never fired.
+//
+// The fuzz run compares against the previous sketch: Bounce2 polled every
+// 10 ms with its 50 ms stable interval. Exits non-zero if any check fails.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <random>
+#include <vector>
+
+#include <ButtonInput.h>
+
+const uint32_t SIM_STEP_US = 100;
+const uint32_t SIM_WAKE_MS = 1;         // GPIO wake from light sleep until the task runs
+const uint32_t SIM_MAX_LATENCY_MS = 20;
+const uint32_t BOUNCE2_POLL_MS = 10;    // previous loop(): delay(10)
+const uint32_t BOUNCE2_INTERVAL_MS = 50;
+
+static const uint32_t WAIT_FOREVER = 0xFFFFFFFFu;
+
+struct Edge {
+  uint32_t us;
+  bool pressed;
+};
+
+// Contact change at atMs that bounces for bounceUs before settling.
+static void contact(std::vector<Edge>& edges, uint32_t atMs, bool pressed, uint32_t bounceUs, std::mt19937& rng) {
+  uint32_t t = atMs * 1000;
+  uint32_t end = t + bounceUs;
+  bool level = pressed;
+  std::uniform_int_distribution<uint32_t> gap(50, 600);
+  while (t < end) {
+    edges.push_back(Edge{t, level});
+    level = !level;
+    t += gap(rng);
+  }
+  edges.push_back(Edge{t > end ? t : end, pressed});
+}
+
+static const char* eventName(ButtonEventType t) {
+  static const char* const names[] = { "press", "release", "click", "double", "long" };
+  return t <= BUTTON_LONG_PRESS ? names[t] : "?";
+}
+
+struct RunResult {
+  std::vector<ButtonEventType> events;
+  std::vector<uint32_t> pressLatencyMs;  // from the first edge of the press
+  uint32_t services = 0;
+};
+
+static RunResult runDecoder(const std::vector<Edge>& edges, uint32_t endMs, bool missedEdges) {
+  ButtonDecoder decoder;
+  decoder.begin(false, 0);
+  RunResult r;
+
+  bool level = false;
+  size_t next = 0;
+  uint32_t pollAtMs = WAIT_FOREVER;
+  uint32_t burstStartUs = 0;
+  bool settled = true;
+
+  for (uint32_t us = 0; us <= endMs * 1000; us += SIM_STEP_US) {
+    uint32_t ms = us / 1000;
+    while (next < edges.size() && edges[next].us <= us) {
+      if (level != edges[next].pressed) {
+        if (settled) burstStartUs = edges[next].us;
+        settled = false;
+        level = edges[next].pressed;
+        if (!missedEdges) decoder.edge(edges[next].us / 1000);
+        // The edge (or the pin wake) posts the task
+        uint32_t at = ms + SIM_WAKE_MS;
+        if (pollAtMs == WAIT_FOREVER || at < pollAtMs) pollAtMs = at;
+      }
+      next++;
+    }
+
+    if (pollAtMs == WAIT_FOREVER || ms < pollAtMs) continue;
+    uint32_t wait = decoder.poll(level, ms);
+    r.services++;
+    pollAtMs = wait == WAIT_FOREVER ? WAIT_FOREVER : ms + wait;
+
+    ButtonEvent e;
+    while (decoder.next(e)) {
+      r.events.push_back(e.type);
+      if (e.type == BUTTON_PRESS) r.pressLatencyMs.push_back(e.tMs - burstStartUs / 1000);
+      if (e.type == BUTTON_PRESS || e.type == BUTTON_RELEASE) settled = true;
+    }
+  }
+  return r;
+}
+
+// The previous sketch: Bounce2 stable-interval debounce polled from loop().
+// Latency is taken from the latest press in pressMs; a press shorter than
+// the interval can go unseen.
+static std::vector<uint32_t> runBounce2(const std::vector<Edge>& edges, const std::vector<uint32_t>& pressMs,
+                                        uint32_t endMs) {
+  std::vector<uint32_t> latency;
+  bool level = false, state = false, seen = false;
+  uint32_t changedMs = 0;
+  size_t next = 0, press = 0;
+
+  for (uint32_t ms = 0; ms <= endMs; ms += BOUNCE2_POLL_MS) {
+    while (next < edges.size() && edges[next].us <= ms * 1000) level = edges[next++].pressed;
+    while (press + 1 < pressMs.size() && pressMs[press + 1] <= ms) press++;
+
+    if (level != seen) {
+      seen = level;
+      changedMs = ms;
+    } else if (seen != state && ms - changedMs >= BOUNCE2_INTERVAL_MS) {
+      state = seen;
+      if (state) latency.push_back(ms - pressMs[press]);
+    }
+  }
+  return latency;
+}
+
+struct Scenario {
+  const char* name;
+  std::vector<Edge> edges;
+  uint32_t endMs;
+  bool missedEdges;
+  std::vector<ButtonEventType> expect;
+};
+
+static bool check(const Scenario& s) {
+  RunResult r = runDecoder(s.edges, s.endMs, s.missedEdges);
+  bool ok = r.events == s.expect;
+  uint32_t worst = 0;
+  for (uint32_t l : r.pressLatencyMs) {
+    if (l > worst) worst = l;
+  }
+  ok = ok && worst <= SIM_MAX_LATENCY_MS;
+
+  printf("%-18s %-4s %6u %9u  ", s.name, ok ? "ok" : "FAIL", worst, r.services);
+  for (ButtonEventType t : r.events) printf("%s ", eventName(t));
+  if (r.events != s.expect) {
+    printf(" (expected:");
+    for (ButtonEventType t : s.expect) printf(" %s", eventName(t));
+    printf(")");
+  }
+  printf("\n");
+  return ok;
+}
+
+static bool fuzz(uint32_t seed, int runs) {
+  std::mt19937 rng(seed);
+  std::uniform_int_distribution<uint32_t> bounce(0, 5000), hold(60, 400), gap(450, 1500);
+
+  std::vector<Edge> edges;
+  std::vector<uint32_t> pressMs;
+  uint32_t t = 100;
+  for (int i = 0; i < runs; i++) {
+    uint32_t held = hold(rng);
+    pressMs.push_back(t);
+    contact(edges, t, true, bounce(rng), rng);
+    contact(edges, t + held, false, bounce(rng), rng);
+    t += held + gap(rng);
+  }
+  uint32_t endMs = t + 500;
+
+  RunResult r = runDecoder(edges, endMs, false);
+  std::vector<uint32_t> old = runBounce2(edges, pressMs, endMs);
+
+  size_t presses = 0, clicks = 0;
+  for (ButtonEventType e : r.events) {
+    presses += e == BUTTON_PRESS;
+    clicks += e == BUTTON_CLICK;
+  }
+
+  printf("\n%-20s %7s %8s %8s %8s %10s\n", "fuzz", "presses", "mean_ms", "max_ms", "services", "services/s");
+  auto row = [&](const char* name, const std::vector<uint32_t>& lat, uint32_t services) {
+    double sum = 0;
+    uint32_t worst = 0;
+    for (uint32_t l : lat) {
+      sum += l;
+      if (l > worst) worst = l;
+    }
+    printf("%-20s %7zu %8.1f %8u %8u %10.2f\n", name, lat.size(), lat.empty() ? 0.0 : sum / lat.size(), worst,
+           services, services / (endMs / 1000.0));
+    return worst;
+  };
+  uint32_t worst = row("interrupt+settle", r.pressLatencyMs, r.services);
+  row("bounce2 10ms poll", old, endMs / BOUNCE2_POLL_MS);
+
+  bool ok = presses == (size_t)runs && clicks == (size_t)runs && worst <= SIM_MAX_LATENCY_MS;
+  printf("%s: %zu presses, %zu clicks of %d, worst latency %u ms\n", ok ? "ok" : "FAIL", presses, clicks, runs, worst);
+  return ok;
+}
+
+int main(int argc, char** argv) {
+  uint32_t seed = 1;
+  int runs = 500;
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "--seed") && i + 1 < argc) seed = (uint32_t)atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--runs") && i + 1 < argc) runs = atoi(argv[++i]);
+    else {
+      fprintf(stderr, "usage: %s [--seed S] [--runs N]\n", argv[0]);
+      return 2;
+    }
+  }
+
+  std::mt19937 rng(seed);
+  std::vector<Scenario> scenarios;
+  Scenario s;
+
+  s = Scenario{"click", {}, 1000, false, { BUTTON_PRESS, BUTTON_RELEASE, BUTTON_CLICK }};
+  contact(s.edges, 100, true, 3000, rng);
+  contact(s.edges, 250, false, 3000, rng);
+  scenarios.push_back(s);
+
+  s = Scenario{"heavy bounce", {}, 1000, false, { BUTTON_PRESS, BUTTON_RELEASE, BUTTON_CLICK }};
+  contact(s.edges, 100, true, 10000, rng);
+  contact(s.edges, 300, false, 10000, rng);
+  scenarios.push_back(s);
+
+  s = Scenario{"double click", {}, 1200, false,
+               { BUTTON_PRESS, BUTTON_RELEASE, BUTTON_PRESS, BUTTON_DOUBLE_CLICK, BUTTON_RELEASE }};
+  contact(s.edges, 100, true, 2000, rng);
+  contact(s.edges, 180, false, 2000, rng);
+  contact(s.edges, 330, true, 2000, rng);
+  contact(s.edges, 420, false, 2000, rng);
+  scenarios.push_back(s);
+
+  s = Scenario{"slow second press", {}, 1500, false,
+               { BUTTON_PRESS, BUTTON_RELEASE, BUTTON_CLICK, BUTTON_PRESS, BUTTON_RELEASE, BUTTON_CLICK }};
+  contact(s.edges, 100, true, 2000, rng);
+  contact(s.edges, 180, false, 2000, rng);
+  contact(s.edges, 600, true, 2000, rng);
+  contact(s.edges, 700, false, 2000, rng);
+  scenarios.push_back(s);
+
+  s = Scenario{"long press", {}, 2000, false, { BUTTON_PRESS, BUTTON_LONG_PRESS, BUTTON_RELEASE }};
+  contact(s.edges, 100, true, 3000, rng);
+  contact(s.edges, 1300, false, 3000, rng);
+  scenarios.push_back(s);
+
+  s = Scenario{"glitch", {}, 500, false, {}};
+  s.edges.push_back(Edge{100000, true});
+  s.edges.push_back(Edge{103000, false});
+  scenarios.push_back(s);
+
+  s = Scenario{"missed edges", {}, 1000, true, { BUTTON_PRESS, BUTTON_RELEASE, BUTTON_CLICK }};
+  contact(s.edges, 100, true, 0, rng);
+  contact(s.edges, 250, false, 0, rng);
+  scenarios.push_back(s);
+
+  printf("%-18s %-4s %6s %9s  %s\n", "scenario", "", "max_ms", "services", "events");
+  bool ok = true;
+  for (const Scenario& sc : scenarios) ok = check(sc) && ok;
+  ok = fuzz(seed, runs) && ok;
+  return ok ? 0 : 1;
+}
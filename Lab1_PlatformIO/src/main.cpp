@@ -1,52 +1,115 @@
 #include <Arduino.h>
-#include <Bounce2.h>
+#include <esp_sleep.h>
+#include <ButtonInput.h>
+#include <CoopScheduler.h>
 
 // Pin definitions
-const int SWITCH_PIN = D2;  // GPIO switch pin
+const int SWITCH_PIN = D2;  // GPIO switch pin (GPIO4: can wake from deep sleep)
 const int LED_PIN = D10;    // GPIO LED pin
 
-// Debounce object
-Bounce2::Button button = Bounce2::Button();
+// Untouched this long with the LED off: deep sleep until the next press (0 = never)
+static const uint32_t DEEP_SLEEP_IDLE_MS = 60000;
+
+// Interrupt-driven, debounced button; active low with the internal pull-up
+InterruptButton button(SWITCH_PIN);
 
 // Variable to track LED state
 bool ledState = false;
+bool sleepRequested = false;  // long press: sleep as soon as the button is let go
+
+// The button task runs on every edge and on its own debounce / gesture
+// deadlines; in between the board light-sleeps with the switch as a wake pin
+CoopScheduler<2> scheduler(SchedulerIdle::millisClock);
+TaskId buttonTask = NO_TASK;
+TaskId sleepTask = NO_TASK;
+
+void IRAM_ATTR onButtonEdge() {
+  scheduler.post(buttonTask);
+}
+
+void onPinWake() {
+  scheduler.post(buttonTask);
+}
+
+void setLed(bool on) {
+  ledState = on;
+  digitalWrite(LED_PIN, ledState ? HIGH : LOW);
+}
+
+void handleButton(const ButtonEvent& e) {
+  switch (e.type) {
+    case BUTTON_PRESS:
+      // Toggle LED state
+      setLed(!ledState);
+      Serial.printf("Button pressed - LED is now: %s (%u ms)\n", ledState ? "ON" : "OFF", e.latencyMs());
+      break;
+    case BUTTON_DOUBLE_CLICK:
+      Serial.println("Double click");
+      break;
+    case BUTTON_LONG_PRESS:
+      // Long press: LED off and deep sleep once the button is let go
+      setLed(false);
+      sleepRequested = true;
+      Serial.println("Long press - going to sleep");
+      break;
+    default:
+      break;
+  }
+}
+
+void serviceButton(void*) {
+  uint32_t wait = button.service();
+
+  ButtonEvent e;
+  while (button.next(e)) handleButton(e);
+
+  if (wait != SCHED_IDLE_FOREVER) scheduler.restart(buttonTask, wait);
+  SchedulerIdle::wakeOnPin(SWITCH_PIN, button.wakeLevel());
+
+  // Every pass restarts the idle countdown; a held button would wake
+  // straight back up, so never while it is down
+  if (button.idle() && !ledState && (sleepRequested || DEEP_SLEEP_IDLE_MS)) {
+    scheduler.restart(sleepTask, sleepRequested ? 0 : DEEP_SLEEP_IDLE_MS);
+  } else {
+    scheduler.cancel(sleepTask);
+  }
+}
+
+void enterDeepSleep(void*) {
+  Serial.println("Deep sleep until the next press");
+  Serial.flush();
+  button.enableDeepSleepWake();
+  esp_deep_sleep_start();
+}
 
 void setup() {
+  bool wokeByPress = esp_sleep_get_wakeup_cause() == ESP_SLEEP_WAKEUP_GPIO;
+
   // Initialize Serial for logging
   Serial.begin(115200);
-  delay(1000);  // Wait for serial to initialize
-  
+  if (!wokeByPress) delay(1000);  // Wait for serial to initialize; a wake-up press is waiting
+
   Serial.println("\n\n=== LED Switch Control Initialized ===");
   Serial.println("XIAO ESP32C3 - Tactile Switch with LED Control");
   Serial.println("=====================================\n");
-  
+
   // Configure LED pin
   pinMode(LED_PIN, OUTPUT);
   digitalWrite(LED_PIN, LOW);  // Start with LED off
-  
-  // Configure debounced button
-  button.attach(SWITCH_PIN, INPUT_PULLUP);  // Use internal pull-up
-  button.interval(50);  // Debounce interval in ms
-  button.setPressedState(LOW);  // Button is pressed when LOW
-  
+
+  SchedulerIdle::begin();
+  SchedulerIdle::onPinWake(onPinWake);
+  scheduler.onPost(SchedulerIdle::wake);
+  buttonTask = scheduler.timer(serviceButton);
+  sleepTask = scheduler.timer(enterDeepSleep);
+
+  // Configure the button interrupt; the first pass arms the wake pin
+  button.begin(onButtonEdge, wokeByPress);
+  scheduler.post(buttonTask);
+
   Serial.println("Setup complete. Waiting for button presses...\n");
 }
 
 void loop() {
-  // Update button state
-  button.update();
-  
-  // Check if button was pressed
-  if (button.pressed()) {
-    // Toggle LED state
-    ledState = !ledState;
-    digitalWrite(LED_PIN, ledState ? HIGH : LOW);
-    
-    // Log the state change
-    Serial.print("Button pressed - LED is now: ");
-    Serial.println(ledState ? "ON" : "OFF");
-  }
-  
-  // Small delay to prevent overwhelming the serial output
-  delay(10);
-}
\ No newline at end of file
+  SchedulerIdle::wait(scheduler.runReady());
+}
@@ -0,0 +1,214 @@
+#include "AdcPipeline.h"
+
+#include <math.h>
+
+bool fitAdcCurve(const float* code, const float* mv, size_t n, uint8_t degree, AdcCurve& out) {
+  if (degree < 1 || degree >= ADC_CURVE_TERMS || n <= degree) return false;
+  const size_t m = degree + 1;
+
+  // Normal equations over x = code / 4095, which keeps them well conditioned
+  double a[ADC_CURVE_TERMS][ADC_CURVE_TERMS + 1] = {};
+  for (size_t k = 0; k < n; k++) {
+    double x = code[k] / 4095.0;
+    double p[2 * ADC_CURVE_TERMS - 1];
+    p[0] = 1.0;
+    for (size_t i = 1; i < 2 * m - 1; i++) p[i] = p[i - 1] * x;
+    for (size_t i = 0; i < m; i++) {
+      for (size_t j = 0; j < m; j++) a[i][j] += p[i + j];
+      a[i][m] += p[i] * mv[k];
+    }
+  }
+
+  // Gauss-Jordan with partial pivoting
+  for (size_t col = 0; col < m; col++) {
+    size_t pivot = col;
+    for (size_t r = col + 1; r < m; r++) {
+      if (fabs(a[r][col]) > fabs(a[pivot][col])) pivot = r;
+    }
+    if (fabs(a[pivot][col]) < 1e-12) return false;
+    if (pivot != col) {
+      for (size_t j = 0; j <= m; j++) {
+        double t = a[col][j];
+        a[col][j] = a[pivot][j];
+        a[pivot][j] = t;
+      }
+    }
+    for (size_t r = 0; r < m; r++) {
+      if (r == col) continue;
+      double f = a[r][col] / a[col][col];
+      for (size_t j = col; j <= m; j++) a[r][j] -= f * a[col][j];
+    }
+  }
+
+  double scale = 1.0;
+  for (size_t i = 0; i < ADC_CURVE_TERMS; i++) {
+    out.c[i] = i < m ? (float)(a[i][m] / a[i][i] / scale) : 0.0f;
+    scale *= 4095.0;
+  }
+  return true;
+}
+
+void fillAdcTable(const AdcCurve& curve, uint16_t* table, size_t size) {
+  for (size_t code = 0; code < size; code++) {
+    float v = curve.mv((float)code) + 0.5f;
+    table[code] = v <= 0.0f ? 0 : v >= 65535.0f ? 65535 : (uint16_t)v;
+  }
+}
+
+void BlockDecimator::reset() {
+  count_ = 0;
+  min_ = 0xFFFF;
+  max_ = 0;
+  sum_ = 0;
+  sumSq_ = 0;
+}
+
+bool BlockDecimator::add(uint16_t mv, AdcBlock& out) {
+  count_++;
+  if (mv < min_) min_ = mv;
+  if (mv > max_) max_ = mv;
+  sum_ += mv;
+  sumSq_ += (uint32_t)mv * mv;
+  if (count_ < block_) return false;
+
+  double mean = (double)sum_ / count_;
+  double meanSq = (double)sumSq_ / count_;
+  double var = meanSq - mean * mean;
+  out.samples = count_;
+  out.minMv = min_;
+  out.maxMv = max_;
+  out.meanMv = (float)mean;
+  out.rmsMv = (float)sqrt(meanSq);
+  out.acRmsMv = var > 0 ? (float)sqrt(var) : 0.0f;
+  reset();
+  return true;
+}
+
+int AdcPipeline::addChannel(uint8_t channel, const uint16_t* mvTable) {
+  if (count_ >= ADC_PIPE_CHANNELS || mvTable == nullptr) return -1;
+  Slot& s = slots_[count_];
+  s.channel = channel;
+  s.table = mvTable;
+  s.decimator = BlockDecimator(blockSamples_);
+  return count_++;
+}
+
+void AdcPipeline::feed(const uint8_t* frame, size_t len) {
+  for (size_t i = 0; i + ADC_RESULT_BYTES <= len; i += ADC_RESULT_BYTES) {
+    AdcResult r = decodeAdcResult(frame + i);
+
+    Slot* s = nullptr;
+    for (uint8_t k = 0; k < count_; k++) {
+      if (slots_[k].channel == r.channel) s = &slots_[k];
+    }
+    if (r.unit != 0 || s == nullptr) {
+      foreign_++;
+      continue;
+    }
+
+    samples_++;
+    AdcBlockReport report;
+    if (s->decimator.add(s->table[r.code], report.block)) {
+      report.slot = (uint8_t)(s - slots_);
+      blocks_.push(report);
+    }
+  }
+}
+
+#ifdef ARDUINO
+
+#include <Arduino.h>
+#include <driver/adc.h>
+#include <esp_adc_cal.h>
+
+bool ContinuousAdc::begin(const int* pins, uint8_t count, uint32_t sampleHz, FrameFn onFrame) {
+  if (count == 0 || count > SOC_ADC_PATT_LEN_MAX) return false;
+  onFrame_ = onFrame;
+
+  adc_digi_pattern_config_t pattern[SOC_ADC_PATT_LEN_MAX] = {};
+  uint16_t mask = 0;
+  for (uint8_t i = 0; i < count; i++) {
+    int8_t ch = digitalPinToAnalogChannel(pins[i]);
+    if (ch < 0 || ch >= SOC_ADC_MAX_CHANNEL_NUM) return false;  // not an ADC1 pin
+    mask |= 1 << ch;
+    pattern[i].atten = ADC_ATTEN_DB_11;
+    pattern[i].channel = ch;
+    pattern[i].unit = 0;
+    pattern[i].bit_width = SOC_ADC_DIGI_MAX_BITWIDTH;
+  }
+
+  adc_digi_init_config_t init = {};
+  init.max_store_buf_size = ADC_FRAME_BYTES * ADC_FRAMES;
+  init.conv_num_each_intr = ADC_FRAME_BYTES;
+  init.adc1_chan_mask = mask;
+  init.adc2_chan_mask = 0;
+  if (adc_digi_initialize(&init) != ESP_OK) return false;
+
+  adc_digi_configuration_t cfg = {};
+  cfg.conv_limit_en = false;
+  cfg.conv_limit_num = 250;
+  cfg.pattern_num = count;
+  cfg.adc_pattern = pattern;
+  cfg.sample_freq_hz = sampleHz;
+  cfg.conv_mode = ADC_CONV_SINGLE_UNIT_1;
+  cfg.format = ADC_DIGI_OUTPUT_FORMAT_TYPE2;
+  if (adc_digi_controller_configure(&cfg) != ESP_OK || adc_digi_start() != ESP_OK) {
+    adc_digi_deinitialize();
+    return false;
+  }
+
+  // The reader only once the converter runs: a false return leaves neither
+  // a task nor the driver behind, so begin() can be tried again
+  if (xTaskCreate(readerTask, "adcReader", 3072, this, 5, (TaskHandle_t*)&task_) != pdPASS) {
+    task_ = nullptr;
+    end();
+    return false;
+  }
+  return true;
+}
+
+void ContinuousAdc::end() {
+  adc_digi_stop();
+  if (task_) vTaskDelete((TaskHandle_t)task_);
+  task_ = nullptr;
+  adc_digi_deinitialize();
+}
+
+void ContinuousAdc::readerTask(void* arg) {
+  ContinuousAdc* self = static_cast<ContinuousAdc*>(arg);
+
+  for (;;) {
+    AdcFrame* frame = self->frames_.acquire();
+    AdcFrame* dst = frame ? frame : &self->scratch_;
+
+    uint32_t len = 0;
+    esp_err_t err = adc_digi_read_bytes(dst->data, ADC_FRAME_BYTES, &len, ADC_MAX_DELAY);
+    if (err == ESP_ERR_INVALID_STATE) self->overruns_++;  // conversions were lost, this frame is still good
+    else if (err != ESP_OK) continue;
+
+    self->frameCount_++;
+    if (frame == nullptr) continue;
+    frame->len = len;
+    self->frames_.commit();
+    if (self->onFrame_) self->onFrame_();
+  }
+}
+
+AdcCurve ContinuousAdc::efuseCurve() {
+  esp_adc_cal_characteristics_t chars;
+  esp_adc_cal_characterize(ADC_UNIT_1, ADC_ATTEN_DB_11, ADC_WIDTH_BIT_12, 0, &chars);
+
+  static const size_t POINTS = 17;
+  float code[POINTS], mv[POINTS];
+  for (size_t i = 0; i < POINTS; i++) {
+    uint32_t c = i * 256 < ADC_CODES ? i * 256 : ADC_CODES - 1;
+    code[i] = (float)c;
+    mv[i] = (float)esp_adc_cal_raw_to_voltage(c, &chars);
+  }
+
+  AdcCurve curve;
+  if (!fitAdcCurve(code, mv, POINTS, 3, curve)) curve = AdcCurve::linear();
+  return curve;
+}
+
+#endif
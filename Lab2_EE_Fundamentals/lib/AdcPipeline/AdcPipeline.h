@@ -0,0 +1,172 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <SpscRing.h>
+
+static const size_t ADC_CODES = 4096;        // 12-bit conversions
+static const uint8_t ADC_PIPE_CHANNELS = 4;  // channels one pipeline decimates
+static const uint8_t ADC_CURVE_TERMS = 4;    // cubic
+
+// ====================== Calibration ======================
+// Raw code -> millivolts as a polynomial, fitted by least squares to
+// (code, mV) pairs: on the board the eFuse characterisation sampled across
+// the range, or readings against a reference meter. The pipeline converts
+// through a table filled from the curve, so the per-sample cost is one
+// lookup however the curve was obtained.
+struct AdcCurve {
+  float c[ADC_CURVE_TERMS];  // mV = c0 + c1*code + c2*code^2 + c3*code^3
+
+  float mv(float code) const { return ((c[3] * code + c[2]) * code + c[1]) * code + c[0]; }
+
+  // The old sketch's conversion: full scale 4095 = 3300 mV.
+  static AdcCurve linear(float fullScaleMv = 3300.0f) { return AdcCurve{{0.0f, fullScaleMv / 4095.0f, 0.0f, 0.0f}}; }
+};
+
+// degree 1..3 and n > degree; false if the points cannot pin the curve down.
+bool fitAdcCurve(const float* code, const float* mv, size_t n, uint8_t degree, AdcCurve& out);
+
+// table[code] = curve(code), rounded and clamped to 0..65535 mV.
+void fillAdcTable(const AdcCurve& curve, uint16_t* table, size_t size = ADC_CODES);
+
+// ====================== Block decimation ======================
+// Reduces a run of samples to one summary. Sums are integers, so a block is
+// exact however long it is; RMS includes DC, acRms is the ripple around the
+// mean.
+struct AdcBlock {
+  uint32_t samples;
+  uint16_t minMv;
+  uint16_t maxMv;
+  float meanMv;
+  float rmsMv;
+  float acRmsMv;
+};
+
+class BlockDecimator {
+public:
+  explicit BlockDecimator(uint32_t blockSamples = 1) : block_(blockSamples ? blockSamples : 1) { reset(); }
+
+  // True when this sample completed a block (written to out).
+  bool add(uint16_t mv, AdcBlock& out);
+  void reset();
+
+  uint32_t blockSamples() const { return block_; }
+
+private:
+  uint32_t block_;
+  uint32_t count_;
+  uint16_t min_;
+  uint16_t max_;
+  uint64_t sum_;
+  uint64_t sumSq_;
+};
+
+// ====================== DMA frame decode ======================
+// ESP32-C3 continuous-mode results (ADC_DIGI_OUTPUT_FORMAT_TYPE2), 4 bytes
+// little endian: code in bits 0-11, channel in 13-15, unit in 16.
+static const size_t ADC_RESULT_BYTES = 4;
+
+struct AdcResult {
+  uint8_t unit;     // 0 = ADC1
+  uint8_t channel;
+  uint16_t code;
+};
+
+inline AdcResult decodeAdcResult(const uint8_t* p) {
+  uint32_t w = (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+  return AdcResult{(uint8_t)((w >> 16) & 0x1), (uint8_t)((w >> 13) & 0x7), (uint16_t)(w & 0xFFF)};
+}
+
+inline void encodeAdcResult(const AdcResult& r, uint8_t* p) {
+  uint32_t w = (uint32_t)(r.code & 0xFFF) | ((uint32_t)(r.channel & 0x7) << 13) | ((uint32_t)(r.unit & 0x1) << 16);
+  for (int i = 0; i < 4; i++) p[i] = (uint8_t)(w >> (8 * i));
+}
+
+// ====================== Pipeline ======================
+// DMA frames in, one AdcBlock per channel per blockSamples conversions of
+// that channel out. Runs in the consumer; the frames come from whatever
+// filled them (ContinuousAdc on the board, synthetic ones on host).
+struct AdcBlockReport {
+  uint8_t slot;  // addChannel() order
+  AdcBlock block;
+};
+
+class AdcPipeline {
+public:
+  explicit AdcPipeline(uint32_t blockSamples) : blockSamples_(blockSamples) {}
+
+  // ADC1 channel with its calibration table (ADC_CODES entries, owned by
+  // the caller); returns the slot, -1 when full.
+  int addChannel(uint8_t channel, const uint16_t* mvTable);
+
+  void feed(const uint8_t* frame, size_t len);
+  bool next(AdcBlockReport& out) { return blocks_.pop(out); }
+
+  uint8_t channels() const { return count_; }
+  uint64_t samples() const { return samples_; }
+  uint32_t foreign() const { return foreign_; }  // results for channels not added
+  uint32_t dropped() const { return blocks_.dropped(); }
+
+private:
+  struct Slot {
+    uint8_t channel;
+    const uint16_t* table;
+    BlockDecimator decimator;
+  };
+
+  uint32_t blockSamples_;
+  Slot slots_[ADC_PIPE_CHANNELS];
+  uint8_t count_ = 0;
+  uint64_t samples_ = 0;
+  uint32_t foreign_ = 0;
+  SpscRing<AdcBlockReport, 8> blocks_;
+};
+
+#ifdef ARDUINO
+// ====================== Continuous ADC ======================
+// ADC1 in continuous mode: the converter walks the channel pattern at
+// sampleHz (total across channels) and DMA fills the driver's buffer with
+// no CPU involvement. A reader task moves whole frames into a ring of
+// ADC_FRAMES buffers, so one frame is filled while the consumer decimates
+// another, and calls onFrame (post the consumer task). The APB clock stops
+// in light sleep and so does the converter: keep the board awake while it
+// runs.
+static const size_t ADC_FRAME_BYTES = 1024;  // 256 conversions per frame
+static const size_t ADC_FRAMES = 4;
+
+struct AdcFrame {
+  uint32_t len;
+  uint8_t data[ADC_FRAME_BYTES];
+};
+
+class ContinuousAdc {
+public:
+  typedef void (*FrameFn)();
+
+  // pins: ADC1-capable GPIOs. 11 dB attenuation (~0-2.5 V on the C3).
+  bool begin(const int* pins, uint8_t count, uint32_t sampleHz, FrameFn onFrame = nullptr);
+  void end();
+
+  // Curve from the eFuse characterisation of this chip at 11 dB, for
+  // fillAdcTable(). Falls back to AdcCurve::linear() if fitting fails.
+  static AdcCurve efuseCurve();
+
+  // Zero-copy consumer side: read the frame from peek(), then release().
+  const AdcFrame* peek() { return frames_.peek(); }
+  void release() { frames_.release(); }
+
+  uint32_t frames() const { return frameCount_; }
+  uint32_t dropped() const { return frames_.dropped(); }  // ring full: consumer too slow
+  uint32_t overruns() const { return overruns_; }         // driver buffer full: reader too slow
+
+private:
+  static void readerTask(void* arg);
+
+  SpscRing<AdcFrame, ADC_FRAMES> frames_;
+  AdcFrame scratch_;  // where a frame goes when the ring is full
+  FrameFn onFrame_ = nullptr;
+  void* task_ = nullptr;
+  volatile uint32_t frameCount_ = 0;
+  volatile uint32_t overruns_ = 0;
+};
+#endif
@@ -0,0 +1,204 @@
+// ============================================
+// Voltage monitor - native pipeline test
+// ============================================
+// Checks the host-side half of lib/AdcPipeline against known answers:
+// the calibration fit and its lookup table, block decimation of a DC level
+// with ripple, and DMA frame decode through the whole pipeline with the two
+// channels interleaved the way the converter's pattern writes them.
+//
+//   pio run -e native && .pio/build/native/program [--seed S]
+//
+// Exits non-zero if any check fails.
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <random>
+#include <vector>
+
+#include <AdcPipeline.h>
+
+static int failures = 0;
+
+static void expect(bool ok, const char* what, double got, double want) {
+  printf("%-34s %-4s got %10.3f  want %10.3f\n", what, ok ? "ok" : "FAIL", got, want);
+  if (!ok) failures++;
+}
+
+static void expectNear(const char* what, double got, double want, double tol) {
+  expect(fabs(got - want) <= tol, what, got, want);
+}
+
+// A C3-like response at 11 dB: offset, gain and a sagging top end
+static const AdcCurve TRUE_CURVE = {{20.0f, 0.55f, 4.0e-5f, -9.0e-9f}};
+
+static double maxCurveError(const AdcCurve& a, const AdcCurve& b) {
+  double worst = 0;
+  for (size_t code = 0; code < ADC_CODES; code++) {
+    double e = fabs((double)a.mv((float)code) - b.mv((float)code));
+    if (e > worst) worst = e;
+  }
+  return worst;
+}
+
+static void testFit(std::mt19937& rng) {
+  printf("\n-- calibration fit\n");
+  std::vector<float> code, exact, noisy;
+  std::uniform_real_distribution<float> noise(-1.0f, 1.0f);
+  for (size_t c = 0; c < ADC_CODES; c += 64) {
+    code.push_back((float)c);
+    exact.push_back(TRUE_CURVE.mv((float)c));
+    noisy.push_back(exact.back() + noise(rng));
+  }
+
+  AdcCurve fit;
+  bool ok = fitAdcCurve(code.data(), exact.data(), code.size(), 3, fit);
+  expectNear("exact points, max error mV", ok ? maxCurveError(fit, TRUE_CURVE) : 1e9, 0, 0.05);
+
+  ok = fitAdcCurve(code.data(), noisy.data(), code.size(), 3, fit);
+  expectNear("+-1 mV noise, max error mV", ok ? maxCurveError(fit, TRUE_CURVE) : 1e9, 0, 1.0);
+
+  AdcCurve line;
+  ok = fitAdcCurve(code.data(), exact.data(), code.size(), 1, line);
+  expect(ok && maxCurveError(line, TRUE_CURVE) > 10, "linear fit misses the sag (mV)",
+         ok ? maxCurveError(line, TRUE_CURVE) : 0, 10);
+
+  float same[4] = {1000, 1000, 1000, 1000};
+  expect(!fitAdcCurve(same, exact.data(), 4, 3, fit), "one code only is rejected", 0, 0);
+  expect(!fitAdcCurve(code.data(), exact.data(), 3, 3, fit), "too few points are rejected", 0, 0);
+}
+
+static void testTable() {
+  printf("\n-- lookup table\n");
+  static uint16_t table[ADC_CODES];
+  fillAdcTable(TRUE_CURVE, table);
+
+  size_t backwards = 0;
+  double worst = 0;
+  for (size_t code = 0; code < ADC_CODES; code++) {
+    if (code && table[code] < table[code - 1]) backwards++;
+    double e = fabs(table[code] - (double)TRUE_CURVE.mv((float)code));
+    if (e > worst) worst = e;
+  }
+  expect(backwards == 0, "monotonic (steps backwards)", backwards, 0);
+  expectNear("rounding error mV", worst, 0, 0.501);
+
+  fillAdcTable(AdcCurve{{-100.0f, 20.0f, 0.0f, 0.0f}}, table);
+  expect(table[0] == 0 && table[ADC_CODES - 1] == 65535, "clamped to 0..65535", table[ADC_CODES - 1], 65535);
+}
+
+static void testDecimator() {
+  printf("\n-- block decimation\n");
+  const double dc = 1500, amp = 200;
+  const uint32_t period = 100, block = 5000;
+  BlockDecimator d(block);
+
+  std::vector<AdcBlock> blocks;
+  AdcBlock b;
+  for (uint32_t i = 0; i < block * 3 + block / 2; i++) {
+    uint16_t mv = (uint16_t)lround(dc + amp * sin(2 * M_PI * i / period));
+    if (d.add(mv, b)) blocks.push_back(b);
+  }
+
+  expect(blocks.size() == 3, "whole blocks only", blocks.size(), 3);
+  if (blocks.empty()) return;
+  const AdcBlock& last = blocks.back();
+  double ac = amp / sqrt(2.0);
+  expect(last.samples == block, "samples", last.samples, block);
+  expectNear("min mV", last.minMv, dc - amp, 0);
+  expectNear("max mV", last.maxMv, dc + amp, 0);
+  expectNear("mean mV", last.meanMv, dc, 0.01);
+  expectNear("rms mV", last.rmsMv, sqrt(dc * dc + ac * ac), 0.05);
+  expectNear("ac rms mV", last.acRmsMv, ac, 0.2);
+
+  BlockDecimator flat(block);
+  for (uint32_t i = 0; i < block; i++) flat.add(3000, b);
+  expectNear("flat ac rms mV", b.acRmsMv, 0, 0);
+}
+
+static void testPipeline(std::mt19937& rng) {
+  printf("\n-- frames through the pipeline\n");
+  size_t roundTrip = 0;
+  std::uniform_int_distribution<uint32_t> any(0, 0x1FFFF);
+  for (int i = 0; i < 10000; i++) {
+    AdcResult r{(uint8_t)(any(rng) & 1), (uint8_t)(any(rng) & 7), (uint16_t)(any(rng) & 0xFFF)};
+    uint8_t bytes[ADC_RESULT_BYTES];
+    encodeAdcResult(r, bytes);
+    AdcResult back = decodeAdcResult(bytes);
+    roundTrip += back.unit == r.unit && back.channel == r.channel && back.code == r.code;
+  }
+  expect(roundTrip == 10000, "encode/decode round trip", roundTrip, 10000);
+
+  // 1 mV per code so the blocks can be checked in codes
+  static uint16_t table[ADC_CODES];
+  fillAdcTable(AdcCurve{{0.0f, 1.0f, 0.0f, 0.0f}}, table);
+
+  const uint32_t block = 5000, frames = 100, perFrame = 256;
+  AdcPipeline pipe(block);
+  bool slots = pipe.addChannel(2, table) == 0 && pipe.addChannel(3, table) == 1;
+  expect(slots, "slots in order", pipe.channels(), 2);
+
+  // ch2 steady at 1000, ch3 a 300-code sawtooth around 2000; every 64th
+  // result belongs to ADC2 or to a channel nobody added
+  std::vector<uint8_t> frame(perFrame * ADC_RESULT_BYTES);
+  uint32_t n = 0, foreign = 0;
+  for (uint32_t f = 0; f < frames; f++) {
+    for (uint32_t i = 0; i < perFrame; i++, n++) {
+      AdcResult r;
+      if (n % 64 == 63) {
+        r = AdcResult{(uint8_t)(n % 128 == 127), (uint8_t)(n % 128 == 127 ? 2 : 5), 4095};
+        foreign++;
+      } else if (n % 2 == 0) {
+        r = AdcResult{0, 2, 1000};
+      } else {
+        r = AdcResult{0, 3, (uint16_t)(1850 + (n / 2) % 300)};
+      }
+      encodeAdcResult(r, &frame[i * ADC_RESULT_BYTES]);
+    }
+    pipe.feed(frame.data(), frame.size());
+  }
+
+  std::vector<AdcBlockReport> reports;
+  AdcBlockReport r;
+  while (pipe.next(r)) reports.push_back(r);
+
+  uint32_t perChannel = (uint32_t)(pipe.samples() / 2);
+  expect(pipe.foreign() == foreign, "foreign results counted", pipe.foreign(), foreign);
+  expect(reports.size() == 2 * (perChannel / block), "one report per channel block", reports.size(),
+         2 * (perChannel / block));
+
+  bool steady = true, saw = true;
+  for (const AdcBlockReport& rep : reports) {
+    if (rep.slot == 0) {
+      steady = steady && rep.block.minMv == 1000 && rep.block.maxMv == 1000 && rep.block.acRmsMv == 0;
+    } else {
+      saw = saw && rep.block.minMv >= 1850 && rep.block.maxMv <= 2149 && fabs(rep.block.meanMv - 2000) < 2 &&
+            fabs(rep.block.acRmsMv - 300 / sqrt(12.0)) < 2;
+    }
+  }
+  expect(steady, "slot 0 steady at 1000", steady, 1);
+  expect(saw, "slot 1 sawtooth mean/ripple", saw, 1);
+  expect(pipe.dropped() == 0, "no reports dropped", pipe.dropped(), 0);
+}
+
+int main(int argc, char** argv) {
+  uint32_t seed = 1;
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "--seed") && i + 1 < argc) seed = (uint32_t)atoi(argv[++i]);
+    else {
+      fprintf(stderr, "usage: %s [--seed S]\n", argv[0]);
+      return 2;
+    }
+  }
+
+  std::mt19937 rng(seed);
+  testFit(rng);
+  testTable();
+  testDecimator();
+  testPipeline(rng);
+
+  printf("\n%s: %d failed\n", failures ? "FAIL" : "ok", failures);
+  return failures ? 1 : 0;
+}
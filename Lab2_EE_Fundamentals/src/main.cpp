@@ -1,38 +1,77 @@
 #include <Arduino.h>
+#include <AdcPipeline.h>
+#include <CoopScheduler.h>
 
 // XIAO ESP32-C3 pin mapping (common):
 // D0 = GPIO2
 // D1 = GPIO3
 static const int PIN_VOUT1 = 2;  // D0 -> GPIO2
 static const int PIN_VOUT2 = 3;  // D1 -> GPIO3
+static const int ADC_PINS[] = { PIN_VOUT1, PIN_VOUT2 };
+static const uint8_t ADC_PIN_COUNT = sizeof(ADC_PINS) / sizeof(ADC_PINS[0]);
+static const char* const ADC_LABELS[] = { "J2(VOUT1) GPIO2", "J3(VOUT2) GPIO3" };
+
+// Continuous sampling, summarised per channel every REPORT_SAMPLES
+static const uint32_t SAMPLE_HZ = 20000;      // total: 10 kHz per channel
+static const uint32_t REPORT_SAMPLES = 5000;  // per channel: one report every 0.5 s
+
+// Per-channel code -> mV tables (the eFuse curve; refit a channel with
+// fitAdcCurve() from readings against a meter to trim its divider)
+static uint16_t mvTable[ADC_PIN_COUNT][ADC_CODES];
+
+ContinuousAdc adc;
+AdcPipeline pipeline(REPORT_SAMPLES);
+
+// The reader task posts the drain task once per DMA frame
+CoopScheduler<1> scheduler(SchedulerIdle::millisClock);
+TaskId drainTask = NO_TASK;
+
+void onFrame() {
+  scheduler.post(drainTask);
+}
+
+void printBlock(const AdcBlockReport& r) {
+  const AdcBlock& b = r.block;
+  Serial.printf("%s: V=%.3f V  min=%u max=%u rms=%.1f ripple=%.1f mV\n", ADC_LABELS[r.slot], b.meanMv / 1000.0f,
+                b.minMv, b.maxMv, b.rmsMv, b.acRmsMv);
+
+  if (r.slot == ADC_PIN_COUNT - 1 && (adc.dropped() || adc.overruns())) {
+    Serial.printf("  frames lost: %u (consumer) %u (driver)\n", adc.dropped(), adc.overruns());
+  }
+}
+
+void drainFrames(void*) {
+  const AdcFrame* f;
+  while ((f = adc.peek()) != nullptr) {
+    pipeline.feed(f->data, f->len);
+    adc.release();
+  }
+
+  AdcBlockReport r;
+  while (pipeline.next(r)) printBlock(r);
+}
 
 void setup() {
   Serial.begin(115200);
   delay(1000);
   Serial.println("Reading VOUT1 (GPIO2) and VOUT2 (GPIO3)...");
 
-  // ESP32 ADC is 12-bit by default, but set explicitly:
-  analogReadResolution(12);
+  AdcCurve curve = ContinuousAdc::efuseCurve();
+  for (uint8_t i = 0; i < ADC_PIN_COUNT; i++) {
+    fillAdcTable(curve, mvTable[i]);
+    pipeline.addChannel(digitalPinToAnalogChannel(ADC_PINS[i]), mvTable[i]);
+  }
+
+  // The converter stops in light sleep: idle waits stay awake
+  SchedulerIdle::begin(false);
+  scheduler.onPost(SchedulerIdle::wake);
+  drainTask = scheduler.onEvent(drainFrames);
+
+  if (!adc.begin(ADC_PINS, ADC_PIN_COUNT, SAMPLE_HZ, onFrame)) {
+    Serial.println("Continuous ADC failed to start");
+  }
 }
 
 void loop() {
-  int adc1 = analogRead(PIN_VOUT1);  // 0~4095
-  int adc2 = analogRead(PIN_VOUT2);
-
-  float v1 = (adc1 / 4095.0) * 3.3;
-  float v2 = (adc2 / 4095.0) * 3.3;
-
-  Serial.print("J2(VOUT1) GPIO2: ADC=");
-  Serial.print(adc1);
-  Serial.print("  V=");
-  Serial.print(v1, 3);
-  Serial.print(" V   |   ");
-
-  Serial.print("J3(VOUT2) GPIO3: ADC=");
-  Serial.print(adc2);
-  Serial.print("  V=");
-  Serial.print(v2, 3);
-  Serial.println(" V");
-
-  delay(500);
-}
\ No newline at end of file
+  SchedulerIdle::wait(scheduler.runReady());
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <SpscRing.h>
+
+// Hand-off between the BLE notify callback and the consumer task.
+// The callback copies the raw payload into a preallocated fixed-size slot
+// and returns; nothing on this path allocates, parses or prints.
+template <size_t SLOT_SIZE, size_t SLOTS>
+class NotifyQueue {
+public:
+  struct Slot {
+    uint8_t source;  // caller-defined tag, e.g. which peer sent it
+    uint16_t length;
+    uint32_t receivedMs;
+    uint8_t data[SLOT_SIZE];
+  };
+
+  // Producer (BLE callback). Returns false if the notification was dropped.
+  bool push(const uint8_t* data, size_t length, uint32_t nowMs, uint8_t source = 0) {
+    received_++;
+    Slot* slot = ring_.acquire();
+    if (slot == nullptr) return false;
+
+    if (length > SLOT_SIZE) {
+      overruns_++;  // payload larger than a slot: keep the head, flag it
+      length = SLOT_SIZE;
+    }
+    memcpy(slot->data, data, length);
+    slot->length = (uint16_t)length;
+    slot->receivedMs = nowMs;
+    slot->source = source;
+    ring_.commit();
+    return true;
+  }
+
+  // Consumer: peek() the oldest slot, process it in place, then release().
+  const Slot* peek() { return ring_.peek(); }
+  void release() { ring_.release(); }
+
+  size_t pending() const { return ring_.size(); }
+  uint32_t received() const { return received_; }
+  uint32_t dropped() const { return ring_.dropped(); }  // ring was full
+  uint32_t overruns() const { return overruns_; }      // payload was truncated
+
+private:
+  SpscRing<Slot, SLOTS> ring_;
+  volatile uint32_t received_ = 0;
+  volatile uint32_t overruns_ = 0;
+};
@@ -0,0 +1,263 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <StreamStats.h>
+#include <SampleBackfill.h>
+#include <SendOnDelta.h>
+
+// Connection bookkeeping for a gateway that talks to several sensor servers.
+// This is transport-agnostic: the sketch owns the BLE objects and reports
+// scan results, connects and disconnects here; the manager decides who to
+// connect next, how long to back off, and keeps per-peer statistics.
+
+typedef StreamStats<80> DistanceStats;  // 5 cm buckets over 0-400 cm
+
+enum PeerState : uint8_t {
+  PEER_EMPTY,       // slot unused
+  PEER_DISCOVERED,  // seen advertising, ready to connect
+  PEER_CONNECTING,
+  PEER_CONNECTED,
+  PEER_BACKOFF      // connect failed or dropped, waiting to retry
+};
+
+struct PeerInfo {
+  char address[18];
+  char name[24];
+  PeerState state;
+  uint32_t lastSeenMs;
+  uint32_t nextAttemptMs;
+  uint32_t backoffMs;
+  uint16_t failures;
+
+  // Sender clock -> local clock. Radio latency only ever adds delay, so the
+  // smallest (received - sent) seen on this connection is the best estimate.
+  int32_t clockOffsetMs;
+  bool offsetValid;
+
+  uint16_t nextSeq;
+  bool fresh;           // no live sample yet on this connection: nextSeq is not known
+  uint32_t received;
+  uint32_t seqGaps;     // in the live stream; backfill fills them afterwards
+  uint32_t backfilled;  // samples that came by backfill
+  BackfillReceiver backfill;  // kept across reconnects: what to ask for next time
+  SeriesReconstructor series;  // readings the server held back, filled in on its ping grid
+  DistanceStats session{0.0f, 400.0f};
+  DistanceStats lifetime{0.0f, 400.0f};
+
+  uint32_t toLocalMs(uint32_t senderMs) const { return senderMs + (uint32_t)clockOffsetMs; }
+};
+
+template <size_t MAX_PEERS>
+class PeerManager {
+public:
+  static const uint32_t BACKOFF_MIN_MS = 1000;
+  static const uint32_t BACKOFF_MAX_MS = 60000;
+  static const uint32_t STALE_MS = 300000;  // forget idle peers after 5 min
+
+  PeerManager() {
+    for (size_t i = 0; i < MAX_PEERS; i++) peers_[i].state = PEER_EMPTY;
+  }
+
+  // Record a scan result. Returns the peer index, or -1 if the table is full.
+  int onAdvertised(const char* address, const char* name, uint32_t nowMs) {
+    int i = find(address);
+    if (i < 0) i = allocate(nowMs);
+    if (i < 0) return -1;
+
+    PeerInfo& p = peers_[i];
+    if (p.state == PEER_EMPTY) {
+      strncpy(p.address, address, sizeof(p.address));
+      p.address[sizeof(p.address) - 1] = '\0';
+      p.state = PEER_DISCOVERED;
+      p.nextAttemptMs = nowMs;
+      p.backoffMs = BACKOFF_MIN_MS;
+      p.failures = 0;
+      p.received = 0;
+      p.seqGaps = 0;
+      p.backfilled = 0;
+      p.backfill.reset();
+      p.session.reset();
+      p.lifetime.reset();
+    }
+    strncpy(p.name, name ? name : "Unknown", sizeof(p.name));
+    p.name[sizeof(p.name) - 1] = '\0';
+    p.lastSeenMs = nowMs;
+    return i;
+  }
+
+  // Round-robin over peers whose retry time has come, so one flaky server
+  // cannot starve the others. Marks the chosen peer CONNECTING.
+  int nextToConnect(uint32_t nowMs) {
+    for (size_t k = 1; k <= MAX_PEERS; k++) {
+      size_t i = (cursor_ + k) % MAX_PEERS;
+      PeerInfo& p = peers_[i];
+      bool due = (int32_t)(nowMs - p.nextAttemptMs) >= 0;
+      if ((p.state == PEER_DISCOVERED || p.state == PEER_BACKOFF) && due) {
+        cursor_ = i;
+        p.state = PEER_CONNECTING;
+        return (int)i;
+      }
+    }
+    return -1;
+  }
+
+  void onConnected(int i) {
+    PeerInfo& p = peers_[i];
+    p.state = PEER_CONNECTED;
+    p.failures = 0;
+    p.backoffMs = BACKOFF_MIN_MS;
+    p.offsetValid = false;
+    p.nextSeq = 0;
+    p.fresh = true;
+    p.series.reset();
+    p.session.reset();
+  }
+
+  void onConnectFailed(int i, uint32_t nowMs) { scheduleRetry(i, nowMs); }
+
+  // Folds the connection's stats into the peer's lifetime stats.
+  void onDisconnected(int i, uint32_t nowMs) {
+    PeerInfo& p = peers_[i];
+    p.lifetime.merge(p.session);
+    scheduleRetry(i, nowMs);
+  }
+
+  // Account for one received sample (sender timestamp) arriving at nowMs.
+  // False for a sample already held, which is then ignored. Backfilled
+  // samples are old, so they count but do not touch the clock estimate.
+  bool onSample(int i, uint16_t seq, uint32_t senderMs, float cm, uint32_t nowMs, bool backfilled = false) {
+    PeerInfo& p = peers_[i];
+    if (!p.backfill.accept(seq)) return false;
+    if (backfilled) {
+      p.backfilled++;
+    } else {
+      int32_t offset = (int32_t)(nowMs - senderMs);
+      if (!p.offsetValid || offset < p.clockOffsetMs) {
+        p.clockOffsetMs = offset;
+        p.offsetValid = true;
+      }
+      if (!p.fresh && seq != p.nextSeq) p.seqGaps++;
+      p.fresh = false;
+      p.nextSeq = (uint16_t)(seq + 1);
+    }
+    p.received++;
+    p.lastSeenMs = nowMs;
+    if (cm > 0.0f) p.session.add(cm);
+    return true;
+  }
+
+  PeerInfo& operator[](int i) { return peers_[i]; }
+  const PeerInfo& operator[](int i) const { return peers_[i]; }
+  static constexpr size_t capacity() { return MAX_PEERS; }
+
+  size_t countIn(PeerState s) const {
+    size_t n = 0;
+    for (size_t i = 0; i < MAX_PEERS; i++) n += peers_[i].state == s;
+    return n;
+  }
+
+  int find(const char* address) const {
+    for (size_t i = 0; i < MAX_PEERS; i++) {
+      if (peers_[i].state != PEER_EMPTY && strcmp(peers_[i].address, address) == 0) return (int)i;
+    }
+    return -1;
+  }
+
+private:
+  void scheduleRetry(int i, uint32_t nowMs) {
+    PeerInfo& p = peers_[i];
+    p.state = PEER_BACKOFF;
+    p.failures++;
+    p.nextAttemptMs = nowMs + p.backoffMs;
+    p.backoffMs = p.backoffMs * 2 > BACKOFF_MAX_MS ? BACKOFF_MAX_MS : p.backoffMs * 2;
+  }
+
+  // Free slot, or the longest-unseen peer that is neither connected nor
+  // connecting and has been quiet for STALE_MS.
+  int allocate(uint32_t nowMs) {
+    int victim = -1;
+    uint32_t oldest = 0;
+    for (size_t i = 0; i < MAX_PEERS; i++) {
+      const PeerInfo& p = peers_[i];
+      if (p.state == PEER_EMPTY) return (int)i;
+      if (p.state == PEER_CONNECTED || p.state == PEER_CONNECTING) continue;
+      uint32_t idle = nowMs - p.lastSeenMs;
+      if (idle >= STALE_MS && idle >= oldest) {
+        oldest = idle;
+        victim = (int)i;
+      }
+    }
+    if (victim >= 0) peers_[victim].state = PEER_EMPTY;
+    return victim;
+  }
+
+  PeerInfo peers_[MAX_PEERS];
+  size_t cursor_ = MAX_PEERS - 1;
+};
+
+// ====================== Time-ordered merge ======================
+// Per-peer FIFOs merged by local timestamp. A sample is released once it is
+// older than the lateness window (so slower links can still slot in before
+// it), or immediately if its FIFO is full.
+struct MergedSample {
+  uint8_t peer;
+  uint16_t seq;
+  uint32_t t_ms;  // local clock
+  float cm;
+};
+
+template <size_t MAX_PEERS, size_t DEPTH>
+class MergedStream {
+public:
+  explicit MergedStream(uint32_t latenessMs = 500) : latenessMs_(latenessMs) {}
+
+  // Returns false (and counts a drop) if the peer's FIFO is still full.
+  bool push(const MergedSample& s) {
+    Fifo& f = fifo_[s.peer];
+    if (f.count == DEPTH) {
+      dropped_++;
+      return false;
+    }
+    f.items[(f.head + f.count) % DEPTH] = s;
+    f.count++;
+    return true;
+  }
+
+  bool pop(MergedSample& out, uint32_t nowMs) {
+    int best = -1;
+    bool forced = false;
+    for (size_t i = 0; i < MAX_PEERS; i++) {
+      const Fifo& f = fifo_[i];
+      if (f.count == 0) continue;
+      if (best < 0 || (int32_t)(f.items[f.head].t_ms - fifo_[best].items[fifo_[best].head].t_ms) < 0) {
+        best = (int)i;
+      }
+      if (f.count == DEPTH) forced = true;
+    }
+    if (best < 0) return false;
+
+    Fifo& f = fifo_[best];
+    const MergedSample& head = f.items[f.head];
+    if (!forced && (int32_t)(nowMs - head.t_ms) < (int32_t)latenessMs_) return false;
+
+    out = head;
+    f.head = (f.head + 1) % DEPTH;
+    f.count--;
+    return true;
+  }
+
+  uint32_t dropped() const { return dropped_; }
+
+private:
+  struct Fifo {
+    MergedSample items[DEPTH];
+    size_t head = 0;
+    size_t count = 0;
+  };
+
+  Fifo fifo_[MAX_PEERS];
+  uint32_t latenessMs_;
+  uint32_t dropped_ = 0;
+};
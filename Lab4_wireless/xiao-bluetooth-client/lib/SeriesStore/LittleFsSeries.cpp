@@ -0,0 +1,64 @@
+#ifdef ARDUINO
+
+#include "LittleFsSeries.h"
+
+#include <LittleFS.h>
+#include <string.h>
+
+// A file written or removed must not be read through a stale handle
+void LittleFsSeries::closeRead(const char* path) {
+  if (path != nullptr && strcmp(path, readerPath_) != 0) return;
+  if (reader_) reader_.close();
+  readerPath_[0] = '\0';
+}
+
+bool LittleFsSeries::append(const char* path, const void* data, size_t n) {
+  closeRead(path);
+  File f = LittleFS.open(path, FILE_APPEND, true);
+  if (!f) return false;
+  size_t written = f.write((const uint8_t*)data, n);
+  f.close();
+  return written == n;
+}
+
+bool LittleFsSeries::read(const char* path, uint32_t offset, void* out, size_t n) {
+  if (!reader_ || strcmp(path, readerPath_) != 0) {
+    closeRead(nullptr);
+    reader_ = LittleFS.open(path, FILE_READ);
+    if (!reader_) return false;
+    strncpy(readerPath_, path, sizeof(readerPath_) - 1);
+    readerPath_[sizeof(readerPath_) - 1] = '\0';
+  }
+  if (offset + n > reader_.size() || !reader_.seek(offset)) return false;
+  return reader_.read((uint8_t*)out, n) == n;
+}
+
+int32_t LittleFsSeries::size(const char* path) {
+  if (!LittleFS.exists(path)) return -1;
+  File f = LittleFS.open(path, FILE_READ);
+  if (!f) return -1;
+  int32_t n = f.size();
+  f.close();
+  return n;
+}
+
+bool LittleFsSeries::remove(const char* path) {
+  closeRead(path);
+  return LittleFS.remove(path);
+}
+
+void LittleFsSeries::list(const char* dir, void (*each)(const char* name, void* ctx), void* ctx) {
+  closeRead(nullptr);
+  if (!LittleFS.exists(dir)) LittleFS.mkdir(dir);
+  File d = LittleFS.open(dir);
+  if (!d || !d.isDirectory()) return;
+  for (File f = d.openNextFile(); f; f = d.openNextFile()) {
+    const char* name = f.name();
+    const char* slash = strrchr(name, '/');  // older cores give the full path
+    each(slash ? slash + 1 : name, ctx);
+    f.close();
+  }
+  d.close();
+}
+
+#endif
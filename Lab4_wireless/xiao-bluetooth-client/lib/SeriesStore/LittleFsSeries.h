@@ -0,0 +1,27 @@
+#pragma once
+
+#ifdef ARDUINO
+
+#include <FS.h>
+#include "SeriesStore.h"
+
+// SeriesFs on the board's LittleFS partition (LittleFS.begin() first). Each
+// append opens, writes and closes the file, which is what commits it.
+// Queries read a segment in many small pieces, so the last file read stays
+// open between calls.
+class LittleFsSeries : public SeriesFs {
+public:
+  bool append(const char* path, const void* data, size_t n) override;
+  bool read(const char* path, uint32_t offset, void* out, size_t n) override;
+  int32_t size(const char* path) override;
+  bool remove(const char* path) override;
+  void list(const char* dir, void (*each)(const char* name, void* ctx), void* ctx) override;
+
+private:
+  void closeRead(const char* path);
+
+  fs::File reader_;
+  char readerPath_[48] = "";
+};
+
+#endif
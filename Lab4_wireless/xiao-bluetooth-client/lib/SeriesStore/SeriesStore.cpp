@@ -0,0 +1,418 @@
+#include "SeriesStore.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+static void putU32(uint8_t* p, uint32_t v) {
+  for (int i = 0; i < 4; i++) p[i] = (uint8_t)(v >> (8 * i));
+}
+
+static uint32_t getU32(const uint8_t* p) {
+  return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static int16_t toRaw(float cm) {
+  if (isnan(cm)) return INT16_MIN;
+  float v = roundf(cm * 10.0f);
+  if (v > INT16_MAX) return INT16_MAX;
+  if (v <= INT16_MIN) return INT16_MIN + 1;
+  return (int16_t)v;
+}
+
+static float fromRaw(int16_t raw) {
+  return raw == INT16_MIN ? NAN : raw / 10.0f;
+}
+
+SeriesStore::SeriesStore(SeriesFs& fs, const SeriesStoreConfig& cfg) : fs_(fs), cfg_(cfg) {
+  // Whole blocks, at least two, and few enough to index
+  uint32_t blocks = (cfg_.segmentBytes + SERIES_BLOCK_SIZE - 1) / SERIES_BLOCK_SIZE;
+  if (blocks < 2) blocks = 2;
+  while (cfg_.capBytes / (blocks * SERIES_BLOCK_SIZE) > SERIES_MAX_SEGMENTS) blocks++;
+  cfg_.segmentBytes = blocks * SERIES_BLOCK_SIZE;
+  if (cfg_.capBytes < 2 * cfg_.segmentBytes) cfg_.capBytes = 2 * cfg_.segmentBytes;
+}
+
+void SeriesStore::path(uint32_t number, char* out, size_t size) const {
+  snprintf(out, size, "%s/%08lu.seg", cfg_.dir, (unsigned long)number);
+}
+
+void SeriesStore::sourcesPath(char* out, size_t size) const {
+  snprintf(out, size, "%s/sources", cfg_.dir);
+}
+
+// ====================== Startup ======================
+struct Found {
+  uint32_t numbers[SERIES_MAX_SEGMENTS];
+  size_t count;
+};
+
+static void collect(const char* name, void* ctx) {
+  Found& f = *(Found*)ctx;
+  unsigned long n;
+  char ext[8];
+  if (sscanf(name, "%8lu.%7s", &n, ext) != 2 || strcmp(ext, "seg") != 0) return;
+  if (f.count < SERIES_MAX_SEGMENTS) f.numbers[f.count++] = (uint32_t)n;
+}
+
+bool SeriesStore::begin(uint32_t nowMs) {
+  count_ = 0;
+  batchLen_ = 0;
+  sources_ = 0;
+  rollNext_ = false;
+
+  Found found;
+  found.count = 0;
+  fs_.list(cfg_.dir, collect, &found);
+  for (size_t i = 1; i < found.count; i++) {
+    uint32_t n = found.numbers[i];
+    size_t j = i;
+    for (; j > 0 && found.numbers[j - 1] > n; j--) found.numbers[j] = found.numbers[j - 1];
+    found.numbers[j] = n;
+  }
+  for (size_t i = 0; i < found.count; i++) load(found.numbers[i]);
+  nextNumber_ = count_ ? current()->number + 1 : 0;
+
+  char p[48];
+  sourcesPath(p, sizeof(p));
+  int32_t size = fs_.size(p);
+  while (size >= (int32_t)((sources_ + 1) * SERIES_SOURCE_NAME) && sources_ < SERIES_MAX_SOURCES) {
+    if (!fs_.read(p, sources_ * SERIES_SOURCE_NAME, names_[sources_], SERIES_SOURCE_NAME)) break;
+    names_[sources_][SERIES_SOURCE_NAME - 1] = '\0';
+    sources_++;
+  }
+
+  anyFlushed_ = count_ > 0;
+  flushedMs_ = anyFlushed_ ? current()->lastMs : 0;
+  lastLocalMs_ = nowMs;
+  clockMs_ = anyFlushed_ ? flushedMs_ + 1 : nowMs;
+  return true;
+}
+
+// One segment into the index; one that does not check out is removed
+bool SeriesStore::load(uint32_t number) {
+  char p[48];
+  path(number, p, sizeof(p));
+  int32_t size = fs_.size(p);
+
+  uint8_t header[SERIES_HEADER_SIZE];
+  bool ok = size >= (int32_t)(SERIES_HEADER_SIZE + SERIES_RECORD_SIZE) && fs_.read(p, 0, header, sizeof(header)) &&
+            getU32(header) == SERIES_MAGIC && getU32(header + 4) == number;
+
+  Segment s;
+  s.number = number;
+  s.baseMs = ok ? (uint64_t)getU32(header + 8) | ((uint64_t)getU32(header + 12) << 32) : 0;
+  s.bytes = ok ? SERIES_HEADER_SIZE + (size - SERIES_HEADER_SIZE) / SERIES_RECORD_SIZE * SERIES_RECORD_SIZE : 0;
+  ok = ok && readRecord(s, 0, s.firstMs) && readRecord(s, (s.bytes - SERIES_HEADER_SIZE) / SERIES_RECORD_SIZE - 1, s.lastMs);
+  if (!ok || count_ == SERIES_MAX_SEGMENTS) {
+    fs_.remove(p);
+    corrupt_++;
+    return false;
+  }
+
+  segs_[count_++] = s;
+  rollNext_ = s.bytes != (uint32_t)size;  // a torn tail: start the next write in a new segment
+  return true;
+}
+
+int SeriesStore::sourceId(const char* name) {
+  for (uint8_t i = 0; i < sources_; i++) {
+    if (strncmp(names_[i], name, SERIES_SOURCE_NAME - 1) == 0) return i;
+  }
+  if (sources_ == SERIES_MAX_SOURCES) return -1;
+
+  char entry[SERIES_SOURCE_NAME] = {};
+  strncpy(entry, name, SERIES_SOURCE_NAME - 1);
+  char p[48];
+  sourcesPath(p, sizeof(p));
+  if (!fs_.append(p, entry, sizeof(entry))) return -1;
+  memcpy(names_[sources_], entry, sizeof(entry));
+  return sources_++;
+}
+
+// ====================== Clock ======================
+uint64_t SeriesStore::now(uint32_t localMs) {
+  int32_t d = (int32_t)(localMs - lastLocalMs_);
+  if (d < 0) return (uint64_t)-d > clockMs_ ? 0 : clockMs_ - (uint64_t)-d;  // a reading from just before
+  clockMs_ += (uint32_t)d;
+  lastLocalMs_ = localMs;
+  return clockMs_;
+}
+
+uint64_t SeriesStore::firstMs() const {
+  if (count_) return segs_[0].firstMs;
+  return batchLen_ ? batch_[0].t_ms : 0;
+}
+
+uint64_t SeriesStore::lastMs() const {
+  if (batchLen_) return batch_[batchLen_ - 1].t_ms;
+  return count_ ? segs_[count_ - 1].lastMs : 0;
+}
+
+uint32_t SeriesStore::records() const {
+  uint32_t n = batchLen_;
+  for (size_t i = 0; i < count_; i++) n += (segs_[i].bytes - SERIES_HEADER_SIZE) / SERIES_RECORD_SIZE;
+  return n;
+}
+
+uint32_t SeriesStore::bytes() const {
+  uint32_t n = 0;
+  for (size_t i = 0; i < count_; i++) n += segs_[i].bytes;
+  return n;
+}
+
+// ====================== Writing ======================
+bool SeriesStore::append(uint32_t localMs, float cm, uint8_t source, uint8_t flags) {
+  uint64_t t = now(localMs);
+  if (anyFlushed_ && t < flushedMs_) {
+    late_++;
+    return false;
+  }
+
+  // Full: the oldest block goes out whatever the window says
+  if (batchLen_ == SERIES_BATCH_RECORDS) {
+    size_t n = room();
+    writeOut(n < batchLen_ ? n : batchLen_);
+    if (t < flushedMs_) {
+      late_++;
+      return false;
+    }
+  }
+
+  size_t i = batchLen_;
+  for (; i > 0 && batch_[i - 1].t_ms > t; i--) batch_[i] = batch_[i - 1];
+  batch_[i] = Pending{t, toRaw(cm), source, flags};
+  batchLen_++;
+
+  uint32_t before = dropped_;
+  serviceAt(clockMs_);
+  return dropped_ == before;
+}
+
+void SeriesStore::service(uint32_t nowMs) {
+  serviceAt(now(nowMs));
+}
+
+bool SeriesStore::flush() {
+  return writeOut(batchLen_);
+}
+
+// Records that fit before the next block boundary
+size_t SeriesStore::room() {
+  const Segment* s = current();
+  if (s == nullptr || rollNext_ || s->bytes >= cfg_.segmentBytes) {
+    return (SERIES_BLOCK_SIZE - SERIES_HEADER_SIZE) / SERIES_RECORD_SIZE;
+  }
+  return (SERIES_BLOCK_SIZE - s->bytes % SERIES_BLOCK_SIZE) / SERIES_RECORD_SIZE;
+}
+
+void SeriesStore::serviceAt(uint64_t nowT) {
+  // Ready: old enough that nothing can still sort in before it
+  size_t ready = 0;
+  while (ready < batchLen_ && batch_[ready].t_ms + cfg_.reorderMs <= nowT) ready++;
+
+  // Whole blocks as soon as they are ready; a partial one once it is old
+  for (size_t n = room(); ready >= n; n = room()) {
+    if (!writeOut(n)) return;
+    ready -= n;
+  }
+  if (ready > 0 && batch_[0].t_ms + cfg_.flushAgeMs <= nowT) writeOut(ready);
+}
+
+void SeriesStore::roll(uint64_t t) {
+  // Make room under the cap for a whole new segment
+  while (count_ > 0 && (count_ == SERIES_MAX_SEGMENTS || bytes() + cfg_.segmentBytes > cfg_.capBytes)) {
+    char p[48];
+    path(segs_[0].number, p, sizeof(p));
+    fs_.remove(p);
+    memmove(segs_, segs_ + 1, (count_ - 1) * sizeof(Segment));
+    count_--;
+  }
+
+  segs_[count_++] = Segment{nextNumber_++, t, t, t, 0};
+  rollNext_ = false;
+}
+
+// Writes the oldest n held records, a block (or what is left of one) per
+// append. False if a write failed; what it held is dropped.
+bool SeriesStore::writeOut(size_t n) {
+  size_t done = 0;
+  bool ok = true;
+  while (done < n) {
+    const Pending* first = &batch_[done];
+    Segment* s = current();
+    if (s == nullptr || rollNext_ || s->bytes >= cfg_.segmentBytes || first->t_ms - s->baseMs > UINT32_MAX) {
+      roll(first->t_ms);
+      s = current();
+    }
+
+    size_t len = 0;
+    if (s->bytes == 0) {
+      putU32(out_, SERIES_MAGIC);
+      putU32(out_ + 4, s->number);
+      putU32(out_ + 8, (uint32_t)s->baseMs);
+      putU32(out_ + 12, (uint32_t)(s->baseMs >> 32));
+      len = SERIES_HEADER_SIZE;
+    }
+    size_t k = 0;
+    size_t fit = (SERIES_BLOCK_SIZE - (s->bytes + len) % SERIES_BLOCK_SIZE) / SERIES_RECORD_SIZE;
+    for (; k < fit && done + k < n && first[k].t_ms - s->baseMs <= UINT32_MAX; k++) {
+      uint8_t* r = out_ + len;
+      putU32(r, (uint32_t)(first[k].t_ms - s->baseMs));
+      r[4] = (uint8_t)first[k].raw;
+      r[5] = (uint8_t)((uint16_t)first[k].raw >> 8);
+      r[6] = first[k].source;
+      r[7] = first[k].flags;
+      len += SERIES_RECORD_SIZE;
+    }
+
+    char p[48];
+    path(s->number, p, sizeof(p));
+    if (!fs_.append(p, out_, len)) {
+      // Whatever landed is off the record grid: carry on in a new segment,
+      // or drop this one if it never got going
+      int32_t size = fs_.size(p);
+      if (s->bytes == 0) {
+        fs_.remove(p);
+        count_--;
+      } else if (size != (int32_t)s->bytes) {
+        rollNext_ = true;
+      }
+      dropped_ += n - done;
+      done = n;
+      ok = false;
+      break;
+    }
+
+    writes_++;
+    if (s->bytes == 0) s->firstMs = first->t_ms;
+    s->bytes += len;
+    s->lastMs = first[k - 1].t_ms;
+    flushedMs_ = s->lastMs;
+    anyFlushed_ = true;
+    done += k;
+  }
+
+  memmove(batch_, batch_ + done, (batchLen_ - done) * sizeof(Pending));
+  batchLen_ -= done;
+  return ok;
+}
+
+// ====================== Queries ======================
+bool SeriesStore::readRecord(const Segment& s, uint32_t i, uint64_t& t) {
+  char p[48];
+  path(s.number, p, sizeof(p));
+  uint8_t b[4];
+  if (!fs_.read(p, SERIES_HEADER_SIZE + i * SERIES_RECORD_SIZE, b, sizeof(b))) return false;
+  t = s.baseMs + getU32(b);
+  return true;
+}
+
+size_t SeriesStore::scanSegment(const Segment& s, uint64_t t0, uint64_t t1, uint8_t source, SeriesVisitor visit,
+                                void* ctx) {
+  uint32_t count = (s.bytes - SERIES_HEADER_SIZE) / SERIES_RECORD_SIZE;
+
+  // First record at or after t0: binary search, one small read a probe
+  uint32_t lo = 0, hi = count;
+  if (s.firstMs < t0) {
+    while (lo < hi) {
+      uint32_t mid = lo + (hi - lo) / 2;
+      uint64_t t;
+      if (!readRecord(s, mid, t)) return 0;
+      if (t < t0) lo = mid + 1;
+      else hi = mid;
+    }
+  }
+
+  // Then forward in chunks until t1
+  char p[48];
+  path(s.number, p, sizeof(p));
+  uint8_t chunk[64 * SERIES_RECORD_SIZE];
+  size_t visited = 0;
+  for (uint32_t i = lo; i < count;) {
+    uint32_t n = count - i < 64 ? count - i : 64;
+    if (!fs_.read(p, SERIES_HEADER_SIZE + i * SERIES_RECORD_SIZE, chunk, n * SERIES_RECORD_SIZE)) break;
+    for (uint32_t k = 0; k < n; k++) {
+      const uint8_t* r = chunk + k * SERIES_RECORD_SIZE;
+      SeriesPoint pt = {s.baseMs + getU32(r), fromRaw((int16_t)(r[4] | (r[5] << 8))), r[6], r[7]};
+      if (pt.t_ms >= t1) return visited;
+      if (source != SERIES_ALL_SOURCES && pt.source != source) continue;
+      visit(pt, ctx);
+      visited++;
+    }
+    i += n;
+  }
+  return visited;
+}
+
+size_t SeriesStore::scan(uint64_t t0, uint64_t t1, uint8_t source, SeriesVisitor visit, void* ctx) {
+  size_t visited = 0;
+  for (size_t i = 0; i < count_; i++) {
+    const Segment& s = segs_[i];
+    if (s.lastMs < t0 || s.firstMs >= t1) continue;  // the index rules it out
+    visited += scanSegment(s, t0, t1, source, visit, ctx);
+  }
+
+  // Still in RAM: newer than anything on flash
+  for (size_t i = 0; i < batchLen_ && batch_[i].t_ms < t1; i++) {
+    const Pending& e = batch_[i];
+    if (e.t_ms < t0 || (source != SERIES_ALL_SOURCES && e.source != source)) continue;
+    visit(SeriesPoint{e.t_ms, fromRaw(e.raw), e.source, e.flags}, ctx);
+    visited++;
+  }
+  return visited;
+}
+
+struct Buckets {
+  uint64_t t0;
+  uint32_t bucketMs;
+  SeriesBucket cur;
+  double sum;
+  bool open;
+  size_t emitted;
+  SeriesBucketVisitor visit;
+  void* ctx;
+
+  void close() {
+    if (!open) return;
+    cur.mean = cur.count ? (float)(sum / cur.count) : NAN;
+    visit(cur, ctx);
+    emitted++;
+    open = false;
+  }
+};
+
+static void addToBucket(const SeriesPoint& p, void* ctx) {
+  Buckets& b = *(Buckets*)ctx;
+  uint64_t start = b.t0 + (p.t_ms - b.t0) / b.bucketMs * b.bucketMs;
+  if (b.open && start != b.cur.t_ms) b.close();
+  if (!b.open) {
+    b.cur = SeriesBucket{start, 0, 0, NAN, NAN, NAN};
+    b.sum = 0;
+    b.open = true;
+  }
+
+  if (isnan(p.cm)) {
+    b.cur.missing++;
+    return;
+  }
+  if (b.cur.count == 0 || p.cm < b.cur.min) b.cur.min = p.cm;
+  if (b.cur.count == 0 || p.cm > b.cur.max) b.cur.max = p.cm;
+  b.cur.count++;
+  b.sum += p.cm;
+}
+
+size_t SeriesStore::downsample(uint64_t t0, uint64_t t1, uint32_t bucketMs, uint8_t source,
+                               SeriesBucketVisitor visit, void* ctx) {
+  if (t1 <= t0) return 0;
+  Buckets b;
+  b.t0 = t0;
+  b.bucketMs = bucketMs ? bucketMs : (t1 - t0 > UINT32_MAX ? UINT32_MAX : (uint32_t)(t1 - t0));
+  b.open = false;
+  b.emitted = 0;
+  b.visit = visit;
+  b.ctx = ctx;
+  scan(t0, t1, source, addToBucket, &b);
+  b.close();
+  return b.emitted;
+}
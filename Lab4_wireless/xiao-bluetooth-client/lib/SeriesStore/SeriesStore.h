@@ -0,0 +1,190 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Append-only time series of distance readings on a flash filesystem, so the
+// gateway keeps what it received across resets. Hardware-free: the sketch
+// hands it a SeriesFs (LittleFsSeries.h on the board, a RAM model in the
+// native sim).
+//
+// Readings wait in RAM and go to flash a whole filesystem block at a time.
+// LittleFS copies a file's last block when appending to it while it is part
+// full, so block-sized appends are what keeps each byte written once;
+// flushAgeMs caps how much a reset can lose when readings come in too slowly
+// to fill a block.
+//
+// Records are kept in time order. Readings arriving up to reorderMs behind
+// the newest one (a peer's held readings filled in after its next sample,
+// a short backfill) are sorted into place before they are written; older
+// ones than what is already on flash are refused and counted as late.
+//
+// Time is the gateway's clock in ms, continued across resets from the last
+// stored record: time spent powered off is not counted.
+
+// ====================== Filesystem interface ======================
+class SeriesFs {
+public:
+  virtual ~SeriesFs() {}
+  // Appends n bytes to path, creating it, and makes them durable. False on
+  // error; the file may then hold part of the data.
+  virtual bool append(const char* path, const void* data, size_t n) = 0;
+  // Exactly n bytes from offset; false if the file is shorter.
+  virtual bool read(const char* path, uint32_t offset, void* out, size_t n) = 0;
+  virtual int32_t size(const char* path) = 0;  // -1 when missing
+  virtual bool remove(const char* path) = 0;
+  // Calls each() with the name (no directory) of every file in dir.
+  virtual void list(const char* dir, void (*each)(const char* name, void* ctx), void* ctx) = 0;
+};
+
+// ====================== Layout ======================
+// A directory of segment files, 00000000.seg, 00000001.seg, ..., and a
+// "sources" file naming the servers (24 bytes each, the record's source is
+// the index). A segment is a 16-byte header and 8-byte records, so records
+// never straddle a block:
+//
+//   header  offset  size  field
+//           0       4     SERIES_MAGIC
+//           4       4     segment number
+//           8       8     base time (ms)
+//
+//   record  0       4     time - base time (ms)
+//           4       2     distance (0.1 cm), INT16_MIN = no reading
+//           6       1     source
+//           7       1     flags (SERIES_FILLED)
+static const size_t SERIES_BLOCK_SIZE = 4096;  // LittleFS block on the ESP32's flash
+static const size_t SERIES_HEADER_SIZE = 16;
+static const size_t SERIES_RECORD_SIZE = 8;
+static const uint32_t SERIES_MAGIC = 0x31475354;  // "TSG1"
+static const size_t SERIES_MAX_SEGMENTS = 64;
+static const size_t SERIES_MAX_SOURCES = 16;
+static const size_t SERIES_SOURCE_NAME = 24;
+static const size_t SERIES_BATCH_RECORDS = 1024;  // a block and the reorder window
+
+static const uint8_t SERIES_FILLED = 0x01;  // a held reading the gateway filled in (SendOnDelta)
+static const uint8_t SERIES_ALL_SOURCES = 0xFF;
+
+struct SeriesStoreConfig {
+  const char* dir;
+  uint32_t segmentBytes;  // roll over to a new segment at this size (rounded to whole blocks)
+  uint32_t capBytes;      // oldest segments are removed to stay under
+  uint32_t flushAgeMs;    // longest a reading waits in RAM; 0 = write each one through
+  uint32_t reorderMs;     // how far behind the newest reading one may still arrive
+};
+
+struct SeriesPoint {
+  uint64_t t_ms;
+  float cm;  // NaN for no reading
+  uint8_t source;
+  uint8_t flags;
+};
+
+// Readings in [t_ms, t_ms + bucket); no readings are counted in missing
+struct SeriesBucket {
+  uint64_t t_ms;
+  uint32_t count;
+  uint32_t missing;
+  float min;
+  float max;
+  float mean;
+};
+
+typedef void (*SeriesVisitor)(const SeriesPoint& p, void* ctx);
+typedef void (*SeriesBucketVisitor)(const SeriesBucket& b, void* ctx);
+
+// ====================== Store ======================
+class SeriesStore {
+public:
+  SeriesStore(SeriesFs& fs, const SeriesStoreConfig& cfg);
+
+  // Indexes the segments on flash (dropping any that do not check out) and
+  // picks the clock up after the last stored record. Call once, before the
+  // rest.
+  bool begin(uint32_t nowMs);
+
+  // Source index for a server address, added on first use; -1 when the
+  // table is full or cannot be written.
+  int sourceId(const char* name);
+  const char* sourceName(uint8_t id) const { return id < sources_ ? names_[id] : "?"; }
+
+  // One reading at the gateway's millis(). False if it is late or could not
+  // be written.
+  bool append(uint32_t localMs, float cm, uint8_t source, uint8_t flags = 0);
+
+  // Writes what the flush age says is due. Call regularly.
+  void service(uint32_t nowMs);
+  // Writes everything held in RAM, e.g. before a planned reset.
+  bool flush();
+
+  // Readings in [t0, t1) of one source (or all), oldest first. Returns the
+  // number visited.
+  size_t scan(uint64_t t0, uint64_t t1, uint8_t source, SeriesVisitor visit, void* ctx);
+  // The same readings summarised in buckets of bucketMs from t0; empty
+  // buckets are skipped. Returns the number of buckets.
+  size_t downsample(uint64_t t0, uint64_t t1, uint32_t bucketMs, uint8_t source, SeriesBucketVisitor visit, void* ctx);
+
+  uint64_t now(uint32_t localMs);  // store clock
+  uint64_t firstMs() const;
+  uint64_t lastMs() const;
+
+  uint32_t records() const;  // on flash and held in RAM
+  size_t pending() const { return batchLen_; }
+  size_t segments() const { return count_; }
+  uint32_t bytes() const;  // on flash
+  uint32_t late() const { return late_; }
+  uint32_t dropped() const { return dropped_; }  // lost to write errors or a full batch
+  uint32_t writes() const { return writes_; }
+  uint32_t corrupt() const { return corrupt_; }  // segments dropped by begin()
+
+private:
+  struct Segment {
+    uint32_t number;
+    uint64_t baseMs;
+    uint64_t firstMs;
+    uint64_t lastMs;
+    uint32_t bytes;
+  };
+
+  struct Pending {
+    uint64_t t_ms;
+    int16_t raw;
+    uint8_t source;
+    uint8_t flags;
+  };
+
+  void path(uint32_t number, char* out, size_t size) const;
+  void sourcesPath(char* out, size_t size) const;
+  bool load(uint32_t number);
+  void roll(uint64_t t);
+  size_t room();
+  void serviceAt(uint64_t nowT);
+  bool writeOut(size_t n);
+  bool readRecord(const Segment& s, uint32_t i, uint64_t& t);
+  size_t scanSegment(const Segment& s, uint64_t t0, uint64_t t1, uint8_t source, SeriesVisitor visit, void* ctx);
+  Segment* current() { return count_ ? &segs_[count_ - 1] : nullptr; }
+
+  SeriesFs& fs_;
+  SeriesStoreConfig cfg_;
+
+  Segment segs_[SERIES_MAX_SEGMENTS];  // oldest first
+  size_t count_ = 0;
+  uint32_t nextNumber_ = 0;
+  bool rollNext_ = false;  // the current segment's tail is not on the record grid
+  uint8_t out_[SERIES_BLOCK_SIZE];
+
+  Pending batch_[SERIES_BATCH_RECORDS];  // sorted by time
+  size_t batchLen_ = 0;
+  uint64_t flushedMs_ = 0;  // newest on flash: anything older is late
+  bool anyFlushed_ = false;
+
+  char names_[SERIES_MAX_SOURCES][SERIES_SOURCE_NAME];
+  uint8_t sources_ = 0;
+
+  uint64_t clockMs_ = 0;  // store time at lastLocalMs_
+  uint32_t lastLocalMs_ = 0;
+
+  uint32_t late_ = 0;
+  uint32_t dropped_ = 0;
+  uint32_t writes_ = 0;
+  uint32_t corrupt_ = 0;
+};
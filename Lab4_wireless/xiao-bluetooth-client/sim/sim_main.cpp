@@ -0,0 +1,1205 @@
+// ============================================
+// BLE client - native test
+// ============================================
+//   pio run -e native && .pio/build/native/program [--seed S]
+//
+// Series store: the gateway's reading log (lib/SeriesStore) over a RAM filesystem that
+// models what LittleFS does to the flash: an append to a file whose last
+// block is part full copies that part into a fresh block first, every
+// append is a metadata commit, and each block allocated is an erase. Write
+// amplification is bytes programmed over record bytes stored. It is a
+// model: metadata compaction, wear levelling and inline files are left out,
+// so treat the numbers as relative between policies.
+//
+// Checks: queries against a plain copy of what was appended (range bounds,
+// sources, downsampling), the size cap, reopening after a reset (index,
+// clock, a torn or corrupt segment), and the reorder window.
+//
+// Benchmarks:
+//   writes   - flush policies at a busy and a quiet gateway rate: appends,
+//              bytes programmed, erases, write amplification, and the most
+//              readings a reset could lose (held in RAM)
+//   queries  - typical range queries against a full store, by the index and
+//              binary search versus reading every segment: flash reads,
+//              bytes read and host time
+//
+// Notify queue: the BLE callback's hand-off (lib/NotifyQueue) as the
+// gateway builds it, 10k numbered notifications of every size up to past a
+// slot, on one thread and then with the callback and the consumer task on
+// two. Nothing the queue accepts may be lost, reordered, repeated or torn,
+// and what it refuses must show in its counters.
+//
+// Statistics: DistanceStats (shared_lib/StreamStats) on 100k samples of
+// known distributions and a sweeping trace, against exact percentiles of
+// the sorted samples: P² p50/p95/p99 within a rank error, the histogram
+// within one bucket, moments against a two-pass sum, and the same after
+// merging three servers' reconnects. Cost: host ns per add() and bytes,
+// next to sorting an hour of samples per query.
+//
+// Many servers: the gateway's peer table and time-ordered merge sized for
+// 48 servers (52 in range) over a simulated transport: per-server ping
+// rates and clocks, batched frames with radio delay, links that drop and
+// reconnect with backoff, failed connects, frames lost on a few live links.
+// Every sample must come out of the merge once and in local time order, the
+// clock estimate within one frame's delay, and the sequence gaps counted
+// only for frames lost on a live link, never for a reconnect.
+//
+// Exits non-zero if any check fails.
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <DistanceFrame.h>
+#include <NotifyQueue.h>
+#include <PeerManager.h>
+#include <SeriesStore.h>
+
+// ====================== RAM filesystem ======================
+static const uint32_t SIM_COMMIT_BYTES = 64;  // metadata programmed per append (one commit)
+
+class MemorySeriesFs : public SeriesFs {
+public:
+  bool append(const char* path, const void* data, size_t n) override {
+    if (failAfter_ >= 0 && failAfter_-- == 0) {
+      // Power cut mid-write: half of it lands
+      std::vector<uint8_t>& f = files_[path];
+      f.insert(f.end(), (const uint8_t*)data, (const uint8_t*)data + n / 2 + 1);
+      return false;
+    }
+    std::vector<uint8_t>& f = files_[path];
+    size_t tail = f.size() % SERIES_BLOCK_SIZE;
+    size_t fresh = (tail + n + SERIES_BLOCK_SIZE - 1) / SERIES_BLOCK_SIZE;  // blocks allocated
+    programmed += tail + n + SIM_COMMIT_BYTES;
+    erases += fresh;
+    appends++;
+    f.insert(f.end(), (const uint8_t*)data, (const uint8_t*)data + n);
+    return true;
+  }
+
+  bool read(const char* path, uint32_t offset, void* out, size_t n) override {
+    auto it = files_.find(path);
+    if (it == files_.end() || offset + n > it->second.size()) return false;
+    memcpy(out, it->second.data() + offset, n);
+    reads++;
+    bytesRead += n;
+    return true;
+  }
+
+  int32_t size(const char* path) override {
+    auto it = files_.find(path);
+    return it == files_.end() ? -1 : (int32_t)it->second.size();
+  }
+
+  bool remove(const char* path) override {
+    return files_.erase(path) > 0;
+  }
+
+  void list(const char* dir, void (*each)(const char* name, void* ctx), void* ctx) override {
+    std::string prefix = std::string(dir) + "/";
+    std::vector<std::string> names;
+    for (const auto& f : files_) {
+      if (f.first.compare(0, prefix.size(), prefix) == 0) names.push_back(f.first.substr(prefix.size()));
+    }
+    std::shuffle(names.begin(), names.end(), std::mt19937(names.size()));  // no order promised
+    for (const auto& n : names) each(n.c_str(), ctx);
+  }
+
+  std::vector<uint8_t>* file(const std::string& path) {
+    auto it = files_.find(path);
+    return it == files_.end() ? nullptr : &it->second;
+  }
+  size_t used() const {
+    size_t n = 0;
+    for (const auto& f : files_) n += f.second.size();
+    return n;
+  }
+  void failNext(int after) { failAfter_ = after; }
+  void resetCounters() { programmed = erases = appends = reads = bytesRead = 0; }
+
+  uint64_t programmed = 0;
+  uint64_t erases = 0;
+  uint64_t appends = 0;
+  uint64_t reads = 0;
+  uint64_t bytesRead = 0;
+
+private:
+  std::map<std::string, std::vector<uint8_t>> files_;
+  int failAfter_ = -1;
+};
+
+static const SeriesStoreConfig SIM_CONFIG = { "/ts", 64 * 1024, 1024 * 1024, 300000, 15000 };  // as the gateway
+
+static int failures = 0;
+
+static void expect(const char* name, bool ok) {
+  printf("%-48s %s\n", name, ok ? "ok" : "FAIL");
+  if (!ok) failures++;
+}
+
+static void collectPoint(const SeriesPoint& p, void* ctx) {
+  ((std::vector<SeriesPoint>*)ctx)->push_back(p);
+}
+
+static void collectBucket(const SeriesBucket& b, void* ctx) {
+  ((std::vector<SeriesBucket>*)ctx)->push_back(b);
+}
+
+static std::vector<SeriesPoint> query(SeriesStore& store, uint64_t t0, uint64_t t1,
+                                      uint8_t source = SERIES_ALL_SOURCES) {
+  std::vector<SeriesPoint> out;
+  store.scan(t0, t1, source, collectPoint, &out);
+  return out;
+}
+
+// What the store should hold: readings as appended, at 0.1 cm
+struct Reference {
+  std::vector<SeriesPoint> points;
+
+  void add(uint64_t t, float cm, uint8_t source, uint8_t flags) {
+    float stored = isnan(cm) ? NAN : roundf(cm * 10.0f) / 10.0f;
+    SeriesPoint p = { t, stored, source, flags };
+    auto at = std::upper_bound(points.begin(), points.end(), p,
+                               [](const SeriesPoint& a, const SeriesPoint& b) { return a.t_ms < b.t_ms; });
+    points.insert(at, p);
+  }
+
+  std::vector<SeriesPoint> range(uint64_t t0, uint64_t t1, uint8_t source = SERIES_ALL_SOURCES) const {
+    std::vector<SeriesPoint> out;
+    for (const auto& p : points) {
+      if (p.t_ms >= t0 && p.t_ms < t1 && (source == SERIES_ALL_SOURCES || p.source == source)) out.push_back(p);
+    }
+    return out;
+  }
+};
+
+static bool samePoint(const SeriesPoint& a, const SeriesPoint& b) {
+  bool sameCm = isnan(a.cm) ? isnan(b.cm) : fabsf(a.cm - b.cm) < 1e-3f;
+  return a.t_ms == b.t_ms && sameCm && a.source == b.source && a.flags == b.flags;
+}
+
+// Same readings; entries with equal times may come in either order
+static bool sameSeries(std::vector<SeriesPoint> a, std::vector<SeriesPoint> b) {
+  if (a.size() != b.size()) return false;
+  auto key = [](const SeriesPoint& p, const SeriesPoint& q) {
+    if (p.t_ms != q.t_ms) return p.t_ms < q.t_ms;
+    if (p.source != q.source) return p.source < q.source;
+    return (isnan(p.cm) ? -1e9f : p.cm) < (isnan(q.cm) ? -1e9f : q.cm);
+  };
+  for (size_t i = 1; i < a.size(); i++) {
+    if (a[i].t_ms < a[i - 1].t_ms) return false;  // time order as scanned
+  }
+  std::sort(a.begin(), a.end(), key);
+  std::sort(b.begin(), b.end(), key);
+  for (size_t i = 0; i < a.size(); i++) {
+    if (!samePoint(a[i], b[i])) return false;
+  }
+  return true;
+}
+
+static bool sameBuckets(const std::vector<SeriesBucket>& got, const std::vector<SeriesPoint>& points, uint64_t t0,
+                        uint32_t bucketMs) {
+  std::vector<SeriesBucket> want;
+  for (const auto& p : points) {
+    uint64_t start = t0 + (p.t_ms - t0) / bucketMs * bucketMs;
+    if (want.empty() || want.back().t_ms != start) want.push_back(SeriesBucket{ start, 0, 0, NAN, NAN, 0 });
+    SeriesBucket& b = want.back();
+    if (isnan(p.cm)) {
+      b.missing++;
+      continue;
+    }
+    b.min = b.count ? std::min(b.min, p.cm) : p.cm;
+    b.max = b.count ? std::max(b.max, p.cm) : p.cm;
+    b.mean += p.cm;
+    b.count++;
+  }
+  if (got.size() != want.size()) return false;
+  for (size_t i = 0; i < got.size(); i++) {
+    const SeriesBucket& g = got[i];
+    SeriesBucket& w = want[i];
+    if (g.t_ms != w.t_ms || g.count != w.count || g.missing != w.missing) return false;
+    if (w.count == 0) {
+      if (!isnan(g.mean)) return false;
+      continue;
+    }
+    w.mean /= w.count;
+    if (g.min != w.min || g.max != w.max || fabsf(g.mean - w.mean) > 1e-3f) return false;
+  }
+  return true;
+}
+
+// ====================== Checks ======================
+static void testQueries(std::mt19937& rng) {
+  MemorySeriesFs fs;
+  SeriesStore store(fs, SIM_CONFIG);
+  store.begin(5000);
+  int a = store.sourceId("aa:bb:cc:dd:ee:01");
+  int b = store.sourceId("aa:bb:cc:dd:ee:02");
+
+  // Two servers at 1 s, jittered arrival, a few out of range and a few
+  // readings filled in after the fact
+  Reference ref;
+  std::uniform_int_distribution<int> jitter(-400, 400);
+  std::uniform_real_distribution<float> cm(5, 300);
+  std::uniform_int_distribution<int> pick(0, 19);
+  uint32_t local = 5000;
+  for (int i = 0; i < 12000; i++) {
+    local += 500;
+    uint32_t at = local + jitter(rng);
+    uint8_t source = (uint8_t)(i % 2 ? b : a);
+    float value = pick(rng) == 0 ? NAN : cm(rng);
+    uint8_t flags = pick(rng) == 1 ? SERIES_FILLED : 0;
+    uint64_t t = store.now(at);
+    if (store.append(at, value, source, flags)) ref.add(t, value, source, flags);
+  }
+  store.service(local + 1000);
+
+  uint64_t first = store.firstMs(), last = store.lastMs();
+  expect("every reading accepted, nothing late", store.late() == 0 && store.dropped() == 0);
+  expect("full scan returns everything in order", sameSeries(query(store, 0, UINT64_MAX), ref.points));
+  expect("records counted on flash and in RAM", store.records() == ref.points.size() && store.pending() > 0);
+
+  bool ranges = true;
+  std::uniform_int_distribution<uint64_t> when(first - 2000, last + 2000);
+  for (int i = 0; i < 200 && ranges; i++) {
+    uint64_t t0 = when(rng), t1 = when(rng);
+    if (t1 < t0) std::swap(t0, t1);
+    uint8_t source = i % 3 == 0 ? SERIES_ALL_SOURCES : (uint8_t)(i % 2 ? a : b);
+    ranges = sameSeries(query(store, t0, t1, source), ref.range(t0, t1, source));
+  }
+  expect("random ranges and sources", ranges);
+
+  uint64_t mid = ref.points[ref.points.size() / 2].t_ms;
+  auto at = query(store, mid, mid + 1);
+  expect("range is [t0, t1)", !at.empty() && at.front().t_ms == mid && query(store, mid, mid).empty());
+
+  bool buckets = true;
+  for (uint32_t bucketMs : { 1000u, 60000u, 3600000u }) {
+    std::vector<SeriesBucket> got;
+    uint64_t t0 = first + 777;
+    store.downsample(t0, last + 1, bucketMs, (uint8_t)a, collectBucket, &got);
+    buckets = buckets && sameBuckets(got, ref.range(t0, last + 1, (uint8_t)a), t0, bucketMs);
+  }
+  std::vector<SeriesBucket> whole;
+  store.downsample(first, last + 1, 0, SERIES_ALL_SOURCES, collectBucket, &whole);
+  buckets = buckets && whole.size() == 1 && whole[0].count + whole[0].missing == ref.points.size();
+  expect("downsampled buckets match the readings", buckets);
+
+  expect("sources named in order", !strcmp(store.sourceName(b), "aa:bb:cc:dd:ee:02") &&
+                                       store.sourceId("aa:bb:cc:dd:ee:01") == a && !strcmp(store.sourceName(9), "?"));
+}
+
+static void testReorder() {
+  MemorySeriesFs fs;
+  SeriesStore store(fs, SIM_CONFIG);
+  store.begin(0);
+
+  // Readings filled in behind the newest sample sort into place
+  store.append(10000, 10, 0);
+  store.append(9000, 9, 0, SERIES_FILLED);
+  store.append(8000, 8, 0, SERIES_FILLED);
+  store.append(11000, 11, 0);
+  auto points = query(store, 0, UINT64_MAX);
+  bool sorted = points.size() == 4;
+  for (size_t i = 0; sorted && i < points.size(); i++) sorted = points[i].cm == 8 + i;
+  expect("late arrivals inside the window sort in", sorted && points[0].flags == SERIES_FILLED);
+
+  // Past the window and the flush age they are written, and then anything
+  // older than them is refused
+  store.service(11000 + SIM_CONFIG.flushAgeMs + SIM_CONFIG.reorderMs);
+  bool flushed = store.pending() == 0 && fs.appends == 1;
+  bool late = !store.append(7000, 7, 0) && store.late() == 1;
+  expect("written once due; older readings are late", flushed && late && query(store, 0, UINT64_MAX).size() == 4);
+}
+
+static void testCap() {
+  MemorySeriesFs fs;
+  SeriesStoreConfig cfg = { "/ts", 16 * 1024, 64 * 1024, 60000, 0 };
+  SeriesStore store(fs, cfg);
+  store.begin(0);
+
+  uint32_t n = 40000;  // 320 KB of records
+  for (uint32_t i = 0; i < n; i++) store.append(i * 100, (float)(i % 3000) / 10, 0);
+  store.flush();
+
+  auto points = query(store, 0, UINT64_MAX);
+  bool newest = !points.empty() && points.back().t_ms == (uint64_t)(n - 1) * 100;
+  bool contiguous = true;
+  for (size_t i = 1; i < points.size() && contiguous; i++) contiguous = points[i].t_ms == points[i - 1].t_ms + 100;
+  expect("size cap holds", store.bytes() <= cfg.capBytes && fs.used() <= cfg.capBytes);
+  expect("oldest segments dropped, newest kept whole", newest && contiguous && store.firstMs() > 0 &&
+                                                           points.front().t_ms == store.firstMs());
+  expect("segments roll at the configured size", store.segments() >= 3 && store.segments() <= 4);
+}
+
+static void testReopen() {
+  MemorySeriesFs fs;
+  {
+    SeriesStore store(fs, SIM_CONFIG);
+    store.begin(1000);
+    store.sourceId("aa:bb:cc:dd:ee:01");
+    store.sourceId("aa:bb:cc:dd:ee:02");
+    for (uint32_t i = 0; i < 3000; i++) store.append(1000 + i * 1000, 20, i % 2);
+    store.flush();
+    for (uint32_t i = 3000; i < 3010; i++) store.append(1000 + i * 1000, 20, 0);  // held, lost on reset
+  }
+
+  SeriesStore store(fs, SIM_CONFIG);
+  store.begin(500);  // millis() starts over
+  bool index = store.records() == 3000 && store.firstMs() == 1000 && store.lastMs() == 1000 + 2999 * 1000ull;
+  expect("reopened: index rebuilt, unflushed batch lost", index && store.corrupt() == 0);
+  expect("reopened: sources kept", store.sourceId("aa:bb:cc:dd:ee:02") == 1 && !strcmp(store.sourceName(0), "aa:bb:cc:dd:ee:01"));
+
+  uint64_t before = store.lastMs();
+  store.append(600, 21, 0);
+  store.flush();
+  expect("reopened: clock carries on from the last record", store.lastMs() > before &&
+                                                               store.lastMs() - before == 101);
+
+  // A write torn by a power cut: its half lands, the store starts a new segment
+  uint32_t segments = store.segments();
+  fs.failNext(0);
+  store.append(1000, 22, 0);
+  bool torn = !store.flush() && store.dropped() == 1;
+  store.append(1100, 23, 0);
+  store.flush();
+  expect("torn write: dropped, next one in a new segment", torn && store.segments() == segments + 1 &&
+                                                               query(store, 0, UINT64_MAX).back().cm == 23);
+
+  // Reopen again with one segment overwritten by garbage
+  std::vector<uint8_t>* seg = fs.file("/ts/00000000.seg");
+  if (seg) memset(seg->data(), 0xA5, 16);
+  SeriesStore again(fs, SIM_CONFIG);
+  again.begin(0);
+  auto points = query(again, 0, UINT64_MAX);
+  bool ordered = true;
+  for (size_t i = 1; i < points.size() && ordered; i++) ordered = points[i].t_ms >= points[i - 1].t_ms;
+  expect("corrupt segment dropped, torn tail trimmed", again.corrupt() == 1 && fs.size("/ts/00000000.seg") < 0 &&
+                                                           ordered && points.back().cm == 23);
+}
+
+// ====================== Write benchmark ======================
+struct WritePolicy {
+  const char* name;
+  uint32_t flushAgeMs;
+  uint32_t reorderMs;
+};
+
+struct WriteResult {
+  uint32_t records;
+  uint64_t appends;
+  uint64_t programmed;
+  uint64_t erases;
+  size_t maxHeld;
+  double hostRecPerSec;
+};
+
+static WriteResult runWrites(const WritePolicy& policy, uint32_t periodMs, uint32_t durationMs, std::mt19937& rng) {
+  MemorySeriesFs fs;
+  SeriesStoreConfig cfg = SIM_CONFIG;
+  cfg.flushAgeMs = policy.flushAgeMs;
+  cfg.reorderMs = policy.reorderMs;
+  SeriesStore store(fs, cfg);
+  store.begin(0);
+
+  std::normal_distribution<float> noise(0.0f, 0.3f);
+  WriteResult r = {};
+  auto start = std::chrono::steady_clock::now();
+  for (uint32_t t = periodMs; t < durationMs; t += periodMs) {
+    store.append(t, 20.0f + noise(rng), (uint8_t)(t / periodMs % 3));
+    if (t % 500 < periodMs) store.service(t);  // the consumer wakes every 500 ms
+    r.maxHeld = std::max(r.maxHeld, store.pending());
+    r.records++;
+  }
+  store.flush();
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  r.appends = fs.appends;
+  r.programmed = fs.programmed;
+  r.erases = fs.erases;
+  r.hostRecPerSec = seconds > 0 ? r.records / seconds : 0;
+  return r;
+}
+
+static void testWrites(std::mt19937& rng) {
+  const WritePolicy policies[] = {
+    { "each reading", 0, 0 },        { "flush 10 s", 10000, 5000 },   { "flush 60 s", 60000, 15000 },
+    { "flush 300 s", 300000, 15000 }, { "whole blocks", UINT32_MAX, 15000 },
+  };
+  const struct {
+    const char* name;
+    uint32_t periodMs;
+  } rates[] = { { "3 servers 1 Hz", 333 }, { "on change 0.2/s", 5000 } };
+  const uint32_t day = 24 * 3600 * 1000u;
+
+  printf("\n%-16s %-15s %-4s %8s %8s %9s %8s %6s %6s %10s\n", "writes", "policy", "", "records", "appends",
+         "prog KB", "erases", "WA", "held", "host rec/s");
+  for (const auto& rate : rates) {
+    double previous = 1e9;
+    for (const auto& policy : policies) {
+      WriteResult r = runWrites(policy, rate.periodMs, day, rng);
+      double wa = (double)r.programmed / ((double)r.records * SERIES_RECORD_SIZE);
+
+      // Batching must pay: never worse than the tighter policy before it,
+      // and whole blocks within 1.1x of the record bytes
+      bool ok = wa <= previous + 1e-9 && (policy.flushAgeMs != UINT32_MAX || wa < 1.1);
+      previous = wa;
+      printf("%-16s %-15s %-4s %8u %8llu %9.0f %8llu %6.2f %6zu %10.0f\n", rate.name, policy.name, ok ? "ok" : "FAIL",
+             r.records, (unsigned long long)r.appends, r.programmed / 1024.0, (unsigned long long)r.erases, wa,
+             r.maxHeld, r.hostRecPerSec);
+      if (!ok) failures++;
+    }
+  }
+}
+
+// ====================== Query benchmark ======================
+struct Count {
+  size_t n;
+};
+
+static void countPoint(const SeriesPoint&, void* ctx) {
+  ((Count*)ctx)->n++;
+}
+
+static void countBucket(const SeriesBucket&, void* ctx) {
+  ((Count*)ctx)->n++;
+}
+
+// Reads every segment front to back, keeping what is in range
+struct Naive {
+  uint64_t t0, t1;
+  uint8_t source;
+  size_t n;
+};
+
+static void naivePoint(const SeriesPoint& p, void* ctx) {
+  Naive& q = *(Naive*)ctx;
+  if (p.t_ms >= q.t0 && p.t_ms < q.t1 && (q.source == SERIES_ALL_SOURCES || p.source == q.source)) q.n++;
+}
+
+static void testQueryLatency() {
+  MemorySeriesFs fs;
+  SeriesStore store(fs, SIM_CONFIG);
+  store.begin(0);
+
+  // 24 h of three servers at 1 Hz: the cap keeps the newest ~12 h
+  for (uint32_t t = 333; t < 24 * 3600 * 1000u; t += 333) store.append(t, 20.0f + (t / 1000 % 50), t / 333 % 3);
+  store.flush();
+
+  uint64_t last = store.lastMs(), first = store.firstMs();
+  const struct {
+    const char* name;
+    uint64_t t0, t1;
+    uint32_t bucketMs;
+    uint8_t source;
+  } queries[] = {
+    { "last minute raw", last - 60000, last + 1, 0xFFFFFFFF, SERIES_ALL_SOURCES },
+    { "last hour 1 min", last - 3600000, last + 1, 60000, SERIES_ALL_SOURCES },
+    { "hour ago 1 srv", last - 7200000, last - 3600000, 0xFFFFFFFF, 1 },
+    { "whole store 10 min", first, last + 1, 600000, SERIES_ALL_SOURCES },
+  };
+
+  printf("\n%-20s %-4s %8s %8s %10s %9s %12s %10s %9s\n", "queries", "", "result", "reads", "bytes", "host us",
+         "naive bytes", "naive us", "span h");
+  printf("%-20s %-4s %8u %8s %10u\n", "(store)", "", store.records(), "", store.bytes());
+  for (const auto& q : queries) {
+    const int reps = 20;
+    Count c = {};
+    fs.resetCounters();
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < reps; i++) {
+      c.n = 0;
+      if (q.bucketMs == 0xFFFFFFFF) store.scan(q.t0, q.t1, q.source, countPoint, &c);
+      else store.downsample(q.t0, q.t1, q.bucketMs, q.source, countBucket, &c);
+    }
+    double us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count() / reps;
+    uint64_t reads = fs.reads / reps, bytes = fs.bytesRead / reps;
+
+    Naive naive = { q.t0, q.t1, q.source, 0 };
+    fs.resetCounters();
+    start = std::chrono::steady_clock::now();
+    store.scan(0, UINT64_MAX, SERIES_ALL_SOURCES, naivePoint, &naive);
+    double naiveUs = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+    uint64_t naiveBytes = fs.bytesRead;
+
+    // Same readings as the full scan, for a fraction of the reading except
+    // when the query spans the store
+    Count direct = {};
+    store.scan(q.t0, q.t1, q.source, countPoint, &direct);
+    bool span = q.t1 - q.t0 >= last - first;
+    bool ok = direct.n == naive.n && direct.n > 0 && (span || bytes * 4 < naiveBytes);
+    printf("%-20s %-4s %8zu %8llu %10llu %9.1f %12llu %10.1f %9.2f\n", q.name, ok ? "ok" : "FAIL", c.n,
+           (unsigned long long)reads, (unsigned long long)bytes, us, (unsigned long long)naiveBytes, naiveUs,
+           (q.t1 - q.t0) / 3600000.0);
+    if (!ok) failures++;
+  }
+}
+
+// ====================== Notify queue ======================
+// The gateway's hand-off as built (NotifyQueue<DISTANCE_FRAME_MAX_SIZE, 8>):
+// 10k notifications of every size through it, each stamped with its number
+// and a byte pattern so loss, reordering, duplication and torn copies all
+// show up at the consumer.
+static const uint32_t NQ_COUNT = 10000;
+static const size_t NQ_SLOTS = 8;  // NOTIFY_SLOTS
+typedef NotifyQueue<DISTANCE_FRAME_MAX_SIZE, NQ_SLOTS> GatewayQueue;
+
+static size_t nqLength(uint32_t n) {
+  return 4 + (n * 37) % (DISTANCE_FRAME_MAX_SIZE + 40 - 4);  // a few past the slot size
+}
+
+static void nqPayload(uint32_t n, uint8_t* out, size_t length) {
+  memcpy(out, &n, 4);
+  for (size_t i = 4; i < length; i++) out[i] = (uint8_t)(n * 31 + i);
+}
+
+// Checks the slot is notification want, as far as it fits
+static bool nqIntact(const GatewayQueue::Slot& slot, uint32_t want) {
+  size_t length = std::min(nqLength(want), DISTANCE_FRAME_MAX_SIZE);
+  uint8_t expected[DISTANCE_FRAME_MAX_SIZE];
+  nqPayload(want, expected, length);
+  return slot.length == length && slot.source == want % 3 && slot.receivedMs == want &&
+         !memcmp(slot.data, expected, length);
+}
+
+struct NqResult {
+  uint32_t delivered = 0;
+  uint32_t outOfOrder = 0;  // behind or repeating the previous one
+  uint32_t torn = 0;
+  uint32_t refused = 0;     // push() returned false
+  uint32_t retries = 0;
+  uint32_t truncated = 0;
+  uint32_t last = 0;
+};
+
+static void nqConsume(const GatewayQueue::Slot& slot, NqResult& r) {
+  uint32_t n;
+  memcpy(&n, slot.data, 4);
+  if (r.delivered > 0 && n <= r.last) r.outOfOrder++;
+  if (!nqIntact(slot, n)) r.torn++;
+  if (nqLength(n) > DISTANCE_FRAME_MAX_SIZE) r.truncated++;
+  r.last = n;
+  r.delivered++;
+}
+
+// The BLE callback and the consumer task on two threads. The callback posts
+// the consumer after every push, as xTaskNotifyGive does. With retry the
+// producer waits for a release and pushes again instead of dropping: what
+// the ring holds must then arrive in full. Without, notifications come in
+// bursts of 1-12 (one connection event) and the next burst waits for the
+// consumer to catch up, so only the long bursts overflow.
+static NqResult nqThreads(bool retry, std::mt19937& rng) {
+  GatewayQueue queue;
+  NqResult r;
+  std::mutex m;
+  std::condition_variable posted, released;
+  bool work = false, done = false;
+
+  std::thread consumer([&] {
+    for (;;) {
+      {
+        std::unique_lock<std::mutex> lock(m);
+        posted.wait(lock, [&] { return work || done; });
+        work = false;
+      }
+      while (const GatewayQueue::Slot* slot = queue.peek()) {
+        nqConsume(*slot, r);
+        queue.release();
+        std::lock_guard<std::mutex> lock(m);
+        released.notify_one();
+      }
+      std::lock_guard<std::mutex> lock(m);
+      if (done && queue.pending() == 0) return;
+    }
+  });
+
+  std::uniform_int_distribution<int> burst(1, 12);
+  int left = burst(rng);
+  uint8_t payload[DISTANCE_FRAME_MAX_SIZE + 40];
+  for (uint32_t n = 0; n < NQ_COUNT; n++) {
+    if (!retry && left-- == 0) {
+      std::unique_lock<std::mutex> lock(m);
+      released.wait(lock, [&] { return queue.pending() == 0; });
+      left = burst(rng) - 1;
+    }
+    size_t length = nqLength(n);
+    nqPayload(n, payload, length);
+    while (!queue.push(payload, length, n, (uint8_t)(n % 3))) {
+      r.refused++;
+      if (!retry) break;
+      r.retries++;
+      std::unique_lock<std::mutex> lock(m);
+      work = true;
+      posted.notify_one();
+      released.wait(lock, [&] { return queue.pending() < NQ_SLOTS; });
+    }
+    std::lock_guard<std::mutex> lock(m);
+    work = true;
+    posted.notify_one();
+  }
+  {
+    std::lock_guard<std::mutex> lock(m);
+    done = true;
+    posted.notify_one();
+  }
+  consumer.join();
+  return r;
+}
+
+static void testNotifyQueue(std::mt19937& rng) {
+  printf("\nnotify queue\n");
+
+  // One thread: the consumer drains 0-9 slots between pushes
+  GatewayQueue queue;
+  NqResult r;
+  std::uniform_int_distribution<int> drain(0, 9);
+  uint8_t payload[DISTANCE_FRAME_MAX_SIZE + 40];
+  auto start = std::chrono::steady_clock::now();
+  for (uint32_t n = 0; n < NQ_COUNT; n++) {
+    for (int k = drain(rng); k > 0; k--) {
+      const GatewayQueue::Slot* slot = queue.peek();
+      if (!slot) break;
+      nqConsume(*slot, r);
+      queue.release();
+    }
+    size_t length = nqLength(n);
+    nqPayload(n, payload, length);
+    if (!queue.push(payload, length, n, (uint8_t)(n % 3))) r.refused++;
+  }
+  while (const GatewayQueue::Slot* slot = queue.peek()) {
+    nqConsume(*slot, r);
+    queue.release();
+  }
+  double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / NQ_COUNT;
+  printf("  one thread: %u delivered, %u refused, %.0f host ns per notification\n", r.delivered, r.refused, ns);
+  expect("every push accepted arrives once, in order", r.delivered + r.refused == NQ_COUNT && r.outOfOrder == 0);
+  expect("payload, length, source and time intact", r.torn == 0);
+  expect("counters: received, dropped, overruns",
+         queue.received() == NQ_COUNT && queue.dropped() == r.refused && queue.overruns() == r.truncated && r.truncated > 0 &&
+           queue.pending() == 0);
+
+  // Two threads, the producer waiting for room: nothing lost
+  r = nqThreads(true, rng);
+  printf("  two threads, waiting for room: %u delivered, %u waits\n", r.delivered, r.retries);
+  expect("10k notifications: none lost or reordered",
+         r.delivered == NQ_COUNT && r.outOfOrder == 0 && r.torn == 0);
+
+  // Two threads, dropping when full as the callback does
+  r = nqThreads(false, rng);
+  printf("  two threads, dropping when full: %u delivered, %u dropped\n", r.delivered, r.refused);
+  expect("drops counted, the rest in order and intact",
+         r.delivered + r.refused == NQ_COUNT && r.refused > 0 && r.outOfOrder == 0 && r.torn == 0);
+}
+
+// ====================== Statistics ======================
+// DistanceStats (shared_lib/StreamStats) against exact percentiles of the
+// same samples, sorted. The histogram interpolates inside 5 cm buckets, so
+// in range it is off by at most one bucket. P² has no hard bound; it is held
+// to a rank error: the share of samples between its estimate and the exact
+// percentile. Independent samples keep it within 1%; a trace that sweeps
+// the same range again and again drags the markers along behind it (up to
+// 2.8% over 20 seeds), so that one gets 4%.
+static const float STATS_HIST_TOL_CM = 400.0f / 80;  // one bucket
+static const double STATS_P2_RANK_TOL = 0.01;        // p50 and p95
+static const double STATS_P2_RANK_TOL_P99 = 0.005;   // p99: 1% either side would be the whole tail
+static const double STATS_P2_RANK_TOL_TRACE = 0.04;
+static const uint32_t STATS_SAMPLES = 100000;
+
+// Linear between the order statistics around p * (n - 1)
+static float exactPercentile(const std::vector<float>& sorted, double p) {
+  double at = p * (sorted.size() - 1);
+  size_t i = (size_t)at;
+  if (i + 1 >= sorted.size()) return sorted.back();
+  return (float)(sorted[i] + (at - i) * (sorted[i + 1] - sorted[i]));
+}
+
+// Share of samples between estimate and exact
+static double rankError(const std::vector<float>& sorted, float estimate, double p) {
+  double below = std::lower_bound(sorted.begin(), sorted.end(), estimate) - sorted.begin();
+  double upTo = std::upper_bound(sorted.begin(), sorted.end(), estimate) - sorted.begin();
+  double want = p * sorted.size();
+  if (want < below) return (below - want) / sorted.size();
+  if (want > upTo) return (want - upTo) / sorted.size();
+  return 0;
+}
+
+struct StatsCase {
+  const char* name;
+  std::function<float(std::mt19937&, uint32_t)> draw;  // i-th sample
+  bool trace;  // correlated: STATS_P2_RANK_TOL_TRACE
+};
+
+static std::vector<StatsCase> statsCases() {
+  return {
+    { "uniform 0-400", [](std::mt19937& g, uint32_t) { return std::uniform_real_distribution<float>(0, 400)(g); }, false },
+    { "normal 120/25", [](std::mt19937& g, uint32_t) {
+        return std::max(0.0f, std::normal_distribution<float>(120, 25)(g));
+      }, false },
+    { "bimodal 40/250", [](std::mt19937& g, uint32_t) {
+        return std::uniform_int_distribution<int>(0, 9)(g) < 7 ? std::normal_distribution<float>(40, 5)(g)
+                                                               : std::normal_distribution<float>(250, 20)(g);
+      }, false },
+    { "exponential 50", [](std::mt19937& g, uint32_t) {
+        return std::min(399.9f, std::exponential_distribution<float>(1.0f / 50)(g));
+      }, false },
+    // A target walking in and out at 1 Hz with sensor noise and 2% spikes
+    { "approach trace", [](std::mt19937& g, uint32_t i) {
+        float phase = (float)fmod(i / 1800.0, 2.0);
+        float cm = phase < 1 ? 300 - 260 * phase : 40 + 260 * (phase - 1);
+        cm += std::normal_distribution<float>(0, 1.5f)(g);
+        return std::uniform_int_distribution<int>(0, 49)(g) == 0 ? std::uniform_real_distribution<float>(5, 395)(g)
+                                                                 : cm;
+      }, true },
+    { "ramp (sorted)", [](std::mt19937&, uint32_t i) { return 400.0f * i / STATS_SAMPLES; }, true },
+  };
+}
+
+static void testStatsAccuracy(std::mt19937& rng) {
+  printf("\n%-16s %-4s %-26s %-26s %-26s\n", "percentiles", "", "p50 exact/P2/hist", "p95 exact/P2/hist",
+         "p99 exact/P2/hist");
+  const double ps[] = { 0.50, 0.95, 0.99 };
+  double worstRank[3] = {}, worstTrace = 0, worstHist = 0;
+
+  for (const StatsCase& c : statsCases()) {
+    DistanceStats stats(0.0f, 400.0f);
+    std::vector<float> xs(STATS_SAMPLES);
+    for (uint32_t i = 0; i < STATS_SAMPLES; i++) {
+      xs[i] = c.draw(rng, i);
+      stats.add(xs[i]);
+    }
+    std::vector<float> sorted = xs;
+    std::sort(sorted.begin(), sorted.end());
+
+    const float p2[] = { stats.p50(), stats.p95(), stats.p99() };
+    bool ok = true;
+    char cols[3][32];
+    for (int k = 0; k < 3; k++) {
+      float exact = exactPercentile(sorted, ps[k]);
+      float hist = stats.percentile((float)ps[k]);
+      double rank = rankError(sorted, p2[k], ps[k]);
+      double histErr = fabsf(hist - exact);
+      worstHist = std::max(worstHist, histErr);
+      double tol = c.trace ? STATS_P2_RANK_TOL_TRACE : k == 2 ? STATS_P2_RANK_TOL_P99 : STATS_P2_RANK_TOL;
+      ok = ok && rank <= tol && histErr <= STATS_HIST_TOL_CM;
+      if (c.trace) worstTrace = std::max(worstTrace, rank);
+      else worstRank[k] = std::max(worstRank[k], rank);
+      snprintf(cols[k], sizeof(cols[k]), "%6.1f/%6.1f/%6.1f", exact, p2[k], hist);
+    }
+
+    // Moments against a two-pass sum in double
+    double sum = 0, sq = 0;
+    for (float x : xs) sum += x;
+    double mean = sum / xs.size();
+    for (float x : xs) sq += (x - mean) * (x - mean);
+    double var = sq / (xs.size() - 1);
+    ok = ok && stats.count() == STATS_SAMPLES && stats.min() == sorted.front() && stats.max() == sorted.back() &&
+         fabs(stats.mean() - mean) <= 1e-5 * fabs(mean) + 1e-4 && fabs(stats.variance() - var) <= 1e-5 * var;
+
+    printf("%-16s %-4s %-26s %-26s %-26s\n", c.name, ok ? "ok" : "FAIL", cols[0], cols[1], cols[2]);
+    if (!ok) failures++;
+  }
+  printf("  worst P2 rank error, independent samples: p50 %.4f, p95 %.4f, p99 %.4f (bounds %.3f, %.3f, %.3f)\n",
+         worstRank[0], worstRank[1], worstRank[2], STATS_P2_RANK_TOL, STATS_P2_RANK_TOL, STATS_P2_RANK_TOL_P99);
+  printf("  worst P2 rank error, traces: %.4f (bound %.3f)\n", worstTrace, STATS_P2_RANK_TOL_TRACE);
+  printf("  worst histogram error %.2f cm (bound %.1f cm)\n", worstHist, STATS_HIST_TOL_CM);
+
+  // Merged across three servers and their reconnects: moments exact, the
+  // percentiles from the summed histogram
+  std::vector<float> all;
+  DistanceStats merged(0.0f, 400.0f), lifetime[3] = { { 0.0f, 400.0f }, { 0.0f, 400.0f }, { 0.0f, 400.0f } };
+  std::uniform_int_distribution<int> sessionLen(1, 5000);
+  std::normal_distribution<float> near(60, 10), mid(150, 30), far(300, 15);
+  for (int s = 0; s < 3; s++) {
+    for (int session = 0; session < 10; session++) {
+      DistanceStats current(0.0f, 400.0f);
+      for (int i = sessionLen(rng); i > 0; i--) {
+        float x = std::max(0.0f, std::min(399.9f, s == 0 ? near(rng) : s == 1 ? mid(rng) : far(rng)));
+        current.add(x);
+        all.push_back(x);
+      }
+      lifetime[s].merge(current);
+    }
+    merged.merge(lifetime[s]);
+  }
+  std::sort(all.begin(), all.end());
+  double sum = 0, sq = 0;
+  for (float x : all) sum += x;
+  double mean = sum / all.size();
+  for (float x : all) sq += (x - mean) * (x - mean);
+  double var = sq / (all.size() - 1);
+  bool ok = merged.count() == all.size() && merged.min() == all.front() && merged.max() == all.back() &&
+            fabs(merged.mean() - mean) <= 1e-5 * mean && fabs(merged.variance() - var) <= 1e-5 * var;
+  for (double p : ps) ok = ok && fabsf(merged.percentile((float)p) - exactPercentile(all, p)) <= STATS_HIST_TOL_CM;
+  ok = ok && merged.p50() == merged.percentile(0.5f);
+  expect("merged across servers and reconnects", ok);
+
+  DistanceStats edge(0.0f, 400.0f);
+  edge.add(NAN);
+  ok = edge.count() == 0 && isnan(edge.p50()) && isnan(edge.mean());
+  edge.add(-3.0f);
+  edge.add(450.0f);
+  edge.add(NAN);
+  ok = ok && edge.count() == 2 && edge.underflow() == 1 && edge.overflow() == 1 && edge.percentile(0.01f) == -3.0f &&
+       edge.percentile(0.99f) == 450.0f;
+  expect("NaN skipped, out of range clamped to min/max", ok);
+}
+
+// Per-update cost, and the memory against keeping the samples to sort
+static volatile float statsSink;
+
+static void testStatsCost(std::mt19937& rng) {
+  std::vector<float> input(1000000);
+  std::normal_distribution<float> d(120, 25);
+  for (float& x : input) x = d(rng);
+
+  DistanceStats stats(0.0f, 400.0f);
+  P2Quantile p2(0.95f);
+  StreamStats<1> moments(0.0f, 400.0f);
+  auto time = [&](auto&& add) {
+    auto start = std::chrono::steady_clock::now();
+    for (float x : input) add(x);
+    return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / input.size();
+  };
+  double statsNs = time([&](float x) { stats.add(x); });
+  double p2Ns = time([&](float x) { p2.add(x); });
+  double momentsNs = time([&](float x) { moments.add(x); });
+
+  // Exact percentiles the plain way: keep an hour at 1 Hz, sort to answer
+  std::vector<float> hour(input.begin(), input.begin() + 3600);
+  auto start = std::chrono::steady_clock::now();
+  const int reps = 200;
+  for (int i = 0; i < reps; i++) {
+    std::vector<float> copy = hour;
+    std::sort(copy.begin(), copy.end());
+    statsSink = copy[copy.size() / 2];
+  }
+  double sortUs = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count() / reps;
+
+  printf("\n%-28s %10s %10s\n", "statistics cost", "host ns", "bytes");
+  printf("%-28s %10.1f %10zu\n", "DistanceStats::add (80 bins)", statsNs, sizeof(DistanceStats));
+  printf("%-28s %10.1f %10zu\n", "P2Quantile::add", p2Ns, sizeof(P2Quantile));
+  printf("%-28s %10.1f %10zu\n", "StreamStats<1>::add", momentsNs, sizeof(StreamStats<1>));
+  printf("%-28s %10.0f %10zu   (us to sort per query)\n", "exact, 1 h at 1 Hz", sortUs, hour.size() * sizeof(float));
+}
+
+// ====================== Many servers ======================
+// The gateway's PeerManager and MergedStream sized for dozens of servers,
+// over a simulated transport on a 10 ms virtual clock. Each virtual server
+// pings at its own rate on its own clock and notifies DistanceFrames of up
+// to 400 ms of samples, each frame after a radio delay, in order. Links drop
+// at random and take what is in flight with them; a few servers also lose
+// the odd frame on a live link. The gateway scans, connects one server at a
+// time (some attempts fail) and runs its consumer every step.
+static const size_t LOAD_SLOTS = 48;
+static const size_t LOAD_SERVERS = 52;              // four more than the table holds
+static const uint32_t LOAD_STEP_MS = 10;
+static const uint32_t LOAD_DURATION_MS = 3600000;
+static const uint32_t LOAD_LATENCY_MIN_MS = 8;       // one connection interval
+static const uint32_t LOAD_LATENCY_MAX_MS = 68;
+static const uint32_t LOAD_BATCH_MS = 400;           // a frame holds at most this much
+static const uint32_t LOAD_CONNECTION_MS = 300000;   // mean time between drops
+static const uint32_t LOAD_SCAN_MS = 5000;
+static const uint32_t LOAD_CONNECT_CHECK_MS = 1000;  // CONNECT_CHECK_MS
+static const uint32_t LOAD_LATENESS_MS = 500;        // MERGE_LATENESS_MS
+
+struct InFlight {
+  uint32_t arriveMs;
+  std::vector<uint8_t> frame;
+};
+
+struct VirtualServer {
+  char address[18];
+  uint32_t periodMs;
+  uint32_t batch;        // samples per frame
+  uint32_t clockMs;      // sender clock = local clock + clockMs
+  bool lossy;
+  int slot = -1;         // in the gateway's table
+  bool connected = false;
+  uint16_t seq = 0;
+  uint32_t nextPingMs = 0;
+  float cm = 100.0f;
+  DistanceFrameEncoder enc;
+  std::deque<InFlight> air;
+  uint32_t lastArriveMs = 0;
+  // What the gateway should count
+  bool firstOnLink = true;
+  uint16_t expectSeq = 0;
+  uint32_t expectGaps = 0;
+  uint32_t connects = 0;
+  uint32_t framesLost = 0;
+};
+
+struct LoadResult {
+  uint32_t samples = 0;       // accepted by the gateway
+  uint32_t valid = 0;
+  uint32_t merged = 0;        // released by the merge
+  uint32_t outOfOrder = 0;
+  uint32_t maxHeldMs = 0;     // local time stamp to release
+  uint32_t maxClockErrMs = 0;
+  bool clockBehind = false;   // a local time earlier than production
+  uint32_t connects = 0;
+  uint32_t reconnects = 0;
+  uint32_t connectFailures = 0;
+  uint32_t framesLost = 0;
+  uint32_t gapsCounted = 0;
+  uint32_t gapsExpected = 0;
+  uint32_t gapMismatch = 0;   // servers whose count is off
+  uint32_t tableFull = 0;
+  uint32_t extrasConnected = 0;
+  uint32_t statsCount = 0;
+  uint32_t mergeDropped = 0;
+  double hostNsPerSample = 0;
+};
+
+struct LoadGateway {
+  PeerManager<LOAD_SLOTS> peers;
+  MergedStream<LOAD_SLOTS, 64> merged{LOAD_LATENESS_MS};
+  int serverOf[LOAD_SLOTS];
+};
+
+static void loadSend(VirtualServer& s, uint32_t nowMs, std::mt19937& rng) {
+  if (s.enc.empty()) return;
+  std::uniform_int_distribution<uint32_t> latency(LOAD_LATENCY_MIN_MS, LOAD_LATENCY_MAX_MS);
+  std::uniform_int_distribution<int> loss(0, 199);
+  if (s.lossy && loss(rng) == 0) {
+    s.framesLost++;
+  } else {
+    // Notifications on one link arrive in the order sent
+    uint32_t at = std::max(nowMs + latency(rng), s.lastArriveMs);
+    s.lastArriveMs = at;
+    s.air.push_back({ at, std::vector<uint8_t>(s.enc.data(), s.enc.data() + s.enc.size()) });
+  }
+  s.enc.reset();
+}
+
+static LoadResult runLoad(std::mt19937& rng) {
+  std::unique_ptr<LoadGateway> gw(new LoadGateway());
+  std::vector<VirtualServer> servers(LOAD_SERVERS);
+  std::uniform_int_distribution<int> pickPeriod(0, 4), coin(0, 99);
+  std::uniform_int_distribution<uint32_t> anyClock, connectMs(200, 800), phase(0, 1999);
+  std::normal_distribution<float> walk(0.0f, 2.0f);
+  const uint32_t periods[] = { 100, 200, 500, 1000, 2000 };
+  for (size_t i = 0; i < LOAD_SERVERS; i++) {
+    VirtualServer& s = servers[i];
+    snprintf(s.address, sizeof(s.address), "24:0a:c4:00:00:%02x", (unsigned)i);
+    s.periodMs = periods[pickPeriod(rng)];
+    s.batch = std::max<uint32_t>(1, LOAD_BATCH_MS / s.periodMs);
+    s.clockMs = anyClock(rng);
+    s.lossy = i % 8 == 0;
+    s.nextPingMs = phase(rng);
+    s.enc.setMtu(247);
+  }
+
+  LoadResult r;
+  int connecting = -1;  // slot of the connect in progress
+  uint32_t connectDoneMs = 0, lastMergedMs = 0;
+  bool anyMerged = false;
+  std::uniform_int_distribution<uint32_t> drop(0, LOAD_CONNECTION_MS / LOAD_STEP_MS - 1);
+  FrameSample samples[DISTANCE_FRAME_MAX_SAMPLES];
+
+  auto start = std::chrono::steady_clock::now();
+  for (uint32_t now = 0; now <= LOAD_DURATION_MS + LOAD_LATENESS_MS + LOAD_STEP_MS; now += LOAD_STEP_MS) {
+    bool producing = now <= LOAD_DURATION_MS;
+
+    // Servers ping, batch and notify; links drop
+    for (VirtualServer& s : servers) {
+      while (producing && (int32_t)(now - s.nextPingMs) >= 0) {
+        s.cm = std::max(2.0f, std::min(398.0f, s.cm + walk(rng)));
+        float cm = coin(rng) < 3 ? NAN : s.cm;
+        uint32_t senderMs = s.nextPingMs + s.clockMs;
+        if (s.connected) {
+          if (!s.enc.add(s.seq, senderMs, cm)) {
+            loadSend(s, now, rng);
+            s.enc.add(s.seq, senderMs, cm);
+          }
+          if (s.enc.count() >= s.batch) loadSend(s, now, rng);
+        }
+        s.seq++;
+        s.nextPingMs += s.periodMs;
+      }
+      if (s.connected && producing && drop(rng) == 0) {
+        s.connected = false;
+        s.air.clear();
+        s.enc.reset();
+        gw->peers.onDisconnected(s.slot, now);
+      }
+    }
+
+    // Scan results, and one connect at a time
+    if (now % LOAD_SCAN_MS == 0 && producing) {
+      for (size_t i = 0; i < LOAD_SERVERS; i++) {
+        VirtualServer& s = servers[i];
+        if (s.connected) continue;
+        int slot = gw->peers.onAdvertised(s.address, "sensor", now);
+        if (slot < 0) {
+          r.tableFull++;
+          continue;
+        }
+        s.slot = slot;
+        gw->serverOf[slot] = (int)i;
+      }
+    }
+    if (connecting >= 0 && (int32_t)(now - connectDoneMs) >= 0) {
+      VirtualServer& s = servers[gw->serverOf[connecting]];
+      if (coin(rng) < 10) {
+        gw->peers.onConnectFailed(connecting, now);
+        r.connectFailures++;
+      } else {
+        gw->peers.onConnected(connecting);
+        s.connected = true;
+        s.firstOnLink = true;
+        s.connects++;
+        s.lastArriveMs = now;
+        s.enc.reset();
+      }
+      connecting = -1;
+    }
+    if (connecting < 0 && now % LOAD_CONNECT_CHECK_MS == 0 && producing) {
+      connecting = gw->peers.nextToConnect(now);
+      connectDoneMs = now + connectMs(rng);
+    }
+
+    // Consumer: decode what arrived, then release what the merge allows
+    for (VirtualServer& s : servers) {
+      while (s.connected && !s.air.empty() && (int32_t)(now - s.air.front().arriveMs) >= 0) {
+        const std::vector<uint8_t>& frame = s.air.front().frame;
+        DistanceFrameInfo info;
+        int n = decodeDistanceFrame(frame.data(), frame.size(), samples, DISTANCE_FRAME_MAX_SAMPLES, &info);
+        if (n > 0) {
+          if (!s.firstOnLink && info.seq != s.expectSeq) s.expectGaps++;
+          s.firstOnLink = false;
+          s.expectSeq = (uint16_t)(info.seq + n);
+        }
+        for (int k = 0; k < n; k++) {
+          if (!gw->peers.onSample(s.slot, samples[k].seq, samples[k].t_ms, samples[k].cm, now)) continue;
+          r.samples++;
+          r.valid += samples[k].cm > 0.0f;
+          uint32_t local = gw->peers[s.slot].toLocalMs(samples[k].t_ms);
+          uint32_t produced = samples[k].t_ms - s.clockMs;
+          if ((int32_t)(local - produced) < 0) r.clockBehind = true;
+          else r.maxClockErrMs = std::max(r.maxClockErrMs, local - produced);
+          gw->merged.push(MergedSample{ (uint8_t)s.slot, samples[k].seq, local, samples[k].cm });
+        }
+        s.air.pop_front();
+      }
+    }
+    MergedSample m;
+    while (gw->merged.pop(m, now)) {
+      if (anyMerged && (int32_t)(m.t_ms - lastMergedMs) < 0) r.outOfOrder++;
+      anyMerged = true;
+      lastMergedMs = m.t_ms;
+      r.merged++;
+      r.maxHeldMs = std::max(r.maxHeldMs, now - m.t_ms);
+    }
+  }
+  r.hostNsPerSample = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() /
+                      std::max<uint32_t>(1, r.samples);
+
+  for (size_t i = 0; i < LOAD_SERVERS; i++) {
+    const VirtualServer& s = servers[i];
+    r.connects += s.connects;
+    r.reconnects += s.connects > 0 ? s.connects - 1 : 0;
+    r.framesLost += s.framesLost;
+    r.gapsExpected += s.expectGaps;
+    if (s.slot < 0) continue;
+    const PeerInfo& p = gw->peers[s.slot];
+    r.gapsCounted += p.seqGaps;
+    if (p.seqGaps != s.expectGaps) r.gapMismatch++;
+  }
+  for (size_t i = LOAD_SLOTS; i < LOAD_SERVERS; i++) r.extrasConnected += servers[i].connects;
+  for (size_t i = 0; i < LOAD_SLOTS; i++) {
+    const PeerInfo& p = gw->peers[i];
+    r.statsCount += p.lifetime.count() + (p.state == PEER_CONNECTED ? p.session.count() : 0);
+  }
+  r.mergeDropped = gw->merged.dropped();
+  return r;
+}
+
+static void testManyServers(std::mt19937& rng) {
+  LoadResult r = runLoad(rng);
+  printf("\n%u servers, %u slots, %u min: %u connects (%u reconnects, %u failed), %u samples, %.0f host ns each\n",
+         (unsigned)LOAD_SERVERS, (unsigned)LOAD_SLOTS, LOAD_DURATION_MS / 60000, r.connects, r.reconnects,
+         r.connectFailures, r.samples, r.hostNsPerSample);
+  printf("  merged %u, out of order %u, dropped %u, held up to %u ms; clock estimate up to %u ms late\n", r.merged,
+         r.outOfOrder, r.mergeDropped, r.maxHeldMs, r.maxClockErrMs);
+  printf("  frames lost on live links %u: gaps counted %u, expected %u\n", r.framesLost, r.gapsCounted,
+         r.gapsExpected);
+  expect("every sample merged once, in local time order",
+         r.merged == r.samples && r.outOfOrder == 0 && r.mergeDropped == 0 && r.samples > 0);
+  expect("merge holds a sample at most lateness + a step", r.maxHeldMs <= LOAD_LATENESS_MS + LOAD_STEP_MS);
+  expect("clock estimate within one frame's delay",
+         !r.clockBehind && r.maxClockErrMs <= LOAD_BATCH_MS + LOAD_LATENCY_MAX_MS);
+  expect("seq gaps: lost frames only, none per reconnect",
+         r.gapMismatch == 0 && r.gapsCounted == r.gapsExpected && r.reconnects > LOAD_SLOTS);
+  expect("statistics hold every reading", r.statsCount == r.valid);
+  expect("servers past the table wait for a slot", r.tableFull > 0 && r.extrasConnected == 0);
+
+  // The reconnect case on its own: the first sample after onConnected
+  // carries on past what was missed, which is not a live gap
+  PeerManager<1> one;
+  one.onAdvertised("24:0a:c4:00:00:01", "sensor", 0);
+  one.nextToConnect(0);
+  one.onConnected(0);
+  one.onSample(0, 10, 1000, 50.0f, 1010);
+  one.onSample(0, 12, 1200, 50.0f, 1210);  // 11 lost: a gap
+  one.onDisconnected(0, 1300);
+  one.nextToConnect(10000);
+  one.onConnected(0);
+  one.onSample(0, 100, 10000, 50.0f, 10010);
+  one.onSample(0, 101, 10100, 50.0f, 10110);
+  expect("one gap, not two, across a reconnect", one[0].seqGaps == 1 && one[0].received == 4);
+
+  // A stale server's slot goes to a new one: none of its counts carry over
+  one.onSample(0, 101, 10100, 50.0f, 10120);  // duplicate
+  one[0].backfill.skipTo(110);                // 11, 13..99, 102..109 never came
+  one[0].backfill.restartAt(0);
+  one.onDisconnected(0, 10200);
+  bool counted = one[0].backfill.duplicates() == 1 && one[0].backfill.lost() == 96 && one[0].backfill.restarts() == 1;
+  uint32_t later = 10200 + PeerManager<1>::STALE_MS;
+  int slot = one.onAdvertised("24:0a:c4:00:00:02", "other", later);
+  const PeerInfo& fresh = one[0];
+  expect("reused slot starts with zero counts",
+         counted && slot == 0 && !strcmp(fresh.address, "24:0a:c4:00:00:02") && fresh.received == 0 &&
+           fresh.seqGaps == 0 && fresh.backfilled == 0 && fresh.backfill.lost() == 0 &&
+           fresh.backfill.duplicates() == 0 && fresh.backfill.restarts() == 0 && !fresh.backfill.started());
+}
+
+int main(int argc, char** argv) {
+  uint32_t seed = 1;
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "--seed") && i + 1 < argc) seed = (uint32_t)atoi(argv[++i]);
+    else {
+      fprintf(stderr, "usage: %s [--seed S]\n", argv[0]);
+      return 2;
+    }
+  }
+
+  std::mt19937 rng(seed);
+  testQueries(rng);
+  testReorder();
+  testCap();
+  testReopen();
+  testWrites(rng);
+  testQueryLatency();
+  testNotifyQueue(rng);
+  testStatsAccuracy(rng);
+  testStatsCost(rng);
+  testManyServers(rng);
+
+  printf("\n%s: %d failed\n", failures ? "FAIL" : "ok", failures);
+  return failures ? 1 : 0;
+}
@@ -3,77 +3,284 @@
 #include <BLEUtils.h>
 #include <BLEScan.h>
 #include <BLEAdvertisedDevice.h>
+#include <atomic>
+#include <mutex>
+#include <DistanceFrame.h>
+#include <NotifyQueue.h>
+#include <StreamStats.h>
+#include <PeerManager.h>
+#include <CoopScheduler.h>
+#include <BleLink.h>
+#include <SensorConfig.h>
+#include <LittleFS.h>
+#include <SeriesStore.h>
+#include <LittleFsSeries.h>
 
 // TODO: change these UUIDs to match your server
 static BLEUUID serviceUUID("724fc8e5-485e-467c-a7b9-ef2796515386");
 static BLEUUID charUUID("976e3398-600d-4d49-ac5d-95383f1c14da");
+static BLEUUID configUUID("976e3398-600d-4d49-ac5d-95383f1c14db");
+
+// ====================== Peers ======================
+// One gateway, several sensor servers. MAX_PEERS is bounded by the BLE
+// controller's connection limit (CONFIG_BTDM_CTRL_BLE_MAX_CONN, 3 by default).
+static const size_t MAX_PEERS = 3;
+static const uint32_t SCAN_SECONDS = 5;
+
+static PeerManager<MAX_PEERS> peers;
+static std::mutex peersLock;  // scan/disconnect callbacks, loop() and the consumer all touch peers
+
+// BLE objects for each peer slot, owned here rather than in PeerManager
+struct PeerLink {
+  BLEAdvertisedDevice* device;
+  BLEClient* client;
+  BLERemoteCharacteristic* characteristic;
+  uint8_t addr[6];
+  RateMeter notifies;
+  RateMeter bytes;
+};
+static PeerLink links[MAX_PEERS] = {};
+
+static volatile bool scanning = false;
+
+// ====================== Scheduler ======================
+// loop() runs one task: connect to due peers and keep the scan going. It is
+// checked every CONNECT_CHECK_MS (peer backoffs are due on the clock) and
+// posted right away when a scan ends, a new server shows up or a link drops.
+// Light sleep stays off: it would drop the BLE links.
+static const uint32_t CONNECT_CHECK_MS = 1000;
+static CoopScheduler<2> scheduler(SchedulerIdle::millisClock);
+static TaskId connectTask = NO_TASK;
+static void servicePeers(void*);
+
+// ====================== Link profile ======================
+// The server picks the profile from the rate it is producing; a build flag
+// (-D BLE_LINK_PROFILE=LINK_PROFILE_STREAMING etc.) makes the gateway
+// request one profile on every link instead. Telemetry either way.
+static const uint32_t LINK_REPORT_MS = 10000;
+static void printLinks(void*);
+
+// ====================== Notify Hand-off ======================
+// The BLE callback only copies the payload into a preallocated slot; parsing,
+// statistics and Serial output run in frameConsumerTask.
+static const size_t NOTIFY_SLOTS = 8;
+static NotifyQueue<DISTANCE_FRAME_MAX_SIZE, NOTIFY_SLOTS> notifyQueue;
+static TaskHandle_t consumerTaskHandle = nullptr;
+static std::atomic<uint32_t> finalStatsPending{0};  // bit per peer, set by the BLE task
+
+// Samples from all servers, merged into one stream ordered by local time.
+// A sample is held back MERGE_LATENESS_MS so slower links can slot in first.
+static const uint32_t MERGE_LATENESS_MS = 500;
+static MergedStream<MAX_PEERS, 64> mergedStream(MERGE_LATENESS_MS);
+static int dataReceivedCount = 0;       // Count received data (all servers)
+
+// ====================== Backfill ======================
+// After a reconnect, or a gap in the live stream, the gateway asks the server
+// for everything from the last sample it holds contiguously; the replay
+// arrives as backfill frames, each ACKed so the server sends more.
+// Backfilled samples count towards the statistics; one line per frame.
+static void writeControl(uint8_t peer, uint8_t op, uint16_t seq) {
+  // Taken under the lock, written outside it: the write waits on the BLE
+  // task, which takes peersLock itself to report a disconnect
+  BLERemoteCharacteristic* characteristic;
+  {
+    std::lock_guard<std::mutex> guard(peersLock);
+    characteristic = links[peer].characteristic;
+  }
+  if (characteristic == nullptr) return;
 
-static boolean doConnect = false;
-static boolean connected = false;
-static boolean doScan = false;
+  uint8_t data[DISTANCE_CONTROL_SIZE];
+  size_t length = encodeDistanceControl(DistanceControl{op, seq}, data);
+  characteristic->writeValue(data, length, false);  // no response: never blocks the consumer for an interval
+}
 
-static BLERemoteCharacteristic* pRemoteCharacteristic = nullptr;
-static BLEAdvertisedDevice* myDevice = nullptr;
+// ====================== Send on change ======================
+// A server in SEND_ON_CHANGE only notifies readings that moved past its
+// deadband, plus a heartbeat. Its settings are read on connect, and the
+// readings it held back are filled in (last value held, on its ping grid)
+// as the merged stream releases samples, so the session statistics weigh
+// every ping rather than only the changes. Backfilled samples skip the
+// merge and are not filled around.
+static void readServerConfig(int peer, BLERemoteService* service) {
+  SensorConfig cfg;
+  BLERemoteCharacteristic* characteristic = service->getCharacteristic(configUUID);
+  std::string value = characteristic && characteristic->canRead() ? characteristic->readValue() : std::string();
+  bool known = decodeConfigBlob((const uint8_t*)value.data(), value.size(), cfg);
+
+  char text[96] = "unknown, no fill-in";
+  if (known) describeConfig(cfg, text, sizeof(text));
+  Serial.printf("Settings of %s: %s\n", peers[peer].name, text);
+
+  std::lock_guard<std::mutex> guard(peersLock);
+  bool onChange = known && cfg.mode == SEND_ON_CHANGE;
+  peers[peer].series.begin(onChange ? cfg.intervalMs : 0, cfg.heartbeatMs);
+}
 
-// Store server name
-static String serverName = "Unknown";
+// ====================== Reading log ======================
+// Every reading released by the merge (and every one filled in) goes to an
+// append-only log on LittleFS, tagged with the server it came from, so the
+// gateway still has the last hours after a reset. Readings are written a
+// flash block at a time, or after SERIES_FLUSH_AGE_MS when they come in
+// slowly: a reset loses at most that much. Backfilled samples are logged
+// too, if they are no older than what is already written. Only the consumer
+// task uses it.
+static const uint32_t SERIES_FLUSH_AGE_MS = 300000;
+static const uint32_t SERIES_REORDER_MS = 15000;  // fills land up to a heartbeat behind the sample
+static const uint32_t SERIES_REPORT_MS = 600000;  // window printed with the final statistics
+static LittleFsSeries seriesFs;
+static SeriesStore seriesLog(seriesFs, {"/ts", 64 * 1024, 1024 * 1024, SERIES_FLUSH_AGE_MS, SERIES_REORDER_MS});
+static bool seriesReady = false;
+
+// The log writes flash and Serial can block: callers copy what they need
+// out of peers and release peersLock first
+static void logReading(const char* address, uint32_t localMs, float cm, uint8_t flags) {
+  if (!seriesReady) return;
+  int source = seriesLog.sourceId(address);
+  if (source >= 0) seriesLog.append(localMs, cm, (uint8_t)source, flags);
+}
 
-// ====================== Statistics for Max/Min ======================
-static float currentDistance = NAN;
-static float maxDistance = -999999.0f;  // Initialize to very small value
-static float minDistance = 999999.0f;   // Initialize to very large value
-static int dataReceivedCount = 0;       // Count received data
+static void printBucket(const SeriesBucket& b, void* ctx) {
+  uint64_t last = *(const uint64_t*)ctx;
+  Serial.printf("  -%3lu s: n=%lu", (unsigned long)((last - b.t_ms) / 1000), (unsigned long)b.count);
+  if (b.count) Serial.printf(" | min %.1f | max %.1f | mean %.1f cm", b.min, b.max, b.mean);
+  if (b.missing) Serial.printf(" | no reading %lu", (unsigned long)b.missing);
+  Serial.println();
+}
 
-// ====================== Notify Callback: Process received data ======================
-static void notifyCallback(
-  BLERemoteCharacteristic* pBLERemoteCharacteristic,
-  uint8_t* pData,
-  size_t length,
-  bool isNotify) {
+// The last SERIES_REPORT_MS of one server from the log, a line a minute
+static void printStoredSeries(const char* address, const char* name) {
+  if (!seriesReady) return;
+  int source = seriesLog.sourceId(address);
+  if (source < 0) return;
+
+  uint64_t last = seriesLog.lastMs();
+  uint64_t from = last > SERIES_REPORT_MS ? last - SERIES_REPORT_MS : 0;
+  Serial.printf("Logged: %lu reading(s) in %u segment(s), %lu B | late %lu | dropped %lu\n",
+                (unsigned long)seriesLog.records(), (unsigned)seriesLog.segments(), (unsigned long)seriesLog.bytes(),
+                (unsigned long)seriesLog.late(), (unsigned long)seriesLog.dropped());
+  Serial.printf("Last %lu min of %s from the log:\n", (unsigned long)(SERIES_REPORT_MS / 60000), name);
+  if (seriesLog.downsample(from, last + 1, 60000, (uint8_t)source, printBucket, &last) == 0) {
+    Serial.println("  No readings logged");
+  }
+}
 
-  // Convert received data to string
-  String receivedData = "";
-  for (size_t i = 0; i < length; i++) {
-    receivedData += (char)pData[i];
+// ====================== Frame Processing (consumer task) ======================
+static void processFrame(uint8_t peer, const uint8_t* pData, size_t length, uint32_t receivedMs) {
+  // Decode the binary frame (one or more samples per notification)
+  static FrameSample samples[DISTANCE_FRAME_MAX_SAMPLES];
+  DistanceFrameInfo info;
+  int n = decodeDistanceFrame(pData, length, samples, DISTANCE_FRAME_MAX_SAMPLES, &info);
+
+  if (n < 0) {
+    Serial.print("Warning: Malformed frame received (");
+    Serial.print(length);
+    Serial.println(" bytes)");
+    return;
   }
 
-  dataReceivedCount++;
+  bool backfill = info.flags & DISTANCE_FRAME_BACKFILL;
+  bool restart = backfill && (info.flags & DISTANCE_FRAME_RESTART);
+  bool ask;
+  int accepted = 0;
+  uint16_t ackSeq;
+  char address[sizeof(PeerInfo::address)], name[sizeof(PeerInfo::name)];
+  {
+    std::lock_guard<std::mutex> guard(peersLock);
+    BackfillReceiver& rx = peers[peer].backfill;
+
+    // Header-only backfill frame: the server has nothing older, or restarted
+    if (backfill && n == 0) {
+      if (restart) rx.restartAt(info.seq);
+      else rx.skipTo(info.seq);
+    }
+    ask = restart || (!backfill && n > 0 && rx.liveGap(info.seq));
+
+    for (int i = 0; i < n; i++) {
+      if (!peers.onSample(peer, samples[i].seq, samples[i].t_ms, samples[i].cm, receivedMs, backfill)) continue;
+      if (backfill) {
+        // Compacted in place (accepted <= i) and logged after the lock
+        FrameSample s = samples[i];
+        s.t_ms = peers[peer].toLocalMs(s.t_ms);
+        samples[accepted++] = s;
+        continue;
+      }
+      accepted++;
+      MergedSample merged = { peer, samples[i].seq, peers[peer].toLocalMs(samples[i].t_ms), samples[i].cm };
+      mergedStream.push(merged);
+    }
+    ackSeq = rx.ackSeq();
+    memcpy(address, peers[peer].address, sizeof(address));
+    memcpy(name, peers[peer].name, sizeof(name));
+  }
+
+  if (backfill) {
+    for (int i = 0; i < accepted; i++) logReading(address, samples[i].t_ms, samples[i].cm, 0);
+    Serial.printf("Backfill from %s: %d of %d sample(s) from #%u, holding up to #%u%s\n", name, accepted, n,
+                  info.seq, ackSeq, restart ? " (server restarted)" : "");
+  }
+  if (ask) writeControl(peer, DISTANCE_CTRL_BACKFILL, ackSeq);
+  else if (backfill) writeControl(peer, DISTANCE_CTRL_ACK, ackSeq);
+}
+
+static void printSample(const MergedSample& sample) {
+  char address[sizeof(PeerInfo::address)], name[sizeof(PeerInfo::name)];
+  int count;
+  float maxCm, minCm;
+
+  // Readings held back by a send-on-change server come back as one run of
+  // the same value on the ping grid
+  size_t held;
+  uint32_t fillFromMs = 0, fillEveryMs = 0;
+  float fillCm = 0.0f;
+  {
+    std::lock_guard<std::mutex> guard(peersLock);
+    PeerInfo& p = peers[sample.peer];
+    count = ++dataReceivedCount;
+    size_t filled = 0;
+    held = p.series.add(sample.t_ms, sample.cm, [&](uint32_t tMs, float cm) {
+      if (cm > 0.0f) p.session.add(cm);
+      if (filled == 0) fillFromMs = tMs;
+      else if (filled == 1) fillEveryMs = tMs - fillFromMs;
+      fillCm = cm;
+      filled++;
+    });
+    memcpy(address, p.address, sizeof(address));
+    memcpy(name, p.name, sizeof(name));
+    maxCm = p.session.max();
+    minCm = p.session.min();
+  }
+
+  for (size_t i = 0; i < held; i++) logReading(address, fillFromMs + (uint32_t)i * fillEveryMs, fillCm, SERIES_FILLED);
+  logReading(address, sample.t_ms, sample.cm, 0);
 
   Serial.println("===========================================");
   Serial.print("Data #");
-  Serial.print(dataReceivedCount);
-  Serial.print(" received from ");
-  Serial.println(serverName);
-  Serial.print("Raw data: ");
-  Serial.println(receivedData);
-
-  // Parse as pure number (denoised distance)
-  currentDistance = receivedData.toFloat();
+  Serial.print(count);
+  Serial.print(" (seq ");
+  Serial.print(sample.seq);
+  Serial.print(", t=");
+  Serial.print(sample.t_ms);
+  Serial.print(" ms) received from ");
+  Serial.print(name);
+  if (held) Serial.printf(" after %u unchanged", (unsigned)held);
+  Serial.println();
 
   // Check if valid data
-  if (currentDistance > 0.0f) {
-    // Update maximum and minimum
-    if (currentDistance > maxDistance) {
-      maxDistance = currentDistance;
-    }
-    if (currentDistance < minDistance) {
-      minDistance = currentDistance;
-    }
-
+  if (sample.cm > 0.0f) {
     // Print current, max, and min values
     Serial.println("-------------------------------------------");
     Serial.print("Current Distance: ");
-    Serial.print(currentDistance, 2);
+    Serial.print(sample.cm, 2);
     Serial.println(" cm");
-    
+
     Serial.print("Maximum Distance: ");
-    Serial.print(maxDistance, 2);
+    Serial.print(maxCm, 2);
     Serial.println(" cm");
-    
+
     Serial.print("Minimum Distance: ");
-    Serial.print(minDistance, 2);
+    Serial.print(minCm, 2);
     Serial.println(" cm");
-    
+
     Serial.println("===========================================");
     Serial.println();
   } else {
@@ -83,49 +290,174 @@ static void notifyCallback(
   }
 }
 
+static void printStats(const char* label, const DistanceStats& stats) {
+  Serial.print(label);
+  Serial.print(" (n=");
+  Serial.print(stats.count());
+  Serial.println("):");
+  if (stats.count() == 0) {
+    Serial.println("  No valid data received");
+    return;
+  }
+  Serial.printf("  min %.2f | max %.2f | mean %.2f | stddev %.2f cm\n",
+                stats.min(), stats.max(), stats.mean(), stats.stddev());
+  Serial.printf("  p50 %.2f | p95 %.2f | p99 %.2f cm\n",
+                stats.p50(), stats.p95(), stats.p99());
+}
+
+static void printFinalStatistics(int peer) {
+  // Copied under peersLock, printed after it
+  char address[sizeof(PeerInfo::address)], name[sizeof(PeerInfo::name)];
+  uint32_t received, seqGaps, backfilled, lost, duplicates, restarts, filled, gaps;
+  DistanceStats lifetime(0.0f, 400.0f);
+  DistanceStats all(0.0f, 400.0f);
+  {
+    std::lock_guard<std::mutex> guard(peersLock);
+    const PeerInfo& p = peers[peer];
+    memcpy(address, p.address, sizeof(address));
+    memcpy(name, p.name, sizeof(name));
+    received = p.received;
+    seqGaps = p.seqGaps;
+    backfilled = p.backfilled;
+    lost = p.backfill.lost();
+    duplicates = p.backfill.duplicates();
+    restarts = p.backfill.restarts();
+    filled = p.series.filled();
+    gaps = p.series.gaps();
+    lifetime = p.lifetime;
+
+    // Aggregate over every server seen so far
+    for (size_t i = 0; i < MAX_PEERS; i++) {
+      all.merge(peers[i].lifetime);
+      if (peers[i].state == PEER_CONNECTED) all.merge(peers[i].session);
+    }
+  }
+
+  Serial.println("===========================================");
+  Serial.print("Final Statistics for ");
+  Serial.println(name);
+  Serial.print("Total data received: ");
+  Serial.print(received);
+  Serial.print(" | sequence gaps: ");
+  Serial.println(seqGaps);
+  Serial.printf("Backfilled: %lu | lost: %lu | duplicates: %lu | server restarts: %lu\n",
+                (unsigned long)backfilled, (unsigned long)lost, (unsigned long)duplicates, (unsigned long)restarts);
+  Serial.printf("Filled in: %lu unchanged reading(s) | silences too long to fill: %lu\n",
+                (unsigned long)filled, (unsigned long)gaps);
+  printStats("Since boot", lifetime);
+  printStats("All servers", all);
+  printStoredSeries(address, name);
+
+  Serial.print("Notifications: ");
+  Serial.print(notifyQueue.received());
+  Serial.print(" | dropped: ");
+  Serial.print(notifyQueue.dropped());
+  Serial.print(" | overrun: ");
+  Serial.println(notifyQueue.overruns());
+  Serial.println("===========================================");
+}
+
+static void frameConsumerTask(void* arg) {
+  uint32_t reportedDrops = 0;
+
+  for (;;) {
+    // Wake on new data, or after the lateness window to release held samples
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(MERGE_LATENESS_MS));
+
+    while (const auto* slot = notifyQueue.peek()) {
+      processFrame(slot->source, slot->data, slot->length, slot->receivedMs);
+      notifyQueue.release();
+    }
+
+    MergedSample sample;
+    while (mergedStream.pop(sample, millis())) {
+      printSample(sample);
+    }
+    if (seriesReady) seriesLog.service(millis());
+
+    uint32_t drops = notifyQueue.dropped() + notifyQueue.overruns() + mergedStream.dropped();
+    if (drops != reportedDrops) {
+      reportedDrops = drops;
+      Serial.print("Warning: notify queue dropped ");
+      Serial.print(notifyQueue.dropped());
+      Serial.print(", overrun ");
+      Serial.print(notifyQueue.overruns());
+      Serial.print(", merge dropped ");
+      Serial.println(mergedStream.dropped());
+    }
+
+    uint32_t pending = finalStatsPending.exchange(0);
+    for (size_t i = 0; i < MAX_PEERS; i++) {
+      if (pending & (1u << i)) printFinalStatistics(i);
+    }
+  }
+}
+
+// ====================== Notify Callback: Queue received data ======================
+static void notifyCallback(
+  BLERemoteCharacteristic* pBLERemoteCharacteristic,
+  uint8_t* pData,
+  size_t length,
+  bool isNotify) {
+  for (size_t i = 0; i < MAX_PEERS; i++) {
+    if (links[i].characteristic == pBLERemoteCharacteristic) {
+      notifyQueue.push(pData, length, millis(), (uint8_t)i);
+      links[i].notifies.add();
+      links[i].bytes.add(length);
+      xTaskNotifyGive(consumerTaskHandle);
+      return;
+    }
+  }
+}
+
 class MyClientCallback : public BLEClientCallbacks {
+public:
+  explicit MyClientCallback(int peer) : peer_(peer) {}
+
   void onConnect(BLEClient* pclient) override {
     Serial.print("Client connected to ");
-    Serial.println(serverName);
+    Serial.println(peers[peer_].name);
   }
 
   void onDisconnect(BLEClient* pclient) override {
-    connected = false;
-    Serial.print("Disconnected from ");
-    Serial.println(serverName);
-    
-    // Print final statistics
-    Serial.println("===========================================");
-    Serial.println("Final Statistics:");
-    Serial.print("Total data received: ");
-    Serial.println(dataReceivedCount);
-    
-    if (maxDistance > -999999.0f && minDistance < 999999.0f) {
-      Serial.print("Maximum Distance: ");
-      Serial.print(maxDistance, 2);
-      Serial.println(" cm");
-      Serial.print("Minimum Distance: ");
-      Serial.print(minDistance, 2);
-      Serial.println(" cm");
-    } else {
-      Serial.println("No valid data received");
+    {
+      std::lock_guard<std::mutex> guard(peersLock);
+      peers.onDisconnected(peer_, millis());
+      links[peer_].characteristic = nullptr;
     }
-    Serial.println("===========================================");
+    BleLink::closed(links[peer_].addr);
+    Serial.print("Disconnected from ");
+    Serial.println(peers[peer_].name);
+
+    // Final statistics are printed by the consumer task, after the queue drains
+    finalStatsPending.fetch_or(1u << peer_);
+    xTaskNotifyGive(consumerTaskHandle);
+    scheduler.post(connectTask);
   }
+
+private:
+  int peer_;
 };
 
-bool connectToServer() {
+bool connectToServer(int peer) {
+  PeerLink& link = links[peer];
+  const char* serverName = peers[peer].name;
+
   Serial.print("Forming a connection to ");
   Serial.print(serverName);
   Serial.print(" | ");
-  Serial.println(myDevice->getAddress().toString().c_str());
+  Serial.println(peers[peer].address);
 
-  BLEClient* pClient = BLEDevice::createClient();
-  Serial.println(" - Created client");
-  pClient->setClientCallbacks(new MyClientCallback());
+  // One BLEClient per slot, reused across reconnects
+  if (link.client == nullptr) {
+    link.client = BLEDevice::createClient();
+    link.client->setClientCallbacks(new MyClientCallback(peer));
+    Serial.println(" - Created client");
+  }
+  BLEClient* pClient = link.client;
 
   // Connect to the BLE Server
-  if (!pClient->connect(myDevice)) {
+  if (!pClient->connect(link.device)) {
     Serial.println(" - Connect failed");
     return false;
   }
@@ -133,10 +465,15 @@ bool connectToServer() {
   Serial.print("Connected to server: ");
   Serial.print(serverName);
   Serial.print(" (");
-  Serial.print(myDevice->getAddress().toString().c_str());
+  Serial.print(peers[peer].address);
   Serial.println(")");
 
   pClient->setMTU(517);
+  memcpy(link.addr, pClient->getPeerAddress().getNative(), sizeof(link.addr));
+  BleLink::opened(link.addr, pClient->getMTU());
+#if BLE_LINK_PROFILE != LINK_PROFILE_AUTO
+  BleLink::apply(link.addr, BLE_LINK_PROFILE == LINK_PROFILE_STREAMING ? LINK_STREAMING : LINK_LOW_POWER);
+#endif
 
   // Get service
   BLERemoteService* pRemoteService = pClient->getService(serviceUUID);
@@ -149,7 +486,7 @@ bool connectToServer() {
   Serial.println(" - Found our service");
 
   // Get characteristic
-  pRemoteCharacteristic = pRemoteService->getCharacteristic(charUUID);
+  BLERemoteCharacteristic* pRemoteCharacteristic = pRemoteService->getCharacteristic(charUUID);
   if (pRemoteCharacteristic == nullptr) {
     Serial.print("Failed to find characteristic UUID: ");
     Serial.println(charUUID.toString().c_str());
@@ -167,6 +504,20 @@ bool connectToServer() {
     Serial.println(value.c_str());
   }
 
+  readServerConfig(peer, pRemoteService);
+
+  bool resume;
+  uint16_t resumeSeq;
+  {
+    std::lock_guard<std::mutex> guard(peersLock);
+    peers.onConnected(peer);
+    resume = peers[peer].backfill.started();
+    resumeSeq = peers[peer].backfill.ackSeq();
+    link.characteristic = pRemoteCharacteristic;
+  }
+  link.notifies.sample(millis());
+  link.bytes.sample(millis());
+
   // Enable notify
   if (pRemoteCharacteristic->canNotify()) {
     pRemoteCharacteristic->registerForNotify(notifyCallback);
@@ -177,53 +528,76 @@ bool connectToServer() {
     Serial.println("===========================================");
   }
 
-  connected = true;
-  
-  // Reset statistics
-  dataReceivedCount = 0;
-  maxDistance = -999999.0f;
-  minDistance = 999999.0f;
-  
+  // Been here before: catch up on what the server recorded meanwhile
+  if (resume) {
+    Serial.printf("Requesting backfill from %s from #%u\n", serverName, resumeSeq);
+    writeControl(peer, DISTANCE_CTRL_BACKFILL, resumeSeq);
+  }
+
   return true;
 }
 
 /**
- * Scan for BLE servers and find the first one advertising the service we want.
+ * Scan for BLE servers and add every one advertising our service to the
+ * peer table; loop() connects to them one at a time.
  */
 class MyAdvertisedDeviceCallbacks : public BLEAdvertisedDeviceCallbacks {
   void onResult(BLEAdvertisedDevice advertisedDevice) override {
-    Serial.print("BLE Advertised Device found: ");
-    Serial.println(advertisedDevice.toString().c_str());
-
-    if (advertisedDevice.haveServiceUUID() && advertisedDevice.isAdvertisingService(serviceUUID)) {
-      // Capture server name for screenshot
-      if (advertisedDevice.haveName()) {
-        serverName = String(advertisedDevice.getName().c_str());
-      } else {
-        serverName = "Unknown";
-      }
+    if (!advertisedDevice.haveServiceUUID() || !advertisedDevice.isAdvertisingService(serviceUUID)) {
+      return;
+    }
+
+    std::string address = advertisedDevice.getAddress().toString();
+    std::string name = advertisedDevice.haveName() ? advertisedDevice.getName() : "Unknown";
 
+    std::lock_guard<std::mutex> guard(peersLock);
+    bool known = peers.find(address.c_str()) >= 0;
+    int i = peers.onAdvertised(address.c_str(), name.c_str(), millis());
+    if (i < 0) return;  // table full
+
+    // Only refresh the device record while no connection is using it
+    if (peers[i].state != PEER_CONNECTED && peers[i].state != PEER_CONNECTING) {
+      if (links[i].device == nullptr) links[i].device = new BLEAdvertisedDevice(advertisedDevice);
+      else *links[i].device = advertisedDevice;
+    }
+
+    if (!known) {
       Serial.print("Target server found! Name: ");
-      Serial.print(serverName);
+      Serial.print(name.c_str());
       Serial.print(" | Address: ");
-      Serial.println(advertisedDevice.getAddress().toString().c_str());
-
-      BLEDevice::getScan()->stop();
-      myDevice = new BLEAdvertisedDevice(advertisedDevice);
-      doConnect = true;
-      doScan = true;
+      Serial.println(address.c_str());
+      scheduler.post(connectTask);
     }
   }
 };
 
+static void scanComplete(BLEScanResults results) {
+  scanning = false;
+  scheduler.post(connectTask);
+}
+
 void setup() {
   Serial.begin(115200);
   Serial.println("===========================================");
   Serial.println("XIAO ESP32-C3 BLE Client Starting...");
   Serial.println("===========================================");
 
+  // Reading log, before the consumer task that writes it
+  seriesReady = LittleFS.begin(true) && seriesLog.begin(millis());
+  if (seriesReady) {
+    Serial.printf("Reading log: %lu reading(s) in %u segment(s), %u dropped as corrupt\n",
+                  (unsigned long)seriesLog.records(), (unsigned)seriesLog.segments(), (unsigned)seriesLog.corrupt());
+  } else {
+    Serial.println("Warning: LittleFS unavailable, readings are not logged");
+  }
+
+  // Consumer task: parses frames and logs outside the BLE callback context
+  // (larger stack: the reading log's flash writes and queries run here)
+  xTaskCreate(frameConsumerTask, "frameConsumer", 6144, nullptr, 1, &consumerTaskHandle);
+
   // Initialize BLE device
   BLEDevice::init("XIAO_C3_CLIENT");
+  BleLink::begin();
 
   BLEScan* pBLEScan = BLEDevice::getScan();
   pBLEScan->setAdvertisedDeviceCallbacks(new MyAdvertisedDeviceCallbacks());
@@ -235,26 +609,69 @@ void setup() {
   Serial.println("Looking for service UUID:");
   Serial.println(serviceUUID.toString().c_str());
   Serial.println("===========================================");
-  
-  pBLEScan->start(5, false);
+
+  SchedulerIdle::begin(false);
+  scheduler.onPost(SchedulerIdle::wake);
+  connectTask = scheduler.every(CONNECT_CHECK_MS, servicePeers);
+  scheduler.every(LINK_REPORT_MS, printLinks);
 }
 
-void loop() {
-  if (doConnect) {
-    if (connectToServer()) {
+// Link-layer telemetry for every connected server
+static void printLinks(void*) {
+  uint32_t now = millis();
+  for (size_t i = 0; i < MAX_PEERS; i++) {
+    PeerLink& link = links[i];
+    if (link.characteristic == nullptr) continue;
+
+    LinkStatus status;
+    char text[96];
+    BleLink::setMtu(link.addr, link.client->getMTU());  // the exchange finishes after connect() returns
+    if (!BleLink::status(link.addr, status)) continue;
+    describeLink(status, text, sizeof(text));
+
+    Serial.printf("Link %s: %s | %.2f notif/s %.0f B/s\n", peers[i].name, text, link.notifies.sample(now),
+                  link.bytes.sample(now));
+  }
+}
+
+// Connect to the next peer that is due and restart the scan when it ends
+static void servicePeers(void*) {
+  // Connect to the next peer that is due (new, or past its backoff)
+  int peer;
+  {
+    std::lock_guard<std::mutex> guard(peersLock);
+    peer = peers.nextToConnect(millis());
+  }
+
+  if (peer >= 0) {
+    if (scanning) {
+      BLEDevice::getScan()->stop();  // connecting while scanning is unreliable
+      scanning = false;
+    }
+
+    if (connectToServer(peer)) {
       Serial.print("Client successfully connected to ");
-      Serial.println(serverName);
+      Serial.println(peers[peer].name);
     } else {
       Serial.println("Failed to connect to the server.");
+      // A failure after the link came up is already handled by onDisconnect
+      std::lock_guard<std::mutex> guard(peersLock);
+      if (peers[peer].state == PEER_CONNECTING) peers.onConnectFailed(peer, millis());
     }
-    doConnect = false;
   }
 
-  // If disconnected, restart scanning
-  if (!connected && doScan) {
-    Serial.println("Restarting scan...");
-    BLEDevice::getScan()->start(0);
+  // Keep scanning in the background while there is room for more servers
+  size_t connected;
+  {
+    std::lock_guard<std::mutex> guard(peersLock);
+    connected = peers.countIn(PEER_CONNECTED);
+  }
+  if (!scanning && connected < MAX_PEERS) {
+    scanning = true;
+    BLEDevice::getScan()->start(SCAN_SECONDS, scanComplete, false);
   }
+}
 
-  delay(1000);
-}
\ No newline at end of file
+void loop() {
+  SchedulerIdle::wait(scheduler.runReady());
+}
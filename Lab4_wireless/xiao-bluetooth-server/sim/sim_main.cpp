@@ -0,0 +1,1600 @@
+// ============================================
+// BLE server - native link test
+// ============================================
+//   pio run -e native && .pio/build/native/program [--seed S] [--trace file.csv]
+//
+// Echo timing: the ranger's EchoTimer (shared_lib/HCSR04Ranger) fed by a
+// fake echo pin on a virtual microsecond clock: edge pairing, stray edges,
+// the no-echo timeout, the micros() wrap, back-to-back pings filling the
+// result ring, and the ISR and the consumer retiring the same ping from two
+// threads; the multi-echo vote, with more readings than a burst holds.
+// Throughput is pings per second back to back and at the sensor's 60 ms
+// cycle, next to the share of that cycle pulseIn() used to block.
+//
+// Filters: the StreamFilters kernels against plain models of the mean and
+// median of the last N readings, with dropouts; the EMA recurrence; the
+// Kalman filter's steady state; the run-time filter at every window it
+// takes. Benchmark: host ns and TSC cycles per sample at windows 5-256.
+//
+// Frames: the fixed DistanceFrame layout against hand-written bytes, both
+// ways, so the byte order is pinned; random frames filled to capacity at
+// MTU 23, 247 and 517 round trip; every length short of or past header +
+// 4 * count, bad versions, flag bits and counts are rejected.
+//
+// Link profiles: runs the server's LinkProfileSelector (shared_lib/BleLink)
+// against synthetic producers on a 100 ms virtual clock. The link is
+// modelled as a queue drained at the current profile's capacity, so a
+// profile that is too slow shows up as backlog, and the backlog feeds back
+// into the selector the way the server reports it. Connection events per
+// second are the power proxy: every interval while streaming, every
+// (1 + latency) intervals when low power and idle.
+//
+// Backfill: the server's history and replay and the client's tracking
+// (shared_lib/SampleBackfill) over a simulated transport that drops the
+// connection at random and loses everything in flight when it does. Every
+// sample produced must reach the client exactly once, or be reported lost
+// because the history overwrote it.
+//
+// Settings: the config characteristic's command parser and validator
+// (shared_lib/SensorConfig), the stored blob, and the run-time filter the
+// settings drive (ConfigurableFilter), including random writes that must
+// never leave the server with settings outside the limits.
+//
+// Send on change: delta frames against the fixed layout and malformed
+// input, the reporter's decisions, and a replay benchmark. Each trace is
+// run through the server's filter, send policy and batching and the
+// client's decoding and fill-in, and compared with sending every reading:
+// notifications and bytes saved, and the error of the rebuilt series
+// against the denoised readings. Synthetic traces at 1 s and 200 ms pings;
+// --trace adds a recording ("seconds,cm" per ping, negative = no echo).
+//
+// Exits non-zero if any check fails.
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include <BleLink.h>
+#include <DistanceFrame.h>
+#include <HCSR04Ranger.h>
+#include <SampleBackfill.h>
+#include <SendOnDelta.h>
+#include <SensorConfig.h>
+#include <StreamFilters.h>
+
+static int failures = 0;
+
+static void expect(const char* name, bool ok) {
+  printf("%-48s %s\n", name, ok ? "ok" : "FAIL");
+  if (!ok) failures++;
+}
+
+// ====================== Echo timing ======================
+// EchoTimer driven by a fake echo pin: the edges the CHANGE interrupt would
+// see, on a virtual microsecond clock. The HC-SR04 raises echo about 450 us
+// after the trigger and holds it high for the round trip.
+static const uint32_t ECHO_LEAD_US = 450;
+static const uint32_t ECHO_TIMEOUT_US = EchoTimer::DEFAULT_TIMEOUT_US;
+static const uint32_t ECHO_POLL_US = 1000;  // HCSR04Ranger::measure() polls every delay(1)
+
+static uint32_t echoWidthUs(float cm) {
+  return (uint32_t)lroundf(cm / 0.01715f);
+}
+
+// One echo of widthUs for the ping triggered at triggerUs
+static void echo(EchoTimer& timer, uint32_t triggerUs, uint32_t widthUs) {
+  timer.onEdge(true, triggerUs + ECHO_LEAD_US);
+  timer.onEdge(false, triggerUs + ECHO_LEAD_US + widthUs);
+}
+
+struct PingRun {
+  uint32_t pings = 0;
+  uint32_t valid = 0;
+  uint32_t wrongWidth = 0;
+  uint32_t polls = 0;
+};
+
+// Pings for durationUs at a target (cm < 0: none), re-armed spacingUs after
+// the previous trigger or as soon as its result is in, whichever is later
+static PingRun runPings(float cm, uint32_t spacingUs, uint32_t durationUs) {
+  EchoTimer timer;
+  PingRun r;
+  uint32_t width = cm < 0 ? 0 : echoWidthUs(cm);
+  uint32_t trigger = 0;
+  while (trigger < durationUs) {
+    timer.arm(trigger);
+    if (cm >= 0) echo(timer, trigger, width);
+
+    RangeSample s;
+    uint32_t now = trigger;
+    do {
+      now += ECHO_POLL_US;
+      r.polls++;
+    } while (now - trigger < ECHO_LEAD_US + width || !timer.poll(now, s));
+    r.pings++;
+    if (s.valid()) r.valid++;
+    if (s.valid() && s.echo_us != width) r.wrongWidth++;
+
+    trigger = std::max(now, trigger + spacingUs);
+  }
+  return r;
+}
+
+static void testEchoTimer(std::mt19937& rng) {
+  printf("\necho timing\n");
+  RangeSample s;
+
+  // Edge pairing: one sample per ping, the width between the edges,
+  // stamped with the trigger time
+  EchoTimer timer;
+  std::uniform_real_distribution<float> target(2.0f, 400.0f);
+  bool paired = true;
+  uint32_t trigger = 1000;
+  for (int i = 0; i < 10000 && paired; i++) {
+    uint32_t width = echoWidthUs(target(rng));
+    uint32_t rise = trigger + ECHO_LEAD_US;
+    paired = timer.arm(trigger) && !timer.poll(rise - 1, s);
+    timer.onEdge(true, rise);
+    paired = paired && timer.busy() && !timer.poll(rise + width / 2, s);
+    timer.onEdge(false, rise + width);
+    paired = paired && !timer.busy() && timer.poll(rise + width, s) && s.t_us == trigger && s.echo_us == width &&
+             !timer.poll(rise + width + ECHO_TIMEOUT_US, s);
+    trigger += RANGE_MIN_SPACING_MS * 1000;
+  }
+  expect("edges pair into one sample per ping", paired && timer.timeouts() == 0 && timer.dropped() == 0);
+  timer.arm(trigger);
+  echo(timer, trigger, echoWidthUs(100.0f));
+  expect("100 cm reads back as 100 cm", timer.poll(trigger, s) && fabsf(s.cm() - 100.0f) < 0.02f);
+
+  // micros() wraps every 71.6 min; a ping across the wrap times the same
+  EchoTimer wrap;
+  uint32_t late = 0xFFFFFF00u;
+  wrap.arm(late);
+  echo(wrap, late, 5000);
+  bool wrapped = wrap.poll(late + 6000, s) && s.echo_us == 5000 && s.t_us == late;
+  bool wrapTimeout = wrap.arm(late) && !wrap.poll(late + ECHO_TIMEOUT_US - 1, s) &&
+                     wrap.poll(late + ECHO_TIMEOUT_US, s) && !s.valid();
+  expect("ping across the micros() wrap", wrapped && wrapTimeout);
+
+  // Stray edges: ignored while idle, a fall before the rise and a second
+  // rise while high change nothing
+  EchoTimer stray;
+  stray.onEdge(true, 100);
+  stray.onEdge(false, 200);
+  bool idle = !stray.busy() && !stray.poll(300, s);
+  stray.arm(1000);
+  stray.onEdge(false, 1100);
+  stray.onEdge(true, 1500);
+  stray.onEdge(true, 1700);
+  stray.onEdge(false, 2500);
+  expect("stray edges ignored", idle && stray.poll(2500, s) && s.echo_us == 1000 && !stray.poll(40000, s));
+
+  // Timeout: nothing back, echo stuck high, and an echo after the timeout
+  EchoTimer quiet;
+  bool none = quiet.arm(0) && !quiet.arm(10) && !quiet.poll(ECHO_TIMEOUT_US - 1, s) &&
+              quiet.poll(ECHO_TIMEOUT_US, s) && !s.valid() && s.t_us == 0 && !quiet.busy();
+  quiet.onEdge(true, ECHO_TIMEOUT_US + 100);
+  quiet.onEdge(false, ECHO_TIMEOUT_US + 200);
+  bool lateEcho = !quiet.poll(ECHO_TIMEOUT_US + 300, s);
+  quiet.arm(100000);
+  quiet.onEdge(true, 100000 + ECHO_LEAD_US);
+  bool stuck = !quiet.poll(100000 + ECHO_TIMEOUT_US - 1, s) && quiet.poll(100000 + ECHO_TIMEOUT_US, s) &&
+               !s.valid();
+  quiet.onEdge(false, 100000 + ECHO_TIMEOUT_US + 10);
+  stuck = stuck && !quiet.poll(200000, s);
+  expect("no echo times out once", none && quiet.timeouts() == 2);
+  expect("echo after the timeout ignored", lateEcho);
+  expect("echo stuck high times out", stuck);
+
+  // A custom timeout, and the edge that lands right at the deadline: the
+  // ISR got there first, so it counts
+  EchoTimer shortTimer(5000);
+  shortTimer.arm(0);
+  echo(shortTimer, 0, 5000 - ECHO_LEAD_US);
+  expect("edge at the deadline beats the timeout", shortTimer.poll(5000, s) && s.valid() &&
+                                                     shortTimer.timeouts() == 0);
+
+  // Back-to-back pings nobody polls: the ring holds 8, then counts drops
+  EchoTimer burst;
+  bool queued = true;
+  for (uint32_t i = 0; i < 9; i++) {
+    queued = queued && burst.arm(i * 10000);
+    echo(burst, i * 10000, 100 + i);
+  }
+  uint32_t order = 0;
+  while (burst.poll(200000, s)) {
+    if (s.echo_us != 100 + order) queued = false;
+    order++;
+  }
+  expect("8 results held unpolled, the 9th dropped", queued && order == 8 && burst.dropped() == 1);
+
+  // The ISR retiring a ping and the consumer timing it out at once, on two
+  // threads: exactly one of them does. The threads only meet to hand over
+  // a ping; the first poll runs while the edges may be arriving.
+  EchoTimer race;
+  const uint32_t racePings = 20000;
+  std::mutex lock;
+  std::condition_variable turn;
+  uint32_t go = 0, done = 0;
+  std::thread isr([&] {
+    for (uint32_t i = 1; i <= racePings; i++) {
+      {
+        std::unique_lock<std::mutex> guard(lock);
+        turn.wait(guard, [&] { return go == i; });
+      }
+      echo(race, i * 100000, ECHO_TIMEOUT_US);
+      {
+        std::lock_guard<std::mutex> guard(lock);
+        done = i;
+      }
+      turn.notify_all();
+    }
+  });
+  uint32_t won = 0, timedOut = 0, twice = 0;
+  std::uniform_int_distribution<int> wait(0, 400);
+  for (uint32_t i = 1; i <= racePings; i++) {
+    uint32_t got = 0;
+    auto retire = [&] {
+      while (race.poll(i * 100000 + 2 * ECHO_TIMEOUT_US, s)) {
+        got++;
+        if (s.valid()) won++;
+        else timedOut++;
+      }
+    };
+    race.arm(i * 100000);
+    {
+      std::lock_guard<std::mutex> guard(lock);
+      go = i;
+    }
+    turn.notify_all();
+    for (volatile int spin = wait(rng); spin > 0; spin--) {}
+    retire();
+    {
+      std::unique_lock<std::mutex> guard(lock);
+      turn.wait(guard, [&] { return done == i; });
+    }
+    retire();
+    if (got != 1) twice++;
+  }
+  isr.join();
+  printf("  ISR vs timeout: %u pings, echo %u, timeout %u\n", racePings, won, timedOut);
+  expect("ISR and timeout retire each ping once", twice == 0 && won + timedOut == racePings);
+
+  // Voting: a failed ping and a stray echo are left out of the median
+  const float echoes[] = { 100.2f, -1.0f, 99.8f, 250.0f, 100.0f };
+  RangeBurst voted = voteRange(echoes, 5);
+  expect("vote drops failed pings and outliers", voted.pings == 5 && voted.valid == 4 && voted.kept == 3 &&
+                                                   fabsf(voted.cm - 100.0f) < 1e-4f);
+  // Past RANGE_BURST_MAX only the first RANGE_BURST_MAX are voted and counted
+  float many[RANGE_BURST_MAX + 4];
+  for (size_t i = 0; i < RANGE_BURST_MAX + 4; i++) many[i] = i < RANGE_BURST_MAX ? 100.0f : 300.0f;
+  voted = voteRange(many, RANGE_BURST_MAX + 4);
+  expect("vote of more than RANGE_BURST_MAX readings", voted.pings == RANGE_BURST_MAX &&
+                                                         voted.valid == RANGE_BURST_MAX &&
+                                                         voted.kept == RANGE_BURST_MAX && voted.cm == 100.0f);
+
+  // Throughput: back to back (re-armed on the result) and at the HC-SR04
+  // cycle, against the CPU pulseIn() kept busy per ping
+  printf("\n%-14s %-4s %10s %10s %8s %12s\n", "pings", "", "b2b /s", "60 ms /s", "polls", "pulseIn busy");
+  const uint32_t second = 1000000;
+  for (float cm : { 10.0f, 100.0f, 400.0f, -1.0f }) {
+    PingRun fast = runPings(cm, 0, 10 * second);
+    PingRun paced = runPings(cm, RANGE_MIN_SPACING_MS * 1000, 10 * second);
+    uint32_t blockUs = cm < 0 ? ECHO_TIMEOUT_US : ECHO_LEAD_US + echoWidthUs(cm);
+    double expectFast = 10.0 * second / (((blockUs + ECHO_POLL_US - 1) / ECHO_POLL_US) * ECHO_POLL_US);
+    bool ok = fast.wrongWidth == 0 && paced.wrongWidth == 0 && fabs(fast.pings - expectFast) <= 1 &&
+              paced.pings == 10000 / RANGE_MIN_SPACING_MS + 1 && (cm < 0 ? fast.valid == 0 : fast.valid == fast.pings);
+    char name[16];
+    snprintf(name, sizeof(name), cm < 0 ? "no target" : "%.0f cm", cm);
+    printf("%-14s %-4s %10.1f %10.1f %8.1f %11.1f%%\n", name, ok ? "ok" : "FAIL", fast.pings / 10.0,
+           paced.pings / 10.0, (double)fast.polls / fast.pings, 100.0 * blockUs / (RANGE_MIN_SPACING_MS * 1000));
+    if (!ok) failures++;
+  }
+
+  // Host cost of one ping through the engine: arm, two edges, poll
+  EchoTimer bench;
+  const uint32_t n = 2000000;
+  uint32_t sink = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (uint32_t i = 0; i < n; i++) {
+    bench.arm(i * 64);
+    echo(bench, i * 64, 20);
+    if (bench.poll(i * 64 + 40, s)) sink += s.echo_us;
+  }
+  double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / n;
+  printf("  host: %.1f ns per ping (arm, 2 edges, poll)\n", ns);
+  expect("every benchmark ping timed", sink == 20u * n);
+}
+
+// ====================== Filters ======================
+// Each kernel against a plain model of what it promises: the mean or median
+// of the last N readings, where a NaN drops the oldest one. The run-time
+// filter against the fixed kernels at every window it accepts. Then the
+// cost per sample at windows 5-256, next to sorting the window per sample
+// (what a median costs without the sorted ring).
+struct WindowModel {
+  std::deque<float> values;
+  size_t n;
+
+  void add(float x) {
+    if (isnan(x)) {
+      if (!values.empty()) values.pop_front();
+      return;
+    }
+    values.push_back(x);
+    if (values.size() > n) values.pop_front();
+  }
+
+  float mean() const {
+    if (values.empty()) return NAN;
+    double sum = 0;
+    for (float v : values) sum += v;
+    return (float)(sum / values.size());
+  }
+
+  float median() const {
+    if (values.empty()) return NAN;
+    std::vector<float> v(values.begin(), values.end());
+    std::sort(v.begin(), v.end());
+    size_t k = v.size();
+    return k & 1 ? v[k / 2] : 0.5f * (v[k / 2 - 1] + v[k / 2]);
+  }
+};
+
+static bool near(float a, float b, float tol) {
+  return isnan(a) ? isnan(b) : !isnan(b) && fabsf(a - b) <= tol;
+}
+
+// Readings around 50 cm, a few dropouts, repeats (equal values in the
+// median's sorted ring) and jumps
+static std::vector<float> filterInput(std::mt19937& rng, size_t n) {
+  std::normal_distribution<float> noise(0.0f, 3.0f);
+  std::uniform_int_distribution<int> pick(0, 99);
+  std::vector<float> x(n);
+  float level = 50;
+  for (size_t i = 0; i < n; i++) {
+    int r = pick(rng);
+    if (r < 2) level = 10 + pick(rng) * 3.5f;
+    x[i] = r < 7 ? NAN : r < 15 && i > 0 && !isnan(x[i - 1]) ? x[i - 1] : roundf((level + noise(rng)) * 10) / 10;
+  }
+  return x;
+}
+
+template <size_t N>
+static bool windowedMatch(const std::vector<float>& input) {
+  MovingAverageFilter<N> ma;
+  MedianFilter<N> med;
+  WindowModel model{ {}, N };
+  for (float x : input) {
+    float a = ma.update(x), m = med.update(x);
+    model.add(x);
+    if (!near(a, model.mean(), 1e-3f) || !near(m, model.median(), 0) || ma.count() != model.values.size()) return false;
+  }
+  return true;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+static uint64_t cycleCount() { return __rdtsc(); }
+#else
+static uint64_t cycleCount() { return 0; }  // no cycle counter: ns only
+#endif
+
+struct FilterCost {
+  double ns;
+  double cycles;
+};
+
+template <typename F>
+static FilterCost cost(const std::vector<float>& input, F&& update) {
+  volatile float sink = 0;
+  auto start = std::chrono::steady_clock::now();
+  uint64_t c0 = cycleCount();
+  for (float x : input) sink = update(x);
+  uint64_t c1 = cycleCount();
+  double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+  (void)sink;
+  return FilterCost{ ns / input.size(), (double)(c1 - c0) / input.size() };
+}
+
+static void printCost(const FilterCost& c) {
+  if (c.cycles > 0) printf(" %7.1f/%-6.0f", c.ns, c.cycles);
+  else printf(" %7.1f/%-6s", c.ns, "-");
+}
+
+template <size_t N>
+static void benchWindow(const std::vector<float>& input) {
+  MovingAverageFilter<N> ma;
+  MedianFilter<N> med;
+  ConfigurableFilter rtMa(DSP_FILTER_MOVING_AVERAGE, std::min(N, DSP_WINDOW_MAX));
+  ConfigurableFilter rtMed(DSP_FILTER_MEDIAN, std::min(N, DSP_WINDOW_MAX));
+  WindowModel sorted{ {}, N };
+
+  printf("%-8zu", N);
+  printCost(cost(input, [&](float x) { return ma.update(x); }));
+  printCost(cost(input, [&](float x) { return med.update(x); }));
+  printCost(cost(input, [&](float x) { return rtMa.update(x); }));
+  printCost(cost(input, [&](float x) { return rtMed.update(x); }));
+  std::vector<float> fewer(input.begin(), input.begin() + input.size() / 20);  // sorting is slow
+  printCost(cost(fewer, [&](float x) {
+    sorted.add(x);
+    return sorted.median();
+  }));
+  printf("\n");
+}
+
+static void testFilters(std::mt19937& rng) {
+  printf("\nfilters\n");
+  std::vector<float> input = filterInput(rng, 20000);
+
+  expect("mean and median of the last N, N = 1..256",
+         windowedMatch<1>(input) && windowedMatch<2>(input) && windowedMatch<5>(input) &&
+           windowedMatch<16>(input) && windowedMatch<64>(input) && windowedMatch<256>(input));
+
+  // A NaN drains one value; N NaNs in a row empty the window
+  MovingAverageFilter<4> drain;
+  MedianFilter<4> drainMed;
+  for (float x : { 1.0f, 2.0f, 3.0f, 4.0f }) {
+    drain.update(x);
+    drainMed.update(x);
+  }
+  bool drained = drain.update(NAN) == 3.0f && drainMed.update(NAN) == 3.0f;
+  for (int i = 0; i < 3; i++) {
+    drain.update(NAN);
+    drainMed.update(NAN);
+  }
+  expect("dropouts drain the window", drained && isnan(drain.value()) && isnan(drainMed.value()) &&
+                                        drain.update(7.0f) == 7.0f && drainMed.update(7.0f) == 7.0f);
+
+  // The running sum does not drift over a day of 10 Hz pings
+  MovingAverageFilter<16> longRun;
+  std::uniform_real_distribution<float> wide(2.0f, 400.0f);
+  WindowModel tail{ {}, 16 };
+  for (int i = 0; i < 864000; i++) {
+    float x = wide(rng);
+    longRun.update(x);
+    tail.add(x);
+  }
+  expect("running sum exact after 864k samples", near(longRun.value(), tail.mean(), 1e-4f));
+
+  // EMA: first reading as is, then the recurrence; a NaN holds the value
+  EmaFilter ema(0.25f);
+  float want = NAN;
+  bool emaOk = isnan(ema.value());
+  for (float x : input) {
+    float got = ema.update(x);
+    if (!isnan(x)) want = isnan(want) ? x : want + 0.25f * (x - want);
+    emaOk = emaOk && near(got, want, 1e-4f);
+  }
+  expect("EMA recurrence, NaN holds", emaOk);
+
+  // Kalman: settles to the steady-state gain, holds through a dropout while
+  // its variance grows, and smooths a still target better than the raw pings
+  KalmanFilter1D kalman(0.05f, 4.0f);
+  std::normal_distribution<float> noise(0.0f, 2.0f);
+  double rawErr = 0, kalErr = 0;
+  for (int i = 0; i < 2000; i++) {
+    float x = 50.0f + noise(rng);
+    float k = kalman.update(x);
+    if (i >= 200) {
+      rawErr += (x - 50) * (x - 50);
+      kalErr += (k - 50) * (k - 50);
+    }
+  }
+  float q = 0.05f, r = 4.0f;
+  float steady = (-q + sqrtf(q * q + 4 * q * r)) / 2;  // p after the update, fixed point of the recursion
+  float held = kalman.value(), before = kalman.variance();
+  bool holds = kalman.update(NAN) == held && fabsf(kalman.variance() - before - q) < 1e-6f;
+  printf("  kalman: rms %.2f cm raw, %.2f cm filtered, variance %.4f (steady %.4f)\n", sqrt(rawErr / 1800),
+         sqrt(kalErr / 1800), before, steady);
+  expect("Kalman settles, holds through a dropout",
+         fabsf(before - steady) < 1e-4f && holds && kalErr < rawErr / 4 && isnan(KalmanFilter1D().update(NAN)));
+
+  // The run-time filter is the fixed kernel at every window it takes
+  bool runtime = true;
+  for (size_t w = 1; w <= DSP_WINDOW_MAX && runtime; w++) {
+    ConfigurableFilter ma(DSP_FILTER_MOVING_AVERAGE, w), med(DSP_FILTER_MEDIAN, w), ema2(DSP_FILTER_EMA, w);
+    WindowModel model{ {}, w };
+    EmaFilter refEma(2.0f / (w + 1));
+    for (size_t i = 0; i < 2000 && runtime; i++) {
+      float x = input[(i * 7 + w) % input.size()];
+      model.add(x);
+      runtime = near(ma.update(x), model.mean(), 1e-3f) && near(med.update(x), model.median(), 0) &&
+                near(ema2.update(x), refEma.update(x), 1e-5f);
+    }
+  }
+  ConfigurableFilter switched(DSP_FILTER_MEDIAN, 9);
+  for (int i = 0; i < 20; i++) switched.update(input[i]);
+  switched.configure(DSP_FILTER_MOVING_AVERAGE, 3);
+  bool restarted = isnan(switched.value()) && switched.update(10.0f) == 10.0f;
+  switched.configure(DSP_FILTER_MEDIAN, 3);
+  restarted = restarted && switched.update(5.0f) == 5.0f && switched.update(9.0f) == 7.0f;
+  expect("run-time filter = kernels, windows 1-255", runtime && restarted);
+
+  // Cost per sample, host ns / TSC cycles
+  std::vector<float> bench = filterInput(rng, 1000000);
+  printf("\n%-8s %-14s %-14s %-14s %-14s %-14s\n", "window", "average", "median", "rt average", "rt median",
+         "sort/sample");
+  benchWindow<5>(bench);
+  benchWindow<8>(bench);
+  benchWindow<16>(bench);
+  benchWindow<32>(bench);
+  benchWindow<64>(bench);
+  benchWindow<128>(bench);
+  benchWindow<256>(bench);
+  EmaFilter emaBench(0.3f);
+  KalmanFilter1D kalBench;
+  printf("%-8s", "EMA");
+  printCost(cost(bench, [&](float x) { return emaBench.update(x); }));
+  printf("\n%-8s", "Kalman");
+  printCost(cost(bench, [&](float x) { return kalBench.update(x); }));
+  printf("\n");
+}
+
+// ====================== Frames ======================
+// The fixed layout byte for byte, both ways, then random frames at each
+// MTU through encode and decode, and every length that is not exactly
+// header + 4 * count.
+static bool sameBytes(const uint8_t* data, size_t length, std::initializer_list<uint8_t> want) {
+  return length == want.size() && std::equal(want.begin(), want.end(), data);
+}
+
+// What a sample reads back as: 0.1 cm steps, clamped to int16
+static float quantized(float cm) {
+  if (isnan(cm)) return NAN;
+  float v = std::max(-32767.0f, std::min(32767.0f, roundf(cm * DISTANCE_FRAME_CM_SCALE)));
+  return v / DISTANCE_FRAME_CM_SCALE;
+}
+
+static bool sameSample(const FrameSample& a, const FrameSample& b) {
+  if (a.seq != b.seq || a.t_ms != b.t_ms || isnan(a.cm) != isnan(b.cm)) return false;
+  return isnan(a.cm) || fabsf(a.cm - b.cm) < 1e-3f;
+}
+
+static void testFrames(std::mt19937& rng) {
+  printf("\nframes\n");
+
+  // Little-endian throughout: 16- and 32-bit fields low byte first
+  DistanceFrameEncoder enc;
+  enc.reset(DISTANCE_FRAME_BACKFILL);
+  bool ok = enc.add(0x1234, 0x89ABCDEF, 12.3f) && enc.add(0x1235, 0x89ABCDEF + 60, NAN) &&
+            enc.add(0x1236, 0x89ABCDEF + 60 + 0x0102, 100.0f);
+  ok = ok && sameBytes(enc.data(), enc.size(),
+                       { 0x81, 0x03, 0x34, 0x12, 0xEF, 0xCD, 0xAB, 0x89,  // version | backfill, n, seq, t
+                         0x7B, 0x00, 0x00, 0x00,                          // 12.3 cm, dt 0
+                         0x00, 0x80, 0x3C, 0x00,                          // no reading, dt 60
+                         0xE8, 0x03, 0x02, 0x01 });                       // 100.0 cm, dt 258
+  expect("fixed frame bytes", ok && !enc.add(0x1237, 0x89ABCDEF + 400, 1.0f));
+
+  const uint8_t wire[] = { 0x01, 0x02, 0xFE, 0xFF, 0x10, 0x00, 0x00, 0x01,
+                           0x2C, 0x01, 0x00, 0x00,  // 30.0 cm
+                           0xF6, 0xFF, 0xE8, 0x03 };  // -1.0 cm, 1000 ms later
+  FrameSample out[DISTANCE_FRAME_MAX_SAMPLES + 1];
+  DistanceFrameInfo info;
+  ok = decodeDistanceFrame(wire, sizeof(wire), out, DISTANCE_FRAME_MAX_SAMPLES, &info) == 2;
+  ok = ok && info.flags == 0 && info.count == 2 && info.seq == 0xFFFE && info.t_ms == 0x01000010;
+  ok = ok && sameSample(out[0], FrameSample{ 0xFFFE, 0x01000010, 30.0f }) &&
+       sameSample(out[1], FrameSample{ 0xFFFF, 0x01000010 + 1000, -1.0f });
+  expect("fixed frame fields read little-endian", ok);
+
+  uint8_t ctrl[DISTANCE_CONTROL_SIZE];
+  DistanceControl c;
+  ok = encodeDistanceControl(DistanceControl{ DISTANCE_CTRL_ACK, 0xBEEF }, ctrl) == DISTANCE_CONTROL_SIZE &&
+       sameBytes(ctrl, sizeof(ctrl), { 0x02, 0xEF, 0xBE });
+  ok = ok && decodeDistanceControl(ctrl, sizeof(ctrl), c) && c.op == DISTANCE_CTRL_ACK && c.seq == 0xBEEF;
+  expect("control write bytes", ok);
+
+  // Random frames filled to capacity at each MTU
+  std::uniform_int_distribution<int> coin(0, 99), byte(0, 255);
+  std::uniform_real_distribution<float> range(-5.0f, 4000.0f);
+  std::uniform_int_distribution<uint32_t> dt(0, 65535), anyU32;
+  const uint16_t mtus[] = { 23, 247, 517 };
+  const size_t capacities[] = { 3, 59, 126 };
+  uint32_t frames = 0, mismatched = 0, wrongCapacity = 0, badLengths = 0, lengths = 0;
+  for (int f = 0; f < 6000; f++) {
+    size_t m = f % 3;
+    enc.setMtu(mtus[m]);
+    uint8_t flags = coin(rng) < 20 ? DISTANCE_FRAME_BACKFILL : 0;
+    enc.reset(flags);
+    uint16_t seq = (uint16_t)anyU32(rng);
+    uint32_t t = anyU32(rng);
+    std::vector<FrameSample> in;
+    while (!enc.full()) {
+      float cm = coin(rng) < 10 ? NAN : range(rng);
+      if (!enc.add(seq, t, cm)) break;
+      in.push_back({ seq++, t, quantized(cm) });
+      t += dt(rng);
+    }
+    if (in.size() != capacities[m] || enc.size() > (size_t)mtus[m] - 3 ||
+        enc.size() != DISTANCE_FRAME_HEADER_SIZE + in.size() * DISTANCE_FRAME_SAMPLE_SIZE) {
+      wrongCapacity++;
+    }
+
+    int n = decodeDistanceFrame(enc.data(), enc.size(), out, DISTANCE_FRAME_MAX_SAMPLES, &info);
+    bool same = n == (int)in.size() && info.flags == flags && info.count == in.size() && info.seq == in[0].seq &&
+                info.t_ms == in[0].t_ms;
+    for (int i = 0; same && i < n; i++) same = sameSample(out[i], in[i]);
+    frames++;
+    if (!same) mismatched++;
+
+    // Every other length, short or long, is malformed
+    std::vector<uint8_t> bytes(enc.data(), enc.data() + enc.size());
+    bytes.resize(bytes.size() + DISTANCE_FRAME_SAMPLE_SIZE + 1, (uint8_t)byte(rng));
+    for (size_t len = 0; len <= bytes.size(); len++) {
+      if (len == enc.size()) continue;
+      lengths++;
+      if (decodeDistanceFrame(bytes.data(), len, out, DISTANCE_FRAME_MAX_SAMPLES) >= 0) badLengths++;
+    }
+  }
+  printf("  %u frames at MTU 23/247/517, %u wrong lengths tried\n", frames, lengths);
+  expect("frames filled to the MTU's capacity", wrongCapacity == 0);
+  expect("fixed frames decode to what was added", mismatched == 0);
+  expect("short and oversized frames rejected", badLengths == 0 && decodeDistanceFrame(nullptr, 8, out, 1) < 0);
+
+  // Header damage and limits
+  uint8_t bad[sizeof(wire)];
+  bool rejected = true;
+  for (uint8_t version : { 0x00, 0x02, 0x11, 0x08 | 0x01, 0xFF }) {  // wrong version, unknown flag bits
+    memcpy(bad, wire, sizeof(wire));
+    bad[0] = version;
+    rejected = rejected && decodeDistanceFrame(bad, sizeof(bad), out, DISTANCE_FRAME_MAX_SAMPLES) < 0;
+  }
+  for (uint8_t count : { 0, 1, 3, 255 }) {
+    memcpy(bad, wire, sizeof(wire));
+    bad[1] = count;
+    rejected = rejected && decodeDistanceFrame(bad, sizeof(bad), out, DISTANCE_FRAME_MAX_SAMPLES) < 0;
+  }
+  expect("bad version, flag bits and count rejected", rejected);
+
+  out[1].seq = 0xAAAA;
+  ok = decodeDistanceFrame(wire, sizeof(wire), out, 1, &info) == 1 && info.count == 2 && out[1].seq == 0xAAAA;
+  enc.setMtu(23);
+  enc.reset();
+  ok = ok && enc.add(1, 1000, 5000.0f) && !enc.add(2, 1000 + 65536, 5.0f) && enc.add(2, 1000 + 65535, -9999.0f);
+  ok = ok && decodeDistanceFrame(enc.data(), enc.size(), out, 2) == 2 && out[0].cm == 3276.7f &&
+       out[1].cm == -3276.7f && out[1].t_ms == 1000 + 65535;
+  expect("maxOut, dt and distance limits", ok);
+
+  const uint8_t ctrlBad[][4] = { { 0x00, 0x01, 0x00 }, { 0x03, 0x01, 0x00 } };
+  ok = !decodeDistanceControl(ctrl, 2, c) && !decodeDistanceControl(ctrlBad[0], 4, c) &&
+       !decodeDistanceControl(ctrlBad[0], 3, c) && !decodeDistanceControl(ctrlBad[1], 3, c) &&
+       !decodeDistanceControl(nullptr, 3, c);
+  expect("control writes of wrong size or opcode rejected", ok);
+}
+
+// ====================== Link profiles ======================
+static const uint32_t SIM_STEP_MS = 100;
+static const uint32_t SIM_TUNE_MS = 1000;  // the server's tuneLink period
+static const uint16_t SIM_MTU = 517;
+
+// Bytes produced in the step ending at t
+typedef std::function<uint32_t(uint32_t tMs)> Producer;
+
+struct Result {
+  uint32_t switches = 0;
+  uint32_t firstSwitchMs = 0;
+  uint32_t streamingMs = 0;
+  uint32_t maxBacklog = 0;
+  double events = 0;
+  LinkProfile final = LINK_STREAMING;
+};
+
+static Result run(const Producer& produce, uint32_t durationMs, LinkProfile start) {
+  LinkProfileSelector selector;
+  selector.reset(0, start);
+  Result r;
+  double backlog = 0;
+
+  for (uint32_t t = SIM_STEP_MS; t <= durationMs; t += SIM_STEP_MS) {
+    uint32_t bytes = produce(t);
+    backlog += bytes;
+
+    const LinkParams& p = LINK_PROFILES[selector.profile()];
+    double sent = linkCapacityBytesPerSec(p, SIM_MTU) * SIM_STEP_MS / 1000.0;
+    if (sent > backlog) sent = backlog;
+    backlog -= sent;
+    selector.produced((size_t)sent);
+    if (backlog > r.maxBacklog) r.maxBacklog = (uint32_t)backlog;
+
+    double eventMs = p.maxInterval * 1.25;
+    if (sent == 0) eventMs *= 1 + p.latency;
+    r.events += SIM_STEP_MS / eventMs;
+    if (selector.profile() == LINK_STREAMING) r.streamingMs += SIM_STEP_MS;
+
+    if (t % SIM_TUNE_MS == 0 && selector.update(t, (uint32_t)backlog)) {
+      if (r.switches++ == 0) r.firstSwitchMs = t;
+    }
+  }
+  r.final = selector.profile();
+  return r;
+}
+
+// A ping every periodMs, framed DistanceFrame style and flushed every second
+static Producer pings(uint32_t periodMs) {
+  return [periodMs](uint32_t t) {
+    uint32_t samples = t / periodMs - (t - SIM_STEP_MS) / periodMs;
+    uint32_t frame = t % 1000 == 0 ? 8 : 0;
+    return samples * 4 + frame;
+  };
+}
+
+static void report(const char* name, const Result& r, uint32_t durationMs, bool ok) {
+  printf("%-20s %-4s %8u %9u %8.0f%% %9u %10.2f  %s\n", name, ok ? "ok" : "FAIL", r.switches, r.firstSwitchMs,
+         100.0 * r.streamingMs / durationMs, r.maxBacklog, r.events * 1000.0 / durationMs, linkProfileName(r.final));
+  if (!ok) failures++;
+}
+
+static void testLinkProfiles(std::mt19937& rng) {
+  LinkSelectorConfig cfg;
+
+  // The low-power link has to carry a rate just under the up threshold, or
+  // backlog builds before the selector reacts
+  uint32_t lowCap = linkCapacityBytesPerSec(LINK_PROFILES[LINK_LOW_POWER], 185);
+  printf("low-power capacity at MTU 185: %u B/s (up threshold %u B/s) %s\n\n", lowCap, cfg.upBytesPerSec,
+         lowCap >= cfg.upBytesPerSec ? "ok" : "FAIL");
+  if (lowCap < cfg.upBytesPerSec) failures++;
+
+  printf("%-20s %-4s %8s %9s %9s %9s %10s  %s\n", "scenario", "", "switches", "first_ms", "streaming", "backlog",
+         "events/s", "final");
+
+  // The lab's 1 Hz ping: streams through discovery, then settles
+  const uint32_t minute = 60000;
+  Result r = run(pings(1000), 2 * minute, LINK_STREAMING);
+  report("1 Hz ping", r, 2 * minute,
+         r.switches == 1 && r.final == LINK_LOW_POWER && r.firstSwitchMs <= cfg.minDwellMs + 2 * cfg.windowMs);
+
+  // 100 Hz ping is ~410 B/s: streaming within a few windows
+  r = run(pings(10), minute, LINK_LOW_POWER);
+  report("100 Hz ping", r, minute, r.switches == 1 && r.final == LINK_STREAMING && r.firstSwitchMs <= 3000);
+
+  // Reconnect backfill: 8 KB at once on a quiet link goes straight to
+  // streaming, drains, and the link settles again
+  auto backfill = [](uint32_t t) { return (t == 30000 ? 8192u : 0u) + pings(1000)(t); };
+  r = run(backfill, 2 * minute, LINK_LOW_POWER);
+  report("backfill burst", r, 2 * minute,
+         r.switches == 2 && r.firstSwitchMs == 30000 && r.final == LINK_LOW_POWER && r.streamingMs <= 20000);
+
+  // Noisy rate straddling the up threshold: the dwell bounds renegotiation
+  std::uniform_int_distribution<uint32_t> noisy(10, 40);  // 100-400 B/s
+  auto straddle = [&](uint32_t) { return noisy(rng); };
+  uint32_t duration = 5 * minute;
+  r = run(straddle, duration, LINK_LOW_POWER);
+  report("noisy 100-400 B/s", r, duration, r.switches <= duration / cfg.minDwellMs);
+
+  // Rate steps every 30 s: one switch per step at most
+  auto steps = [](uint32_t t) { return (t / 30000) % 2 ? 50u : 1u; };
+  r = run(steps, 4 * minute, LINK_LOW_POWER);
+  report("steps 10/500 B/s", r, 4 * minute, r.switches >= 6 && r.switches <= 8);
+}
+
+// ====================== Backfill ======================
+static const uint32_t BF_STEP_MS = 10;
+static const uint32_t BF_SAMPLE_MS = 100;  // 10 Hz: the uint16 sequence wraps in under 2 h
+static const uint16_t BF_MTU = 247;
+
+struct BackfillScenario {
+  const char* name;
+  uint32_t durationMs;
+  size_t history;          // samples
+  uint32_t meanUpMs;       // connection lifetime, exponential
+  uint32_t maxDownMs;      // outage, uniform from 1 s
+  double notifyLoss;       // per notification while connected (stack congestion)
+  uint32_t rebootAtMs;     // server restarts at the first disconnect after this, 0 = never
+};
+
+struct BackfillResult {
+  uint32_t produced = 0;
+  uint32_t received = 0;
+  uint32_t missing = 0;      // never received, truth
+  uint32_t duplicates = 0;   // handed to the client twice, truth
+  uint32_t drops = 0;
+  uint32_t liveFrames = 0;
+  uint32_t rewinds = 0;
+  uint32_t backfillFrames = 0;
+  uint32_t missingAfterReboot = 0;
+  BackfillReceiver rx;
+};
+
+struct Packet {
+  uint32_t atMs;
+  std::vector<uint8_t> data;
+};
+
+static void runBackfill(const BackfillScenario& sc, std::mt19937& rng, BackfillResult& r) {
+  std::vector<HistoryEntry> storage(sc.history);
+  SampleHistory history;
+  history.begin(storage.data(), storage.size());
+  BackfillSender sender;
+  DistanceFrameEncoder live, bulk;
+  live.setMtu(BF_MTU);
+  bulk.setMtu(BF_MTU);
+
+  std::deque<Packet> toClient, toServer;
+  std::uniform_int_distribution<uint32_t> latency(5, 40);
+  std::uniform_real_distribution<double> unit(0, 1);
+  std::exponential_distribution<double> upTime(1.0 / sc.meanUpMs);
+  std::uniform_int_distribution<uint32_t> downTime(1000, sc.maxDownMs);
+
+  uint32_t endMs = sc.durationMs + sc.maxDownMs + 120000;  // reconnect once more and drain
+
+  // Indexed by production time, which is unique across reboots
+  std::vector<uint8_t> got(endMs / BF_SAMPLE_MS + 1, 0);
+  uint32_t firstIdx = UINT32_MAX, lastIdx = 0, rebootIdx = UINT32_MAX;
+  bool rebooted = false;
+
+  uint16_t seq = 0;
+  bool connected = false;
+  uint32_t toggleAtMs = 2000;
+
+  auto send = [&](std::deque<Packet>& q, const uint8_t* p, size_t n, uint32_t now, double loss) {
+    if (unit(rng) < loss) return;
+    q.push_back(Packet{now + latency(rng), std::vector<uint8_t>(p, p + n)});
+  };
+
+  for (uint32_t t = 0; t <= endMs; t += BF_STEP_MS) {
+    // Link up/down
+    if (t >= toggleAtMs && (!connected || t < sc.durationMs)) {
+      connected = !connected;
+      if (connected) {
+        toggleAtMs = t >= sc.durationMs ? UINT32_MAX : t + 1000 + (uint32_t)upTime(rng);
+        live.reset();
+        sender.stop();
+        if (r.rx.started()) {
+          uint8_t msg[DISTANCE_CONTROL_SIZE];
+          send(toServer, msg, encodeDistanceControl(DistanceControl{DISTANCE_CTRL_BACKFILL, r.rx.ackSeq()}, msg), t, 0);
+        }
+      } else {
+        toggleAtMs = t + downTime(rng);
+        toClient.clear();
+        toServer.clear();
+        sender.stop();
+        r.drops++;
+        if (sc.rebootAtMs && !rebooted && t >= sc.rebootAtMs) {
+          // Power cycle while nobody listens: numbering and history start over
+          rebooted = true;
+          rebootIdx = (t + BF_SAMPLE_MS - 1) / BF_SAMPLE_MS;  // first sample of the new numbering
+          history.begin(storage.data(), storage.size());
+          seq = 0;
+        }
+      }
+    }
+
+    // Server: sample, record, send live. Sampling goes on while the link
+    // drains, so a lost last frame still shows as a gap; samples are checked
+    // up to the newest one the client got.
+    if (t % BF_SAMPLE_MS == 0) {
+      float cm = (float)((t / BF_SAMPLE_MS) % 300) / 10.0f;
+      history.add(seq, t, cm);
+      r.produced++;
+      if (connected) {
+        if (!live.add(seq, t, cm)) {
+          send(toClient, live.data(), live.size(), t, sc.notifyLoss);
+          r.liveFrames++;
+          live.reset();
+          live.add(seq, t, cm);
+        }
+        if (live.full()) {
+          send(toClient, live.data(), live.size(), t, sc.notifyLoss);
+          r.liveFrames++;
+          live.reset();
+        }
+      }
+      seq++;
+    }
+
+    if (!connected) continue;
+    if (!live.empty() && t - live.firstTimeMs() >= 1000) {
+      send(toClient, live.data(), live.size(), t, sc.notifyLoss);
+      r.liveFrames++;
+      live.reset();
+    }
+
+    // Server: control writes, then pump the replay
+    while (!toServer.empty() && toServer.front().atMs <= t) {
+      DistanceControl c;
+      if (decodeDistanceControl(toServer.front().data.data(), toServer.front().data.size(), c)) {
+        if (c.op == DISTANCE_CTRL_BACKFILL) sender.start(c.seq, (uint16_t)(seq - live.count()), t);
+        else sender.ack(c.seq, t);
+      }
+      toServer.pop_front();
+    }
+    while (sender.next(bulk, history, t)) send(toClient, bulk.data(), bulk.size(), t, sc.notifyLoss);
+
+    // Client: every frame through the receiver
+    while (!toClient.empty() && toClient.front().atMs <= t) {
+      const std::vector<uint8_t>& d = toClient.front().data;
+      FrameSample samples[DISTANCE_FRAME_MAX_SAMPLES];
+      DistanceFrameInfo info;
+      int n = decodeDistanceFrame(d.data(), d.size(), samples, DISTANCE_FRAME_MAX_SAMPLES, &info);
+      toClient.pop_front();
+      if (n < 0) continue;
+
+      // Backfill frames are ACKed; a restart or a gap in the live stream asks again
+      bool backfill = info.flags & DISTANCE_FRAME_BACKFILL;
+      bool restart = backfill && (info.flags & DISTANCE_FRAME_RESTART);
+      if (backfill && n == 0) {
+        if (restart) r.rx.restartAt(info.seq);
+        else r.rx.skipTo(info.seq);
+      }
+      bool ask = restart || (!backfill && n > 0 && r.rx.liveGap(info.seq));
+      for (int i = 0; i < n; i++) {
+        if (!r.rx.accept(samples[i].seq)) continue;
+        uint32_t idx = samples[i].t_ms / BF_SAMPLE_MS;
+        if (got[idx]) r.duplicates++;
+        got[idx] = 1;
+        r.received++;
+        if (idx < firstIdx) firstIdx = idx;
+        if (idx > lastIdx) lastIdx = idx;
+      }
+      if (backfill || ask) {
+        uint8_t op = ask ? DISTANCE_CTRL_BACKFILL : DISTANCE_CTRL_ACK;
+        uint8_t msg[DISTANCE_CONTROL_SIZE];
+        send(toServer, msg, encodeDistanceControl(DistanceControl{op, r.rx.ackSeq()}, msg), t, 0);
+      }
+    }
+  }
+
+  r.rewinds = sender.rewinds();
+  r.backfillFrames = sender.frames();
+  for (uint32_t i = firstIdx; i < got.size() && i <= lastIdx; i++) {
+    if (got[i]) continue;
+    r.missing++;
+    if (i >= rebootIdx) r.missingAfterReboot++;
+  }
+}
+
+static void testBackfill(std::mt19937& rng) {
+  const uint32_t minute = 60000, hour = 60 * minute;
+  const BackfillScenario scenarios[] = {
+    { "flaky link",     3 * hour, 8192, 2 * minute, 30000,      0.0,   0 },
+    { "congested",      3 * hour, 8192, 2 * minute, 30000,      0.01,  0 },
+    { "long outages",   3 * hour, 4096, 5 * minute, 15 * minute, 0.005, 0 },
+    { "server reboot",  1 * hour, 8192, 2 * minute, 60000,      0.005, 30 * minute },
+  };
+
+  printf("\n%-16s %-4s %8s %8s %8s %8s %6s %6s %8s %8s %8s\n", "backfill", "", "produced", "received", "missing",
+         "reported", "dups", "drops", "bf_frames", "rewinds", "live_fr");
+  for (const BackfillScenario& sc : scenarios) {
+    BackfillResult r;
+    runBackfill(sc, rng, r);
+
+    // Every gap is either replayed or reported, and nothing is reported
+    // while outages fit in the history. A reboot loses what the old
+    // numbering had not sent; the client cannot count that, only restart.
+    bool fits = sc.history * BF_SAMPLE_MS > sc.maxDownMs * 2;
+    bool ok = r.duplicates == 0 && r.received > 0;
+    if (sc.rebootAtMs) ok = ok && r.rx.restarts() == 1 && r.missingAfterReboot == 0;
+    else ok = ok && r.missing == r.rx.lost() && (!fits || r.missing == 0);
+
+    printf("%-16s %-4s %8u %8u %8u %8u %6u %6u %8u %8u %8u\n", sc.name, ok ? "ok" : "FAIL", r.produced, r.received,
+           r.missing, r.rx.lost(), r.rx.duplicates(), r.drops, r.backfillFrames, r.rewinds, r.liveFrames);
+    if (!ok) failures++;
+  }
+}
+
+// ====================== Settings ======================
+static const SensorConfig SIM_DEFAULTS = { 1000, DSP_FILTER_MOVING_AVERAGE, 5, 300, 0, SEND_PERIODIC, 0 };
+
+// Applies bytes to the defaults; the status, with cfg left as the result
+static ConfigStatus apply(std::initializer_list<uint8_t> bytes, SensorConfig& cfg) {
+  std::vector<uint8_t> data(bytes);
+  cfg = SIM_DEFAULTS;
+  return applyConfigCommands(data.data(), data.size(), SIM_DEFAULTS, cfg);
+}
+
+// Rejected with this status and the settings untouched
+static bool rejects(std::initializer_list<uint8_t> bytes, ConfigStatus want) {
+  SensorConfig cfg;
+  return apply(bytes, cfg) == want && cfg == SIM_DEFAULTS;
+}
+
+static void testSettings(std::mt19937& rng) {
+  printf("\nsettings\n");
+  SensorConfig cfg;
+
+  // Commands, one at a time and together
+  expect("interval", apply({ 0x01, 0xC8, 0x00 }, cfg) == CONFIG_OK && cfg.intervalMs == 200);
+  expect("filter kernel and window",
+         apply({ 0x02, DSP_FILTER_MEDIAN, 9 }, cfg) == CONFIG_OK && cfg.filter == DSP_FILTER_MEDIAN &&
+           cfg.window == 9);
+  expect("threshold, 0 = any distance",
+         apply({ 0x03, 0xA0, 0x0F }, cfg) == CONFIG_OK && cfg.thresholdMm == 4000 &&
+           apply({ 0x03, 0x00, 0x00 }, cfg) == CONFIG_OK && cfg.thresholdMm == 0);
+  expect("deadband", apply({ 0x04, 0x0F, 0x00 }, cfg) == CONFIG_OK && cfg.deadbandMm == 15);
+  expect("mode", apply({ 0x05, SEND_ON_CHANGE }, cfg) == CONFIG_OK && cfg.mode == SEND_ON_CHANGE);
+  expect("heartbeat", apply({ 0x06, 0x10, 0x27 }, cfg) == CONFIG_OK && cfg.heartbeatMs == 10000);
+  expect("several in one write",
+         apply({ 0x01, 0xC8, 0x00, 0x05, 0x01, 0x04, 0x14, 0x00 }, cfg) == CONFIG_OK &&
+           cfg.intervalMs == 200 && cfg.mode == SEND_ON_CHANGE && cfg.deadbandMm == 20 &&
+           cfg.filter == SIM_DEFAULTS.filter);
+  expect("later command wins", apply({ 0x01, 0xC8, 0x00, 0x01, 0x2C, 0x01 }, cfg) == CONFIG_OK &&
+                                 cfg.intervalMs == 300);
+
+  cfg = SIM_DEFAULTS;
+  cfg.intervalMs = 5000;
+  cfg.mode = SEND_ON_CHANGE;
+  const uint8_t reset[] = { 0x7F, 0x02, DSP_FILTER_KALMAN, 1 };
+  expect("defaults, then what follows",
+         applyConfigCommands(reset, sizeof(reset), SIM_DEFAULTS, cfg) == CONFIG_OK &&
+           cfg.intervalMs == SIM_DEFAULTS.intervalMs && cfg.mode == SEND_PERIODIC &&
+           cfg.filter == DSP_FILTER_KALMAN && cfg.window == 1);
+
+  // Limits: edges in, one past out
+  expect("interval 60 and 60000 ms accepted",
+         apply({ 0x01, 60, 0 }, cfg) == CONFIG_OK && apply({ 0x01, 0x60, 0xEA }, cfg) == CONFIG_OK);
+  expect("interval 0, 59, 60001 ms rejected",
+         rejects({ 0x01, 0, 0 }, CONFIG_ERR_RANGE) && rejects({ 0x01, 59, 0 }, CONFIG_ERR_RANGE) &&
+           rejects({ 0x01, 0x61, 0xEA }, CONFIG_ERR_RANGE));
+  expect("window 1 and 255 accepted",
+         apply({ 0x02, 0, 1 }, cfg) == CONFIG_OK && apply({ 0x02, 0, 255 }, cfg) == CONFIG_OK);
+  expect("window 0 and kernel 4 rejected",
+         rejects({ 0x02, 0, 0 }, CONFIG_ERR_RANGE) && rejects({ 0x02, 4, 5 }, CONFIG_ERR_RANGE));
+  expect("threshold and deadband past 4 m rejected",
+         rejects({ 0x03, 0xA1, 0x0F }, CONFIG_ERR_RANGE) && rejects({ 0x04, 0xA1, 0x0F }, CONFIG_ERR_RANGE));
+  expect("mode 2 rejected", rejects({ 0x05, 2 }, CONFIG_ERR_RANGE));
+  expect("heartbeat 0 and 60000 ms accepted, 60001 rejected",
+         apply({ 0x06, 0, 0 }, cfg) == CONFIG_OK && apply({ 0x06, 0x60, 0xEA }, cfg) == CONFIG_OK &&
+           rejects({ 0x06, 0x61, 0xEA }, CONFIG_ERR_RANGE));
+
+  // Malformed writes
+  expect("empty write", rejects({}, CONFIG_ERR_EMPTY) &&
+                          applyConfigCommands(nullptr, 3, SIM_DEFAULTS, cfg) == CONFIG_ERR_EMPTY);
+  expect("unknown opcode", rejects({ 0x07, 0 }, CONFIG_ERR_OPCODE) && rejects({ 0x00 }, CONFIG_ERR_OPCODE));
+  expect("arguments cut short", rejects({ 0x01, 0xC8 }, CONFIG_ERR_TRUNCATED) &&
+                                  rejects({ 0x02, 0 }, CONFIG_ERR_TRUNCATED) &&
+                                  rejects({ 0x05 }, CONFIG_ERR_TRUNCATED));
+  expect("all or nothing: bad command after good ones",
+         rejects({ 0x01, 0xC8, 0x00, 0x05, 0x01, 0x02, 0, 0 }, CONFIG_ERR_RANGE) &&
+           rejects({ 0x01, 0xC8, 0x00, 0x42 }, CONFIG_ERR_OPCODE) &&
+           rejects({ 0x01, 0xC8, 0x00, 0x03, 0x01 }, CONFIG_ERR_TRUNCATED));
+  std::vector<uint8_t> overlong;
+  for (int i = 0; i < 11; i++) overlong.insert(overlong.end(), { 0x01, 0xC8, 0x00 });
+  cfg = SIM_DEFAULTS;
+  expect("longer than CONFIG_WRITE_MAX",
+         applyConfigCommands(overlong.data(), overlong.size(), SIM_DEFAULTS, cfg) == CONFIG_ERR_TRUNCATED &&
+           cfg == SIM_DEFAULTS);
+
+  // Equality: every field counts, padding does not
+  SensorConfig a, c;
+  memset(&a, 0x00, sizeof(a));
+  memset(&c, 0xA5, sizeof(c));
+  a = SIM_DEFAULTS;
+  c.intervalMs = a.intervalMs, c.filter = a.filter, c.window = a.window, c.thresholdMm = a.thresholdMm;
+  c.deadbandMm = a.deadbandMm, c.mode = a.mode, c.heartbeatMs = a.heartbeatMs;
+  int differ = 0;
+  for (int field = 0; field < 7; field++) {
+    SensorConfig d = a;
+    switch (field) {
+      case 0: d.intervalMs++; break;
+      case 1: d.filter++; break;
+      case 2: d.window++; break;
+      case 3: d.thresholdMm++; break;
+      case 4: d.deadbandMm++; break;
+      case 5: d.mode++; break;
+      case 6: d.heartbeatMs++; break;
+    }
+    differ += d != a;
+  }
+  expect("== compares every field, not padding", a == c && differ == 7);
+
+  // Client-side builder
+  ConfigCommandBuilder b;
+  b.interval(200).mode(SEND_ON_CHANGE);
+  const uint8_t expected[] = { 0x01, 0xC8, 0x00, 0x05, 0x01 };
+  expect("builder bytes match the documented example",
+         b.size() == sizeof(expected) && memcmp(b.data(), expected, sizeof(expected)) == 0);
+  ConfigCommandBuilder all;
+  all.defaults().interval(250).filter(DSP_FILTER_EMA, 8).threshold(1500);
+  all.deadband(5).mode(SEND_ON_CHANGE).heartbeat(5000);
+  cfg = SIM_DEFAULTS;
+  SensorConfig want = { 250, DSP_FILTER_EMA, 8, 1500, 5, SEND_ON_CHANGE, 5000 };
+  expect("builder round trip",
+         applyConfigCommands(all.data(), all.size(), SIM_DEFAULTS, cfg) == CONFIG_OK && cfg == want);
+  ConfigCommandBuilder full;
+  for (int i = 0; i < 11; i++) full.interval(100);
+  expect("builder stops at CONFIG_WRITE_MAX", full.overflow() && full.size() == 30);
+
+  // Stored blob
+  uint8_t blob[CONFIG_BLOB_SIZE];
+  SensorConfig back = SIM_DEFAULTS;
+  ConfigStatus last = CONFIG_OK;
+  size_t n = encodeConfigBlob(want, CONFIG_ERR_RANGE, blob);
+  expect("blob round trip with the last status",
+         n == CONFIG_BLOB_SIZE && decodeConfigBlob(blob, n, back, &last) && back == want &&
+           last == CONFIG_ERR_RANGE);
+  back = SIM_DEFAULTS;
+  uint8_t old[CONFIG_BLOB_SIZE];
+  memcpy(old, blob, sizeof(old));
+  old[0] = CONFIG_BLOB_VERSION + 1;
+  uint8_t bad[CONFIG_BLOB_SIZE];
+  memcpy(bad, blob, sizeof(bad));
+  bad[5] = 0;  // window
+  expect("blob of another version, size or invalid rejected",
+         !decodeConfigBlob(old, n, back) && !decodeConfigBlob(blob, n - 1, back) &&
+           !decodeConfigBlob(bad, n, back) && !decodeConfigBlob(nullptr, n, back) &&
+           back == SIM_DEFAULTS);
+
+  char text[96];
+  describeConfig(want, text, sizeof(text));
+  expect("describe",
+         strcmp(text, "interval 250 ms | EMA x8 | < 1500 mm | on change > 5 mm, heartbeat 5000 ms") == 0);
+
+  // Random writes: whatever arrives, the settings stay valid, and a
+  // rejected write changes nothing
+  std::uniform_int_distribution<int> len(0, CONFIG_WRITE_MAX + 4), byte(0, 255), pick(0, 9);
+  const uint8_t likely[] = { 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x7F };
+  uint32_t accepted = 0, invalid = 0, leaked = 0;
+  cfg = SIM_DEFAULTS;
+  for (int i = 0; i < 200000; i++) {
+    uint8_t data[CONFIG_WRITE_MAX + 4];
+    int n = len(rng);
+    for (int k = 0; k < n; k++) {
+      // Mostly real opcodes and small values, so many writes get deep
+      int r = pick(rng);
+      data[k] = r < 3 ? likely[byte(rng) % sizeof(likely)] : r < 7 ? (uint8_t)(byte(rng) % 20) : (uint8_t)byte(rng);
+    }
+    SensorConfig before = cfg;
+    ConfigStatus st = applyConfigCommands(data, n, SIM_DEFAULTS, cfg);
+    if (st == CONFIG_OK) accepted++;
+    else if (before != cfg) leaked++;
+    if (!validateConfig(cfg)) invalid++;
+  }
+  printf("  random writes: 200000, accepted %u, invalid %u, partial %u\n", accepted, invalid, leaked);
+  expect("random writes keep settings valid", invalid == 0 && leaked == 0 && accepted > 1000);
+
+  // The filter the settings drive matches the fixed kernels
+  std::normal_distribution<float> noise(50.0f, 8.0f);
+  std::uniform_real_distribution<float> unit(0, 1);
+  ConfigurableFilter ma(DSP_FILTER_MOVING_AVERAGE, 3), med(DSP_FILTER_MEDIAN, 5), ema(DSP_FILTER_EMA, 5),
+    kal(DSP_FILTER_KALMAN, 1);
+  MovingAverageFilter<3> refMa;
+  MedianFilter<5> refMed;
+  EmaFilter refEma(2.0f / 6);
+  KalmanFilter1D refKal(0.05f, 4.0f);
+  float worst = 0;
+  for (int i = 0; i < 5000; i++) {
+    float x = unit(rng) < 0.05f ? NAN : noise(rng);
+    float pairs[4][2] = { { ma.update(x), refMa.update(x) }, { med.update(x), refMed.update(x) },
+                          { ema.update(x), refEma.update(x) }, { kal.update(x), refKal.update(x) } };
+    for (auto& p : pairs) {
+      if (isnan(p[0]) != isnan(p[1])) worst = INFINITY;
+      else if (!isnan(p[0]) && fabsf(p[0] - p[1]) > worst) worst = fabsf(p[0] - p[1]);
+    }
+  }
+  expect("run-time filter matches fixed kernels", worst < 1e-3f);
+  ConfigurableFilter f(DSP_FILTER_MEDIAN, 5);
+  expect("filter rejects window 0, 256 and kernel 4",
+         !f.configure(DSP_FILTER_MEDIAN, 0) && !f.configure(DSP_FILTER_MEDIAN, 256) && !f.configure(4, 5) &&
+           f.kernel() == DSP_FILTER_MEDIAN && f.window() == 5);
+}
+
+// ====================== Send on change ======================
+// Frames: delta encoding against the fixed layout, and the decoder against
+// anything a radio could hand it.
+static void testDeltaFrames(std::mt19937& rng) {
+  printf("\ndelta frames\n");
+  std::uniform_int_distribution<int> pickMtu(0, 2), coin(0, 99), small(-40, 40), big(-32767, 32767);
+  std::uniform_int_distribution<uint32_t> jitter(990, 1010), anyDt(0, 65535);
+  const uint16_t mtus[] = { 23, 247, 517 };
+  uint32_t frames = 0, mismatched = 0, fixedBytes = 0, deltaBytes = 0, rejectedCuts = 0, cuts = 0;
+
+  for (int f = 0; f < 20000; f++) {
+    DistanceFrameEncoder fixed, delta;
+    uint16_t mtu = mtus[pickMtu(rng)];
+    fixed.setMtu(mtu);
+    delta.setMtu(mtu);
+    delta.setDelta(true);
+    fixed.reset();
+    delta.reset(f % 7 == 0 ? DISTANCE_FRAME_BACKFILL : 0);
+
+    // Mostly a slow target on a steady ping, with dropouts, jumps and odd gaps
+    uint16_t seq = (uint16_t)(f * 300);
+    uint32_t t = (uint32_t)f * 977;
+    int32_t raw = 200;
+    std::vector<FrameSample> in;
+    while (!delta.full()) {
+      int c = coin(rng);
+      raw = c < 5 ? big(rng) : std::max(-32767, std::min(32767, raw + small(rng)));
+      float cm = c >= 95 ? NAN : raw / DISTANCE_FRAME_CM_SCALE;
+      t += c % 10 == 0 ? anyDt(rng) : jitter(rng);
+      if (!delta.add(seq, t, cm)) break;
+      if (fixed.full() || !fixed.add(seq, t, cm)) fixed.reset();  // only compares sizes while it keeps up
+      in.push_back({ seq++, t, cm });
+    }
+    if (in.empty()) continue;
+
+    FrameSample out[DISTANCE_FRAME_MAX_SAMPLES];
+    DistanceFrameInfo info;
+    int n = decodeDistanceFrame(delta.data(), delta.size(), out, DISTANCE_FRAME_MAX_SAMPLES, &info);
+    bool same = n == (int)in.size() && info.seq == in[0].seq && info.t_ms == in[0].t_ms &&
+                (info.flags & DISTANCE_FRAME_DELTA) && delta.size() <= (size_t)mtu - 3;
+    for (int i = 0; same && i < n; i++) {
+      float want = isnan(in[i].cm) ? NAN : roundf(in[i].cm * DISTANCE_FRAME_CM_SCALE) / DISTANCE_FRAME_CM_SCALE;
+      same = out[i].seq == in[i].seq && out[i].t_ms == in[i].t_ms && isnan(out[i].cm) == isnan(want) &&
+             (isnan(want) || fabsf(out[i].cm - want) < 1e-3f);
+    }
+    frames++;
+    if (!same) mismatched++;
+    if (fixed.count() == in.size()) {
+      fixedBytes += fixed.size();
+      deltaBytes += delta.size();
+    }
+
+    // Cut short or padded, a delta frame must not decode
+    std::vector<uint8_t> bytes(delta.data(), delta.data() + delta.size());
+    for (size_t len = DISTANCE_FRAME_HEADER_SIZE; len < bytes.size(); len += 1 + bytes.size() / 8, cuts++) {
+      if (decodeDistanceFrame(bytes.data(), len, out, DISTANCE_FRAME_MAX_SAMPLES) < 0) rejectedCuts++;
+    }
+    bytes.push_back(0);
+    cuts++;
+    if (decodeDistanceFrame(bytes.data(), bytes.size(), out, DISTANCE_FRAME_MAX_SAMPLES) < 0) rejectedCuts++;
+  }
+  printf("  %u frames, delta %.1f%% of fixed size where both fit\n", frames, 100.0 * deltaBytes / fixedBytes);
+  expect("delta frames decode to what was added", mismatched == 0 && frames > 0);
+  expect("delta frames cut short or padded rejected", rejectedCuts == cuts);
+
+  // Random bytes behind a valid header: never read past the end
+  std::uniform_int_distribution<int> byte(0, 255), len(0, 64);
+  uint32_t decoded = 0;
+  for (int i = 0; i < 200000; i++) {
+    std::vector<uint8_t> d(DISTANCE_FRAME_HEADER_SIZE + len(rng));
+    for (uint8_t& b : d) b = (uint8_t)byte(rng);
+    d[0] = DISTANCE_FRAME_VERSION | DISTANCE_FRAME_DELTA;
+    d[1] = (uint8_t)(byte(rng) % 40);
+    FrameSample out[DISTANCE_FRAME_MAX_SAMPLES];
+    if (decodeDistanceFrame(d.data(), d.size(), out, 4) >= 0) decoded++;
+  }
+  printf("  random delta frames: 200000, decoded %u\n", decoded);
+
+  DistanceFrameEncoder header;
+  header.setDelta(true);
+  header.reset(DISTANCE_FRAME_BACKFILL);
+  header.header(42, 7);
+  FrameSample none[1];
+  DistanceFrameInfo info;
+  expect("header-only delta frame",
+         decodeDistanceFrame(header.data(), header.size(), none, 1, &info) == 0 && info.seq == 42 &&
+           info.flags == (DISTANCE_FRAME_BACKFILL | DISTANCE_FRAME_DELTA));
+}
+
+// Reporter decisions on hand-picked readings
+static void testReporter() {
+  printf("\nreporter\n");
+  SensorConfig cfg = { 1000, DSP_FILTER_MOVING_AVERAGE, 5, 300, 5, SEND_ON_CHANGE, 10000 };
+  DeltaReporter r;
+  r.configure(cfg);
+  float v;
+  bool ok = r.update(0, 20.0f, v) == REPORT_CHANGE && v == 20.0f;
+  ok = ok && r.update(1000, 20.4f, v) == REPORT_SKIP_UNCHANGED;
+  ok = ok && r.update(2000, 19.6f, v) == REPORT_SKIP_UNCHANGED;  // 0.4 cm from 20.0: still held
+  ok = ok && r.update(3000, 20.6f, v) == REPORT_CHANGE && v == 20.6f;
+  expect("deadband against the last value sent", ok);
+
+  ok = r.update(4000, NAN, v) == REPORT_RANGE && isnan(v);
+  ok = ok && r.update(5000, 35.0f, v) == REPORT_SKIP_RANGE;
+  ok = ok && r.update(6000, NAN, v) == REPORT_SKIP_NO_READING;
+  ok = ok && r.update(7000, 20.6f, v) == REPORT_RANGE && v == 20.6f;
+  expect("leaving and entering the range sent once", ok);
+
+  ok = true;
+  for (uint32_t t = 8000; t < 17000; t += 1000) ok = ok && r.update(t, 20.6f, v) == REPORT_SKIP_UNCHANGED;
+  ok = ok && r.update(17000, 20.6f, v) == REPORT_HEARTBEAT && r.update(18000, 20.6f, v) == REPORT_SKIP_UNCHANGED;
+  r.update(19000, 50.0f, v);
+  ok = ok && r.update(29000, 50.0f, v) == REPORT_HEARTBEAT && isnan(v);  // out of range: the heartbeat says so
+  expect("heartbeat after heartbeatMs of silence", ok && r.heartbeats() == 2);
+
+  cfg.mode = SEND_PERIODIC;
+  r.configure(cfg);
+  ok = r.update(0, 20.0f, v) == REPORT_SAMPLE && r.update(1000, 20.0f, v) == REPORT_SAMPLE;
+  ok = ok && r.update(2000, 30.0f, v) == REPORT_SKIP_RANGE && r.update(3000, NAN, v) == REPORT_SKIP_NO_READING;
+  expect("periodic: every reading under the threshold", ok);
+
+  // Filling in: on the ping grid, nothing across a silence past the heartbeat
+  SeriesReconstructor s;
+  s.begin(1000, 10000);
+  std::vector<uint32_t> at;
+  auto fill = [&](uint32_t t, float) { at.push_back(t); };
+  s.add(0, 20.0f, fill);
+  size_t held = s.add(4003, 21.0f, fill);
+  ok = held == 3 && at[0] == 1000 && at[2] == 3000;
+  ok = ok && s.add(4003 + 30000, 21.0f, fill) == 0 && s.gaps() == 1;
+  s.begin(0, 10000);
+  ok = ok && s.add(0, 20.0f, fill) == 0 && s.add(5000, 20.0f, fill) == 0;
+  expect("client fills holds on the ping grid", ok);
+}
+
+// Replay: one ping per trace point through the server's filter and send
+// policy, batched into frames the way the server flushes them, decoded and
+// filled in the way the client does. The baseline is the old behaviour:
+// every reading under the threshold, fixed-size samples.
+struct TracePoint {
+  uint32_t t_ms;
+  float cm;  // raw, NaN = no echo
+};
+
+struct Trace {
+  std::string name;
+  uint32_t intervalMs;
+  std::vector<TracePoint> points;
+};
+
+struct Batcher {
+  explicit Batcher(bool delta) {
+    enc.setMtu(SIM_MTU);
+    enc.setDelta(delta);
+  }
+
+  void add(uint16_t seq, uint32_t t, float cm) {
+    if (!enc.empty() && (int32_t)(t - deadline) >= 0) send();  // the flush timer got there first
+    if (!enc.add(seq, t, cm)) {
+      send();
+      enc.add(seq, t, cm);
+    }
+    if (enc.count() == 1) deadline = t + 1000;  // BATCH_FLUSH_MS
+    if (enc.full()) send();
+  }
+
+  void send() {
+    if (enc.empty()) return;
+    notifications++;
+    bytes += enc.size();
+    frames.emplace_back(enc.data(), enc.data() + enc.size());
+    enc.reset();
+  }
+
+  DistanceFrameEncoder enc;
+  uint32_t deadline = 0;
+  uint32_t notifications = 0;
+  uint32_t bytes = 0;
+  std::vector<std::vector<uint8_t>> frames;
+};
+
+struct ReplayResult {
+  uint32_t readings = 0;
+  uint32_t periodicNotifications = 0, periodicBytes = 0;
+  uint32_t notifications = 0, bytes = 0, fixedBytes = 0;
+  uint32_t backfillFixedBytes = 0, backfillBytes = 0;
+  uint32_t sent = 0, heartbeats = 0, longestSilenceMs = 0;
+  uint32_t compared = 0, presenceErrors = 0;
+  bool aligned = false;
+  double sqErr = 0;
+  float maxErr = 0;
+};
+
+static ReplayResult replay(const Trace& trace, const SensorConfig& cfg) {
+  ReplayResult r;
+  SensorConfig periodic = cfg;
+  periodic.mode = SEND_PERIODIC;
+  ConfigurableFilter filter(cfg.filter, cfg.window);
+  DeltaReporter base, onChange;
+  base.configure(periodic);
+  onChange.configure(cfg);
+  Batcher baseOut(false), fixedOut(false), deltaOut(true);
+  DistanceFrameEncoder bulk[2];  // a later backfill of the same samples: full frames
+  bulk[1].setDelta(true);
+  uint32_t* bulkBytes[2] = { &r.backfillFixedBytes, &r.backfillBytes };
+
+  // What the client would know with every reading: NaN out of range
+  std::vector<float> truth;
+  int firstSent = -1, lastSent = -1;
+  uint32_t lastSentMs = 0;
+  uint16_t seq = 0;
+  for (const TracePoint& p : trace.points) {
+    float denoised = filter.update(p.cm);
+    bool in = !isnan(denoised) && (cfg.thresholdMm == 0 || denoised * 10.0f < cfg.thresholdMm);
+    truth.push_back(in ? denoised : NAN);
+
+    float v;
+    if (reportSends(base.update(p.t_ms, denoised, v))) baseOut.add(seq, p.t_ms, v);
+    if (reportSends(onChange.update(p.t_ms, denoised, v))) {
+      fixedOut.add(seq, p.t_ms, v);
+      deltaOut.add(seq, p.t_ms, v);
+      for (int k = 0; k < 2; k++) {
+        bulk[k].setMtu(SIM_MTU);
+        if (bulk[k].add(seq, p.t_ms, v)) continue;
+        *bulkBytes[k] += bulk[k].size();
+        bulk[k].reset();
+        bulk[k].add(seq, p.t_ms, v);
+      }
+      seq++;
+      if (firstSent >= 0 && p.t_ms - lastSentMs > r.longestSilenceMs) r.longestSilenceMs = p.t_ms - lastSentMs;
+      if (firstSent < 0) firstSent = (int)truth.size() - 1;
+      lastSent = (int)truth.size() - 1;
+      lastSentMs = p.t_ms;
+    }
+  }
+  baseOut.send();
+  fixedOut.send();
+  deltaOut.send();
+  for (int k = 0; k < 2; k++) *bulkBytes[k] += bulk[k].empty() ? 0 : bulk[k].size();
+
+  // Client: decode, fill in, line up with the pings from the first sent
+  SeriesReconstructor series;
+  series.begin(cfg.intervalMs, cfg.heartbeatMs);
+  std::vector<float> rebuilt;
+  for (const auto& frame : deltaOut.frames) {
+    FrameSample samples[DISTANCE_FRAME_MAX_SAMPLES];
+    int n = decodeDistanceFrame(frame.data(), frame.size(), samples, DISTANCE_FRAME_MAX_SAMPLES);
+    for (int i = 0; i < n; i++) {
+      series.add(samples[i].t_ms, samples[i].cm, [&](uint32_t, float cm) { rebuilt.push_back(cm); });
+      rebuilt.push_back(samples[i].cm);
+    }
+  }
+
+  r.aligned = firstSent >= 0 && rebuilt.size() == (size_t)(lastSent - firstSent + 1);
+  for (size_t i = 0; r.aligned && i < rebuilt.size(); i++) {
+    float want = truth[firstSent + i];
+    r.compared++;
+    if (isnan(want) != isnan(rebuilt[i])) {
+      r.presenceErrors++;
+    } else if (!isnan(want)) {
+      float err = fabsf(want - rebuilt[i]) * 10.0f;  // mm
+      r.sqErr += err * err;
+      if (err > r.maxErr) r.maxErr = err;
+    }
+  }
+
+  r.readings = trace.points.size();
+  r.periodicNotifications = baseOut.notifications;
+  r.periodicBytes = baseOut.bytes;
+  r.notifications = deltaOut.notifications;
+  r.bytes = deltaOut.bytes;
+  r.fixedBytes = fixedOut.bytes;
+  r.sent = onChange.sent();
+  r.heartbeats = onChange.heartbeats();
+  return r;
+}
+
+// Synthetic traces of an hour, raw readings with HC-SR04-like noise and the
+// odd missed echo, at the given ping interval
+static Trace synthetic(const char* name, uint32_t intervalMs, std::mt19937& rng,
+                       std::function<float(double tSec, std::mt19937&)> position) {
+  Trace trace{ name, intervalMs, {} };
+  std::normal_distribution<float> noise(0.0f, 0.3f);
+  std::uniform_real_distribution<float> unit(0, 1);
+  std::uniform_int_distribution<uint32_t> collect(35, 40);  // echo timeout plus retries
+  for (uint32_t t = 0; t < 3600000; t += intervalMs) {
+    float cm = position(t / 1000.0, rng) + noise(rng);
+    trace.points.push_back({ t + collect(rng), unit(rng) < 0.01f ? NAN : cm });
+  }
+  return trace;
+}
+
+// "seconds,cm" per line, one ping each; negative cm = no echo
+static bool loadTrace(const char* path, Trace& trace) {
+  FILE* f = fopen(path, "r");
+  if (!f) return false;
+  char line[128];
+  double t;
+  float cm;
+  while (fgets(line, sizeof(line), f)) {
+    if (sscanf(line, "%lf,%f", &t, &cm) == 2) trace.points.push_back({ (uint32_t)(t * 1000.0), cm < 0 ? NAN : cm });
+  }
+  fclose(f);
+  if (trace.points.size() < 2) return false;
+
+  // The ping interval is the typical step between points
+  std::vector<uint32_t> steps;
+  for (size_t i = 1; i < trace.points.size(); i++) steps.push_back(trace.points[i].t_ms - trace.points[i - 1].t_ms);
+  std::nth_element(steps.begin(), steps.begin() + steps.size() / 2, steps.end());
+  trace.intervalMs = std::max<uint32_t>(CONFIG_INTERVAL_MIN_MS, std::min<uint32_t>(CONFIG_INTERVAL_MAX_MS, steps[steps.size() / 2]));
+  const char* base = strrchr(path, '/');
+  trace.name = base ? base + 1 : path;
+  return true;
+}
+
+static void testSendOnDelta(std::mt19937& rng, const char* tracePath) {
+  testDeltaFrames(rng);
+  testReporter();
+
+  // Each trace gets a fresh copy of its shape, state and all
+  std::uniform_real_distribution<float> unit(0, 1);
+  auto still = [](double, std::mt19937&) { return 18.0f; };
+  auto approach = [](double t, std::mt19937&) {
+    double phase = fmod(t, 3600.0) / 1800.0;
+    return (float)(phase < 1 ? 28 - 22 * phase : 6 + 22 * (phase - 1));
+  };
+  auto steps = [unit, step = 15.0f, next = 0.0](double t, std::mt19937& g) mutable {
+    if (t >= next) {
+      step = 5 + 23 * unit(g);
+      next = t + 60 + 120 * unit(g);
+    }
+    return step;
+  };
+  auto waves = [unit, until = -1.0, next = 0.0](double t, std::mt19937& g) mutable {
+    if (t >= next) {
+      until = t + 5 + 15 * unit(g);
+      next = until + 30 + 120 * unit(g);
+    }
+    return t < until ? (float)(16 + 8 * sin(t * 2.1)) : 80.0f;
+  };
+  auto fidget = [walk = 20.0f](double, std::mt19937& g) mutable {
+    std::normal_distribution<float> drift(0.0f, 0.05f);
+    walk = std::max(8.0f, std::min(27.0f, walk + drift(g)));
+    return walk;
+  };
+  const std::pair<const char*, std::function<float(double, std::mt19937&)>> shapes[] = {
+    { "still target", still }, { "slow approach", approach }, { "repositioned", steps },
+    { "hand waves", waves },   { "fidgeting", fidget },
+  };
+
+  std::vector<Trace> traces;
+  for (uint32_t interval : { 1000u, 200u }) {
+    for (const auto& s : shapes) traces.push_back(synthetic(s.first, interval, rng, s.second));
+  }
+  if (tracePath) {
+    Trace recorded;
+    if (loadTrace(tracePath, recorded)) traces.push_back(recorded);
+    else {
+      printf("cannot read trace %s\n", tracePath);
+      failures++;
+    }
+  }
+
+  printf("\n%-16s %-4s %5s %7s %15s %15s %8s %6s %6s %5s %7s %7s\n", "send on change", "", "ms", "pings",
+         "periodic n/B", "on change n/B", "fixed B", "saved", "bf B", "hb", "rms mm", "max mm");
+  for (const Trace& trace : traces) {
+    SensorConfig cfg = { (uint16_t)trace.intervalMs, DSP_FILTER_MOVING_AVERAGE, 5, 300, 5, SEND_ON_CHANGE, 10000 };
+    ReplayResult r = replay(trace, cfg);
+
+    // Every reading comes back within the deadband (plus the 0.5 mm the
+    // frame rounds to), in or out of range as it was, and the server never
+    // goes quiet for longer than a heartbeat and a ping
+    float bound = cfg.deadbandMm + 0.5f + 1e-3f;
+    uint32_t silenceMax = cfg.heartbeatMs + trace.intervalMs + 10;
+    bool ok = r.aligned && r.presenceErrors == 0 && r.maxErr <= bound && r.longestSilenceMs <= silenceMax &&
+              r.bytes <= r.fixedBytes && r.backfillBytes < r.backfillFixedBytes;
+    double saved = r.periodicNotifications ? 100.0 * (1.0 - (double)r.notifications / r.periodicNotifications) : 0;
+    if (trace.name == "still target") ok = ok && saved >= 80;
+
+    char periodic[24], changed[24];
+    snprintf(periodic, sizeof(periodic), "%u/%u", r.periodicNotifications, r.periodicBytes);
+    snprintf(changed, sizeof(changed), "%u/%u", r.notifications, r.bytes);
+    double rms = r.compared ? sqrt(r.sqErr / r.compared) : 0;
+    double backfill = r.backfillFixedBytes ? 100.0 * r.backfillBytes / r.backfillFixedBytes : 0;
+    printf("%-16.16s %-4s %5u %7u %15s %15s %8u %5.0f%% %5.0f%% %5u %7.2f %7.2f\n", trace.name.c_str(),
+           ok ? "ok" : "FAIL", trace.intervalMs, r.readings, periodic, changed, r.fixedBytes, saved, backfill,
+           r.heartbeats, rms, r.maxErr);
+    if (!ok) failures++;
+  }
+}
+
+int main(int argc, char** argv) {
+  uint32_t seed = 1;
+  const char* tracePath = nullptr;
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "--seed") && i + 1 < argc) seed = (uint32_t)atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--trace") && i + 1 < argc) tracePath = argv[++i];
+    else {
+      fprintf(stderr, "usage: %s [--seed S] [--trace seconds,cm.csv]\n", argv[0]);
+      return 2;
+    }
+  }
+
+  std::mt19937 rng(seed);
+  testEchoTimer(rng);
+  testFilters(rng);
+  testFrames(rng);
+  testLinkProfiles(rng);
+  testBackfill(rng);
+  testSettings(rng);
+  testSendOnDelta(rng, tracePath);
+
+  printf("\n%s: %d failed\n", failures ? "FAIL" : "ok", failures);
+  return failures ? 1 : 0;
+}
@@ -4,6 +4,15 @@
 #include <BLEUtils.h>
 #include <BLE2902.h>
 #include <stdlib.h>
+#include <HCSR04Ranger.h>
+#include <StreamFilters.h>
+#include <DistanceFrame.h>
+#include <CoopScheduler.h>
+#include <BleLink.h>
+#include <SampleBackfill.h>
+#include <SpscRing.h>
+#include <SensorConfig.h>
+#include <SendOnDelta.h>
 
 // ====================== BLE ======================
 BLEServer* pServer = NULL;
@@ -12,77 +21,394 @@ BLECharacteristic* pCharacteristic = NULL;
 bool deviceConnected = false;
 bool oldDeviceConnected = false;
 
-unsigned long previousMillis = 0;
-const long interval = 1000;  // print/send interval (ms)
-
 // Print device name periodically so it is guaranteed to appear in your screenshot
-unsigned long namePrintMillis = 0;
 const long namePrintInterval = 5000;
 
+// Batching: samples are packed into one binary frame per notification,
+// flushed when the frame fills the MTU or its oldest sample is this old.
+// Frames are delta-encoded (shared_lib/DistanceFrame), about 2 bytes a sample.
+const unsigned long BATCH_FLUSH_MS = 1000;
+DistanceFrameEncoder frame;
+uint16_t sampleSeq = 0;
+volatile uint16_t negotiatedMtu = 23;
+uint8_t clientAddr[6] = {};
+
+// Link profile: streaming while the client discovers the service and while
+// the data rate or backlog is high, low power otherwise. A build flag pins
+// one profile: -D BLE_LINK_PROFILE=LINK_PROFILE_LOW_POWER etc.
+#if BLE_LINK_PROFILE == LINK_PROFILE_LOW_POWER
+static const LinkProfile CONNECT_PROFILE = LINK_LOW_POWER;
+#else
+static const LinkProfile CONNECT_PROFILE = LINK_STREAMING;
+#endif
+static const uint32_t LINK_TUNE_MS = 1000;
+static const uint32_t LINK_REPORT_MS = 5000;
+
+LinkProfileSelector linkSelector;
+RateMeter notifyRate;
+RateMeter notifyBytes;
+
+// Catch-up: every sample is numbered and kept, connected or not, so a client
+// that reconnects can ask for what it missed (shared_lib/SampleBackfill). The
+// history takes a fixed share of the heap left after BLE is up, so the rest
+// of the firmware keeps the same headroom whatever the board has free.
+static const size_t HISTORY_HEAP_DIVISOR = 4;  // at most a quarter of the free heap
+SampleHistory history;
+BackfillSender backfill;
+DistanceFrameEncoder bulkFrame;
+SpscRing<DistanceControl, 8> controls;  // written by the client, BLE task -> loop
+
 // Server device name (will show in Serial Monitor)
 static const char* SERVER_NAME = "BLE_SERVER";
 
 // UUIDs
 #define SERVICE_UUID        "724fc8e5-485e-467c-a7b9-ef2796515386"
 #define CHARACTERISTIC_UUID "976e3398-600d-4d49-ac5d-95383f1c14da"
+#define CONFIG_UUID         "976e3398-600d-4d49-ac5d-95383f1c14db"
 
 // ====================== HC-SR04 Pins ======================
 static const int TRIG_PIN = 4; 
 static const int ECHO_PIN = 5;
 
-// ====================== DSP: Moving Average ======================
-static const int MA_WINDOW = 5;
-float maBuffer[MA_WINDOW];
-int maIndex = 0;
-int maCount = 0;
+HCSR04Ranger ranger(TRIG_PIN, ECHO_PIN);
+
+// ====================== Settings ======================
+// Ping interval, filter and send policy. These are the defaults; a client
+// writes commands to the config characteristic to change them at run time
+// (shared_lib/SensorConfig) and they are kept in NVS across resets. The
+// default kernel still comes from the build: -D DSP_FILTER=DSP_FILTER_MEDIAN etc.
+// Readings go out on change (shared_lib/SendOnDelta): a target that stays
+// put costs a heartbeat every 10 s instead of a notification every second.
+#ifndef DSP_FILTER
+#define DSP_FILTER DSP_FILTER_MOVING_AVERAGE
+#endif
+
+static const SensorConfig DEFAULT_CONFIG = {
+  1000,           // ping every second
+  DSP_FILTER, 5,  // kernel, window
+  300,            // send below 30 cm
+  5,              // deadband: above the filtered noise of a still target
+  SEND_ON_CHANGE,
+  10000,          // heartbeat
+};
+
+SensorConfig config = DEFAULT_CONFIG;
+ConfigStatus lastConfigStatus = CONFIG_OK;
+ConfigStore configStore;
+BLECharacteristic* pConfigCharacteristic = NULL;
+
+struct ConfigWrite {
+  uint8_t length;
+  uint8_t data[CONFIG_WRITE_MAX + 1];  // one past the limit, so an overlong write still fails
+};
+SpscRing<ConfigWrite, 4> configWrites;  // BLE task -> loop
+
+// ====================== DSP: Streaming Filter ======================
+ConfigurableFilter distanceFilter(DEFAULT_CONFIG.filter, DEFAULT_CONFIG.window);
 
 float rawDistanceCm = NAN;
 float denoisedDistanceCm = NAN;
+DeltaReporter reporter;
+
+// ====================== Scheduler ======================
+// loop() only runs what is due. The BLE link does not survive light sleep,
+// so idle time blocks the loop task and lets FreeRTOS modem-sleep instead.
+static const uint32_t ECHO_COLLECT_MS = 35;        // past the ranger's 30 ms echo timeout
+static const uint32_t ECHO_RETRY_MS = 5;
+static const uint32_t READVERTISE_DELAY_MS = 500;  // let the stack finish the disconnect
+
+CoopScheduler<10> scheduler(SchedulerIdle::millisClock);
+TaskId collectTask = NO_TASK;
+TaskId flushTask = NO_TASK;
+TaskId linkTask = NO_TASK;
+TaskId advertiseTask = NO_TASK;
+TaskId backfillTask = NO_TASK;
+TaskId pingTask = NO_TASK;
+TaskId configTask = NO_TASK;
 
 // ====================== BLE Callbacks ======================
 class MyServerCallbacks : public BLEServerCallbacks {
-  void onConnect(BLEServer* pServer) override {
+  void onConnect(BLEServer* pServer, esp_ble_gatts_cb_param_t* param) override {
+    memcpy(clientAddr, param->connect.remote_bda, sizeof(clientAddr));
+    BleLink::opened(clientAddr);
     deviceConnected = true;
+    scheduler.post(linkTask);
     Serial.print("Client connected to ");
     Serial.println(SERVER_NAME);
   }
 
   void onDisconnect(BLEServer* pServer) override {
     deviceConnected = false;
+    negotiatedMtu = 23;
+    BleLink::closed(clientAddr);
+    scheduler.post(linkTask);
     Serial.print("Client disconnected from ");
     Serial.println(SERVER_NAME);
   }
+
+  void onMtuChanged(BLEServer* pServer, esp_ble_gatts_cb_param_t* param) override {
+    negotiatedMtu = param->mtu.mtu;
+    BleLink::setMtu(clientAddr, negotiatedMtu);
+  }
 };
 
+// Control writes: BACKFILL on reconnect, ACKs while it runs
+class ControlCallbacks : public BLECharacteristicCallbacks {
+  void onWrite(BLECharacteristic* pCharacteristic) override {
+    std::string value = pCharacteristic->getValue();
+    DistanceControl control;
+    if (!decodeDistanceControl((const uint8_t*)value.data(), value.size(), control)) return;
+    if (controls.push(control)) scheduler.post(backfillTask);
+  }
+};
+
+// Settings commands, applied by configChanged() in the loop
+class ConfigCallbacks : public BLECharacteristicCallbacks {
+  void onWrite(BLECharacteristic* pCharacteristic) override {
+    std::string value = pCharacteristic->getValue();
+    ConfigWrite* write = configWrites.acquire();
+    if (write == nullptr) return;
+    write->length = value.size() < sizeof(write->data) ? value.size() : sizeof(write->data);
+    memcpy(write->data, value.data(), write->length);
+    configWrites.commit();
+    scheduler.post(configTask);
+  }
+};
+
+// ====================== BLE Frame Transmit ======================
+void notifyFrame(const DistanceFrameEncoder& out) {
+  pCharacteristic->setValue((uint8_t*)out.data(), out.size());
+  pCharacteristic->notify();
+  linkSelector.produced(out.size());
+  notifyRate.add();
+  notifyBytes.add(out.size());
+}
+
+void sendFrame() {
+  if (!frame.empty()) {
+    notifyFrame(frame);
+
+    Serial.print("BLE frame sent: ");
+    Serial.print(frame.count());
+    Serial.print(" sample(s), ");
+    Serial.print(frame.size());
+    Serial.println(" bytes");
+  }
+
+  frame.reset();
+  frame.setMtu(negotiatedMtu);  // pick up a newly negotiated MTU between frames
+}
+
 // ====================== HC-SR04 Reading ======================
-float readDistanceCm() {
-  digitalWrite(TRIG_PIN, LOW);
-  delayMicroseconds(2);
-  digitalWrite(TRIG_PIN, HIGH);
-  delayMicroseconds(10);
-  digitalWrite(TRIG_PIN, LOW);
-
-  // Timeout avoids blocking forever
-  unsigned long duration = pulseIn(ECHO_PIN, HIGH, 30000);
-  if (duration == 0) return NAN;
-
-  // Distance(cm) = duration(us) * 0.0343 / 2
-  return (duration * 0.0343f) / 2.0f;
-}
-
-// ====================== DSP Algorithm: Moving Average ======================
-float movingAverage(float x) {
-  if (!isnan(x)) {
-    maBuffer[maIndex] = x;
-    maIndex = (maIndex + 1) % MA_WINDOW;
-    if (maCount < MA_WINDOW) maCount++;
+// Non-blocking: the echo is timed in a GPIO interrupt, loop() only collects
+// finished samples, so BLE keeps being serviced while the ping is in flight.
+bool readDistanceCm(float& distanceCm) {
+  RangeSample sample;
+  if (!ranger.poll(sample)) return false;
+
+  distanceCm = sample.valid() ? sample.cm() : NAN;
+  return true;
+}
+
+// ====================== Tasks ======================
+// Periodically print server name (helps screenshot)
+void printName(void*) {
+  Serial.print("Server Device Name: ");
+  Serial.println(SERVER_NAME);
+}
+
+// Fire one ping per interval; the result is collected once the echo is due
+void firePing(void*) {
+  if (ranger.trigger()) scheduler.restart(collectTask, ECHO_COLLECT_MS);
+}
+
+// DSP + print + conditional BLE transmit for each finished ping
+void collectPing(void*) {
+  if (!readDistanceCm(rawDistanceCm)) {
+    scheduler.restart(collectTask, ECHO_RETRY_MS);
+    return;
+  }
+
+  denoisedDistanceCm = distanceFilter.update(rawDistanceCm);
+
+  // Print raw and denoised
+  Serial.print("raw_cm=");
+  if (isnan(rawDistanceCm)) Serial.print("NaN");
+  else Serial.print(rawDistanceCm, 2);
+
+  Serial.print(" | denoised_cm=");
+  if (isnan(denoisedDistanceCm)) Serial.print("NaN");
+  else Serial.print(denoisedDistanceCm, 2);
+
+  // Send policy: every reading in range, or only changes and heartbeats
+  uint32_t now = millis();
+  float value;
+  ReportDecision decision = reporter.update(now, denoisedDistanceCm, value);
+  bool shouldSend = reportSends(decision);
+
+  // Numbered and kept whether or not anyone listens, for backfill
+  uint16_t seq = sampleSeq;
+  if (shouldSend) {
+    history.add(seq, now, value);
+    sampleSeq++;
+  }
+
+  if (deviceConnected && shouldSend) {
+    // Queue the value; the frame goes out when full or aged
+    if (!frame.add(seq, now, value)) {
+      sendFrame();
+      frame.add(seq, now, value);
+    }
+
+    // The first sample of a frame starts its flush deadline
+    if (frame.count() == 1) scheduler.restart(flushTask, BATCH_FLUSH_MS);
+
+    Serial.printf(" | BLE queued #%u (%s)\n", (unsigned)frame.count(), reportDecisionName(decision));
+    if (frame.full()) {
+      sendFrame();
+      scheduler.cancel(flushTask);
+    }
   } else {
-    if (maCount == 0) return NAN;
+    Serial.print(" | BLE not sent");
+    Serial.printf(" (%s)\n", !shouldSend ? reportDecisionName(decision) : "no client");
+  }
+}
+
+// Flush a partial frame once its oldest sample has waited long enough
+void flushFrame(void*) {
+  if (deviceConnected) sendFrame();
+}
+
+// Posted by the connect/disconnect callbacks
+void linkChanged(void*) {
+  // reconnect advertising when disconnected
+  if (!deviceConnected && oldDeviceConnected) {
+    frame.reset();
+    scheduler.cancel(flushTask);
+    backfill.stop();
+    scheduler.post(backfillTask);  // drops writes still queued
+    scheduler.restart(advertiseTask, READVERTISE_DELAY_MS);
+    oldDeviceConnected = deviceConnected;
+  }
+
+  if (deviceConnected && !oldDeviceConnected) {
+    frame.setMtu(negotiatedMtu);
+    reporter.restart();  // the client's hold starts from a fresh value
+    linkSelector.reset(millis(), CONNECT_PROFILE);
+    BleLink::apply(clientAddr, CONNECT_PROFILE);
+    notifyRate.sample(millis());
+    notifyBytes.sample(millis());
+    oldDeviceConnected = deviceConnected;
   }
+}
+
+// Replay what the client asked for, a window of frames per ACK. Posted by
+// each control write, re-armed for the ACK timeout while frames are out.
+void pumpBackfill(void*) {
+  uint32_t now = millis();
+  bool wasActive = backfill.active();
+
+  DistanceControl control;
+  while (controls.pop(control)) {
+    if (!deviceConnected) continue;
+    if (control.op == DISTANCE_CTRL_ACK) {
+      backfill.ack(control.seq, now);
+      continue;
+    }
+    // Up to the first sample the live stream carries on this connection
+    uint16_t until = sampleSeq - frame.count();
+    backfill.start(control.seq, until, now);
+    Serial.printf("Backfill requested from #%u: %u sample(s) up to #%u, history #%u..#%u\n", control.seq,
+                  (uint16_t)(until - control.seq), until, history.oldestSeq(), history.nextSeq());
+  }
+  if (!deviceConnected) return;
+
+  bulkFrame.setMtu(negotiatedMtu);
+  while (backfill.next(bulkFrame, history, now)) notifyFrame(bulkFrame);
+
+  if (wasActive && !backfill.active()) {
+    Serial.printf("Backfill done: %lu frame(s), %lu rewind(s) in total\n", (unsigned long)backfill.frames(),
+                  (unsigned long)backfill.rewinds());
+  }
+  uint32_t wait = backfill.wait(now);
+  if (wait != 0xFFFFFFFFu) scheduler.restart(backfillTask, wait);
+}
+
+// Settings into the filter, the ping task and the send policy. With the
+// settings they replace, only what changed is touched: configure() starts
+// the filter over, which a new deadband or heartbeat should not do.
+void applyConfig(const SensorConfig* before = nullptr) {
+  if (!before || before->filter != config.filter || before->window != config.window) {
+    distanceFilter.configure(config.filter, config.window);
+  }
+  if (!before || before->intervalMs != config.intervalMs) scheduler.setPeriod(pingTask, config.intervalMs);
+  reporter.configure(config);
+}
 
-  float sum = 0.0f;
-  for (int i = 0; i < maCount; i++) sum += maBuffer[i];
-  return (maCount > 0) ? (sum / maCount) : NAN;
+// What a read of the config characteristic returns: settings and the
+// status of the last write
+void publishConfig() {
+  uint8_t blob[CONFIG_BLOB_SIZE];
+  size_t n = encodeConfigBlob(config, lastConfigStatus, blob);
+  pConfigCharacteristic->setValue(blob, n);
+}
+
+// Posted by each write: apply, keep in NVS, report
+void configChanged(void*) {
+  while (const ConfigWrite* write = configWrites.peek()) {
+    SensorConfig next = config;
+    lastConfigStatus = applyConfigCommands(write->data, write->length, DEFAULT_CONFIG, next);
+    configWrites.release();
+
+    char text[96];
+    if (lastConfigStatus == CONFIG_OK) {
+      bool changed = next != config;
+      SensorConfig before = config;
+      config = next;
+      if (changed) {
+        applyConfig(&before);
+        if (!configStore.save(config)) Serial.println("Settings: NVS write failed");
+      }
+      describeConfig(config, text, sizeof(text));
+      Serial.printf("Settings %s: %s\n", changed ? "changed" : "unchanged", text);
+    } else {
+      Serial.printf("Settings write rejected: %s\n", configStatusName(lastConfigStatus));
+    }
+    publishConfig();
+  }
+}
+
+// Follow the data rate: streaming when it outgrows the low-power link. A
+// replay still to go counts as backlog.
+void tuneLink(void*) {
+  uint32_t backlog = frame.size() + backfill.remaining() * DISTANCE_FRAME_SAMPLE_SIZE;
+  if (!deviceConnected || !linkSelector.update(millis(), backlog)) return;
+
+  BleLink::apply(clientAddr, linkSelector.profile());
+  Serial.printf("Link profile -> %s (%.0f B/s)\n", linkProfileName(linkSelector.profile()),
+                linkSelector.bytesPerSec());
+}
+
+// What the controller agreed to, and what is going over it
+void printLink(void*) {
+  if (!deviceConnected) return;
+
+  LinkStatus status;
+  char text[96];
+  if (!BleLink::status(clientAddr, status)) return;
+  describeLink(status, text, sizeof(text));
+
+  uint32_t now = millis();
+  Serial.printf("Link (%s): %s | %.2f notif/s %.0f B/s | sent %lu of %lu readings, %lu heartbeat(s)\n",
+                linkProfileName(linkSelector.profile()), text, notifyRate.sample(now), notifyBytes.sample(now),
+                (unsigned long)reporter.sent(), (unsigned long)reporter.readings(),
+                (unsigned long)reporter.heartbeats());
+}
+
+void restartAdvertising(void*) {
+  if (deviceConnected) return;
+  pServer->startAdvertising();
+  Serial.println("Start advertising again");
 }
 
 void setup() {
@@ -94,16 +420,38 @@ void setup() {
   Serial.print("Server Device Name: ");
   Serial.println(SERVER_NAME);
 
-  // HC-SR04 pins
-  pinMode(TRIG_PIN, OUTPUT);
-  pinMode(ECHO_PIN, INPUT);
-  digitalWrite(TRIG_PIN, LOW);
-
-  // Init moving average buffer
-  for (int i = 0; i < MA_WINDOW; i++) maBuffer[i] = 0.0f;
+  // HC-SR04 pins + echo interrupt
+  ranger.begin();
+  frame.setDelta(true);
+  bulkFrame.setDelta(true);
+
+  // Stored settings, or the defaults on first boot
+  char text[96];
+  bool stored = configStore.load(config);
+  describeConfig(config, text, sizeof(text));
+  Serial.printf("Settings (%s): %s\n", stored ? "NVS" : "defaults", text);
+
+  // Tasks exist before BLE can post connection changes
+  SchedulerIdle::begin(false);
+  scheduler.onPost(SchedulerIdle::wake);
+  scheduler.every(namePrintInterval, printName);
+  scheduler.every(LINK_REPORT_MS, printLink);
+#if BLE_LINK_PROFILE == LINK_PROFILE_AUTO
+  scheduler.every(LINK_TUNE_MS, tuneLink);
+#endif
+  pingTask = scheduler.every(config.intervalMs, firePing);
+  applyConfig();
+  collectTask = scheduler.timer(collectPing);
+  flushTask = scheduler.timer(flushFrame);
+  linkTask = scheduler.onEvent(linkChanged);
+  advertiseTask = scheduler.timer(restartAdvertising);
+  backfillTask = scheduler.timer(pumpBackfill);
+  configTask = scheduler.onEvent(configChanged);
 
   // BLE init
   BLEDevice::init(SERVER_NAME);
+  BLEDevice::setMTU(517);  // let the client's MTU request fill whole frames
+  BleLink::begin();
 
   pServer = BLEDevice::createServer();
   pServer->setCallbacks(new MyServerCallbacks());
@@ -114,84 +462,49 @@ void setup() {
     CHARACTERISTIC_UUID,
     BLECharacteristic::PROPERTY_READ |
     BLECharacteristic::PROPERTY_WRITE |
+    BLECharacteristic::PROPERTY_WRITE_NR |
     BLECharacteristic::PROPERTY_NOTIFY
   );
 
+  pCharacteristic->setCallbacks(new ControlCallbacks());
   pCharacteristic->addDescriptor(new BLE2902());
   pCharacteristic->setValue("Ready");
 
+  pConfigCharacteristic = pService->createCharacteristic(
+    CONFIG_UUID,
+    BLECharacteristic::PROPERTY_READ |
+    BLECharacteristic::PROPERTY_WRITE
+  );
+  pConfigCharacteristic->setCallbacks(new ConfigCallbacks());
+  publishConfig();
+
   pService->start();
 
   BLEAdvertising *pAdvertising = BLEDevice::getAdvertising();
   pAdvertising->addServiceUUID(SERVICE_UUID);
   pAdvertising->setScanResponse(true);
-  pAdvertising->setMinPreferred(0x06);
-  pAdvertising->setMinPreferred(0x12);
+  // Preferred connection interval range, so the first connection starts in
+  // the profile linkChanged() will ask for anyway
+  pAdvertising->setMinPreferred(LINK_PROFILES[CONNECT_PROFILE].minInterval);
+  pAdvertising->setMaxPreferred(LINK_PROFILES[CONNECT_PROFILE].maxInterval);
 
   BLEDevice::startAdvertising();
 
+  // A quarter of what BLE left, in one block, up to SAMPLE_HISTORY_MAX samples
+  size_t budget = ESP.getFreeHeap() / HISTORY_HEAP_DIVISOR;
+  if (budget > ESP.getMaxAllocHeap()) budget = ESP.getMaxAllocHeap();
+  size_t entries = budget / sizeof(HistoryEntry);
+  if (entries > SAMPLE_HISTORY_MAX) entries = SAMPLE_HISTORY_MAX;
+  HistoryEntry* storage = entries ? (HistoryEntry*)malloc(entries * sizeof(HistoryEntry)) : nullptr;
+  history.begin(storage, storage ? entries : 0);
+  Serial.printf("Sample history: %u samples (%u bytes)\n", (unsigned)history.capacity(),
+                (unsigned)(history.capacity() * sizeof(HistoryEntry)));
+
   Serial.println("Advertising started.");
   Serial.println("Characteristic defined.");
   Serial.println("Output: raw_cm, denoised_cm, BLE sent/not sent");
 }
 
 void loop() {
-  // Periodically print server name (helps screenshot)
-  unsigned long now = millis();
-  if (now - namePrintMillis >= namePrintInterval) {
-    namePrintMillis = now;
-    Serial.print("Server Device Name: ");
-    Serial.println(SERVER_NAME);
-  }
-
-  // Read + DSP + print + conditional BLE transmit once per interval
-  unsigned long currentMillis = millis();
-  if (currentMillis - previousMillis >= interval) {
-    previousMillis = currentMillis;
-
-    rawDistanceCm = readDistanceCm();
-    denoisedDistanceCm = movingAverage(rawDistanceCm);
-
-    // Print raw and denoised
-    Serial.print("raw_cm=");
-    if (isnan(rawDistanceCm)) Serial.print("NaN");
-    else Serial.print(rawDistanceCm, 2);
-
-    Serial.print(" | denoised_cm=");
-    if (isnan(denoisedDistanceCm)) Serial.print("NaN");
-    else Serial.print(denoisedDistanceCm, 2);
-
-    bool shouldSend = (!isnan(denoisedDistanceCm) && denoisedDistanceCm < 30.0f);
-
-if (deviceConnected && shouldSend) {
-      // Send only the denoised distance value as a float
-      char payload[16];
-      snprintf(payload, sizeof(payload), "%.2f", denoisedDistanceCm);
-
-      pCharacteristic->setValue(payload);
-      pCharacteristic->notify();
-
-      Serial.print(" | BLE sent: ");
-      Serial.println(payload);
-    } else {
-      Serial.print(" | BLE not sent");
-      if (!deviceConnected) Serial.print(" (no client)");
-      else Serial.print(" (>=30cm)");
-      Serial.println();
-    }
-  }
-
-  // reconnect advertising when disconnected
-  if (!deviceConnected && oldDeviceConnected) {
-    delay(500);
-    pServer->startAdvertising();
-    Serial.println("Start advertising again");
-    oldDeviceConnected = deviceConnected;
-  }
-
-  if (deviceConnected && !oldDeviceConnected) {
-    oldDeviceConnected = deviceConnected;
-  }
-
-  delay(10);
-}
\ No newline at end of file
+  SchedulerIdle::wait(scheduler.runReady());
+}
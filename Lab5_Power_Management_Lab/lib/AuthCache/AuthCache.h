@@ -0,0 +1,60 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+// ====================== Cached Firebase credentials ======================
+// Keeps the ID token and refresh token from the last sign-in in RTC memory,
+// so later wake-ups can skip the sign-in round trip while the token is still
+// valid. Declare the state RTC_DATA_ATTR in the sketch.
+struct AuthCacheState {
+  uint32_t magic;
+  uint32_t expiresAtMs;  // on the sleep-compensated clock
+  char idToken[1400];    // Firebase ID tokens are ~1 KB JWTs
+  char refreshToken[512];
+};
+
+class AuthCache {
+public:
+  static const uint32_t MAGIC = 0x41544B31;  // "ATK1"
+
+  explicit AuthCache(AuthCacheState& state) : s_(state) {}
+
+  // True if a token is cached and has more than marginMs left.
+  bool valid(uint32_t nowMs, uint32_t marginMs) const {
+    return s_.magic == MAGIC && s_.idToken[0] != '\0' &&
+           (int32_t)(s_.expiresAtMs - nowMs) > (int32_t)marginMs;
+  }
+
+  // Seconds of validity left, for handing the token back to the client.
+  uint32_t remainingSec(uint32_t nowMs) const {
+    int32_t left = (int32_t)(s_.expiresAtMs - nowMs);
+    return left > 0 ? (uint32_t)left / 1000 : 0;
+  }
+
+  // Returns false if a token does not fit (nothing is cached then).
+  bool store(const char* idToken, const char* refreshToken, uint32_t ttlSec, uint32_t nowMs) {
+    if (strlen(idToken) >= sizeof(s_.idToken) || strlen(refreshToken) >= sizeof(s_.refreshToken)) {
+      clear();
+      return false;
+    }
+    strcpy(s_.idToken, idToken);
+    strcpy(s_.refreshToken, refreshToken);
+    s_.expiresAtMs = nowMs + ttlSec * 1000;
+    s_.magic = MAGIC;
+    return true;
+  }
+
+  void clear() {
+    s_.magic = 0;
+    s_.idToken[0] = '\0';
+    s_.refreshToken[0] = '\0';
+  }
+
+  const char* idToken() const { return s_.idToken; }
+  const char* refreshToken() const { return s_.refreshToken; }
+
+private:
+  AuthCacheState& s_;
+};
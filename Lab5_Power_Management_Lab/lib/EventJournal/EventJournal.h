@@ -0,0 +1,102 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <EventUpload.h>
+
+// ====================== Flash spill interface ======================
+// Overflow storage for the journal. Records stay in arrival order.
+class JournalSpill {
+public:
+  virtual ~JournalSpill() {}
+  virtual size_t count() = 0;
+  virtual bool append(const MotionEvent* events, size_t n) = 0;
+  virtual size_t read(MotionEvent* out, size_t max) = 0;  // oldest first
+  virtual void drop(size_t n) = 0;                        // remove oldest n
+};
+
+// ====================== RTC journal ======================
+// Ring of motion events kept in RTC memory across deep sleep. When it fills,
+// the whole ring spills to flash in one write, so nothing is dropped while
+// uploads are deferred. Declare the state RTC_DATA_ATTR in the sketch.
+template <size_t N>
+struct JournalState {
+  uint32_t magic;
+  uint16_t count;
+  MotionEvent events[N];
+};
+
+template <size_t N>
+class EventJournal {
+public:
+  static const uint32_t MAGIC = 0x4A524E31;  // "JRN1"
+
+  EventJournal(JournalState<N>& state, JournalSpill* spill) : s_(state), spill_(spill) {}
+
+  // Call once per boot. RTC memory is garbage after a power-on reset.
+  void begin() {
+    if (s_.magic != MAGIC || s_.count > N) {
+      s_.magic = MAGIC;
+      s_.count = 0;
+    }
+  }
+
+  // Returns false only if the ring is full and the spill write failed.
+  bool append(const MotionEvent& event) {
+    if (s_.count == N && !spillRing()) return false;
+    s_.events[s_.count++] = event;
+    return true;
+  }
+
+  size_t size() { return spilled() + s_.count; }
+  bool empty() { return size() == 0; }
+
+  // Oldest pending event; false when the journal is empty.
+  bool oldest(MotionEvent& out) {
+    if (spilled() > 0) return spill_->read(&out, 1) == 1;
+    if (s_.count == 0) return false;
+    out = s_.events[0];
+    return true;
+  }
+
+  // Copies up to max of the oldest events; flash-spilled ones come first.
+  size_t peek(MotionEvent* out, size_t max) {
+    size_t n = spilled() > 0 ? spill_->read(out, max) : 0;
+    for (size_t i = 0; n < max && i < s_.count; i++) out[n++] = s_.events[i];
+    return n;
+  }
+
+  // Removes the n oldest events after they were uploaded.
+  void consume(size_t n) {
+    size_t fromSpill = spilled();
+    if (fromSpill > n) fromSpill = n;
+    if (fromSpill > 0) spill_->drop(fromSpill);
+    n -= fromSpill;
+
+    if (n >= s_.count) {
+      s_.count = 0;
+      return;
+    }
+    for (size_t i = n; i < s_.count; i++) s_.events[i - n] = s_.events[i];
+    s_.count -= n;
+  }
+
+  // Flush when enough events are queued or the oldest has waited too long.
+  bool shouldFlush(uint32_t nowMs, size_t countThreshold, uint32_t maxAgeMs) {
+    if (size() >= countThreshold) return true;
+    MotionEvent first;
+    return oldest(first) && (nowMs - first.timestamp_ms) >= maxAgeMs;
+  }
+
+private:
+  size_t spilled() { return spill_ ? spill_->count() : 0; }
+
+  bool spillRing() {
+    if (spill_ == nullptr || !spill_->append(s_.events, s_.count)) return false;
+    s_.count = 0;
+    return true;
+  }
+
+  JournalState<N>& s_;
+  JournalSpill* spill_;
+};
@@ -0,0 +1,62 @@
+#ifdef ARDUINO
+
+#include "NvsJournalSpill.h"
+
+static MotionEvent s_scratch[NvsJournalSpill::MAX_EVENTS];
+
+size_t NvsJournalSpill::load(MotionEvent* out) {
+  prefs_.begin(ns_, true);
+  size_t bytes = prefs_.getBytes("events", out, sizeof(s_scratch));
+  prefs_.end();
+  cachedCount_ = bytes / sizeof(MotionEvent);
+  return cachedCount_;
+}
+
+bool NvsJournalSpill::store(const MotionEvent* events, size_t n) {
+  prefs_.begin(ns_, false);
+  bool ok = n == 0 ? prefs_.remove("events") || !prefs_.isKey("events")
+                   : prefs_.putBytes("events", events, n * sizeof(MotionEvent)) == n * sizeof(MotionEvent);
+  prefs_.end();
+  cachedCount_ = ok ? (int)n : -1;
+  return ok;
+}
+
+size_t NvsJournalSpill::count() {
+  if (cachedCount_ < 0) {
+    prefs_.begin(ns_, true);
+    cachedCount_ = prefs_.getBytesLength("events") / sizeof(MotionEvent);
+    prefs_.end();
+  }
+  return cachedCount_;
+}
+
+bool NvsJournalSpill::append(const MotionEvent* events, size_t n) {
+  size_t have = load(s_scratch);
+  // Full: drop the oldest so the newest events survive
+  if (have + n > MAX_EVENTS) {
+    size_t excess = have + n - MAX_EVENTS;
+    if (excess > have) excess = have;
+    for (size_t i = excess; i < have; i++) s_scratch[i - excess] = s_scratch[i];
+    have -= excess;
+  }
+  for (size_t i = 0; i < n && have < MAX_EVENTS; i++) s_scratch[have++] = events[i];
+  return store(s_scratch, have);
+}
+
+size_t NvsJournalSpill::read(MotionEvent* out, size_t max) {
+  size_t have = load(s_scratch);
+  size_t n = have < max ? have : max;
+  for (size_t i = 0; i < n; i++) out[i] = s_scratch[i];
+  return n;
+}
+
+void NvsJournalSpill::drop(size_t n) {
+  size_t have = load(s_scratch);
+  if (n >= have) {
+    store(s_scratch, 0);
+    return;
+  }
+  store(s_scratch + n, have - n);
+}
+
+#endif
@@ -0,0 +1,30 @@
+#pragma once
+
+#ifdef ARDUINO
+
+#include <Preferences.h>
+#include "EventJournal.h"
+
+// Journal spill stored as a single NVS blob. Spills are rare (only when the
+// RTC ring fills before an upload), so rewriting the blob is acceptable.
+class NvsJournalSpill : public JournalSpill {
+public:
+  static const size_t MAX_EVENTS = 128;
+
+  explicit NvsJournalSpill(const char* ns = "journal") : ns_(ns) {}
+
+  size_t count() override;
+  bool append(const MotionEvent* events, size_t n) override;
+  size_t read(MotionEvent* out, size_t max) override;
+  void drop(size_t n) override;
+
+private:
+  size_t load(MotionEvent* out);
+  bool store(const MotionEvent* events, size_t n);
+
+  const char* ns_;
+  Preferences prefs_;
+  int cachedCount_ = -1;
+};
+
+#endif
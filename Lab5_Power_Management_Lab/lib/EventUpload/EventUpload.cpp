@@ -0,0 +1,102 @@
+#include "EventUpload.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+void UploadBuilder::reset() {
+  buf_[0] = '{';
+  buf_[1] = '\0';
+  len_ = 1;
+  fields_ = 0;
+  overflow_ = false;
+}
+
+void UploadBuilder::append(const char* text) {
+  size_t n = strlen(text);
+  // Keep room for the closing brace added by json()
+  if (overflow_ || len_ + n + 2 > CAPACITY) {
+    overflow_ = true;
+    return;
+  }
+  memcpy(buf_ + len_, text, n + 1);
+  len_ += n;
+}
+
+// A field that does not fit is left out whole, so json() stays well-formed
+UploadBuilder& UploadBuilder::field(const char* path, const char* value, bool quoted) {
+  size_t mark = len_;
+  if (fields_ > 0) append(",");
+  append("\"");
+  append(path);
+  append("\":");
+  if (quoted) append("\"");
+  append(value);  // callers pass plain identifiers, no escaping needed
+  if (quoted) append("\"");
+
+  if (overflow_) {
+    len_ = mark;
+    buf_[len_] = '\0';
+  } else {
+    fields_++;
+  }
+  return *this;
+}
+
+UploadBuilder& UploadBuilder::add(const char* path, float value) {
+  char num[24];
+  if (isnan(value) || isinf(value)) snprintf(num, sizeof(num), "null");
+  else snprintf(num, sizeof(num), "%.2f", value);
+  return field(path, num, false);
+}
+
+UploadBuilder& UploadBuilder::add(const char* path, uint32_t value) {
+  char num[12];
+  snprintf(num, sizeof(num), "%lu", (unsigned long)value);
+  return field(path, num, false);
+}
+
+UploadBuilder& UploadBuilder::add(const char* path, bool value) {
+  return field(path, value ? "true" : "false", false);
+}
+
+UploadBuilder& UploadBuilder::add(const char* path, const char* value) {
+  return field(path, value, true);
+}
+
+const char* UploadBuilder::json() {
+  // Close without consuming capacity, so more fields can still be added
+  buf_[len_] = '}';
+  buf_[len_ + 1] = '\0';
+  return buf_;
+}
+
+void appendMotionEvent(UploadBuilder& builder, const MotionEvent& event, uint32_t epochSec) {
+  char path[48];
+  int n = snprintf(path, sizeof(path), "events/event_%lu/", (unsigned long)event.index);
+  char* field = path + n;
+  size_t room = sizeof(path) - n;
+
+  snprintf(field, room, "distance_cm");
+  builder.add(path, event.distance_cm);
+  snprintf(field, room, "timestamp_ms");
+  builder.add(path, event.timestamp_ms);
+  snprintf(field, room, "boot_count");
+  builder.add(path, event.boot_count);
+  snprintf(field, room, "motion_detected");
+  builder.add(path, true);
+  if (epochSec != 0) {
+    snprintf(field, room, "timestamp");
+    builder.add(path, epochSec);
+  }
+}
+
+void appendEventStats(UploadBuilder& builder, uint32_t totalEvents, const MotionEvent& last,
+                      uint32_t lastEpochSec) {
+  builder.add("stats/total_events", totalEvents);
+  builder.add("stats/last_event_time", last.timestamp_ms);
+  builder.add("stats/last_distance", last.distance_cm);
+  if (lastEpochSec != 0) {
+    builder.add("stats/last_event_epoch", lastEpochSec);
+  }
+}
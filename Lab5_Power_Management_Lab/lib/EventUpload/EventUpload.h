@@ -0,0 +1,56 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// One confirmed motion event, as uploaded to the database.
+struct MotionEvent {
+  uint32_t index;         // event number (g_total_uploads at the time)
+  uint32_t timestamp_ms;  // monotonic clock (TimeService::now32), not epoch
+  uint32_t boot_count;
+  float distance_cm;
+};
+
+// ====================== Multi-location update builder ======================
+// Collects "path": value pairs into one flat JSON object suitable for a
+// single Realtime Database multi-location update (one PATCH), instead of one
+// HTTPS round trip per field. Paths are relative to the update root.
+class UploadBuilder {
+public:
+  static const size_t CAPACITY = 4096;
+
+  UploadBuilder() { reset(); }
+
+  void reset();
+
+  UploadBuilder& add(const char* path, float value);
+  UploadBuilder& add(const char* path, uint32_t value);
+  UploadBuilder& add(const char* path, bool value);
+  UploadBuilder& add(const char* path, const char* value);
+
+  // Closed JSON document; valid until the next add()/reset().
+  const char* json();
+  size_t fields() const { return fields_; }
+  size_t size() const { return len_ + 1; }  // json() length
+  // A field did not fit: it and every later one were left out, the
+  // document holds the fields added before it
+  bool overflow() const { return overflow_; }
+
+private:
+  UploadBuilder& field(const char* path, const char* value, bool quoted);
+  void append(const char* text);
+
+  char buf_[CAPACITY];
+  size_t len_;
+  size_t fields_;
+  bool overflow_;
+};
+
+// Adds events/event_<index>/{distance_cm,timestamp_ms,boot_count,motion_detected},
+// plus timestamp (epoch seconds) when the wall-clock time is known (non-zero)
+void appendMotionEvent(UploadBuilder& builder, const MotionEvent& event, uint32_t epochSec = 0);
+
+// Adds stats/{total_events,last_event_time,last_distance}, plus
+// stats/last_event_epoch when known (non-zero)
+void appendEventStats(UploadBuilder& builder, uint32_t totalEvents, const MotionEvent& last,
+                      uint32_t lastEpochSec = 0);
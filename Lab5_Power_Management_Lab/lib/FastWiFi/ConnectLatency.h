@@ -0,0 +1,45 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// ====================== Connect latency counters ======================
+// Fixed-bucket histogram of WiFi connect times, plain data so it can live in
+// RTC memory (no constructor to re-run on every wake). Percentiles are read
+// from the bucket counts, accurate to one bucket width.
+struct ConnectLatency {
+  static const uint32_t BUCKET_MS = 50;
+  static const size_t BUCKETS = 64;  // 0 - 3.2 s, last bucket catches the rest
+
+  uint32_t fastOk;      // cached BSSID/channel/IP worked
+  uint32_t fastFailed;  // cached data was stale, fell back to a scan
+  uint32_t fullOk;      // full scan + DHCP
+  uint32_t failed;      // no connection at all
+  uint16_t bins[BUCKETS];
+
+  void record(uint32_t ms) {
+    size_t i = ms / BUCKET_MS;
+    if (i >= BUCKETS) i = BUCKETS - 1;
+    if (bins[i] < UINT16_MAX) bins[i]++;
+  }
+
+  uint32_t samples() const {
+    uint32_t n = 0;
+    for (size_t i = 0; i < BUCKETS; i++) n += bins[i];
+    return n;
+  }
+
+  // Upper edge of the bucket holding the p-th sample (0 < p <= 1).
+  uint32_t percentileMs(float p) const {
+    uint32_t n = samples();
+    if (n == 0) return 0;
+    uint32_t target = (uint32_t)(p * n + 0.5f);
+    if (target == 0) target = 1;
+    uint32_t seen = 0;
+    for (size_t i = 0; i < BUCKETS; i++) {
+      seen += bins[i];
+      if (seen >= target) return (uint32_t)(i + 1) * BUCKET_MS;
+    }
+    return BUCKETS * BUCKET_MS;
+  }
+};
@@ -0,0 +1,103 @@
+#ifdef ARDUINO
+
+#include <Arduino.h>
+#include <WiFi.h>
+#include <string.h>
+#include <CoopScheduler.h>
+#include "FastWiFi.h"
+
+void FastWiFi::begin() {
+  if (cache_.magic != MAGIC) {
+    memset(&cache_, 0, sizeof(cache_));
+    memset(&latency_, 0, sizeof(latency_));
+  }
+}
+
+static void onGotIp(WiFiEvent_t event) {
+  SchedulerIdle::wake();
+}
+
+// Blocks until the IP event wakes the task instead of polling, so the
+// measured latency is not rounded up to a poll period
+bool FastWiFi::waitConnected(uint32_t startMs, uint32_t timeoutMs) {
+  static bool hooked = false;
+  if (!hooked) {
+    WiFi.onEvent(onGotIp, ARDUINO_EVENT_WIFI_STA_GOT_IP);
+    hooked = true;
+  }
+
+  uint32_t waited;
+  while (WiFi.status() != WL_CONNECTED && (waited = millis() - startMs) < timeoutMs) {
+    SchedulerIdle::wait(timeoutMs - waited);
+  }
+  return WiFi.status() == WL_CONNECTED;
+}
+
+void FastWiFi::saveLease() {
+  memcpy(cache_.bssid, WiFi.BSSID(), sizeof(cache_.bssid));
+  cache_.channel = WiFi.channel();
+  cache_.ip = (uint32_t)WiFi.localIP();
+  cache_.gateway = (uint32_t)WiFi.gatewayIP();
+  cache_.subnet = (uint32_t)WiFi.subnetMask();
+  cache_.dns = (uint32_t)WiFi.dnsIP();
+  cache_.fastSinceRefresh = 0;
+  cache_.magic = MAGIC;
+}
+
+bool FastWiFi::connect(const char* ssid, const char* password, uint32_t timeoutMs) {
+  uint32_t start = millis();
+  WiFi.persistent(false);  // don't rewrite the credentials to flash every wake
+  WiFi.mode(WIFI_STA);
+
+  // Fast path: known AP, known channel, reuse the IP lease
+  bool tryFast = cache_.magic == MAGIC && cache_.fastSinceRefresh < REFRESH_EVERY;
+  if (tryFast) {
+    WiFi.config(IPAddress(cache_.ip), IPAddress(cache_.gateway), IPAddress(cache_.subnet), IPAddress(cache_.dns));
+    WiFi.begin(ssid, password, cache_.channel, cache_.bssid, true);
+    if (waitConnected(start, FAST_TIMEOUT_MS)) {
+      cache_.fastSinceRefresh++;
+      lastMs_ = millis() - start;
+      lastFast_ = true;
+      latency_.fastOk++;
+      latency_.record(lastMs_);
+      return true;
+    }
+
+    latency_.fastFailed++;
+    WiFi.disconnect();
+    cache_.magic = 0;
+  }
+
+  // Full path: scan + DHCP, then remember what worked
+  WiFi.config(IPAddress((uint32_t)0), IPAddress((uint32_t)0), IPAddress((uint32_t)0));
+  WiFi.begin(ssid, password);
+  if (!waitConnected(start, timeoutMs)) {
+    latency_.failed++;
+    lastMs_ = millis() - start;
+    lastFast_ = false;
+    return false;
+  }
+
+  saveLease();
+  lastMs_ = millis() - start;
+  lastFast_ = false;
+  latency_.fullOk++;
+  latency_.record(lastMs_);
+  return true;
+}
+
+void FastWiFi::disconnect() {
+  WiFi.disconnect(true);
+  WiFi.mode(WIFI_OFF);
+}
+
+void FastWiFi::printReport() const {
+  Serial.printf("WiFi connect: %u ms (%s)\n", lastMs_, lastFast_ ? "fast" : "full");
+  Serial.printf("  fast ok %u | fast failed %u | full ok %u | failed %u\n",
+                latency_.fastOk, latency_.fastFailed, latency_.fullOk, latency_.failed);
+  Serial.printf("  p50 <= %u ms | p90 <= %u ms | p99 <= %u ms (n=%u)\n",
+                latency_.percentileMs(0.50f), latency_.percentileMs(0.90f),
+                latency_.percentileMs(0.99f), latency_.samples());
+}
+
+#endif
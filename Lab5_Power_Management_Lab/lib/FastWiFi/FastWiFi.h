@@ -0,0 +1,54 @@
+#pragma once
+
+#include <stdint.h>
+#include "ConnectLatency.h"
+
+// Last good association, kept in RTC memory between wake-ups.
+struct WiFiCacheState {
+  uint32_t magic;
+  uint8_t bssid[6];
+  int32_t channel;
+  uint32_t ip;
+  uint32_t gateway;
+  uint32_t subnet;
+  uint32_t dns;
+  uint16_t fastSinceRefresh;  // fast connects since the lease was last renewed
+};
+
+#ifdef ARDUINO
+
+// ====================== Fast WiFi reconnect ======================
+// Skips the channel scan and DHCP by reusing the cached BSSID, channel and IP
+// lease, and falls back to a normal scan + DHCP when that fails. Every
+// REFRESH_EVERY fast connects a full DHCP connect renews the lease.
+class FastWiFi {
+public:
+  static const uint32_t MAGIC = 0x46574931;  // "FWI1"
+  static const uint32_t FAST_TIMEOUT_MS = 1500;
+  static const uint16_t REFRESH_EVERY = 50;
+
+  FastWiFi(WiFiCacheState& cache, ConnectLatency& latency) : cache_(cache), latency_(latency) {}
+
+  // Call once per boot; RTC memory is garbage after a power-on reset.
+  void begin();
+
+  bool connect(const char* ssid, const char* password, uint32_t timeoutMs);
+  void disconnect();
+
+  uint32_t lastConnectMs() const { return lastMs_; }
+  bool lastWasFast() const { return lastFast_; }
+  void invalidate() { cache_.magic = 0; }
+
+  void printReport() const;
+
+private:
+  bool waitConnected(uint32_t startMs, uint32_t timeoutMs);
+  void saveLease();
+
+  WiFiCacheState& cache_;
+  ConnectLatency& latency_;
+  uint32_t lastMs_ = 0;
+  bool lastFast_ = false;
+};
+
+#endif
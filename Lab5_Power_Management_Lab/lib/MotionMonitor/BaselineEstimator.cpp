@@ -0,0 +1,136 @@
+#include "BaselineEstimator.h"
+
+#include <math.h>
+#include "MotionConfig.h"
+
+static const float MAD_TO_SIGMA = 1.4826f;  // MAD of Gaussian noise x this = sigma
+static const uint8_t BOOTSTRAP_SAMPLES = 3; // accepted ungated, the median needs a few
+static const uint16_t STEP_MIN_READINGS = 3;
+
+static void sortSmall(float* v, size_t n) {
+  for (size_t i = 1; i < n; i++) {
+    float x = v[i];
+    size_t j = i;
+    while (j > 0 && v[j - 1] > x) { v[j] = v[j - 1]; j--; }
+    v[j] = x;
+  }
+}
+
+static float medianOfSorted(const float* v, size_t n) {
+  return (n & 1) ? v[n / 2] : 0.5f * (v[n / 2 - 1] + v[n / 2]);
+}
+
+void BaselineEstimator::estimate(float& median, float& spread) const {
+  size_t n = s_.count;
+  if (n == 0) {
+    median = -1.0f;
+    spread = BASELINE_NOISE_FLOOR_CM;
+    return;
+  }
+
+  float v[BASELINE_SAMPLES];
+  for (size_t i = 0; i < n; i++) v[i] = s_.samples[i];
+  sortSmall(v, n);
+  median = medianOfSorted(v, n);
+
+  for (size_t i = 0; i < n; i++) v[i] = fabsf(s_.samples[i] - median);
+  sortSmall(v, n);
+  spread = medianOfSorted(v, n) * MAD_TO_SIGMA;
+  if (spread < BASELINE_NOISE_FLOOR_CM) spread = BASELINE_NOISE_FLOOR_CM;
+}
+
+float BaselineEstimator::median() const {
+  float m, sd;
+  estimate(m, sd);
+  return m;
+}
+
+float BaselineEstimator::spread() const {
+  float m, sd;
+  estimate(m, sd);
+  return sd;
+}
+
+static float enterThreshold(float spread, const MotionConfig& cfg) {
+  float noise = BaselineEstimator::BASELINE_SIGMA_K * spread;
+  return noise > cfg.motionThresholdCm ? noise : cfg.motionThresholdCm;
+}
+
+float BaselineEstimator::enterThresholdCm(const MotionConfig& cfg) const {
+  return enterThreshold(spread(), cfg);
+}
+
+BaselineVerdict BaselineEstimator::classify(float cm, bool active, const MotionConfig& cfg, uint8_t readings) const {
+  BaselineVerdict v = { false, 0.0f, 0.0f, 0.0f };
+  if (s_.count == 0 || cm < 0) return v;
+
+  float m, sd;
+  estimate(m, sd);
+  float enter = enterThreshold(sd, cfg);
+
+  v.deviationCm = fabsf(cm - m);
+  v.thresholdCm = active ? enter * BASELINE_HOLD_RATIO : enter;
+  v.motion = v.deviationCm > v.thresholdCm;
+
+  // Distance from the threshold, discounted while the ring is still filling
+  // and halved for every ping short of certainty
+  float margin = fabsf(v.deviationCm - v.thresholdCm) / v.thresholdCm;
+  if (margin > 1.0f) margin = 1.0f;
+  float evidence = 1.0f - ldexpf(1.0f, -(int)(readings ? readings : 1));
+  v.confidence = margin * evidence * (0.5f + 0.5f * s_.count / BASELINE_SAMPLES);
+  return v;
+}
+
+bool BaselineEstimator::learn(float cm, uint32_t nowMs, const MotionConfig& cfg) {
+  if (cm < 0) return false;
+  s_.stepReadings = 0;
+
+  if (s_.count >= BOOTSTRAP_SAMPLES) {
+    BaselineVerdict v = classify(cm, true, cfg);
+    if (v.motion) {
+      s_.rejected++;
+      return false;
+    }
+  }
+  if (s_.count == BASELINE_SAMPLES && nowMs - s_.lastSampleMs < cfg.baselineUpdateIntervalMs) {
+    return false;
+  }
+
+  s_.samples[s_.next] = cm;
+  s_.next = (s_.next + 1) % BASELINE_SAMPLES;
+  if (s_.count < BASELINE_SAMPLES) s_.count++;
+  s_.lastSampleMs = nowMs;
+  return true;
+}
+
+bool BaselineEstimator::trackStep(float cm, uint32_t nowMs, const MotionConfig& cfg) {
+  if (cm < 0) return false;
+
+  float tolerance = 2.0f * spread();
+  if (tolerance < BASELINE_STEP_TOLERANCE_CM) tolerance = BASELINE_STEP_TOLERANCE_CM;
+
+  if (s_.stepReadings == 0 || fabsf(cm - s_.stepCm) > tolerance) {
+    s_.stepCm = cm;
+    s_.stepSinceMs = nowMs;
+    s_.stepReadings = 1;
+    return false;
+  }
+
+  s_.stepReadings++;
+  s_.stepCm += (cm - s_.stepCm) / s_.stepReadings;
+  if (s_.stepReadings < STEP_MIN_READINGS || nowMs - s_.stepSinceMs < cfg.baselineRelearnMs) {
+    return false;
+  }
+
+  restart(s_.stepCm, nowMs);
+  s_.relearns++;
+  return true;
+}
+
+void BaselineEstimator::restart(float cm, uint32_t nowMs) {
+  s_.samples[0] = cm;
+  s_.count = 1;
+  s_.next = 1;
+  s_.lastSampleMs = nowMs;
+  s_.stepReadings = 0;
+}
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+struct MotionConfig;
+
+static const size_t BASELINE_SAMPLES = 15;  // background readings kept in RTC memory
+
+// Recent background readings plus the bookkeeping for a scene change.
+// Lives inside MotionRtcState.
+struct BaselineState {
+  float samples[BASELINE_SAMPLES];  // ring of accepted background readings
+  uint8_t count;
+  uint8_t next;
+  uint32_t lastSampleMs;            // monotonic clock, low 32 bits
+  float stepCm;                     // where readings have been sitting away from the baseline...
+  uint32_t stepSinceMs;             // ...since this time
+  uint16_t stepReadings;
+  uint32_t rejected;                // readings kept out of the ring
+  uint32_t relearns;                // scene changes adopted
+};
+
+// Outcome for one reading.
+struct BaselineVerdict {
+  bool motion;
+  float deviationCm;    // |reading - baseline|
+  float thresholdCm;    // the threshold that applied (enter or hold)
+  float confidence;     // 0..1, how clear-cut the decision is and how much evidence backs it
+};
+
+// ====================== Robust baseline ======================
+// The baseline is the median of the last BASELINE_SAMPLES background
+// readings and its spread the scaled median absolute deviation, so a bad
+// echo neither moves the baseline nor widens the threshold much.
+//   - Motion starts when a reading is more than max(motionThresholdCm,
+//     BASELINE_SIGMA_K x spread) away, and holds while it stays above
+//     BASELINE_HOLD_RATIO of that (hysteresis).
+//   - Only readings inside the hold threshold enter the ring, at most one
+//     per baselineUpdateIntervalMs once it is full; slow drift walks the
+//     median along.
+//   - Readings that sit still away from the baseline for baselineRelearnMs
+//     are a changed scene (moved furniture), not motion; the ring restarts
+//     there.
+class BaselineEstimator {
+public:
+  static constexpr float BASELINE_SIGMA_K = 4.0f;
+  static constexpr float BASELINE_HOLD_RATIO = 0.6f;
+  static constexpr float BASELINE_NOISE_FLOOR_CM = 0.5f;  // HC-SR04 resolution
+  static constexpr float BASELINE_STEP_TOLERANCE_CM = 3.0f;
+
+  explicit BaselineEstimator(BaselineState& state) : s_(state) {}
+
+  bool ready() const { return s_.count > 0; }
+  size_t samples() const { return s_.count; }
+  uint32_t rejected() const { return s_.rejected; }
+  uint32_t relearns() const { return s_.relearns; }
+
+  // Median of the ring; -1 while empty.
+  float median() const;
+
+  // Scaled MAD (a standard deviation for Gaussian noise), floored at the
+  // sensor resolution.
+  float spread() const;
+
+  // Threshold to enter motion.
+  float enterThresholdCm(const MotionConfig& cfg) const;
+
+  // active: motion is already in progress, so the lower hold threshold
+  // applies. readings: valid pings behind cm (it is their median); one
+  // ping alone never reaches full confidence, a bad echo looks the same.
+  BaselineVerdict classify(float cm, bool active, const MotionConfig& cfg, uint8_t readings = 1) const;
+
+  // Offers a reading judged still; true if it entered the ring.
+  bool learn(float cm, uint32_t nowMs, const MotionConfig& cfg);
+
+  // Offers a reading judged motion; true if it completed a scene change
+  // and the ring now starts from it.
+  bool trackStep(float cm, uint32_t nowMs, const MotionConfig& cfg);
+
+  void restart(float cm, uint32_t nowMs);
+
+private:
+  void estimate(float& median, float& spread) const;
+
+  BaselineState& s_;
+};
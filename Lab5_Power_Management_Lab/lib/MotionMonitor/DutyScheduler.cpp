@@ -0,0 +1,120 @@
+#include "DutyScheduler.h"
+
+#include <math.h>
+#include <HCSR04Ranger.h>
+#include "MotionConfig.h"
+#include "WakeStub.h"
+
+static const float PRIOR_EVENTS = 0.5f;        // an unseen hour counts as 0.5 motions...
+static const float PRIOR_HOURS = 1.0f;         // ...in one observed hour
+static const float MAX_GAP_HOURS = 2.0f;       // longer gaps (power off) are not observation
+static const uint32_t DEFAULT_BOOT_MS = 550;   // until the ledger has measured a wake
+static const uint32_t DEFAULT_CHECK_MS = 20;   // quick-check logic besides the pings
+static const uint32_t PING_MS = 15;            // one trigger + echo
+
+void DutyScheduler::observe(size_t bucket, uint32_t nowMs, bool motion, float halfLifeHours) {
+  if (bucket >= ACTIVITY_BUCKETS) return;
+
+  float gapHours = s_.lastObservedMs ? (nowMs - s_.lastObservedMs) / 3600000.0f : 0.0f;
+  if (gapHours > MAX_GAP_HOURS) gapHours = 0.0f;
+  s_.lastObservedMs = nowMs ? nowMs : 1;
+
+  float decay = halfLifeHours > 0 ? expf(-gapHours * 0.693147f / halfLifeHours) : 0.0f;
+  s_.events[bucket] = s_.events[bucket] * decay + (motion ? 1.0f : 0.0f);
+  s_.hours[bucket] = s_.hours[bucket] * decay + gapHours;
+}
+
+float DutyScheduler::rate(size_t bucket) const {
+  if (bucket >= ACTIVITY_BUCKETS) return PRIOR_EVENTS / PRIOR_HOURS;
+  return (s_.events[bucket] + PRIOR_EVENTS) / (s_.hours[bucket] + PRIOR_HOURS);
+}
+
+// One active-monitor period (mA*ms): a burst per interval, idle between
+static double activeMonitorCharge(const MotionConfig& cfg, uint32_t activeMs) {
+  const CurrentTable& I = cfg.current;
+  uint8_t pings = cfg.activeMonitorBurst ? cfg.activeMonitorBurst : 1;
+  double burstMs = pings * PING_MS + (pings - 1) * (double)RANGE_MIN_SPACING_MS;
+  double idleMa = cfg.activeMonitorLightSleep ? I.mA[ENERGY_LIGHT_SLEEP] : I.mA[ENERGY_CPU];
+  return activeMs * idleMa + (double)activeMs / cfg.activeMonitorIntervalMs * burstMs * I.mA[ENERGY_SENSOR];
+}
+
+// Sleep interval at which wakes, active monitoring and radio use just fit
+// the budget (mA*ms charges); maxSleepMs when nothing fits.
+static double budgetSleep(const MotionConfig& cfg, float lambda, uint32_t activeMs,
+                          double wakeCharge, double wakeMs, double radioPerHour) {
+  const CurrentTable& I = cfg.current;
+  double activeCharge = activeMonitorCharge(cfg, activeMs);
+  double spare = (cfg.energyBudgetMa - I.mA[ENERGY_DEEP_SLEEP]) * 3600000.0 - lambda * activeCharge - radioPerHour;
+  if (spare <= 0) return cfg.maxSleepMs;
+
+  double sleep = 3600000.0 * wakeCharge / spare - wakeMs;
+  if (sleep < cfg.minSleepMs) return cfg.minSleepMs;
+  if (sleep > cfg.maxSleepMs) return cfg.maxSleepMs;
+  return sleep;
+}
+
+DutyPlan DutyScheduler::fixedPlan(const MotionConfig& cfg) {
+  DutyPlan p;
+  p.sleepMs = cfg.deepSleepNormalMs;
+  p.activeMonitorMs = cfg.activeMonitorDurationMs;
+  p.burst = 1;
+  p.ratePerHour = 0;
+  p.predictedMa = 0;
+  p.budgetLimited = false;
+  return p;
+}
+
+DutyPlan DutyScheduler::plan(size_t bucket, const MotionConfig& cfg, const EnergyLedger& ledger) const {
+  const CurrentTable& I = cfg.current;
+  DutyPlan p = fixedPlan(cfg);
+  float lambda = rate(bucket);
+  p.ratePerHour = lambda;
+
+  // More pings when motion is likely, a single one otherwise
+  uint32_t burst = 1 + (uint32_t)(lambda / cfg.burstRatePerHour);
+  p.burst = (uint8_t)(burst < cfg.maxBurst ? burst : cfg.maxBurst);
+
+  // Cost of one quick-check wake, measured where possible (mA*ms)
+  uint32_t wakes = ledger.wakeups();
+  double bootMs = wakes ? (double)ledger.activityMs(ENERGY_BOOT) / wakes : DEFAULT_BOOT_MS;
+  double burstMs = p.burst * PING_MS + (p.burst - 1) * (double)RANGE_MIN_SPACING_MS;
+  double wakeMs = bootMs + DEFAULT_CHECK_MS + burstMs;
+  double wakeCharge = bootMs * I.mA[ENERGY_BOOT] + DEFAULT_CHECK_MS * I.mA[ENERGY_CPU] +
+                      burstMs * I.mA[ENERGY_SENSOR];
+  if (cfg.wakeStub) {
+    // Quiet wakes never reach the main core
+    p.burst = 1;
+    wakeMs = WAKE_STUB_CHECK_MS;
+    wakeCharge = WAKE_STUB_CHECK_MS * I.mA[ENERGY_WAKE_STUB];
+  }
+
+  // Radio cost per hour as measured so far (uploads follow activity, but
+  // the history is the best estimate available)
+  double hours = ledger.totalMs() / 3600000.0;
+  double radioPerHour = hours >= 1.0 ? (ledger.activityMs(ENERGY_WIFI) * I.mA[ENERGY_WIFI] +
+                                        ledger.activityMs(ENERGY_TLS) * I.mA[ENERGY_TLS]) / hours
+                                     : 0.0;
+
+  // Sleep wanted by the activity alone
+  double activitySleep = lambda > 0 ? cfg.targetMotionPerSleep / lambda * 3600000.0 : cfg.maxSleepMs;
+  if (activitySleep < cfg.minSleepMs) activitySleep = cfg.minSleepMs;
+  if (activitySleep > cfg.maxSleepMs) activitySleep = cfg.maxSleepMs;
+
+  // Shortest sleep the budget allows with full active monitoring; if that
+  // is what limits the sleep, fall back to the shortest useful monitoring
+  double fullSleep = budgetSleep(cfg, lambda, cfg.activeMonitorDurationMs, wakeCharge, wakeMs, radioPerHour);
+  if (fullSleep <= activitySleep) {
+    p.sleepMs = (uint32_t)activitySleep;
+    p.activeMonitorMs = cfg.activeMonitorDurationMs;
+  } else {
+    double shortSleep = budgetSleep(cfg, lambda, cfg.minActiveMonitorMs, wakeCharge, wakeMs, radioPerHour);
+    p.sleepMs = (uint32_t)(shortSleep > activitySleep ? shortSleep : activitySleep);
+    p.activeMonitorMs = cfg.minActiveMonitorMs;
+    p.budgetLimited = true;
+  }
+
+  double activeCharge = activeMonitorCharge(cfg, p.activeMonitorMs);
+  double perHour = 3600000.0 / (p.sleepMs + wakeMs) * wakeCharge + lambda * activeCharge + radioPerHour;
+  p.predictedMa = (float)(perHour / 3600000.0 + I.mA[ENERGY_DEEP_SLEEP]);
+  return p;
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include "EnergyModel.h"
+
+struct MotionConfig;
+
+static const size_t ACTIVITY_BUCKETS = 24;  // one per hour of the day (UTC)
+
+// Motion history per time-of-day bucket. Both sums decay with the time the
+// bucket was observed, so the rate follows changes in routine within days.
+// Lives inside MotionRtcState.
+struct ActivityState {
+  uint32_t lastObservedMs;           // monotonic clock, low 32 bits
+  float events[ACTIVITY_BUCKETS];    // decayed motion detections
+  float hours[ACTIVITY_BUCKETS];     // decayed observed hours
+};
+
+// What the next wake cycle should look like.
+struct DutyPlan {
+  uint32_t sleepMs;
+  uint32_t activeMonitorMs;
+  uint8_t burst;           // pings per quick check
+  float ratePerHour;       // expected motion detections per hour
+  float predictedMa;       // average current if the plan holds for an hour
+  bool budgetLimited;      // the energy budget, not the activity, set sleepMs
+};
+
+// ====================== Adaptive duty cycle ======================
+// Picks sleep interval, active-monitor length and burst size from the
+// activity rate of the current hour bucket:
+//   - sleep so that roughly targetMotionPerSleep motions start per sleep
+//     (short when motion is likely, up to maxSleepMs when it is not),
+//   - but never shorter than the energy budget allows, using the measured
+//     per-wake cost from the EnergyLedger,
+//   - shorten active monitoring when the budget is what limits the sleep.
+class DutyScheduler {
+public:
+  explicit DutyScheduler(ActivityState& state) : s_(state) {}
+
+  static size_t bucketOf(uint64_t timeMs) { return (size_t)((timeMs / 3600000ULL) % ACTIVITY_BUCKETS); }
+
+  // Books the time since the last observation against this bucket.
+  void observe(size_t bucket, uint32_t nowMs, bool motion, float halfLifeHours);
+
+  // Motion detections per hour; unseen buckets start at a modest prior.
+  float rate(size_t bucket) const;
+
+  DutyPlan plan(size_t bucket, const MotionConfig& cfg, const EnergyLedger& ledger) const;
+
+  // The non-adaptive policy, for comparison.
+  static DutyPlan fixedPlan(const MotionConfig& cfg);
+
+private:
+  ActivityState& s_;
+};
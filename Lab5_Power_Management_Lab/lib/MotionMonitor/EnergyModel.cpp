@@ -0,0 +1,111 @@
+#include "EnergyModel.h"
+
+#include <stdio.h>
+#include <EventUpload.h>
+
+const char* EnergyLedger::activityName(EnergyActivity a) {
+  static const char* const names[ENERGY_COUNT] = { "boot", "cpu", "sensor", "wifi", "tls", "light_sleep", "wake_stub", "deep_sleep" };
+  return a < ENERGY_COUNT ? names[a] : "?";
+}
+
+const char* EnergyLedger::stateName(DeviceState s) {
+  static const char* const names[DEVICE_STATE_COUNT] = { "deep_sleep", "quick_check", "active_monitor", "upload_event" };
+  return (size_t)s < DEVICE_STATE_COUNT ? names[s] : "?";
+}
+
+void EnergyLedger::begin() {
+  if (t_.magic != MAGIC) reset();
+}
+
+void EnergyLedger::reset() {
+  t_.magic = MAGIC;
+  t_.wakeups = 0;
+  t_.stubChecks = 0;
+  for (size_t i = 0; i < DEVICE_STATE_COUNT; i++) t_.stateMs[i] = 0;
+  for (size_t i = 0; i < ENERGY_COUNT; i++) t_.activityMs[i] = 0;
+}
+
+void EnergyLedger::beginWake(uint32_t nowMs) {
+  t_.wakeups++;
+  t_.activityMs[ENERGY_BOOT] += nowMs;
+  activity_ = ENERGY_CPU;
+  activitySince_ = nowMs;
+  inState_ = false;
+}
+
+void EnergyLedger::enterState(DeviceState state, uint32_t nowMs) {
+  if (inState_) t_.stateMs[state_] += nowMs - stateSince_;
+  state_ = state;
+  stateSince_ = nowMs;
+  inState_ = true;
+}
+
+EnergyActivity EnergyLedger::setActivity(EnergyActivity activity, uint32_t nowMs) {
+  EnergyActivity previous = activity_;
+  t_.activityMs[activity_] += nowMs - activitySince_;
+  activity_ = activity;
+  activitySince_ = nowMs;
+  return previous;
+}
+
+void EnergyLedger::close(uint32_t nowMs) {
+  setActivity(ENERGY_CPU, nowMs);
+  if (inState_) t_.stateMs[state_] += nowMs - stateSince_;
+  inState_ = false;
+}
+
+void EnergyLedger::deepSleep(uint32_t sleepMs, uint32_t nowMs) {
+  close(nowMs);
+  t_.stateMs[STATE_DEEP_SLEEP] += sleepMs;
+  t_.activityMs[ENERGY_DEEP_SLEEP] += sleepMs;
+}
+
+void EnergyLedger::wakeStubCycles(uint32_t checks, uint32_t checkMs, uint32_t sleepMs) {
+  t_.stubChecks += checks;
+  t_.activityMs[ENERGY_WAKE_STUB] += (uint64_t)checks * checkMs;
+  t_.activityMs[ENERGY_DEEP_SLEEP] += (uint64_t)checks * sleepMs;
+  t_.stateMs[STATE_DEEP_SLEEP] += (uint64_t)checks * (checkMs + sleepMs);
+}
+
+uint64_t EnergyLedger::totalMs() const {
+  uint64_t sum = 0;
+  for (size_t i = 0; i < ENERGY_COUNT; i++) sum += t_.activityMs[i];
+  return sum;
+}
+
+double EnergyLedger::chargeMah(const CurrentTable& table) const {
+  double mAms = 0;
+  for (size_t i = 0; i < ENERGY_COUNT; i++) mAms += (double)t_.activityMs[i] * table.mA[i];
+  return mAms / 3600000.0;
+}
+
+double EnergyLedger::averageMa(const CurrentTable& table) const {
+  uint64_t ms = totalMs();
+  return ms ? chargeMah(table) * 3600000.0 / (double)ms : 0.0;
+}
+
+double EnergyLedger::batteryLifeHours(const CurrentTable& table, float batteryMah) const {
+  double mA = averageMa(table);
+  return mA > 0 ? batteryMah / mA : 0.0;
+}
+
+void appendEnergyReport(UploadBuilder& builder, const EnergyLedger& ledger,
+                        const CurrentTable& table, float batteryMah) {
+  char path[48];
+
+  builder.add("power/mah_per_hour", (float)ledger.averageMa(table));
+  builder.add("power/battery_life_h", (float)ledger.batteryLifeHours(table, batteryMah));
+  builder.add("power/charge_mah", (float)ledger.chargeMah(table));
+  builder.add("power/hours", (float)(ledger.totalMs() / 3600000.0));
+  builder.add("power/wakeups", ledger.wakeups());
+  builder.add("power/stub_checks", ledger.stubChecks());
+
+  for (size_t i = 0; i < DEVICE_STATE_COUNT; i++) {
+    snprintf(path, sizeof(path), "power/state_s/%s", EnergyLedger::stateName((DeviceState)i));
+    builder.add(path, (uint32_t)(ledger.stateMs((DeviceState)i) / 1000));
+  }
+  for (size_t i = 0; i < ENERGY_COUNT; i++) {
+    snprintf(path, sizeof(path), "power/activity_s/%s", EnergyLedger::activityName((EnergyActivity)i));
+    builder.add(path, (uint32_t)(ledger.activityMs((EnergyActivity)i) / 1000));
+  }
+}
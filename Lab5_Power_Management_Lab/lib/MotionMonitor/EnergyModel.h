@@ -0,0 +1,105 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include "MotionHal.h"
+
+class UploadBuilder;
+
+static const size_t DEVICE_STATE_COUNT = 4;
+
+// ====================== Energy model ======================
+// What the board is doing right now. Exactly one activity is active while
+// awake, so time splits cleanly between them and the charge estimate is a
+// plain sum of duration x current.
+enum EnergyActivity : uint8_t {
+  ENERGY_BOOT,        // reset until setup() hands over to the state machine
+  ENERGY_CPU,         // awake, radio off (state logic)
+  ENERGY_SENSOR,      // ultrasonic burst (pings + spacing between them)
+  ENERGY_WIFI,        // radio on: association, DHCP, idle, writes
+  ENERGY_TLS,         // radio on + TLS handshake / sign-in
+  ENERGY_LIGHT_SLEEP, // between active-monitor bursts
+  ENERGY_WAKE_STUB,   // wake stub ping without booting the main core
+  ENERGY_DEEP_SLEEP,
+  ENERGY_COUNT
+};
+
+// Average current per activity in mA. The defaults sit in the ranges the
+// Five_Stages sketch measured on the XIAO ESP32-C3; replace them with your
+// own meter readings.
+struct CurrentTable {
+  float mA[ENERGY_COUNT] = {
+    45.0f,   // boot
+    45.0f,   // cpu
+    60.0f,   // sensor
+    120.0f,  // wifi
+    160.0f,  // tls
+    0.8f,    // light sleep
+    30.0f,   // wake stub (CPU on XTAL + sensor)
+    0.05f    // deep sleep
+  };
+};
+
+// Accumulated time, kept RTC_DATA_ATTR so it covers every wake-up since the
+// last power-on reset.
+struct EnergyTotals {
+  uint32_t magic;
+  uint32_t wakeups;
+  uint32_t stubChecks;
+  uint64_t stateMs[DEVICE_STATE_COUNT];
+  uint64_t activityMs[ENERGY_COUNT];
+};
+
+class EnergyLedger {
+public:
+  static const uint32_t MAGIC = 0x454E4733;  // "ENG3"
+
+  explicit EnergyLedger(EnergyTotals& totals) : t_(totals) {}
+
+  static const char* activityName(EnergyActivity a);
+  static const char* stateName(DeviceState s);
+
+  // Call once per boot; RTC memory is garbage after a power-on reset.
+  void begin();
+  void reset();
+
+  // Start of a wake-up: everything before nowMs was boot.
+  void beginWake(uint32_t nowMs);
+
+  // State entry; closes the previous state at nowMs.
+  void enterState(DeviceState state, uint32_t nowMs);
+
+  // Switches the current activity; returns the one it replaced.
+  EnergyActivity setActivity(EnergyActivity activity, uint32_t nowMs);
+
+  // Closes the wake at nowMs and books the coming sleep.
+  void deepSleep(uint32_t sleepMs, uint32_t nowMs);
+
+  // Books quiet wake-stub checks, each followed by another sleep.
+  void wakeStubCycles(uint32_t checks, uint32_t checkMs, uint32_t sleepMs);
+
+  uint32_t wakeups() const { return t_.wakeups; }
+  uint32_t stubChecks() const { return t_.stubChecks; }
+  uint64_t stateMs(DeviceState s) const { return s < DEVICE_STATE_COUNT ? t_.stateMs[s] : 0; }
+  uint64_t activityMs(EnergyActivity a) const { return a < ENERGY_COUNT ? t_.activityMs[a] : 0; }
+
+  uint64_t totalMs() const;
+  double chargeMah(const CurrentTable& table) const;
+  double averageMa(const CurrentTable& table) const;  // == mAh per hour
+  double batteryLifeHours(const CurrentTable& table, float batteryMah) const;
+
+private:
+  void close(uint32_t nowMs);
+
+  EnergyTotals& t_;
+  DeviceState state_ = STATE_DEEP_SLEEP;
+  EnergyActivity activity_ = ENERGY_BOOT;
+  bool inState_ = false;
+  uint32_t stateSince_ = 0;
+  uint32_t activitySince_ = 0;
+};
+
+// Adds power/{mah_per_hour,battery_life_h,charge_mah,hours,wakeups,stub_checks,
+// state_s/<state>,activity_s/<activity>} to an upload.
+void appendEnergyReport(UploadBuilder& builder, const EnergyLedger& ledger,
+                        const CurrentTable& table, float batteryMah);
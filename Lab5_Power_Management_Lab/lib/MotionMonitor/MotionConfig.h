@@ -0,0 +1,70 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include "EnergyModel.h"
+
+// Wake-on-motion stub (see WakeStub.h); override with -D MOTION_WAKE_STUB=1
+#ifndef MOTION_WAKE_STUB
+#define MOTION_WAKE_STUB 0
+#endif
+
+// ============================================
+// POWER MANAGEMENT CONFIGURATION
+// ============================================
+// Defaults match the deployed firmware; the simulator overrides fields to
+// explore other policies.
+struct MotionConfig {
+  // Sleep Durations (milliseconds)
+  uint32_t deepSleepNormalMs = 10000;       // 10 seconds - normal monitoring
+  uint32_t deepSleepExtendedMs = 30000;     // 30 seconds - quiet period
+
+  // Active Monitoring
+  uint32_t activeMonitorDurationMs = 30000; // 30 seconds - active monitoring
+  uint32_t activeMonitorIntervalMs = 2000;  // 2 seconds - check interval when active
+  uint8_t activeMonitorBurst = 3;           // voted pings per check
+  bool activeMonitorLightSleep = true;      // light sleep between checks instead of delay()
+
+  // Motion Detection
+  float motionThresholdCm = 10.0f;          // 10 cm change = motion detected
+  uint32_t motionConfirmTimeMs = 2000;      // 2 seconds - confirm motion is real
+  uint32_t baselineUpdateIntervalMs = 60000; // 1 minute - between background samples once the ring is full
+  bool robustBaseline = true;               // false: single-reading baseline and threshold (old behaviour)
+  uint32_t baselineRelearnMs = 900000;      // 15 minutes - still readings off the baseline become the new scene
+  float motionMinConfidence = 0.6f;         // below this a quick-check motion gets a confirming burst
+
+  // Upload Control
+  uint32_t minUploadIntervalMs = 60000;     // 60 seconds - minimum between uploads
+
+  // Event Journal (deferred bulk upload)
+  size_t journalFlushCount = 10;            // upload once this many events are queued...
+  uint32_t journalFlushAgeMs = 3600000;     // ...or the oldest is 1 hour old
+
+  // Adaptive Behavior
+  uint32_t quietPeriodThresholdMs = 300000; // 5 minutes - no motion = quiet
+
+  // Adaptive Duty Cycle (DutyScheduler)
+  bool adaptiveSchedule = true;             // false: fixed normal/extended sleep above
+  float energyBudgetMa = 2.0f;              // average current to stay under (500 mAh ~ 10 days)
+  uint32_t minSleepMs = 5000;               // 5 seconds - shortest sleep when motion is likely
+  uint32_t maxSleepMs = 120000;             // 2 minutes - longest sleep when it is not
+  uint32_t minActiveMonitorMs = 10000;      // 10 seconds - shortest monitoring that can confirm
+  float targetMotionPerSleep = 0.02f;       // expected motions starting during one sleep
+  float activityHalfLifeHours = 4.0f;       // observed hours per bucket (~4 days for hourly buckets)
+  float burstRatePerHour = 2.0f;            // one extra ping per this many motions/hour...
+  uint8_t maxBurst = 3;                     // ...up to this many pings per quick check
+
+  // Wake-on-Motion Stub
+  bool wakeStub = MOTION_WAKE_STUB;         // ping from the wake stub, boot only on change
+  uint32_t wakeStubMaxAwayMs = 300000;      // 5 minutes - main core runs at least this often
+
+  // Timekeeping
+  uint32_t timeResyncMs = 21600000;         // 6 hours - SNTP again on the next upload after this
+
+  // Energy Model
+  CurrentTable current;                     // mA per activity, see EnergyModel.h
+  float batteryMah = 500.0f;                // battery capacity for the life estimate
+};
+
+static const size_t MOTION_JOURNAL_EVENTS = 32;  // events held in RTC memory before spilling to flash
+static const size_t MOTION_UPLOAD_BATCH_MAX = 20; // events per multi-location update
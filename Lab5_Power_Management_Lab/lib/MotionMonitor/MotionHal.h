@@ -0,0 +1,63 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <HCSR04Ranger.h>
+
+typedef enum {
+  STATE_DEEP_SLEEP,
+  STATE_QUICK_CHECK,
+  STATE_ACTIVE_MONITOR,
+  STATE_UPLOAD_EVENT
+} DeviceState;
+
+// ====================== Hardware abstraction ======================
+// Everything the motion state machine needs from the board. The firmware
+// implements it on top of Arduino/WiFi/Firebase; the native simulator
+// implements it on a virtual clock with a trace-driven sensor.
+class MotionHal {
+public:
+  virtual ~MotionHal() {}
+
+  // Clock since this wake (millis() on the board: restarts after deep sleep)
+  virtual uint32_t uptimeMs() = 0;
+  virtual void delayMs(uint32_t ms) = 0;
+
+  // Idle with the CPU stopped; RAM, peripherals and millis() carry on
+  virtual void lightSleepMs(uint32_t ms) { delayMs(ms); }
+
+  // One ultrasonic reading in cm, or a negative value on failure
+  virtual float readDistanceCm() = 0;
+
+  // pings readings at the sensor's cycle, voted (see voteRange())
+  virtual RangeBurst readBurst(uint8_t pings) {
+    float cm[RANGE_BURST_MAX];
+    if (pings > RANGE_BURST_MAX) pings = RANGE_BURST_MAX;
+    for (uint8_t i = 0; i < pings; i++) {
+      cm[i] = readDistanceCm();
+      if (i + 1 < pings) delayMs(RANGE_MIN_SPACING_MS);
+    }
+    return voteRange(cm, pings);
+  }
+
+  virtual bool connectNetwork() = 0;
+  virtual void disconnectNetwork() = 0;
+  virtual bool initDatabase() = 0;
+  // One multi-location update; true once the server acknowledged it
+  virtual bool uploadBatch(const char* json) = 0;
+
+  // SNTP while the network is up; epoch milliseconds on success
+  virtual bool syncTime(uint64_t& /*epochMs*/) { return false; }
+
+  // Does not return on the board; the simulator returns and ends the wake
+  virtual void deepSleep(uint32_t ms) = 0;
+
+  // Install (or remove) the wake-on-motion stub for the coming sleeps;
+  // false if the board cannot run it
+  virtual bool enableWakeStub(bool /*on*/) { return false; }
+
+  virtual void log(const char* fmt, ...) = 0;
+
+  // Optional hooks for instrumentation
+  virtual void onStateEnter(DeviceState /*state*/) {}
+};
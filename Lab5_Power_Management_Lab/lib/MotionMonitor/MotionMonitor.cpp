@@ -0,0 +1,471 @@
+#include "MotionMonitor.h"
+
+#include <math.h>
+
+void MotionMonitor::onBoot(bool timerWake) {
+  rtc_.boot_count++;
+  journal_.begin();
+  time_.begin();
+  energy_.begin();
+  if (timerWake) {
+    collectWakeStub();
+  }
+  energy_.beginWake(hal_.uptimeMs());
+  plan_ = DutyScheduler::fixedPlan(cfg_);
+  sleeping_ = false;
+
+  if (!timerWake) {
+    rtc_.state = STATE_QUICK_CHECK;
+  }
+}
+
+bool MotionMonitor::step() {
+  switch (rtc_.state) {
+    case STATE_QUICK_CHECK:
+      stateQuickCheck();
+      break;
+
+    case STATE_ACTIVE_MONITOR:
+      stateActiveMonitor();
+      break;
+
+    case STATE_UPLOAD_EVENT:
+      stateUploadEvent();
+      break;
+
+    case STATE_DEEP_SLEEP:
+      enterDeepSleep(plan_.sleepMs);
+      break;
+
+    default:
+      hal_.log("Unknown state - resetting to QUICK_CHECK\n");
+      rtc_.state = STATE_QUICK_CHECK;
+      break;
+  }
+  return sleeping_;
+}
+
+void MotionMonitor::enter(DeviceState state) {
+  rtc_.state = state;
+}
+
+void MotionMonitor::markState(DeviceState state) {
+  energy_.enterState(state, hal_.uptimeMs());
+  hal_.onStateEnter(state);
+}
+
+void MotionMonitor::enterDeepSleep(uint32_t durationMs) {
+  // Every wake starts with a quick check, whatever state we slept from
+  rtc_.state = STATE_QUICK_CHECK;
+  sleeping_ = true;
+  hal_.onStateEnter(STATE_DEEP_SLEEP);
+  hal_.log("Entering deep sleep for %u seconds\n", durationMs / 1000);
+  energy_.deepSleep(durationMs, hal_.uptimeMs());
+  time_.prepareSleep(durationMs, hal_.uptimeMs());
+  armWakeStub(durationMs);
+  hal_.deepSleep(durationMs);
+}
+
+// Hand the baseline to the wake stub; without one the stub just boots us
+void MotionMonitor::armWakeStub(uint32_t sleepMs) {
+  bool arm = cfg_.wakeStub && rtc_.baseline_distance > 0;
+  if (arm) {
+    float threshold = cfg_.robustBaseline ? baseline_.enterThresholdCm(cfg_) : cfg_.motionThresholdCm;
+    wakeStubArm(rtc_.stub, rtc_.baseline_distance, threshold, sleepMs, cfg_.wakeStubMaxAwayMs);
+  }
+  if (!hal_.enableWakeStub(arm) || !arm) {
+    rtc_.stub.armed = 0;
+  }
+}
+
+// Book the checks the stub did on its own since the last boot
+void MotionMonitor::collectWakeStub() {
+  WakeStubState& s = rtc_.stub;
+  if (s.armed != WAKE_STUB_ARMED) return;
+
+  uint32_t sleepMs = s.sleepUs / 1000;
+  for (uint16_t i = 0; i < s.skipped; i++) {
+    time_.addCycle(sleepMs, WAKE_STUB_CHECK_MS);
+  }
+  energy_.wakeStubCycles(s.skipped, WAKE_STUB_CHECK_MS, sleepMs);
+  hal_.log("Wake stub: %u quiet check(s), booted for %s (echo %u us)\n",
+           s.skipped, wakeStubDecisionName(s.lastDecision), s.lastEchoUs);
+  s.skipped = 0;
+}
+
+// Voted burst; a single ping when pings == 1
+RangeBurst MotionMonitor::readBurst(uint8_t pings) {
+  energy_.setActivity(ENERGY_SENSOR, hal_.uptimeMs());
+  RangeBurst burst = hal_.readBurst(pings ? pings : 1);
+  energy_.setActivity(ENERGY_CPU, hal_.uptimeMs());
+  return burst;
+}
+
+// Wait between active-monitor checks
+void MotionMonitor::idle(uint32_t ms) {
+  if (!cfg_.activeMonitorLightSleep) {
+    hal_.delayMs(ms);
+    return;
+  }
+  energy_.setActivity(ENERGY_LIGHT_SLEEP, hal_.uptimeMs());
+  hal_.lightSleepMs(ms);
+  energy_.setActivity(ENERGY_CPU, hal_.uptimeMs());
+}
+
+// Hour of the day once synced; before that the monotonic clock keeps the
+// buckets consistent, just not aligned to the wall clock
+size_t MotionMonitor::activityBucket() {
+  uint64_t t = time_.synced() ? time_.epochMs(hal_.uptimeMs()) : time_.nowMs(hal_.uptimeMs());
+  return DutyScheduler::bucketOf(t);
+}
+
+// SNTP only when the radio is up anyway, and only if the last sync is old
+void MotionMonitor::syncTime() {
+  if (!time_.needsSync(hal_.uptimeMs(), cfg_.timeResyncMs)) return;
+
+  uint64_t epochMs;
+  if (!hal_.syncTime(epochMs)) {
+    hal_.log("Time sync failed - keeping monotonic clock\n");
+    return;
+  }
+  time_.onSync(epochMs, hal_.uptimeMs());
+  hal_.log("Time synced: epoch %lu s | correction %d ms | sleep scale %.4f\n",
+           (unsigned long)(epochMs / 1000), (int)time_.lastErrorMs(), time_.sleepScale());
+}
+
+// A batch is full or its oldest event too old, and the last attempt was
+// long enough ago (failed attempts count, so an outage is not retried on
+// every wake)
+bool MotionMonitor::uploadDue() {
+  uint32_t now = clockMs();
+  if (!journal_.shouldFlush(now, cfg_.journalFlushCount, cfg_.journalFlushAgeMs)) return false;
+  return rtc_.last_upload_time == 0 || (now - rtc_.last_upload_time) >= cfg_.minUploadIntervalMs;
+}
+
+uint32_t MotionMonitor::oldestEventAgeMs() {
+  MotionEvent first;
+  return journal_.oldest(first) ? clockMs() - first.timestamp_ms : 0;
+}
+
+// Journal timestamps are monotonic; map them to epoch once synced
+uint32_t MotionMonitor::epochSecAt(uint32_t stamp) {
+  return (uint32_t)(time_.epochAt(time_.widen(stamp, hal_.uptimeMs())) / 1000);
+}
+
+void MotionMonitor::buildBatch(UploadBuilder& upload, MotionEvent* events, size_t n, bool withEnergy) {
+  upload.reset();
+  for (size_t i = 0; i < n; i++) {
+    events[i].index = rtc_.total_uploads + i;
+    appendMotionEvent(upload, events[i], epochSecAt(events[i].timestamp_ms));
+  }
+  appendEventStats(upload, rtc_.total_uploads + n, events[n - 1], epochSecAt(events[n - 1].timestamp_ms));
+  if (withEnergy) {
+    appendEnergyReport(upload, energy_, cfg_.current, cfg_.batteryMah);
+  }
+}
+
+void MotionMonitor::printEnergyReport() {
+  hal_.log("\n--- Energy (since power-on, %.2f h) ---\n", energy_.totalMs() / 3600000.0);
+  for (size_t i = 0; i < DEVICE_STATE_COUNT; i++) {
+    DeviceState s = (DeviceState)i;
+    hal_.log("  state %-15s %10.1f s\n", EnergyLedger::stateName(s), energy_.stateMs(s) / 1000.0);
+  }
+  for (size_t i = 0; i < ENERGY_COUNT; i++) {
+    EnergyActivity a = (EnergyActivity)i;
+    double mAh = energy_.activityMs(a) * cfg_.current.mA[i] / 3600000.0;
+    hal_.log("  %-21s %10.1f s %8.3f mAh\n", EnergyLedger::activityName(a), energy_.activityMs(a) / 1000.0, mAh);
+  }
+  hal_.log("Average: %.3f mA (mAh per hour) | Battery life: %.1f h on %.0f mAh\n",
+           energy_.averageMa(cfg_.current), energy_.batteryLifeHours(cfg_.current, cfg_.batteryMah), cfg_.batteryMah);
+}
+
+// A reading judged still: into the estimator's ring, or with
+// robustBaseline off, the baseline itself once per update interval
+void MotionMonitor::updateBaseline(float distance) {
+  if (distance <= 0) return;
+
+  if (cfg_.robustBaseline) {
+    if (!baseline_.learn(distance, clockMs(), cfg_)) return;
+    rtc_.baseline_distance = baseline_.median();
+  } else {
+    if (rtc_.baseline_distance > 0 && (clockMs() - rtc_.last_baseline_update) <= cfg_.baselineUpdateIntervalMs) return;
+    rtc_.baseline_distance = distance;
+  }
+  rtc_.last_baseline_update = clockMs();
+  hal_.log("Baseline updated: %.2f cm (%u samples, spread %.2f cm)\n", rtc_.baseline_distance,
+           (unsigned)baseline_.samples(), cfg_.robustBaseline ? baseline_.spread() : 0.0f);
+}
+
+// active: motion already in progress (the lower hold threshold applies)
+BaselineVerdict MotionMonitor::detectMotion(float currentDistance, bool active, uint8_t readings) const {
+  if (cfg_.robustBaseline) {
+    return baseline_.classify(currentDistance, active, cfg_, readings);
+  }
+
+  BaselineVerdict v = { false, 0.0f, cfg_.motionThresholdCm, 1.0f };
+  if (rtc_.baseline_distance < 0 || currentDistance < 0) {
+    return v;
+  }
+  v.deviationCm = fabsf(currentDistance - rtc_.baseline_distance);
+  v.motion = v.deviationCm > cfg_.motionThresholdCm;
+  return v;
+}
+
+// ============================================
+// STATE: QUICK CHECK
+// ============================================
+
+void MotionMonitor::stateQuickCheck() {
+  markState(STATE_QUICK_CHECK);
+  hal_.log("\n=== STATE: QUICK CHECK ===\n");
+  hal_.log("Boot #%u | Uptime: %u ms\n", rtc_.boot_count, hal_.uptimeMs());
+
+  // Plan this wake cycle from the activity seen at this hour
+  size_t bucket = activityBucket();
+  if (cfg_.adaptiveSchedule) {
+    plan_ = scheduler_.plan(bucket, cfg_, energy_);
+    hal_.log("Plan: hour %u | %.2f motions/h | sleep %u ms | monitor %u ms | %u ping(s) | %.3f mA%s\n",
+             (unsigned)bucket, plan_.ratePerHour, plan_.sleepMs, plan_.activeMonitorMs, plan_.burst,
+             plan_.predictedMa, plan_.budgetLimited ? " (budget)" : "");
+  }
+
+  // Read sensor
+  RangeBurst burst = readBurst(plan_.burst);
+  float distance = burst.cm;
+
+  if (distance < 0) {
+    hal_.log("Sensor read failed, returning to sleep\n");
+    enterDeepSleep(plan_.sleepMs);
+    return;
+  }
+
+  hal_.log("Distance: %.2f cm | Baseline: %.2f cm\n", distance, rtc_.baseline_distance);
+
+  // Initialize baseline on first boot
+  if (rtc_.baseline_distance < 0) {
+    updateBaseline(distance);
+    enterDeepSleep(plan_.sleepMs);
+    return;
+  }
+
+  // Check for motion
+  BaselineVerdict verdict = detectMotion(distance, false, burst.kept);
+
+  // A lone or marginal reading is what a bad echo looks like; another
+  // burst is far cheaper than a false ACTIVE_MONITOR
+  if (verdict.motion && verdict.confidence < cfg_.motionMinConfidence) {
+    burst = readBurst(2);
+    hal_.log("Unsure: change %.2f cm (threshold %.2f cm, confidence %.2f) - recheck: %.2f cm\n",
+             verdict.deviationCm, verdict.thresholdCm, verdict.confidence, burst.cm);
+    verdict = detectMotion(burst.cm, false, burst.kept);
+    if (burst.ok()) distance = burst.cm;
+  }
+
+  // Readings that stay put away from the baseline are a changed scene
+  bool motion = verdict.motion;
+  if (motion && cfg_.robustBaseline && baseline_.trackStep(distance, clockMs(), cfg_)) {
+    rtc_.baseline_distance = baseline_.median();
+    hal_.log("Scene changed - baseline relearned at %.2f cm\n", rtc_.baseline_distance);
+    motion = false;
+  }
+  if (!motion) {
+    updateBaseline(distance);
+  }
+  scheduler_.observe(bucket, clockMs(), motion, cfg_.activityHalfLifeHours);
+
+  if (motion) {
+    hal_.log(">>> MOTION DETECTED! <<< (%.2f cm over %.2f cm, confidence %.2f)\n",
+             verdict.deviationCm, verdict.thresholdCm, verdict.confidence);
+    rtc_.motion_active = true;
+    rtc_.last_motion_time = clockMs();
+    rtc_.motion_event_count++;
+    enter(STATE_ACTIVE_MONITOR);
+  } else {
+    hal_.log("No motion detected\n");
+
+    // The age limit holds without further motion too
+    if (uploadDue()) {
+      hal_.log("Oldest event is %u s old - uploading\n", (unsigned)(oldestEventAgeMs() / 1000));
+      enter(STATE_UPLOAD_EVENT);
+      return;
+    }
+
+    // Check if quiet period (no motion for 5+ minutes); the adaptive
+    // schedule backs off on its own
+    if (!cfg_.adaptiveSchedule && rtc_.last_motion_time > 0 && (clockMs() - rtc_.last_motion_time) > cfg_.quietPeriodThresholdMs) {
+      hal_.log("Quiet period detected - entering extended sleep\n");
+      enterDeepSleep(cfg_.deepSleepExtendedMs);
+    } else {
+      enterDeepSleep(plan_.sleepMs);
+    }
+  }
+}
+
+// ============================================
+// STATE: ACTIVE MONITOR
+// ============================================
+
+void MotionMonitor::stateActiveMonitor() {
+  markState(STATE_ACTIVE_MONITOR);
+  hal_.log("\n=== STATE: ACTIVE MONITOR ===\n");
+  hal_.log("Monitoring for %u seconds with %u-second intervals, %u ping(s) each\n",
+           plan_.activeMonitorMs / 1000, cfg_.activeMonitorIntervalMs / 1000, cfg_.activeMonitorBurst);
+
+  uint32_t startTime = hal_.uptimeMs();
+  float lastDistance = -1.0f;
+  bool motionConfirmed = false;
+  uint32_t stableMotionStart = 0;
+
+  while (hal_.uptimeMs() - startTime < plan_.activeMonitorMs) {
+    RangeBurst burst = readBurst(cfg_.activeMonitorBurst);
+    float distance = burst.cm;
+
+    if (burst.ok()) {
+      hal_.log("[%.1fs] Distance: %.2f cm (+/-%.2f, %u/%u pings)", (hal_.uptimeMs() - startTime) / 1000.0,
+               distance, burst.spreadCm, burst.kept, burst.pings);
+
+      bool motion = detectMotion(distance, rtc_.motion_active, burst.kept).motion;
+
+      if (motion) {
+        hal_.log(" - MOTION\n");
+
+        // Check if motion is stable (same for 2+ seconds)
+        if (lastDistance > 0 && fabsf(distance - lastDistance) < 5.0f) {
+          if (stableMotionStart == 0) {
+            stableMotionStart = hal_.uptimeMs();
+          } else if (hal_.uptimeMs() - stableMotionStart >= cfg_.motionConfirmTimeMs) {
+            if (!motionConfirmed) {
+              motionConfirmed = true;
+              hal_.log(">>> MOTION CONFIRMED! <<<\n");
+            }
+          }
+        } else {
+          stableMotionStart = 0;
+        }
+      } else {
+        hal_.log(" - No motion\n");
+        stableMotionStart = 0;
+      }
+
+      lastDistance = distance;
+    } else {
+      hal_.log("Sensor read failed\n");
+    }
+
+    idle(cfg_.activeMonitorIntervalMs);
+  }
+
+  // Decision: journal the event, upload only when a batch is due
+  if (motionConfirmed) {
+    rtc_.confirmed_count++;
+    MotionEvent event = { 0, clockMs(), rtc_.boot_count, lastDistance };
+    if (!journal_.append(event)) {
+      hal_.log("Journal full - event lost\n");
+    }
+    hal_.log("Motion event confirmed - journaled (%u pending)\n", (unsigned)journal_.size());
+
+    if (uploadDue()) {
+      enter(STATE_UPLOAD_EVENT);
+    } else {
+      hal_.log("Batch not due - deferring upload\n");
+      rtc_.motion_active = false;
+      enterDeepSleep(plan_.sleepMs);
+    }
+  } else {
+    hal_.log("Motion not confirmed - false alarm\n");
+    rtc_.motion_active = false;
+    enterDeepSleep(plan_.sleepMs);
+  }
+}
+
+// ============================================
+// STATE: UPLOAD EVENT
+// ============================================
+
+void MotionMonitor::stateUploadEvent() {
+  markState(STATE_UPLOAD_EVENT);
+  hal_.log("\n=== STATE: UPLOAD EVENT ===\n");
+
+  uint32_t uploadStartTime = hal_.uptimeMs();
+  rtc_.last_upload_time = clockMs();
+
+  // Connect WiFi
+  energy_.setActivity(ENERGY_WIFI, hal_.uptimeMs());
+  if (!hal_.connectNetwork()) {
+    hal_.log("WiFi connection failed - aborting upload\n");
+    hal_.disconnectNetwork();
+    rtc_.motion_active = false;
+    enterDeepSleep(plan_.sleepMs);
+    return;
+  }
+
+  syncTime();
+
+  // Initialize Firebase
+  energy_.setActivity(ENERGY_TLS, hal_.uptimeMs());
+  bool dbReady = hal_.initDatabase();
+  energy_.setActivity(ENERGY_WIFI, hal_.uptimeMs());
+  if (!dbReady) {
+    hal_.log("Firebase initialization failed - aborting upload\n");
+    hal_.disconnectNetwork();
+    rtc_.motion_active = false;
+    enterDeepSleep(plan_.sleepMs);
+    return;
+  }
+
+  // Flush the journal in batches, one multi-location update per batch
+  static MotionEvent pending[MOTION_UPLOAD_BATCH_MAX];
+  static UploadBuilder upload;
+  bool energyPending = true;  // power summary rides along with the first batch
+
+  while (!journal_.empty()) {
+    size_t n = journal_.peek(pending, MOTION_UPLOAD_BATCH_MAX);
+    if (n == 0) break;
+
+    // Too big for one update: the power summary waits for the next batch,
+    // then fewer events go
+    bool withEnergy = energyPending;
+    buildBatch(upload, pending, n, withEnergy);
+    while (upload.overflow() && (withEnergy || n > 1)) {
+      if (withEnergy) withEnergy = false;
+      else n = (n + 1) / 2;
+      buildBatch(upload, pending, n, withEnergy);
+    }
+    if (upload.overflow()) {
+      hal_.log("Event does not fit in one update - keeping events\n");
+      break;
+    }
+    if (withEnergy) energyPending = false;
+
+    hal_.log("Uploading %u journaled event(s) to Firebase (%u bytes)...\n", (unsigned)n, (unsigned)upload.size());
+
+    if (!hal_.uploadBatch(upload.json())) {
+      hal_.log("Upload not acknowledged - keeping events\n");
+      break;
+    }
+
+    // Only acknowledged events leave the journal
+    journal_.consume(n);
+    rtc_.total_uploads += n;
+  }
+
+  uint32_t uploadDuration = hal_.uptimeMs() - uploadStartTime;
+  hal_.log("Radio on for %u ms\n", uploadDuration);
+
+  // Disconnect WiFi immediately
+  hal_.disconnectNetwork();
+  energy_.setActivity(ENERGY_CPU, hal_.uptimeMs());
+
+  rtc_.motion_active = false;
+
+  // Print statistics
+  hal_.log("\n--- Statistics ---\n");
+  hal_.log("Total Uploads: %u\n", rtc_.total_uploads);
+  hal_.log("Motion Events: %u\n", rtc_.motion_event_count);
+  hal_.log("Journal Pending: %u\n", (unsigned)journal_.size());
+  hal_.log("Boot Count: %u\n", rtc_.boot_count);
+  printEnergyReport();
+
+  // Return to deep sleep
+  enterDeepSleep(plan_.sleepMs);
+}
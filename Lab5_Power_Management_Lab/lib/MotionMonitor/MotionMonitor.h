@@ -0,0 +1,103 @@
+#pragma once
+
+#include <stdint.h>
+#include <EventJournal.h>
+#include <EventUpload.h>
+#include <TimeService.h>
+#include "BaselineEstimator.h"
+#include "DutyScheduler.h"
+#include "EnergyModel.h"
+#include "MotionConfig.h"
+#include "MotionHal.h"
+#include "WakeStub.h"
+
+typedef EventJournal<MOTION_JOURNAL_EVENTS> MotionJournal;
+
+// ============================================
+// RTC MEMORY (Persists Through Deep Sleep)
+// ============================================
+// Plain data with constant initializers, so it can be declared
+// RTC_DATA_ATTR and is only initialized on a power-on reset.
+// The last_* times are on the TimeService monotonic clock (low 32 bits).
+struct MotionRtcState {
+  DeviceState state = STATE_QUICK_CHECK;
+  float baseline_distance = -1.0f;
+  uint32_t last_motion_time = 0;
+  uint32_t last_upload_time = 0;
+  uint32_t last_baseline_update = 0;
+  uint32_t motion_event_count = 0;
+  uint32_t confirmed_count = 0;
+  uint32_t total_uploads = 0;
+  uint32_t boot_count = 0;
+  bool motion_active = false;
+  ActivityState activity = {};
+  WakeStubState stub = {};
+  BaselineState baseline = {};
+};
+
+// ====================== Smart motion detection state machine ======================
+// QUICK_CHECK -> ACTIVE_MONITOR -> UPLOAD_EVENT, with deep sleep in between.
+// Motion is judged against the BaselineEstimator kept in RTC memory;
+// baseline_distance mirrors its median for logs and the wake stub.
+// All hardware access goes through MotionHal; time spent in each state and
+// activity is booked in the EnergyLedger, and timing runs on the
+// sleep-compensated TimeService clock.
+class MotionMonitor {
+public:
+  MotionMonitor(MotionHal& hal, MotionRtcState& rtc, MotionJournal& journal,
+                EnergyLedger& energy, TimeService& time, const MotionConfig& config = MotionConfig())
+    : hal_(hal), rtc_(rtc), journal_(journal), energy_(energy), time_(time), cfg_(config),
+      scheduler_(rtc.activity), baseline_(rtc.baseline), plan_(DutyScheduler::fixedPlan(config)) {}
+
+  // Call once per wake, before the first step().
+  void onBoot(bool timerWake);
+
+  // Runs the current state. Returns true once deep sleep was requested
+  // (only observable in the simulator; on the board sleep never returns).
+  bool step();
+
+  // Monotonic ms across deep sleep (low 32 bits; compare by difference)
+  uint32_t clockMs() { return time_.now32(hal_.uptimeMs()); }
+
+  const MotionRtcState& rtc() const { return rtc_; }
+  MotionJournal& journal() { return journal_; }
+  const EnergyLedger& energy() const { return energy_; }
+  const TimeService& time() const { return time_; }
+  const BaselineEstimator& baseline() const { return baseline_; }
+  const DutyPlan& plan() const { return plan_; }
+  const MotionConfig& config() const { return cfg_; }
+
+  void printEnergyReport();
+
+private:
+  void stateQuickCheck();
+  void stateActiveMonitor();
+  void stateUploadEvent();
+
+  void enter(DeviceState state);
+  void markState(DeviceState state);
+  RangeBurst readBurst(uint8_t pings);
+  void idle(uint32_t ms);
+  size_t activityBucket();
+  void syncTime();
+  uint32_t epochSecAt(uint32_t stamp);
+  bool uploadDue();
+  uint32_t oldestEventAgeMs();
+  void buildBatch(UploadBuilder& upload, MotionEvent* events, size_t n, bool withEnergy);
+  void enterDeepSleep(uint32_t durationMs);
+  void armWakeStub(uint32_t sleepMs);
+  void collectWakeStub();
+  void updateBaseline(float distance);
+  BaselineVerdict detectMotion(float currentDistance, bool active, uint8_t readings = 1) const;
+
+  MotionHal& hal_;
+  MotionRtcState& rtc_;
+  MotionJournal& journal_;
+  EnergyLedger& energy_;
+  TimeService& time_;
+  MotionConfig cfg_;
+  DutyScheduler scheduler_;
+  BaselineEstimator baseline_;
+  DutyPlan plan_;
+  bool sleeping_ = false;
+};
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <stdint.h>
+
+// ====================== Wake-on-motion stub ======================
+// The ESP32-C3 has no ULP coprocessor, but a deep-sleep wake stub runs from
+// RTC fast memory before the bootloader loads the app. The stub takes one
+// ping, compares it to the baseline and goes straight back to sleep unless
+// something changed, so the main core (setup(), Serial, the 500 ms delay)
+// only boots for motion, a failing sensor or periodic housekeeping.
+//
+// Everything here is integer-only and force-inlined: the stub cannot call
+// into flash, and soft-float helpers live there.
+static const uint32_t WAKE_STUB_ARMED = 0x53545542;   // "STUB"
+static const uint32_t WAKE_STUB_CHECK_MS = 12;        // stub run: ROM entry + one ping at ~1.5 m
+static const uint16_t WAKE_STUB_MAX_FAILURES = 3;     // consecutive failed pings before booting
+static const uint32_t WAKE_STUB_MIN_ECHO_US = 116;    // 2 cm (same valid range as the main core)
+static const uint32_t WAKE_STUB_MAX_ECHO_US = 23280;  // 400 cm
+static const float WAKE_STUB_US_PER_CM = 58.2f;       // HC-SR04 round trip, matches readUltrasonicDistance()
+
+enum WakeStubDecision : uint8_t {
+  WAKE_STUB_SLEEP,          // nothing changed, back to sleep
+  WAKE_STUB_BOOT_MOTION,    // change above the threshold
+  WAKE_STUB_BOOT_SENSOR,    // pings keep failing, let the main core look
+  WAKE_STUB_BOOT_DUE,       // housekeeping (baseline refresh, uploads, scheduler)
+  WAKE_STUB_BOOT_UNARMED    // no baseline handed over
+};
+
+// Shared between the main core (fills it in before sleeping) and the stub.
+// Lives inside MotionRtcState.
+struct WakeStubState {
+  uint32_t armed;             // WAKE_STUB_ARMED when the fields below are valid
+  uint32_t baselineEchoUs;
+  uint32_t thresholdEchoUs;
+  uint32_t sleepUs;
+  uint16_t maxSkips;          // boot the main core after this many quiet checks
+  uint16_t skipped;           // quiet checks since the main core last ran
+  uint16_t failures;          // consecutive failed pings
+  uint8_t lastDecision;
+  uint32_t lastEchoUs;
+  uint32_t totalChecks;
+  uint32_t totalSkips;
+};
+
+// Main core, before deep sleep. maxAwayMs bounds how long the main core
+// may stay down; the stub never skips more cycles than that.
+inline void wakeStubArm(WakeStubState& s, float baselineCm, float thresholdCm, uint32_t sleepMs, uint32_t maxAwayMs) {
+  s.baselineEchoUs = (uint32_t)(baselineCm * WAKE_STUB_US_PER_CM + 0.5f);
+  s.thresholdEchoUs = (uint32_t)(thresholdCm * WAKE_STUB_US_PER_CM + 0.5f);
+  s.sleepUs = sleepMs * 1000;
+  uint32_t skips = sleepMs ? maxAwayMs / sleepMs : 0;
+  s.maxSkips = (uint16_t)(skips > 0xFFFF ? 0xFFFF : skips);
+  s.skipped = 0;
+  s.failures = 0;
+  s.armed = WAKE_STUB_ARMED;
+}
+
+// Stub, once per timer wake. echoUs is the measured echo (0 on timeout).
+__attribute__((always_inline)) inline WakeStubDecision wakeStubDecide(WakeStubState& s, uint32_t echoUs) {
+  WakeStubDecision d = WAKE_STUB_SLEEP;
+  s.lastEchoUs = echoUs;
+
+  if (s.armed != WAKE_STUB_ARMED) {
+    d = WAKE_STUB_BOOT_UNARMED;
+  } else {
+    s.totalChecks++;
+    if (echoUs < WAKE_STUB_MIN_ECHO_US || echoUs > WAKE_STUB_MAX_ECHO_US) {
+      if (++s.failures >= WAKE_STUB_MAX_FAILURES) d = WAKE_STUB_BOOT_SENSOR;
+    } else {
+      s.failures = 0;
+      uint32_t change = echoUs > s.baselineEchoUs ? echoUs - s.baselineEchoUs : s.baselineEchoUs - echoUs;
+      if (change > s.thresholdEchoUs) d = WAKE_STUB_BOOT_MOTION;
+    }
+    if (d == WAKE_STUB_SLEEP && s.skipped >= s.maxSkips) d = WAKE_STUB_BOOT_DUE;
+  }
+
+  if (d == WAKE_STUB_SLEEP) {
+    s.skipped++;
+    s.totalSkips++;
+  }
+  s.lastDecision = d;
+  return d;
+}
+
+inline const char* wakeStubDecisionName(uint8_t d) {
+  switch (d) {
+    case WAKE_STUB_SLEEP: return "sleep";
+    case WAKE_STUB_BOOT_MOTION: return "motion";
+    case WAKE_STUB_BOOT_SENSOR: return "sensor failing";
+    case WAKE_STUB_BOOT_DUE: return "housekeeping";
+    case WAKE_STUB_BOOT_UNARMED: return "not armed";
+  }
+  return "?";
+}
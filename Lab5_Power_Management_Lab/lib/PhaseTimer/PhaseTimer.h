@@ -0,0 +1,60 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// ====================== Upload phase timing ======================
+// Per-phase durations of one upload wake-up, plus a running total per phase
+// across wake-ups (keep the totals RTC_DATA_ATTR to survive deep sleep).
+enum UploadPhase : uint8_t {
+  PHASE_WIFI_ASSOC,  // WiFi.begin() -> associated
+  PHASE_DHCP,        // associated -> got IP
+  PHASE_AUTH,        // app init until ready (TLS + sign-in, or cached token)
+  PHASE_WRITE,       // update sent -> acknowledged
+  PHASE_COUNT
+};
+
+struct PhaseTotals {
+  uint32_t samples[PHASE_COUNT];
+  uint32_t totalMs[PHASE_COUNT];
+};
+
+class PhaseTimer {
+public:
+  static const char* name(UploadPhase p) {
+    static const char* const names[PHASE_COUNT] = { "wifi_assoc", "dhcp", "auth", "write" };
+    return p < PHASE_COUNT ? names[p] : "?";
+  }
+
+  void reset() {
+    for (size_t i = 0; i < PHASE_COUNT; i++) { startMs_[i] = 0; durMs_[i] = 0; started_[i] = done_[i] = false; }
+  }
+
+  void start(UploadPhase p, uint32_t nowMs) { startMs_[p] = nowMs; started_[p] = true; done_[p] = false; }
+
+  // Ignored if the phase never started (e.g. a WiFi event was missed).
+  void stop(UploadPhase p, uint32_t nowMs) {
+    if (!started_[p]) return;
+    durMs_[p] = nowMs - startMs_[p];
+    started_[p] = false;
+    done_[p] = true;
+  }
+
+  bool done(UploadPhase p) const { return done_[p]; }
+  uint32_t ms(UploadPhase p) const { return durMs_[p]; }
+
+  // Fold the finished phases of this wake-up into the running totals.
+  void accumulate(PhaseTotals& totals) const {
+    for (size_t i = 0; i < PHASE_COUNT; i++) {
+      if (!done_[i]) continue;
+      totals.samples[i]++;
+      totals.totalMs[i] += durMs_[i];
+    }
+  }
+
+private:
+  uint32_t startMs_[PHASE_COUNT] = {};
+  uint32_t durMs_[PHASE_COUNT] = {};
+  bool started_[PHASE_COUNT] = {};
+  bool done_[PHASE_COUNT] = {};
+};
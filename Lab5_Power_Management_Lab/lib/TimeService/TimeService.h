@@ -0,0 +1,118 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// ====================== Time across deep sleep ======================
+// millis() restarts after every deep sleep, so on its own it cannot measure
+// anything longer than one wake-up. TimeService keeps a monotonic clock in
+// RTC memory: the time at which this wake's millis() started, advanced by
+// the awake time plus the programmed sleep before every deep sleep.
+//
+// The sleep timer runs off the RTC oscillator and millis() does not see the
+// boot after a timer wake, so the monotonic clock slowly falls behind. Every
+// SNTP sync anchors it to epoch time and measures that error; the error per
+// booked sleep millisecond becomes a scale applied to later sleeps.
+// Declare the state RTC_DATA_ATTR in the sketch.
+struct ClockState {
+  uint32_t magic;
+  uint64_t wakeBaseMs;        // monotonic time at millis() == 0 of this wake
+  int64_t epochOffsetMs;      // epoch = monotonic + offset, once synced
+  uint64_t lastSyncMs;        // monotonic time of the last sync
+  uint64_t sleptSinceSyncMs;  // booked sleep since the last sync
+  float sleepScale;           // real sleep / programmed sleep
+  int32_t lastErrorMs;        // correction applied by the last sync
+  uint32_t syncs;
+  bool synced;
+};
+
+class TimeService {
+public:
+  static const uint32_t MAGIC = 0x434C4B31;  // "CLK1"
+  static constexpr float SCALE_MIN = 0.9f;   // a sync error beyond +-10% is a bad sample
+  static constexpr float SCALE_MAX = 1.1f;
+
+  explicit TimeService(ClockState& state) : s_(state) {}
+
+  // Call once per boot; RTC memory is garbage after a power-on reset.
+  void begin() {
+    if (s_.magic != MAGIC || !(s_.sleepScale >= SCALE_MIN && s_.sleepScale <= SCALE_MAX)) {
+      s_.magic = MAGIC;
+      s_.wakeBaseMs = 0;
+      s_.epochOffsetMs = 0;
+      s_.lastSyncMs = 0;
+      s_.sleptSinceSyncMs = 0;
+      s_.sleepScale = 1.0f;
+      s_.lastErrorMs = 0;
+      s_.syncs = 0;
+      s_.synced = false;
+    }
+  }
+
+  // Monotonic milliseconds since the first power-on; uptimeMs is millis().
+  uint64_t nowMs(uint32_t uptimeMs) const { return s_.wakeBaseMs + uptimeMs; }
+
+  // Low 32 bits, for stored timestamps; compare them by unsigned difference.
+  uint32_t now32(uint32_t uptimeMs) const { return (uint32_t)nowMs(uptimeMs); }
+
+  // Widens a 32-bit timestamp from the last ~49 days back to 64 bits.
+  uint64_t widen(uint32_t stamp, uint32_t uptimeMs) const {
+    uint64_t now = nowMs(uptimeMs);
+    return now - (uint32_t)((uint32_t)now - stamp);
+  }
+
+  // Call right before deep sleep; the next wake continues from here.
+  void prepareSleep(uint32_t sleepMs, uint32_t uptimeMs) {
+    uint64_t booked = (uint64_t)(sleepMs * (double)s_.sleepScale + 0.5);
+    s_.wakeBaseMs += uptimeMs + booked;
+    s_.sleptSinceSyncMs += booked;
+  }
+
+  // A whole sleep + awake cycle that the main core did not run (the
+  // wake stub checked and went back to sleep).
+  void addCycle(uint32_t sleepMs, uint32_t awakeMs) {
+    uint64_t booked = (uint64_t)(sleepMs * (double)s_.sleepScale + 0.5);
+    s_.wakeBaseMs += awakeMs + booked;
+    s_.sleptSinceSyncMs += booked;
+  }
+
+  bool synced() const { return s_.synced; }
+
+  // A sync is worth doing when never synced or the last one is old.
+  bool needsSync(uint32_t uptimeMs, uint32_t resyncMs) const {
+    return !s_.synced || nowMs(uptimeMs) - s_.lastSyncMs >= resyncMs;
+  }
+
+  // Anchors the clock to an SNTP result and re-estimates the sleep scale.
+  void onSync(uint64_t epochMs, uint32_t uptimeMs) {
+    uint64_t now = nowMs(uptimeMs);
+    if (s_.synced) {
+      int64_t error = (int64_t)epochMs - (int64_t)(now + s_.epochOffsetMs);
+      s_.lastErrorMs = (int32_t)error;
+      if (s_.sleptSinceSyncMs > 0) {
+        float scale = s_.sleepScale * (1.0f + (float)error / (float)s_.sleptSinceSyncMs);
+        if (scale >= SCALE_MIN && scale <= SCALE_MAX) s_.sleepScale = scale;
+      }
+      // Move the monotonic clock forward only; epoch absorbs the rest
+      if (error > 0) s_.wakeBaseMs += error;
+    }
+    s_.epochOffsetMs = (int64_t)epochMs - (int64_t)nowMs(uptimeMs);
+    s_.lastSyncMs = nowMs(uptimeMs);
+    s_.sleptSinceSyncMs = 0;
+    s_.synced = true;
+    s_.syncs++;
+  }
+
+  // Epoch milliseconds for a monotonic time; 0 until the first sync.
+  uint64_t epochAt(uint64_t monoMs) const {
+    return s_.synced ? (uint64_t)((int64_t)monoMs + s_.epochOffsetMs) : 0;
+  }
+  uint64_t epochMs(uint32_t uptimeMs) const { return epochAt(nowMs(uptimeMs)); }
+
+  float sleepScale() const { return s_.sleepScale; }
+  int32_t lastErrorMs() const { return s_.lastErrorMs; }
+  uint32_t syncs() const { return s_.syncs; }
+
+private:
+  ClockState& s_;
+};
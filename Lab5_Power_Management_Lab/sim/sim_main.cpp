@@ -0,0 +1,1474 @@
+// ============================================
+// Smart Motion Detection - native simulator
+// ============================================
+// Runs the firmware's MotionMonitor state machine on the host against a
+// virtual clock. The sensor is driven by a recorded trace or by synthetic
+// motion episodes; WiFi and Firebase are modelled as fixed latencies, with a
+// mock Realtime Database that checks and stores every update.
+//
+//   pio run -e native && .pio/build/native/program --days 7 --timeline
+//
+// Options:
+//   --days N        virtual time to simulate (default 7)
+//   --rate R        synthetic motion episodes per hour (default 2)
+//   --profile P     flat | office (office: 3x rate 08-18 h, 0.1x at night)
+//   --trace FILE    CSV "t_s,distance_cm[,motion]" trace, replayed in a loop;
+//                   the optional 0/1 motion column labels the ground truth
+//   --seed S        random seed (default 1)
+//   --rtc-drift P   sleep timer error in ppm, real = programmed * (1 + P/1e6)
+//                   (default 20000: the uncalibrated RC oscillator is off by %)
+//   --fixed         fixed normal/extended sleep instead of the adaptive schedule
+//   --budget MA     energy budget of the adaptive schedule in mA
+//   --wake-stub     emulate the wake-on-motion stub (quiet timer wakes ping
+//                   from the stub and never boot the main core)
+//   --glitch F      fraction of readings that are bad echoes (random distance
+//                   or timeout)
+//   --scene-drift C background distance drift in cm per day
+//   --ack-loss F    fraction of upload acknowledgements lost after the
+//                   database applied the update (the firmware retries)
+//   --simple-baseline
+//                   single-reading baseline instead of the robust estimator
+//   --delay-monitor one ping per active-monitor check and delay() between
+//                   checks, instead of voted bursts and light sleep
+//   --sweep         evaluation harness: detection latency vs. energy for the
+//                   fixed policy and a range of budgets on the same trace,
+//                   each with and without the wake stub
+//   --bench         test bench: false alarms and misses of the simple and
+//                   robust baseline under glitches and drift, then
+//                   ACTIVE_MONITOR charge per confirmed event for delay()
+//                   vs. burst + light sleep
+//   --sched-bench   shared_lib CoopScheduler on a virtual clock with the Lab4
+//                   server's task set and random interrupt posts: deadline
+//                   lateness (jitter), post-to-run latency and time in light
+//                   sleep for a delay(10) loop vs. the scheduler's idle modes
+//   --upload-bench  upload path against the mock database: update sizes,
+//                   builder overflow, batch fallback, lost acks, and radio-on
+//                   time per event by flush threshold; non-zero on a failure
+//   --flush-replay  the same days under several journal flush policies
+//                   (count, age): radio time vs. how long events wait, flat
+//                   and office profile; non-zero if an age limit is missed
+//   --auth-bench    cached ID token (AuthCache) and upload phase times
+//                   (PhaseTimer) against a stand-in auth server: sign-ins,
+//                   refused and expired tokens, clock error and wrap
+//   --latency-test  WiFi connect-time percentiles (ConnectLatency) from
+//                   known samples; non-zero on a failure
+//   --timeline      print one CSV line per state change / wakeup / upload
+//   --verbose       print the firmware's serial log
+//
+// Charge is estimated with the firmware's own EnergyLedger and the default
+// CurrentTable, so the numbers are comparable with the uploaded power/ summary.
+// Detection latency is measured from the start of each motion episode in the
+// trace to the first wake that saw it; episodes that end unseen are missed.
+// An ACTIVE_MONITOR entry outside every episode is a false alarm, and so is
+// a confirmed event from one.
+
+#include <ctype.h>
+#include <math.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <map>
+#include <random>
+#include <set>
+#include <string>
+#include <vector>
+
+#include <AuthCache.h>
+#include <ConnectLatency.h>
+#include <CoopScheduler.h>
+#include <MotionMonitor.h>
+#include <PhaseTimer.h>
+
+// ============================================
+// SIMULATION PARAMETERS
+// ============================================
+
+// Timing of the things the firmware waits on
+const uint32_t SIM_BOOT_MS = 550;           // ROM boot + setup() incl. delay(500)
+const uint32_t SIM_SENSOR_READ_MS = 12;     // trigger + echo + yield
+const uint32_t SIM_WIFI_CONNECT_MS = 450;   // cached BSSID/IP reconnect
+const uint32_t SIM_DB_INIT_MS = 350;        // TLS + cached token
+const uint32_t SIM_UPLOAD_MS = 300;         // one multi-location PATCH: round trip
+const uint32_t SIM_UPLOAD_MS_PER_KB = 20;   // plus the body over TLS
+const uint32_t SIM_NTP_MS = 80;             // one SNTP round trip
+const uint32_t SIM_SIGN_IN_MS = 650;        // email/password sign-in instead of a cached token
+const uint64_t SIM_EPOCH_START_MS = 1767225600000ULL;  // 2026-01-01 00:00:00 UTC
+
+// Synthetic scene
+const float SIM_BASELINE_CM = 150.0f;
+const float SIM_MOTION_CM = 60.0f;
+const float SIM_NOISE_CM = 0.8f;
+const float SIM_TRACE_MOTION_CM = 10.0f;    // trace episodes: this far from the first sample
+
+struct SimOptions {
+  double days = 7.0;
+  double rate = 2.0;
+  bool office = false;
+  const char* tracePath = nullptr;
+  uint32_t seed = 1;
+  double rtcDriftPpm = 20000;
+  double glitchRate = 0;
+  double sceneDriftCmPerDay = 0;
+  double ackLoss = 0;
+  bool timeline = false;
+  bool verbose = false;
+};
+
+// ============================================
+// SENSOR TRACE
+// ============================================
+
+struct TracePoint {
+  uint64_t t_ms;
+  float cm;
+  int label;  // 1 motion, 0 still, -1 unlabeled
+};
+
+struct Episode {
+  uint64_t start, end;
+};
+
+class SensorTrace {
+public:
+  SensorTrace(const SimOptions& opt) : opt_(opt), rng_(opt.seed) {}
+
+  bool load(const char* path) {
+    FILE* f = fopen(path, "r");
+    if (!f) return false;
+    char line[128];
+    double t;
+    float cm;
+    int label;
+    while (fgets(line, sizeof(line), f)) {
+      int fields = sscanf(line, "%lf,%f,%d", &t, &cm, &label);
+      if (fields >= 2) points_.push_back({ (uint64_t)(t * 1000.0), cm, fields == 3 ? label : -1 });
+    }
+    fclose(f);
+    return !points_.empty();
+  }
+
+  // Ground-truth motion episodes up to endMs; call once before the run
+  void prepare(uint64_t endMs) {
+    episodes_.clear();
+    if (!points_.empty()) {
+      traceEpisodes(endMs);
+    } else {
+      syntheticEpisodes(endMs);
+    }
+  }
+
+  // Distance at virtual time t (queries must not go backwards), with the
+  // configured scene drift and bad echoes on top
+  float at(uint64_t t) {
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+    if (opt_.glitchRate > 0 && unit(glitchRng_) < opt_.glitchRate) {
+      return unit(glitchRng_) < 0.5f ? -1.0f : 2.0f + 398.0f * unit(glitchRng_);
+    }
+    float drift = (float)(opt_.sceneDriftCmPerDay * t / 86400000.0);
+    if (!points_.empty()) return replay(t) + drift;
+
+    while (cursor_ < episodes_.size() && episodes_[cursor_].end <= t) cursor_++;
+    bool inMotion = cursor_ < episodes_.size() && t >= episodes_[cursor_].start;
+    std::normal_distribution<float> noise(0.0f, SIM_NOISE_CM);
+    return (inMotion ? SIM_MOTION_CM : SIM_BASELINE_CM + drift) + noise(rng_);
+  }
+
+  const std::vector<Episode>& episodes() const { return episodes_; }
+
+private:
+  float replay(uint64_t t) {
+    uint64_t local = t % span();
+    auto it = std::upper_bound(points_.begin(), points_.end(), local,
+                               [](uint64_t v, const TracePoint& p) { return v < p.t_ms; });
+    return it == points_.begin() ? points_[0].cm : (it - 1)->cm;
+  }
+
+  uint64_t span() const { return points_.back().t_ms + 1; }
+
+  // Labeled runs, or without labels runs of samples away from the first
+  // one; repeated for every loop
+  void traceEpisodes(uint64_t endMs) {
+    std::vector<Episode> loop;
+    float baseline = points_[0].cm;
+    bool labeled = std::any_of(points_.begin(), points_.end(), [](const TracePoint& p) { return p.label >= 0; });
+    bool in = false;
+    for (const TracePoint& p : points_) {
+      bool moving = labeled ? p.label > 0 : fabsf(p.cm - baseline) > SIM_TRACE_MOTION_CM;
+      if (moving && !in) loop.push_back({ p.t_ms, span() });
+      if (!moving && in) loop.back().end = p.t_ms;
+      in = moving;
+    }
+    for (uint64_t base = 0; base < endMs; base += span()) {
+      for (const Episode& e : loop) episodes_.push_back({ base + e.start, base + e.end });
+    }
+  }
+
+  // Poisson arrivals (thinned by the time-of-day profile), each episode
+  // 5 s to 2 min of someone standing close
+  void syntheticEpisodes(uint64_t endMs) {
+    double peak = opt_.rate * (opt_.office ? 3.0 : 1.0);
+    if (peak <= 0) return;
+    std::exponential_distribution<double> gap(peak / 3600000.0);
+    std::uniform_real_distribution<double> accept(0.0, 1.0);
+    std::uniform_int_distribution<uint32_t> length(5000, 120000);
+
+    uint64_t t = 0;
+    while (true) {
+      t += (uint64_t)gap(rng_);
+      if (t >= endMs) break;
+      if (accept(rng_) * peak > opt_.rate * profile(t)) continue;
+      Episode e = { t, t + length(rng_) };
+      episodes_.push_back(e);
+      t = e.end;
+    }
+  }
+
+  double profile(uint64_t t) const {
+    if (!opt_.office) return 1.0;
+    unsigned hour = (unsigned)((SIM_EPOCH_START_MS + t) / 3600000ULL % 24);
+    return (hour >= 8 && hour < 18) ? 3.0 : 0.1;
+  }
+
+  const SimOptions& opt_;
+  std::mt19937 rng_;
+  std::mt19937 glitchRng_{ 0x5EED };
+  std::vector<TracePoint> points_;
+  std::vector<Episode> episodes_;
+  size_t cursor_ = 0;
+};
+
+// ============================================
+// MOCK REALTIME DATABASE
+// ============================================
+// Stands in for Firebase RTDB behind uploadBatch(). The body of a
+// multi-location update is parsed the way the server takes it: one flat
+// JSON object of "path": value, paths that do not overlap. Anything else is
+// refused whole, as the server answers 400, and nothing is stored. null
+// deletes the path. Values are kept as their JSON text.
+
+class MockRtdb {
+public:
+  // False for a malformed update
+  bool patch(const char* json) {
+    requests_++;
+    bytes_ += strlen(json);
+    std::vector<std::pair<std::string, std::string>> fields;
+    if (!parse(json, fields) || overlapping(fields)) {
+      rejected_++;
+      return false;
+    }
+    for (const auto& f : fields) {
+      if (f.second == "null") data_.erase(f.first);
+      else data_[f.first] = f.second;
+    }
+    return true;
+  }
+
+  bool has(const std::string& path) const { return data_.count(path) > 0; }
+  std::string get(const std::string& path) const {
+    auto it = data_.find(path);
+    return it == data_.end() ? std::string() : it->second;
+  }
+  // Children of prefix ("events/") one level down
+  size_t children(const std::string& prefix) const {
+    std::set<std::string> names;
+    for (auto it = data_.lower_bound(prefix); it != data_.end() && !it->first.compare(0, prefix.size(), prefix); ++it) {
+      names.insert(it->first.substr(prefix.size(), it->first.find('/', prefix.size()) - prefix.size()));
+    }
+    return names.size();
+  }
+
+  uint32_t requests() const { return requests_; }
+  uint32_t rejected() const { return rejected_; }
+  uint64_t bytes() const { return bytes_; }
+
+  // One body on its own: the fields, or false if the server would refuse it
+  static bool parse(const char* p, std::vector<std::pair<std::string, std::string>>& out) {
+    if (*p++ != '{') return false;
+    if (*p == '}') return p[1] == '\0';
+    for (;;) {
+      std::string key, value;
+      if (!string(p, key) || *p++ != ':' || !scalar(p, value) || !validPath(key)) return false;
+      out.push_back({ key, value });
+      if (*p == '}') return p[1] == '\0';
+      if (*p++ != ',') return false;
+    }
+  }
+
+private:
+  static bool string(const char*& p, std::string& out) {
+    if (*p++ != '"') return false;
+    const char* end = strchr(p, '"');
+    if (!end) return false;
+    out.assign(p, end);
+    p = end + 1;
+    return out.find('\\') == std::string::npos;
+  }
+
+  static bool scalar(const char*& p, std::string& out) {
+    const char* start = p;
+    if (*p == '"') {
+      std::string s;
+      if (!string(p, s)) return false;
+    } else if (!strncmp(p, "true", 4) || !strncmp(p, "null", 4)) {
+      p += 4;
+    } else if (!strncmp(p, "false", 5)) {
+      p += 5;
+    } else {
+      if (*p == '-') p++;
+      if (!isdigit((unsigned char)*p)) return false;
+      while (isdigit((unsigned char)*p)) p++;
+      if (*p == '.') {
+        p++;
+        if (!isdigit((unsigned char)*p)) return false;
+        while (isdigit((unsigned char)*p)) p++;
+      }
+    }
+    out.assign(start, p);
+    return true;
+  }
+
+  // Non-empty segments, none of the characters RTDB keys cannot hold
+  static bool validPath(const std::string& path) {
+    if (path.empty() || path.front() == '/' || path.back() == '/' || path.find("//") != std::string::npos) {
+      return false;
+    }
+    return path.find_first_of(".#$[]") == std::string::npos;
+  }
+
+  // "a/b" next to "a/b" or "a/b/c" in one update is an error
+  static bool overlapping(std::vector<std::pair<std::string, std::string>> fields) {
+    std::sort(fields.begin(), fields.end());
+    for (size_t i = 1; i < fields.size(); i++) {
+      const std::string& a = fields[i - 1].first;
+      const std::string& b = fields[i].first;
+      if (a == b || (!b.compare(0, a.size(), a) && b[a.size()] == '/')) return true;
+    }
+    return false;
+  }
+
+  std::map<std::string, std::string> data_;
+  uint32_t requests_ = 0;
+  uint32_t rejected_ = 0;
+  uint64_t bytes_ = 0;
+};
+
+// ============================================
+// SIMULATED HARDWARE
+// ============================================
+
+static const char* stateName(DeviceState s) {
+  switch (s) {
+    case STATE_DEEP_SLEEP: return "DEEP_SLEEP";
+    case STATE_QUICK_CHECK: return "QUICK_CHECK";
+    case STATE_ACTIVE_MONITOR: return "ACTIVE_MONITOR";
+    case STATE_UPLOAD_EVENT: return "UPLOAD_EVENT";
+  }
+  return "?";
+}
+
+class SimHal : public MotionHal {
+public:
+  SimHal(SensorTrace& trace, const SimOptions& opt)
+    : trace_(trace), sleepFactor_(1.0 + opt.rtcDriftPpm / 1e6), timeline_(opt.timeline), verbose_(opt.verbose) {}
+
+  // Power-on or timer wake: millis() restarts after the boot overhead
+  void beginWake() {
+    wakeStart_ = now_;
+    advance(SIM_BOOT_MS);
+    sleeping_ = false;
+    wakeups_++;
+    event("WAKE", "boot=%u", wakeups_);
+  }
+
+  uint32_t uptimeMs() override { return (uint32_t)(now_ - wakeStart_); }
+  void delayMs(uint32_t ms) override { advance(ms); }
+
+  float readDistanceCm() override {
+    advance(SIM_SENSOR_READ_MS);
+    float cm = trace_.at(now_);
+    return (cm < 2.0f || cm > 400.0f) ? -1.0f : cm;
+  }
+
+  bool connectNetwork() override {
+    radioOnAt_ = now_;
+    advance(SIM_WIFI_CONNECT_MS);
+    event("WIFI_UP", "");
+    return true;
+  }
+
+  void disconnectNetwork() override {
+    uint64_t on = now_ - radioOnAt_;
+    radioMs_ += on;
+    radioMaxMs_ = std::max(radioMaxMs_, on);
+    radioWakes_++;
+    event("WIFI_DOWN", "on_ms=%llu", (unsigned long long)on);
+  }
+
+  bool initDatabase() override {
+    advance(SIM_DB_INIT_MS);
+    return true;
+  }
+
+  // The database applies the update; an acknowledgement can still be lost
+  // on the way back (ackLoss), and then the firmware sends it again
+  bool uploadBatch(const char* json) override {
+    size_t bytes = strlen(json);
+    advance(SIM_UPLOAD_MS + (uint32_t)(bytes * SIM_UPLOAD_MS_PER_KB / 1024));
+    uploads_++;
+    uploadBytes_ += bytes;
+    bool applied = db_.patch(json);
+    bool acked = applied && std::uniform_real_distribution<double>(0, 1)(ackRng_) >= ackLoss_;
+    event("UPLOAD", "bytes=%u%s", (unsigned)bytes, applied ? (acked ? "" : " ack-lost") : " rejected");
+    return acked;
+  }
+
+  void setAckLoss(double p) { ackLoss_ = p; }
+
+  bool syncTime(uint64_t& epochMs) override {
+    advance(SIM_NTP_MS);
+    epochMs = epochNow();
+    event("NTP", "");
+    return true;
+  }
+
+  void deepSleep(uint32_t ms) override {
+    event("SLEEP", "ms=%u", ms);
+    now_ += (uint64_t)(ms * sleepFactor_ + 0.5);
+    sleeping_ = true;
+    if (stubEnabled_ && stub_) runWakeStub();
+  }
+
+  // The stub state lives in MotionRtcState, which is built after the HAL
+  void attachWakeStub(WakeStubState* stub) { stub_ = stub; }
+
+  bool enableWakeStub(bool on) override {
+    stubEnabled_ = on;
+    return true;
+  }
+
+  void log(const char* fmt, ...) override {
+    if (!verbose_) return;
+    va_list args;
+    va_start(args, fmt);
+    vprintf(fmt, args);
+    va_end(args);
+  }
+
+  void onStateEnter(DeviceState state) override {
+    if (state == STATE_ACTIVE_MONITOR) detections_.push_back(now_);
+    if (state != STATE_DEEP_SLEEP) event("STATE", "%s", stateName(state));
+  }
+
+  uint64_t now() const { return now_; }
+  uint64_t epochNow() const { return SIM_EPOCH_START_MS + now_; }
+  bool sleeping() const { return sleeping_; }
+  uint32_t wakeups() const { return wakeups_; }
+  uint32_t stubChecks() const { return stubChecks_; }
+  uint32_t uploads() const { return uploads_; }
+  uint64_t uploadBytes() const { return uploadBytes_; }
+  uint64_t radioMs() const { return radioMs_; }
+  uint64_t radioMaxMs() const { return radioMaxMs_; }
+  uint32_t radioWakes() const { return radioWakes_; }
+  const MockRtdb& db() const { return db_; }
+  const std::vector<uint64_t>& detections() const { return detections_; }
+
+private:
+  void advance(uint32_t ms) { now_ += ms; }
+
+  // Timer wakes that the stub handles on its own, using the firmware's
+  // wakeStubDecide() on an echo time built from the trace
+  void runWakeStub() {
+    for (;;) {
+      float cm = trace_.at(now_);
+      uint32_t echoUs = (cm < 2.0f || cm > 400.0f) ? 0 : (uint32_t)(cm * WAKE_STUB_US_PER_CM + 0.5f);
+      advance(WAKE_STUB_CHECK_MS);
+      stubChecks_++;
+      WakeStubDecision d = wakeStubDecide(*stub_, echoUs);
+      if (d != WAKE_STUB_SLEEP) {
+        event("STUB_BOOT", "%s", wakeStubDecisionName(d));
+        return;
+      }
+      now_ += (uint64_t)(stub_->sleepUs / 1000 * sleepFactor_ + 0.5);
+    }
+  }
+
+  void event(const char* kind, const char* fmt, ...) {
+    if (!timeline_) return;
+    char detail[64];
+    va_list args;
+    va_start(args, fmt);
+    vsnprintf(detail, sizeof(detail), fmt, args);
+    va_end(args);
+    printf("%.3f,%s,%s\n", now_ / 1000.0, kind, detail);
+  }
+
+  SensorTrace& trace_;
+  double sleepFactor_;
+  bool timeline_, verbose_;
+  uint64_t now_ = 0, wakeStart_ = 0;
+  bool sleeping_ = false;
+  uint32_t wakeups_ = 0, uploads_ = 0, stubChecks_ = 0;
+  uint64_t uploadBytes_ = 0;
+  uint64_t radioOnAt_ = 0, radioMs_ = 0, radioMaxMs_ = 0;
+  uint32_t radioWakes_ = 0;
+  MockRtdb db_;
+  std::mt19937 ackRng_{7};
+  double ackLoss_ = 0;
+  WakeStubState* stub_ = nullptr;
+  bool stubEnabled_ = false;
+  std::vector<uint64_t> detections_;  // virtual time of each ACTIVE_MONITOR entry
+};
+
+// Flash spill kept in RAM
+class MemoryJournalSpill : public JournalSpill {
+public:
+  size_t count() override { return events_.size(); }
+  bool append(const MotionEvent* events, size_t n) override {
+    events_.insert(events_.end(), events, events + n);
+    return true;
+  }
+  size_t read(MotionEvent* out, size_t max) override {
+    size_t n = events_.size() < max ? events_.size() : max;
+    for (size_t i = 0; i < n; i++) out[i] = events_[i];
+    return n;
+  }
+  void drop(size_t n) override { events_.erase(events_.begin(), events_.begin() + (n < events_.size() ? n : events_.size())); }
+
+private:
+  std::vector<MotionEvent> events_;
+};
+
+// ============================================
+// ONE RUN
+// ============================================
+
+struct SimResult {
+  bool ok = false;
+  double hours = 0;
+  double averageMa = 0;
+  double batteryLifeH = 0;
+  size_t episodes = 0;
+  size_t detected = 0;
+  double medianLatencyS = 0;
+  double p95LatencyS = 0;
+  uint32_t wakeups = 0;
+  uint32_t stubChecks = 0;
+  size_t falseAlarms = 0;
+  uint32_t monitorRuns = 0;
+  uint32_t confirmed = 0;
+  uint32_t falseConfirmed = 0;
+  double monitorMah = 0;      // awake charge spent in ACTIVE_MONITOR
+  double monitorAwakeS = 0;   // CPU and sensor time in ACTIVE_MONITOR
+  uint32_t uploaded = 0;      // events acknowledged
+  size_t stored = 0;          // events in the database
+  uint32_t requests = 0;
+  uint32_t rejected = 0;      // malformed updates
+  uint32_t radioSessions = 0;
+  double radioS = 0;
+  double radioMaxS = 0;
+  double maxPendingS = 0;     // oldest journaled event seen at a wake
+};
+
+static bool inEpisode(const std::vector<Episode>& episodes, uint64_t t) {
+  auto it = std::upper_bound(episodes.begin(), episodes.end(), t,
+                             [](uint64_t v, const Episode& e) { return v < e.start; });
+  return it != episodes.begin() && t < (it - 1)->end;
+}
+
+// Charge and time with the CPU running, i.e. not in any kind of sleep
+static double awakeMah(const EnergyLedger& energy, const CurrentTable& I) {
+  double mAh = 0;
+  for (size_t i = 0; i < ENERGY_COUNT; i++) {
+    if (i == ENERGY_DEEP_SLEEP || i == ENERGY_LIGHT_SLEEP || i == ENERGY_WAKE_STUB) continue;
+    mAh += energy.activityMs((EnergyActivity)i) * I.mA[i] / 3600000.0;
+  }
+  return mAh;
+}
+
+static double awakeS(const EnergyLedger& energy) {
+  return (energy.activityMs(ENERGY_CPU) + energy.activityMs(ENERGY_SENSOR)) / 1000.0;
+}
+
+// First detection inside each episode; detections outside all of them
+// are false alarms
+static void scoreDetections(const std::vector<Episode>& episodes, const std::vector<uint64_t>& detections,
+                            uint64_t endMs, SimResult& r) {
+  std::vector<double> latencies;
+  size_t d = 0;
+  for (const Episode& e : episodes) {
+    if (e.start >= endMs) break;
+    r.episodes++;
+    for (; d < detections.size() && detections[d] < e.start; d++) r.falseAlarms++;
+    if (d < detections.size() && detections[d] < e.end) latencies.push_back((detections[d] - e.start) / 1000.0);
+    while (d < detections.size() && detections[d] < e.end) d++;
+  }
+  r.falseAlarms += detections.size() - d;
+  r.detected = latencies.size();
+  if (latencies.empty()) return;
+  std::sort(latencies.begin(), latencies.end());
+  r.medianLatencyS = latencies[latencies.size() / 2];
+  r.p95LatencyS = latencies[(size_t)(latencies.size() * 0.95)];
+}
+
+static SimResult runSim(const SimOptions& opt, const MotionConfig& cfg, bool report) {
+  SimResult r;
+  SensorTrace trace(opt);
+  if (opt.tracePath && !trace.load(opt.tracePath)) {
+    fprintf(stderr, "cannot read trace %s\n", opt.tracePath);
+    return r;
+  }
+  const uint64_t endMs = (uint64_t)(opt.days * 86400000.0);
+  trace.prepare(endMs);
+
+  SimHal hal(trace, opt);
+  hal.setAckLoss(opt.ackLoss);
+  MotionRtcState rtc;
+  hal.attachWakeStub(&rtc.stub);
+  JournalState<MOTION_JOURNAL_EVENTS> journalState = {};
+  MemoryJournalSpill spill;
+  MotionJournal journal(journalState, &spill);
+  EnergyTotals energyTotals = {};
+  EnergyLedger energy(energyTotals);
+  ClockState clockState = {};
+  TimeService clock(clockState);
+  MotionMonitor monitor(hal, rtc, journal, energy, clock, cfg);
+
+  if (opt.timeline) printf("t_s,event,detail\n");
+
+  bool timerWake = false;
+  while (hal.now() < endMs) {
+    hal.beginWake();
+    monitor.onBoot(timerWake);
+    timerWake = true;
+    MotionEvent oldest;
+    if (journal.oldest(oldest)) {
+      r.maxPendingS = std::max(r.maxPendingS, (monitor.clockMs() - oldest.timestamp_ms) / 1000.0);
+    }
+
+    // A wake that never sleeps would hang the board; stop instead
+    int steps = 0;
+    bool asleep = false;
+    while (!asleep) {
+      // ACTIVE_MONITOR runs as one step; measure it from the outside
+      bool monitoring = rtc.state == STATE_ACTIVE_MONITOR;
+      uint64_t entered = hal.now();
+      uint32_t confirmed = rtc.confirmed_count;
+      double mAh = awakeMah(energy, cfg.current), awake = awakeS(energy);
+
+      asleep = monitor.step();
+
+      if (monitoring) {
+        r.monitorRuns++;
+        r.monitorMah += awakeMah(energy, cfg.current) - mAh;
+        r.monitorAwakeS += awakeS(energy) - awake;
+        if (rtc.confirmed_count != confirmed) {
+          r.confirmed++;
+          if (!inEpisode(trace.episodes(), entered)) r.falseConfirmed++;
+        }
+      }
+      if (!asleep && ++steps > 100) {
+        fprintf(stderr, "state machine did not sleep at t=%.3f s\n", hal.now() / 1000.0);
+        return r;
+      }
+    }
+  }
+
+  r.ok = true;
+  r.hours = hal.now() / 3600000.0;
+  r.averageMa = energy.averageMa(cfg.current);
+  r.batteryLifeH = energy.batteryLifeHours(cfg.current, cfg.batteryMah);
+  r.wakeups = hal.wakeups();
+  r.stubChecks = hal.stubChecks();
+  r.uploaded = rtc.total_uploads;
+  r.stored = hal.db().children("events/");
+  r.requests = hal.db().requests();
+  r.rejected = hal.db().rejected();
+  r.radioSessions = hal.radioWakes();
+  r.radioS = hal.radioMs() / 1000.0;
+  r.radioMaxS = hal.radioMaxMs() / 1000.0;
+  scoreDetections(trace.episodes(), hal.detections(), endMs, r);
+  if (!report) return r;
+
+  printf("\n--- Simulation summary (%.2f virtual days, %s schedule%s, %s baseline) ---\n", r.hours / 24.0,
+         cfg.adaptiveSchedule ? "adaptive" : "fixed", cfg.wakeStub ? ", wake stub" : "",
+         cfg.robustBaseline ? "robust" : "simple");
+  printf("Motion episodes:     %u (%u detected, latency median %.1f s, p95 %.1f s)\n",
+         (unsigned)r.episodes, (unsigned)r.detected, r.medianLatencyS, r.p95LatencyS);
+  printf("False alarms:        %u (%.1f per day)\n", (unsigned)r.falseAlarms, r.falseAlarms / (r.hours / 24.0));
+  printf("Active monitor:      %u runs, %u confirmed (%u outside episodes), %.1f s awake per run,\n"
+         "                     %.3f mAh per confirmed event\n",
+         r.monitorRuns, r.confirmed, r.falseConfirmed, r.monitorRuns ? r.monitorAwakeS / r.monitorRuns : 0.0,
+         r.confirmed ? r.monitorMah / r.confirmed : 0.0);
+  if (cfg.robustBaseline) {
+    printf("Baseline:            %.2f cm, spread %.2f cm, %u readings rejected, %u scene changes\n",
+           monitor.baseline().median(), monitor.baseline().spread(), monitor.baseline().rejected(),
+           monitor.baseline().relearns());
+  }
+  printf("Wakeups:             %u\n", hal.wakeups());
+  if (cfg.wakeStub) printf("Wake stub checks:    %u (%u booted the main core)\n", hal.stubChecks(), rtc.stub.totalChecks - rtc.stub.totalSkips);
+  printf("Motion detections:   %u\n", rtc.motion_event_count);
+  printf("Events uploaded:     %u\n", rtc.total_uploads);
+  printf("Events pending:      %u (oldest waited up to %.1f min)\n", (unsigned)journal.size(), r.maxPendingS / 60.0);
+  printf("Upload requests:     %u (%llu bytes, %u refused by the database)\n", hal.uploads(),
+         (unsigned long long)hal.uploadBytes(), r.rejected);
+  printf("Radio on:            %.1f s in %u session(s), %.2f s each, longest %.2f s, %.2f s per event\n", r.radioS,
+         r.radioSessions, r.radioSessions ? r.radioS / r.radioSessions : 0.0, r.radioMaxS,
+         r.uploaded ? r.radioS / r.uploaded : 0.0);
+  printf("Database:            %u event(s) stored\n", (unsigned)r.stored);
+
+  printf("\nTime per state:\n");
+  for (size_t i = 0; i < DEVICE_STATE_COUNT; i++) {
+    DeviceState s = (DeviceState)i;
+    printf("  %-15s %12.1f s\n", EnergyLedger::stateName(s), energy.stateMs(s) / 1000.0);
+  }
+  printf("Time and charge per activity:\n");
+  for (size_t i = 0; i < ENERGY_COUNT; i++) {
+    EnergyActivity a = (EnergyActivity)i;
+    printf("  %-15s %12.1f s %10.2f mAh\n", EnergyLedger::activityName(a), energy.activityMs(a) / 1000.0,
+           energy.activityMs(a) * cfg.current.mA[i] / 3600000.0);
+  }
+  printf("Estimated charge:    %.2f mAh (%.3f mAh per hour)\n", energy.chargeMah(cfg.current), r.averageMa);
+  if (clock.synced()) {
+    // The run ends asleep: compare the clock's start of the next wake
+    // (millis() == 0) against the true virtual time, counting the stub
+    // checks that wake would collect
+    double pendingMs = 0;
+    if (rtc.stub.armed == WAKE_STUB_ARMED) {
+      pendingMs = rtc.stub.skipped * (rtc.stub.sleepUs / 1000.0 * clock.sleepScale() + WAKE_STUB_CHECK_MS);
+    }
+    double errorS = ((double)clock.epochMs(0) + pendingMs - (double)hal.epochNow()) / 1000.0;
+    printf("Clock:               %u SNTP syncs, sleep scale %.4f, error at end %.1f s\n",
+           clock.syncs(), clock.sleepScale(), errorS);
+  } else {
+    printf("Clock:               never synced (no upload happened)\n");
+  }
+  printf("Battery life:        %.1f h on %.0f mAh\n", r.batteryLifeH, cfg.batteryMah);
+  return r;
+}
+
+// ============================================
+// EVALUATION HARNESS
+// ============================================
+
+static void printSweepRow(const char* policy, const SimResult& r) {
+  double detectedPct = r.episodes ? 100.0 * r.detected / r.episodes : 0.0;
+  printf("%-22s %8.3f %9.1f %8u %8u %8.1f %9.1f %9.1f %8.1f\n", policy, r.averageMa, r.batteryLifeH / 24.0,
+         r.wakeups, r.stubChecks, detectedPct, r.medianLatencyS, r.p95LatencyS, r.falseAlarms / (r.hours / 24.0));
+}
+
+static int sweep(const SimOptions& opt) {
+  static const float budgets[] = { 0.5f, 1.0f, 2.0f, 4.0f, 8.0f };
+
+  printf("%-22s %8s %9s %8s %8s %8s %9s %9s %8s\n", "policy", "avg_mA", "life_days", "wakeups", "stub",
+         "detect%", "median_s", "p95_s", "false/d");
+
+  for (int stub = 0; stub < 2; stub++) {
+    MotionConfig fixed;
+    fixed.adaptiveSchedule = false;
+    fixed.wakeStub = stub;
+    SimResult r = runSim(opt, fixed, false);
+    if (!r.ok) return 1;
+    printSweepRow(stub ? "fixed + stub" : "fixed", r);
+
+    for (float budget : budgets) {
+      MotionConfig adaptive;
+      adaptive.energyBudgetMa = budget;
+      adaptive.wakeStub = stub;
+      r = runSim(opt, adaptive, false);
+      if (!r.ok) return 1;
+      char name[32];
+      snprintf(name, sizeof(name), "adaptive %.1fmA%s", budget, stub ? " + stub" : "");
+      printSweepRow(name, r);
+    }
+  }
+  return 0;
+}
+
+// Simple vs. robust baseline on the fixed schedule, same trace and glitches
+static int bench(const SimOptions& base) {
+  static const double glitches[] = { 0.0, 0.01, 0.05 };
+  static const double drifts[] = { 0.0, 20.0 };
+
+  printf("%-8s %-8s %-8s %8s %8s %8s %8s\n", "baseline", "glitch", "drift_cm", "avg_mA", "detect%", "missed",
+         "false/d");
+  for (double drift : drifts) {
+    for (double glitch : glitches) {
+      for (int robust = 0; robust < 2; robust++) {
+        SimOptions opt = base;
+        opt.glitchRate = glitch;
+        opt.sceneDriftCmPerDay = drift;
+        MotionConfig cfg;
+        cfg.adaptiveSchedule = false;
+        cfg.robustBaseline = robust;
+        SimResult r = runSim(opt, cfg, false);
+        if (!r.ok) return 1;
+        double detectedPct = r.episodes ? 100.0 * r.detected / r.episodes : 0.0;
+        printf("%-8s %-8.2f %-8.0f %8.3f %8.1f %8u %8.1f\n", robust ? "robust" : "simple", glitch, drift,
+               r.averageMa, detectedPct, (unsigned)(r.episodes - r.detected), r.falseAlarms / (r.hours / 24.0));
+      }
+    }
+  }
+
+  printf("\n%-14s %-8s %8s %8s %9s %9s %11s %12s\n", "monitor", "glitch", "avg_mA", "detect%", "confirmed",
+         "false_cnf", "awake_s/run", "mAh/confirm");
+  for (double glitch : glitches) {
+    for (int burst = 0; burst < 2; burst++) {
+      SimOptions opt = base;
+      opt.glitchRate = glitch;
+      MotionConfig cfg;
+      cfg.adaptiveSchedule = false;
+      if (!burst) {
+        cfg.activeMonitorBurst = 1;
+        cfg.activeMonitorLightSleep = false;
+      }
+      SimResult r = runSim(opt, cfg, false);
+      if (!r.ok) return 1;
+      double detectedPct = r.episodes ? 100.0 * r.detected / r.episodes : 0.0;
+      printf("%-14s %-8.2f %8.3f %8.1f %9u %9u %11.1f %12.3f\n", burst ? "burst+light" : "ping+delay", glitch,
+             r.averageMa, detectedPct, r.confirmed, r.falseConfirmed,
+             r.monitorRuns ? r.monitorAwakeS / r.monitorRuns : 0.0, r.confirmed ? r.monitorMah / r.confirmed : 0.0);
+    }
+  }
+  return 0;
+}
+
+// ============================================
+// UPLOAD BENCH
+// ============================================
+// The upload path against the mock database: what one multi-location
+// update holds, a builder filled past its capacity, the UPLOAD_EVENT state
+// flushing journals of different sizes (the power summary, then events,
+// are held back until the update fits), lost acknowledgements, and radio-on
+// time per event for a range of flush thresholds on the same trace.
+
+// One ok/FAIL line per check, for the bench modes
+static int g_benchFailures = 0;
+
+static void benchCheck(const char* name, bool ok) {
+  printf("%-52s %s\n", name, ok ? "ok" : "FAIL");
+  if (!ok) g_benchFailures++;
+}
+
+// One MotionMonitor and its state, for driving single upload wakes
+struct UploadRig {
+  explicit UploadRig(const SimOptions& opt)
+    : trace(opt), hal(trace, opt), journal(journalState, &spill), energy(energyTotals), clock(clockState),
+      monitor(hal, rtc, journal, energy, clock) {
+    hal.attachWakeStub(&rtc.stub);
+  }
+
+  // A wake that goes straight to UPLOAD_EVENT, as after a confirmed event.
+  // The first one journals `events` events, a minute apart, an hour in.
+  void uploadWake(size_t events = 0) {
+    hal.beginWake();
+    monitor.onBoot(true);
+    if (events) hal.delayMs(3600000);
+    for (size_t i = 0; i < events; i++) {
+      uint32_t stamp = clock.now32(hal.uptimeMs()) - (uint32_t)(events - i) * 60000;
+      journal.append(MotionEvent{ 0, stamp, rtc.boot_count, 123.45f });
+    }
+    rtc.state = STATE_UPLOAD_EVENT;
+    while (!monitor.step()) {}
+  }
+
+  SensorTrace trace;
+  SimHal hal;
+  MotionRtcState rtc;
+  JournalState<MOTION_JOURNAL_EVENTS> journalState = {};
+  MemoryJournalSpill spill;
+  MotionJournal journal;
+  EnergyTotals energyTotals = {};
+  EnergyLedger energy;
+  ClockState clockState = {};
+  TimeService clock;
+  MotionMonitor monitor;
+};
+
+// Events first .. first + n - 1 stored with every field, and no others
+static bool storedEvents(const MockRtdb& db, uint32_t first, size_t n) {
+  static const char* const fields[] = { "distance_cm", "timestamp_ms", "boot_count", "motion_detected", "timestamp" };
+  for (size_t i = 0; i < n; i++) {
+    for (const char* f : fields) {
+      if (!db.has("events/event_" + std::to_string(first + i) + "/" + f)) return false;
+    }
+  }
+  return db.children("events/") == n;
+}
+
+static int uploadBench(const SimOptions& base) {
+  SimOptions opt = base;
+  opt.timeline = false;
+  opt.verbose = false;
+  MotionConfig cfg;
+
+  // Sizes with long numbers everywhere
+  MotionEvent e = { 1000000, 4000000000u, 100000, 123.45f };
+  UploadBuilder b;
+  appendMotionEvent(b, e, 1767225600);
+  size_t perEvent = b.size() - 2;
+  b.reset();
+  appendEventStats(b, 1000000, e, 1767225600);
+  size_t stats = b.size() - 2;
+  UploadRig sizing(opt);
+  b.reset();
+  appendEnergyReport(b, sizing.energy, cfg.current, cfg.batteryMah);
+  size_t power = b.size() - 2;
+  printf("Update: %u B per event, %u B stats, %u B power summary, %u B capacity\n", (unsigned)perEvent,
+         (unsigned)stats, (unsigned)power, (unsigned)UploadBuilder::CAPACITY);
+  printf("        %u events fit with the power summary, %u without (batch max %u)\n\n",
+         (unsigned)((UploadBuilder::CAPACITY - stats - power) / perEvent),
+         (unsigned)((UploadBuilder::CAPACITY - stats) / perEvent), (unsigned)MOTION_UPLOAD_BATCH_MAX);
+
+  // Past capacity the document keeps whole fields and stays valid
+  b.reset();
+  size_t added = 0;
+  for (; !b.overflow(); added++) appendMotionEvent(b, MotionEvent{ 1000000 + (uint32_t)added, 1, 2, 3.0f }, 1);
+  std::vector<std::pair<std::string, std::string>> parsed;
+  bool valid = MockRtdb::parse(b.json(), parsed);
+  benchCheck("builder past capacity: valid, whole fields only",
+              valid && added > 1 && parsed.size() == b.fields() && b.size() <= UploadBuilder::CAPACITY);
+
+  // A few events: one update, the power summary along
+  UploadRig few(opt);
+  few.uploadWake(3);
+  const MockRtdb& db = few.hal.db();
+  benchCheck("3 events: one update with the power summary",
+              db.requests() == 1 && storedEvents(db, 0, 3) && db.has("power/mah_per_hour") &&
+                db.get("stats/total_events") == "3" && few.journal.empty());
+
+  // A long backlog at long indices: the first batch does not fit whole
+  UploadRig backlog(opt);
+  backlog.rtc.total_uploads = 1000000;
+  backlog.uploadWake(45);
+  const MockRtdb& big = backlog.hal.db();
+  printf("  45 events from index 1000000: %u updates, %llu B\n", big.requests(), (unsigned long long)big.bytes());
+  benchCheck("45 long events: all stored, none refused",
+              big.rejected() == 0 && storedEvents(big, 1000000, 45) && big.has("power/mah_per_hour") &&
+                big.get("stats/total_events") == "1000045" && backlog.journal.empty());
+
+  // Lost acknowledgements: the retry writes the same paths again
+  UploadRig lossy(opt);
+  lossy.hal.setAckLoss(0.3);
+  int wakes = 0;
+  do {
+    lossy.uploadWake(wakes ? 0 : 60);
+  } while (!lossy.journal.empty() && ++wakes < 50);
+  const MockRtdb& retried = lossy.hal.db();
+  printf("  60 events, 30%% of acks lost: %d wakes, %u updates\n", wakes + 1, retried.requests());
+  benchCheck("lost acks: every event stored once",
+              lossy.journal.empty() && storedEvents(retried, 0, 60) && lossy.rtc.total_uploads == 60);
+
+  // Radio on per event, uploading each event vs. waiting for a batch
+  static const size_t flushCounts[] = { 1, 5, 10, 20 };
+  static const double ackLosses[] = { 0.0, 0.1 };
+  printf("\n%-6s %-6s %8s %8s %8s %9s %9s %11s %8s %s\n", "flush", "acks", "uploaded", "stored", "updates", "sessions",
+         "radio_s", "radio_s/evt", "avg_mA", "");
+  for (size_t flush : flushCounts) {
+    for (double loss : ackLosses) {
+      SimOptions run = opt;
+      run.ackLoss = loss;
+      MotionConfig batch;
+      batch.journalFlushCount = flush;
+      SimResult r = runSim(run, batch, false);
+      if (!r.ok) return 1;
+      bool ok = r.uploaded > 0 && r.stored == r.uploaded && r.rejected == 0;
+      if (!ok) g_benchFailures++;
+      printf("%-6u %-6s %8u %8u %8u %9u %9.1f %11.2f %8.3f %s\n", (unsigned)flush, loss ? "-10%" : "all",
+             r.uploaded, (unsigned)r.stored, r.requests, r.radioSessions, r.radioS,
+             r.uploaded ? r.radioS / r.uploaded : 0.0, r.averageMa, ok ? "ok" : "FAIL");
+    }
+  }
+
+  printf("\n%s: %d failed\n", g_benchFailures ? "FAIL" : "ok", g_benchFailures);
+  return g_benchFailures ? 1 : 0;
+}
+
+// ============================================
+// AUTH BENCH
+// ============================================
+// initFirebase() in src/main.cpp against a stand-in auth server: the ID
+// token cached in RTC memory (AuthCache) is presented while it has more
+// than the margin left, otherwise the device signs in again. The server
+// refuses expired and revoked tokens; the device must never present an
+// expired one, even with its sleep clock off by a few percent or wrapping
+// 2^32, and must drop a refused one. PhaseTimer books the auth phase of
+// every wake; its averages are checked against the server's round trips.
+
+const uint32_t AUTH_TTL_S = 3600;              // Firebase ID token lifetime
+const uint32_t AUTH_MARGIN_MS = 300000;        // AUTH_TOKEN_MARGIN_MS in src/main.cpp
+const uint32_t AUTH_WAKE_INTERVAL_MS = 60000;  // an upload wake every minimum upload interval
+const uint32_t AUTH_BENCH_MS = 86400000;
+
+class MockAuthServer {
+public:
+  // A new token valid for AUTH_TTL_S from nowMs (server time)
+  std::string signIn(uint64_t nowMs) {
+    signIns_++;
+    std::string token = "jwt." + std::to_string(signIns_) + ".";
+    token.resize(tokenBytes_, 'x');
+    expiry_[token] = nowMs + AUTH_TTL_S * 1000ULL;
+    return token;
+  }
+
+  // The first request of a session with a cached token
+  bool accept(const std::string& token, uint64_t nowMs) {
+    auto it = expiry_.find(token);
+    if (it == expiry_.end() || revoked_.count(token)) {
+      refused_++;
+      return false;
+    }
+    if (nowMs >= it->second) {
+      refused_++;
+      expiredPresented_++;
+      return false;
+    }
+    return true;
+  }
+
+  void revokeAll() {
+    for (const auto& t : expiry_) revoked_.insert(t.first);
+  }
+  void setTokenBytes(size_t n) { tokenBytes_ = n; }
+
+  uint32_t signIns() const { return signIns_; }
+  uint32_t refused() const { return refused_; }
+  uint32_t expiredPresented() const { return expiredPresented_; }
+
+private:
+  std::map<std::string, uint64_t> expiry_;
+  std::set<std::string> revoked_;
+  size_t tokenBytes_ = 900;
+  uint32_t signIns_ = 0, refused_ = 0, expiredPresented_ = 0;
+};
+
+struct AuthCase {
+  const char* name;
+  double clockError;      // device clock runs (1 + clockError) times real time
+  uint32_t clockStartMs;  // device clock at the first wake
+  size_t tokenBytes;
+  uint64_t revokeAtMs;    // 0: never
+};
+
+struct AuthResult {
+  uint32_t wakes = 0, cachedWakes = 0, refusedAfterDrop = 0;
+  uint32_t expectedAuthMs = 0;  // sum of the round trips the server saw
+  PhaseTotals totals = {};
+};
+
+// One day of upload wakes, each running the flow of initFirebase()
+static AuthResult runAuth(const AuthCase& c, MockAuthServer& server) {
+  AuthResult r;
+  AuthCacheState state = {};
+  AuthCache cache(state);
+  PhaseTimer timer;
+  bool refusedLast = false;
+  server.setTokenBytes(c.tokenBytes);
+
+  for (uint64_t t = 0; t < AUTH_BENCH_MS; t += AUTH_WAKE_INTERVAL_MS) {
+    if (c.revokeAtMs && t >= c.revokeAtMs && t < c.revokeAtMs + AUTH_WAKE_INTERVAL_MS) server.revokeAll();
+    uint32_t deviceMs = c.clockStartMs + (uint32_t)(t * (1.0 + c.clockError));
+    uint32_t uptime = SIM_BOOT_MS + SIM_WIFI_CONNECT_MS;
+    r.wakes++;
+
+    timer.reset();
+    timer.start(PHASE_AUTH, uptime);
+    uptime += SIM_DB_INIT_MS;
+    bool ok;
+    if (cache.valid(deviceMs, AUTH_MARGIN_MS)) {
+      r.cachedWakes++;
+      if (refusedLast) r.refusedAfterDrop++;  // a refused token came back
+      ok = server.accept(cache.idToken(), t);
+    } else {
+      uptime += SIM_SIGN_IN_MS;
+      std::string token = server.signIn(t);
+      cache.store(token.c_str(), "refresh", AUTH_TTL_S, deviceMs);
+      ok = true;
+    }
+    if (ok) {
+      timer.stop(PHASE_AUTH, uptime);
+      r.expectedAuthMs += uptime - (SIM_BOOT_MS + SIM_WIFI_CONNECT_MS);
+    } else {
+      cache.clear();
+    }
+    refusedLast = !ok;
+    timer.accumulate(r.totals);
+  }
+  return r;
+}
+
+static int authBench(const SimOptions&) {
+  static const AuthCase cases[] = {
+    { "clock exact", 0.0, 0, 900, 0 },
+    { "clock 5% slow", -0.05, 0, 900, 0 },
+    { "clock 5% fast", 0.05, 0, 900, 0 },
+    { "clock wraps 2^32", 0.0, 0xFFFFFFFFu - 1800000, 900, 0 },
+    { "revoked at 3 h", 0.0, 0, 900, 3 * 3600000ULL },
+    { "token too large", 0.0, 0, sizeof(AuthCacheState::idToken), 0 },
+  };
+
+  printf("%-18s %6s %8s %7s %7s %8s %11s %s\n", "case", "wakes", "sign_ins", "cached", "refused", "expired",
+         "auth_avg_ms", "");
+  for (const AuthCase& c : cases) {
+    MockAuthServer server;
+    AuthResult r = runAuth(c, server);
+    uint32_t n = r.totals.samples[PHASE_AUTH];
+    bool ok = server.expiredPresented() == 0 && r.refusedAfterDrop == 0 &&
+              n == r.wakes - server.refused() && r.totals.totalMs[PHASE_AUTH] == r.expectedAuthMs;
+    if (c.revokeAtMs) ok = ok && server.refused() == 1;
+    else ok = ok && server.refused() == 0;
+    if (c.tokenBytes >= sizeof(AuthCacheState::idToken)) ok = ok && r.cachedWakes == 0;
+    else if (c.clockError <= 0) ok = ok && server.signIns() <= r.wakes / 5 + 1;
+    if (!ok) g_benchFailures++;
+    printf("%-18s %6u %8u %7u %7u %8u %11.0f %s\n", c.name, r.wakes, server.signIns(), r.cachedWakes,
+           server.refused(), server.expiredPresented(), n ? (double)r.totals.totalMs[PHASE_AUTH] / n : 0.0,
+           ok ? "ok" : "FAIL");
+  }
+  printf("\n");
+
+  // A phase that never started (a missed WiFi event) is not booked
+  PhaseTimer timer;
+  PhaseTotals totals = {};
+  timer.reset();
+  timer.stop(PHASE_DHCP, 500);
+  timer.start(PHASE_WIFI_ASSOC, 100);
+  timer.stop(PHASE_WIFI_ASSOC, 340);
+  timer.accumulate(totals);
+  benchCheck("phase timer: unstarted phase not booked",
+             !timer.done(PHASE_DHCP) && totals.samples[PHASE_DHCP] == 0 && totals.samples[PHASE_WIFI_ASSOC] == 1 &&
+               totals.totalMs[PHASE_WIFI_ASSOC] == 240);
+  timer.start(PHASE_WRITE, 0xFFFFFF00u);
+  timer.stop(PHASE_WRITE, 0x100);
+  benchCheck("phase timer: millis() wrap", timer.ms(PHASE_WRITE) == 0x200);
+
+  printf("\n%s: %d failed\n", g_benchFailures ? "FAIL" : "ok", g_benchFailures);
+  return g_benchFailures ? 1 : 0;
+}
+
+// ============================================
+// CONNECT LATENCY
+// ============================================
+// ConnectLatency (lib/FastWiFi) percentiles from known samples: worked
+// values at the bucket edges, empty and single-sample histograms, the
+// overflow bucket, a saturated bin, and random connect times against the
+// exact sorted percentile (the histogram promises one bucket width).
+
+static int latencyTest(const SimOptions& opt) {
+  const uint32_t W = ConnectLatency::BUCKET_MS;
+
+  // 10, 20, ..., 1000 ms: the 50th, 90th and 99th samples are 500, 900 and
+  // 990 ms, reported as the upper edges of their buckets
+  ConnectLatency lat = {};
+  for (uint32_t ms = 10; ms <= 1000; ms += 10) lat.record(ms);
+  printf("10..1000 ms: p50 %u, p90 %u, p99 %u ms\n", lat.percentileMs(0.5f), lat.percentileMs(0.9f),
+         lat.percentileMs(0.99f));
+  benchCheck("known samples: p50 550, p90 950, p99 1000 ms",
+             lat.samples() == 100 && lat.percentileMs(0.5f) == 550 && lat.percentileMs(0.9f) == 950 &&
+               lat.percentileMs(0.99f) == 1000);
+
+  // 90 fast reconnects at 180 ms, 9 scans at 1400 ms, one at 2600 ms
+  lat = {};
+  for (int i = 0; i < 90; i++) lat.record(180);
+  for (int i = 0; i < 9; i++) lat.record(1400);
+  lat.record(2600);
+  benchCheck("fast/scan mix: p50 200, p90 200, p99 1450 ms",
+             lat.percentileMs(0.5f) == 200 && lat.percentileMs(0.9f) == 200 && lat.percentileMs(0.99f) == 1450 &&
+               lat.percentileMs(1.0f) == 2650);
+
+  lat = {};
+  bool empty = lat.samples() == 0 && lat.percentileMs(0.5f) == 0;
+  lat.record(120);
+  benchCheck("empty reports 0, one sample reports its bucket",
+             empty && lat.percentileMs(0.01f) == 150 && lat.percentileMs(0.5f) == 150 &&
+               lat.percentileMs(0.99f) == 150);
+
+  // Timeouts land in the last bucket: a lower bound, never beyond it
+  lat = {};
+  for (int i = 0; i < 95; i++) lat.record(300);
+  for (int i = 0; i < 5; i++) lat.record(10000);
+  uint32_t top = ConnectLatency::BUCKETS * W;
+  benchCheck("overflow bucket caps p99 at 3200 ms",
+             lat.percentileMs(0.9f) == 350 && lat.percentileMs(0.99f) == top && top == 3200);
+
+  // A bin stops counting at UINT16_MAX instead of wrapping to 0
+  lat = {};
+  for (uint32_t i = 0; i < 70000; i++) lat.record(100);
+  lat.record(900);
+  benchCheck("saturated bin does not wrap",
+             lat.bins[100 / W] == UINT16_MAX && lat.samples() == UINT16_MAX + 1u && lat.percentileMs(0.5f) == 150);
+
+  // Random connect times: mostly cached reconnects, some full scans
+  std::mt19937 rng(opt.seed);
+  std::lognormal_distribution<double> fast(log(250.0), 0.3), scan(log(1500.0), 0.25);
+  std::vector<uint32_t> samples;
+  lat = {};
+  for (int i = 0; i < 20000; i++) {
+    uint32_t ms = (uint32_t)std::min(3000.0, i % 10 == 0 ? scan(rng) : fast(rng));
+    samples.push_back(ms);
+    lat.record(ms);
+  }
+  std::sort(samples.begin(), samples.end());
+  static const float ps[] = { 0.5f, 0.9f, 0.99f };
+  bool close = true;
+  for (float p : ps) {
+    uint32_t exact = samples[(size_t)(p * samples.size() + 0.5f) - 1];
+    uint32_t hist = lat.percentileMs(p);
+    printf("random p%-3.0f exact %5u ms, histogram %5u ms\n", p * 100, exact, hist);
+    close = close && hist > exact && hist - exact <= W;
+  }
+  benchCheck("random samples: within one bucket above exact", close);
+
+  printf("\n%s: %d failed\n", g_benchFailures ? "FAIL" : "ok", g_benchFailures);
+  return g_benchFailures ? 1 : 0;
+}
+
+// ============================================
+// FLUSH REPLAY
+// ============================================
+// The same days replayed under several journal flush policies: how much
+// radio time batching saves and how long events wait for it. The office
+// profile leaves a few events at the end of each day with no motion after
+// them; only the age limit gets those out before the morning, so every
+// policy with one must keep the oldest pending event under it (plus the
+// wake and upload spacing). Exits non-zero if any check fails.
+
+const uint32_t FLUSH_AGE_SLACK_MS = 600000;  // longest sleep, upload interval, a monitor run
+
+struct FlushPolicy {
+  const char* name;
+  size_t count;
+  uint32_t ageMs;  // UINT32_MAX: no age limit
+};
+
+static int flushReplay(const SimOptions& base) {
+  static const FlushPolicy policies[] = {
+    { "every event", 1, UINT32_MAX },
+    { "10", 10, UINT32_MAX },
+    { "10 or 1 h", 10, 3600000 },
+    { "20 or 4 h", 20, 14400000 },
+    { "32 or 15 min", 32, 900000 },
+  };
+  int failures = 0;
+
+  printf("%-8s %-14s %8s %8s %8s %9s %11s %8s %10s %s\n", "profile", "flush at", "uploaded", "pending", "updates",
+         "radio_s", "radio_s/evt", "avg_mA", "oldest_min", "");
+  for (int office = 0; office < (base.tracePath ? 1 : 2); office++) {
+    for (const FlushPolicy& p : policies) {
+      SimOptions opt = base;
+      opt.office = base.tracePath ? base.office : office;
+      MotionConfig cfg;
+      cfg.journalFlushCount = p.count;
+      cfg.journalFlushAgeMs = p.ageMs;
+      SimResult r = runSim(opt, cfg, false);
+      if (!r.ok) return 1;
+
+      bool ok = r.stored == r.uploaded && r.rejected == 0;
+      if (p.ageMs != UINT32_MAX) ok = ok && r.maxPendingS * 1000.0 <= (double)p.ageMs + FLUSH_AGE_SLACK_MS;
+      if (!ok) failures++;
+      printf("%-8s %-14s %8u %8u %8u %9.1f %11.2f %8.3f %10.1f %s\n",
+             base.tracePath ? "trace" : (office ? "office" : "flat"), p.name, r.uploaded,
+             r.confirmed - r.uploaded, r.requests, r.radioS, r.uploaded ? r.radioS / r.uploaded : 0.0, r.averageMa,
+             r.maxPendingS / 60.0, ok ? "ok" : "FAIL");
+    }
+  }
+
+  printf("\n%s: %d failed\n", failures ? "FAIL" : "ok", failures);
+  return failures ? 1 : 0;
+}
+
+// ============================================
+// SCHEDULER BENCH
+// ============================================
+// The loop of the Lab4 server on a virtual millisecond clock: name print
+// every 5 s, a ping every 1 s collected 35 ms later, a frame flush deadline
+// 1 s after the first sample, plus interrupt posts at random (mean 2 s).
+// Tasks advance the clock by their cost. SchedulerIdle is modelled as:
+//   delay(10)    the old loop: one pass every 10 ms, posts wait for it
+//   task wait    block until the deadline or a post
+//   light sleep  as SchedulerIdle with light sleep on and the interrupt pin
+//                as a wake source; every sleep costs SCHED_SLEEP_EXIT_MS
+
+const uint32_t SCHED_BENCH_MS = 3600000;
+const double SCHED_PASS_MS = 0.05;        // runReady() + loop overhead per pass
+const uint32_t SCHED_SLEEP_EXIT_MS = 1;   // light sleep wake-up until code runs
+const double SCHED_POST_MEAN_MS = 2000;
+
+static uint32_t g_schedNowMs = 0;
+static uint32_t schedClock() { return g_schedNowMs; }
+
+struct SchedBench {
+  CoopScheduler<6>* sched;
+  TaskId collect, flush;
+  std::vector<uint32_t> posted;  // post times not yet handled
+  size_t samplesInFrame;
+  double awakeMs;
+  double postLatencySum;
+  uint32_t postLatencyMax;
+  uint32_t posts;
+};
+static SchedBench g_sb;
+
+static void sbSpend(uint32_t ms) {
+  g_schedNowMs += ms;
+  g_sb.awakeMs += ms;
+}
+
+static void sbPrintName(void*) { sbSpend(1); }
+static void sbPing(void*) { g_sb.sched->restart(g_sb.collect, 35); }
+static void sbCollect(void*) {
+  sbSpend(2);
+  if (g_sb.samplesInFrame++ == 0) g_sb.sched->restart(g_sb.flush, 1000);
+}
+static void sbFlush(void*) {
+  sbSpend(1);
+  g_sb.samplesInFrame = 0;
+}
+static void sbInterrupt(void*) {
+  for (uint32_t t : g_sb.posted) {
+    uint32_t latency = g_schedNowMs - t;
+    g_sb.postLatencySum += latency;
+    if (latency > g_sb.postLatencyMax) g_sb.postLatencyMax = latency;
+    g_sb.posts++;
+  }
+  g_sb.posted.clear();
+  sbSpend(1);
+}
+
+static int schedBench(const SimOptions& opt) {
+  enum { IDLE_DELAY, IDLE_TASK_WAIT, IDLE_LIGHT_SLEEP };
+  static const char* const names[] = { "delay(10)", "task wait", "light sleep" };
+  CurrentTable I;
+
+  printf("%-12s %8s %9s %9s %8s %9s %9s %7s %8s\n", "idle", "passes/s", "late_ms", "late_max", "skipped",
+         "post_ms", "post_max", "light%", "avg_mA");
+  for (int mode = IDLE_DELAY; mode <= IDLE_LIGHT_SLEEP; mode++) {
+    std::mt19937 rng(opt.seed);
+    std::exponential_distribution<double> gap(1.0 / SCHED_POST_MEAN_MS);
+
+    g_schedNowMs = 0;
+    g_sb = SchedBench();
+    CoopScheduler<6> sched(schedClock);
+    g_sb.sched = &sched;
+    TaskId tasks[] = {
+      sched.every(5000, sbPrintName),
+      sched.every(1000, sbPing),
+      g_sb.collect = sched.timer(sbCollect),
+      g_sb.flush = sched.timer(sbFlush),
+    };
+    TaskId irq = sched.onEvent(sbInterrupt);
+
+    double nextPost = gap(rng);
+    uint64_t passes = 0;
+    double lightMs = 0;
+    while (g_schedNowMs < SCHED_BENCH_MS) {
+      while (nextPost <= g_schedNowMs) {
+        g_sb.posted.push_back((uint32_t)nextPost);
+        sched.post(irq);
+        nextPost += gap(rng);
+      }
+
+      uint32_t wait = sched.runReady();
+      passes++;
+      g_sb.awakeMs += SCHED_PASS_MS;
+      if (mode == IDLE_DELAY) {
+        g_schedNowMs += 10;
+        continue;
+      }
+      if (wait == 0) continue;
+
+      // Idle until the deadline, or until the next post wakes the loop
+      uint64_t until = wait == SCHED_IDLE_FOREVER ? SCHED_BENCH_MS : (uint64_t)g_schedNowMs + wait;
+      uint32_t post = (uint32_t)ceil(nextPost);
+      if (post < until) until = post > g_schedNowMs ? post : g_schedNowMs;
+      bool light = mode == IDLE_LIGHT_SLEEP && until - g_schedNowMs >= SCHED_LIGHT_SLEEP_MIN_MS;
+      if (light) lightMs += until - g_schedNowMs;
+      g_schedNowMs = (uint32_t)until;
+      if (light) sbSpend(SCHED_SLEEP_EXIT_MS);
+    }
+
+    uint64_t lateSum = 0;
+    uint32_t lateMax = 0, runs = 0, skipped = 0;
+    for (TaskId id : tasks) {
+      const TaskStats& st = sched.stats(id);
+      lateSum += st.totalLateMs;
+      runs += st.runs;
+      skipped += st.skipped;
+      if (st.maxLateMs > lateMax) lateMax = st.maxLateMs;
+    }
+
+    double total = g_schedNowMs;
+    double mA = ((total - lightMs) * I.mA[ENERGY_CPU] + lightMs * I.mA[ENERGY_LIGHT_SLEEP]) / total;
+    printf("%-12s %8.1f %9.2f %9u %8u %9.2f %9u %7.1f %8.2f\n", names[mode], passes / (total / 1000.0),
+           runs ? (double)lateSum / runs : 0.0, lateMax, skipped, g_sb.posts ? g_sb.postLatencySum / g_sb.posts : 0.0,
+           g_sb.postLatencyMax, 100.0 * lightMs / total, mA);
+  }
+  return 0;
+}
+
+// ============================================
+// MAIN
+// ============================================
+
+int main(int argc, char** argv) {
+  SimOptions opt;
+  MotionConfig cfg;
+  bool sweepMode = false;
+  bool benchMode = false;
+  bool schedBenchMode = false;
+  bool uploadBenchMode = false;
+  bool flushReplayMode = false;
+  bool authBenchMode = false;
+  bool latencyTestMode = false;
+
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "--days") && i + 1 < argc) opt.days = atof(argv[++i]);
+    else if (!strcmp(argv[i], "--rate") && i + 1 < argc) opt.rate = atof(argv[++i]);
+    else if (!strcmp(argv[i], "--profile") && i + 1 < argc) opt.office = !strcmp(argv[++i], "office");
+    else if (!strcmp(argv[i], "--trace") && i + 1 < argc) opt.tracePath = argv[++i];
+    else if (!strcmp(argv[i], "--seed") && i + 1 < argc) opt.seed = (uint32_t)atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--rtc-drift") && i + 1 < argc) opt.rtcDriftPpm = atof(argv[++i]);
+    else if (!strcmp(argv[i], "--fixed")) cfg.adaptiveSchedule = false;
+    else if (!strcmp(argv[i], "--budget") && i + 1 < argc) cfg.energyBudgetMa = (float)atof(argv[++i]);
+    else if (!strcmp(argv[i], "--wake-stub")) cfg.wakeStub = true;
+    else if (!strcmp(argv[i], "--glitch") && i + 1 < argc) opt.glitchRate = atof(argv[++i]);
+    else if (!strcmp(argv[i], "--scene-drift") && i + 1 < argc) opt.sceneDriftCmPerDay = atof(argv[++i]);
+    else if (!strcmp(argv[i], "--ack-loss") && i + 1 < argc) opt.ackLoss = atof(argv[++i]);
+    else if (!strcmp(argv[i], "--simple-baseline")) cfg.robustBaseline = false;
+    else if (!strcmp(argv[i], "--delay-monitor")) {
+      cfg.activeMonitorBurst = 1;
+      cfg.activeMonitorLightSleep = false;
+    }
+    else if (!strcmp(argv[i], "--sweep")) sweepMode = true;
+    else if (!strcmp(argv[i], "--bench")) benchMode = true;
+    else if (!strcmp(argv[i], "--sched-bench")) schedBenchMode = true;
+    else if (!strcmp(argv[i], "--upload-bench")) uploadBenchMode = true;
+    else if (!strcmp(argv[i], "--flush-replay")) flushReplayMode = true;
+    else if (!strcmp(argv[i], "--auth-bench")) authBenchMode = true;
+    else if (!strcmp(argv[i], "--latency-test")) latencyTestMode = true;
+    else if (!strcmp(argv[i], "--timeline")) opt.timeline = true;
+    else if (!strcmp(argv[i], "--verbose")) opt.verbose = true;
+    else {
+      fprintf(stderr, "usage: %s [--days N] [--rate R] [--profile flat|office] [--trace FILE] [--seed S]\n"
+                      "          [--rtc-drift P] [--fixed] [--budget MA] [--wake-stub] [--glitch F] [--scene-drift C]\n"
+                      "          [--ack-loss F] [--simple-baseline] [--delay-monitor] [--sweep] [--bench]\n"
+                      "          [--sched-bench] [--upload-bench] [--flush-replay] [--auth-bench] [--timeline]\n"
+                      "          [--latency-test] [--verbose]\n", argv[0]);
+      return 2;
+    }
+  }
+
+  if (schedBenchMode) return schedBench(opt);
+  if (uploadBenchMode) return uploadBench(opt);
+  if (flushReplayMode) return flushReplay(opt);
+  if (authBenchMode) return authBench(opt);
+  if (latencyTestMode) return latencyTest(opt);
+  if (sweepMode || benchMode) {
+    opt.timeline = false;
+    opt.verbose = false;
+    return sweepMode ? sweep(opt) : bench(opt);
+  }
+  return runSim(opt, cfg, true).ok ? 0 : 1;
+}
@@ -5,59 +5,116 @@
 #include <WiFi.h>
 #include <WiFiClientSecure.h>
 #include <FirebaseClient.h>
+#include <HCSR04Ranger.h>
+#include <EventUpload.h>
+#include <EventJournal.h>
+#include <NvsJournalSpill.h>
+#include <AuthCache.h>
+#include <PhaseTimer.h>
+#include <FastWiFi.h>
+#include <MotionMonitor.h>
+#include <TimeService.h>
+#include <CoopScheduler.h>
+#include <esp_sntp.h>
+#include <sys/time.h>
 #include "secrets.h"
 
+#if MOTION_WAKE_STUB
+#include <esp_sleep.h>
+#include <esp_wake_stub.h>
+#include <esp_cpu.h>
+#include <esp_rom_sys.h>
+#include <soc/gpio_reg.h>
+#include <soc/io_mux_reg.h>
+#endif
+
 // ============================================
 // POWER MANAGEMENT CONFIGURATION
 // ============================================
-
-// Sleep Durations (milliseconds)
-const uint32_t DEEP_SLEEP_NORMAL_MS = 10000;      // 10 seconds - normal monitoring
-const uint32_t DEEP_SLEEP_EXTENDED_MS = 30000;    // 30 seconds - quiet period
-const uint32_t QUICK_CHECK_DURATION_MS = 500;     // 0.5 seconds - quick sensor read
-
-// Active Monitoring
-const uint32_t ACTIVE_MONITOR_DURATION_MS = 30000;  // 30 seconds - active monitoring
-const uint32_t ACTIVE_MONITOR_INTERVAL_MS = 2000;   // 2 seconds - check interval when active
-
-// Motion Detection
-const float MOTION_THRESHOLD_CM = 10.0;           // 10 cm change = motion detected
-const uint32_t MOTION_CONFIRM_TIME_MS = 2000;     // 2 seconds - confirm motion is real
-const uint32_t BASELINE_UPDATE_INTERVAL_MS = 300000; // 5 minutes - update baseline
+// Sleep, monitoring, motion and journal policy live in MotionConfig
+// (lib/MotionMonitor) so the native simulator runs the same numbers.
 
 // Upload Control
-const uint32_t MIN_UPLOAD_INTERVAL_MS = 60000;    // 60 seconds - minimum between uploads
 const uint32_t WIFI_CONNECT_TIMEOUT_MS = 5000;    // 5 seconds - WiFi connection timeout
 const uint32_t UPLOAD_TIMEOUT_MS = 3000;          // 3 seconds - Firebase upload timeout
-
-// Adaptive Behavior
-const uint32_t QUIET_PERIOD_THRESHOLD_MS = 300000;  // 5 minutes - no motion = quiet
-const uint8_t HIGH_ACTIVITY_THRESHOLD = 5;          // 5 events/minute = high activity
+const uint32_t AUTH_TOKEN_MARGIN_MS = 300000;     // 5 minutes - re-sign-in before the ID token expires
+const uint32_t NTP_TIMEOUT_MS = 1500;             // 1.5 seconds - give up on SNTP, keep the monotonic clock
+const char* NTP_SERVER = "pool.ntp.org";
 
 // Sensor Configuration
 const int PIN_TRIG = 2;  // D0 on XIAO ESP32-C3
 const int PIN_ECHO = 3;  // D1 on XIAO ESP32-C3
 
+HCSR04Ranger ranger(PIN_TRIG, PIN_ECHO);
+
 // ============================================
 // RTC MEMORY (Persists Through Deep Sleep)
 // ============================================
 
-typedef enum {
-  STATE_DEEP_SLEEP,
-  STATE_QUICK_CHECK,
-  STATE_ACTIVE_MONITOR,
-  STATE_UPLOAD_EVENT
-} DeviceState;
-
-RTC_DATA_ATTR DeviceState g_state = STATE_QUICK_CHECK;
-RTC_DATA_ATTR float g_baseline_distance = -1.0;
-RTC_DATA_ATTR uint32_t g_last_motion_time = 0;
-RTC_DATA_ATTR uint32_t g_last_upload_time = 0;
-RTC_DATA_ATTR uint32_t g_last_baseline_update = 0;
-RTC_DATA_ATTR uint32_t g_motion_event_count = 0;
-RTC_DATA_ATTR uint32_t g_total_uploads = 0;
-RTC_DATA_ATTR uint32_t g_boot_count = 0;
-RTC_DATA_ATTR bool g_motion_active = false;
+RTC_DATA_ATTR MotionRtcState g_rtc;
+RTC_DATA_ATTR JournalState<MOTION_JOURNAL_EVENTS> g_journal_state;
+RTC_DATA_ATTR AuthCacheState g_auth_state;
+RTC_DATA_ATTR PhaseTotals g_phase_totals;
+RTC_DATA_ATTR WiFiCacheState g_wifi_cache;
+RTC_DATA_ATTR ConnectLatency g_wifi_latency;
+RTC_DATA_ATTR EnergyTotals g_energy_totals;
+RTC_DATA_ATTR ClockState g_clock;
+
+#if MOTION_WAKE_STUB
+// ============================================
+// WAKE STUB (runs from RTC fast memory, no flash)
+// ============================================
+// One HC-SR04 ping on raw registers, then WakeStub.h decides whether the
+// main core boots. Nothing in here may touch flash: no Arduino calls, no
+// floats, no logging.
+
+static RTC_IRAM_ATTR uint32_t wakeStubPing() {
+  const uint32_t trig = 1UL << PIN_TRIG;
+  const uint32_t echo = 1UL << PIN_ECHO;
+
+  // Pads come back from deep sleep unconfigured: GPIO function, echo as input
+  REG_SET_FIELD(IO_MUX_GPIO2_REG, MCU_SEL, PIN_FUNC_GPIO);
+  REG_SET_FIELD(IO_MUX_GPIO3_REG, MCU_SEL, PIN_FUNC_GPIO);
+  REG_SET_BIT(IO_MUX_GPIO3_REG, FUN_IE);
+  REG_WRITE(GPIO_FUNC2_OUT_SEL_CFG_REG, SIG_GPIO_OUT_IDX);
+  REG_WRITE(GPIO_ENABLE_W1TS_REG, trig);
+  REG_WRITE(GPIO_ENABLE_W1TC_REG, echo);
+
+  REG_WRITE(GPIO_OUT_W1TC_REG, trig);
+  esp_rom_delay_us(2);
+  REG_WRITE(GPIO_OUT_W1TS_REG, trig);
+  esp_rom_delay_us(10);
+  REG_WRITE(GPIO_OUT_W1TC_REG, trig);
+
+  uint32_t ticksPerUs = esp_rom_get_cpu_ticks_per_us();
+  uint32_t timeout = (WAKE_STUB_MAX_ECHO_US + 1000) * ticksPerUs;
+  uint32_t start = esp_cpu_get_cycle_count();
+  while (!(REG_READ(GPIO_IN_REG) & echo)) {
+    if (esp_cpu_get_cycle_count() - start > timeout) return 0;
+  }
+  uint32_t rise = esp_cpu_get_cycle_count();
+  while (REG_READ(GPIO_IN_REG) & echo) {
+    if (esp_cpu_get_cycle_count() - rise > timeout) return 0;
+  }
+  return (esp_cpu_get_cycle_count() - rise) / ticksPerUs;
+}
+
+void RTC_IRAM_ATTR motionWakeStub() {
+  if (wakeStubDecide(g_rtc.stub, wakeStubPing()) == WAKE_STUB_SLEEP) {
+    esp_wake_stub_set_wakeup_time(g_rtc.stub.sleepUs);
+    esp_wake_stub_sleep(&motionWakeStub);
+  }
+  esp_default_wake_deep_sleep();
+}
+#endif
+
+NvsJournalSpill journalSpill;
+MotionJournal journal(g_journal_state, &journalSpill);
+AuthCache authCache(g_auth_state);
+PhaseTimer phaseTimer;
+FastWiFi fastWiFi(g_wifi_cache, g_wifi_latency);
+EnergyLedger energyLedger(g_energy_totals);
+TimeService timeService(g_clock);
 
 // ============================================
 // FIREBASE OBJECTS
@@ -69,14 +126,22 @@ WiFiClientSecure ssl_client1, ssl_client2;
 using AsyncClient = AsyncClientClass;
 AsyncClient async_client1(ssl_client1), async_client2(ssl_client2);
 RealtimeDatabase Database;
-AsyncResult dbResult;
 
 bool firebaseReady = false;
 
+// Completion of the single multi-location update per event
+volatile bool g_upload_done = false;
+volatile bool g_upload_ok = false;
+
 // ============================================
 // HELPER FUNCTIONS
 // ============================================
 
+// millis() restarts after every deep sleep; this clock keeps running
+uint32_t journalClockMs() {
+  return timeService.now32(millis());
+}
+
 void processData(AsyncResult &aResult) {
   if (!aResult.isResult()) return;
   
@@ -89,23 +154,29 @@ void processData(AsyncResult &aResult) {
   }
 }
 
-float readUltrasonicDistance() {
-  pinMode(PIN_TRIG, OUTPUT);
-  pinMode(PIN_ECHO, INPUT);
+void onUploadResult(AsyncResult &aResult) {
+  if (!aResult.isResult()) return;
 
-  digitalWrite(PIN_TRIG, LOW);
-  delayMicroseconds(2);
-  digitalWrite(PIN_TRIG, HIGH);
-  delayMicroseconds(10);
-  digitalWrite(PIN_TRIG, LOW);
+  if (aResult.isError()) {
+    Serial.printf("Firebase Error: %s\n", aResult.error().message().c_str());
+    g_upload_ok = false;
+    g_upload_done = true;
+  } else if (aResult.available()) {
+    Serial.printf("Firebase Success: %s\n", aResult.uid().c_str());
+    g_upload_ok = true;
+    g_upload_done = true;
+  }
+}
 
-  uint32_t duration = pulseIn(PIN_ECHO, HIGH, 30000);
+float readUltrasonicDistance() {
+  // Echo is timed by interrupt; measure() yields instead of spinning in pulseIn()
+  RangeSample sample = ranger.measure();
   
-  if (duration == 0) {
+  if (!sample.valid()) {
     return -1.0;
   }
 
-  float distanceCm = duration / 58.2;
+  float distanceCm = sample.echo_us / 58.2;
   
   // Validate range
   if (distanceCm < 2.0 || distanceCm > 400.0) {
@@ -115,29 +186,32 @@ float readUltrasonicDistance() {
   return distanceCm;
 }
 
+// Association and DHCP complete at different events; split the timing there
+void onWiFiAssociated(WiFiEvent_t event) {
+  phaseTimer.stop(PHASE_WIFI_ASSOC, millis());
+  phaseTimer.start(PHASE_DHCP, millis());
+}
+
 bool connectWiFi() {
   Serial.println("WiFi: Connecting...");
-  WiFi.mode(WIFI_STA);
-  WiFi.begin(WIFI_SSID, WIFI_PASSWORD);
+  WiFi.onEvent(onWiFiAssociated, ARDUINO_EVENT_WIFI_STA_CONNECTED);
+  phaseTimer.start(PHASE_WIFI_ASSOC, millis());
 
-  uint32_t startTime = millis();
-  while (WiFi.status() != WL_CONNECTED && (millis() - startTime) < WIFI_CONNECT_TIMEOUT_MS) {
-    delay(100);
-    Serial.print(".");
-  }
+  // Cached BSSID/channel/IP first, full scan + DHCP as fallback
+  bool ok = fastWiFi.connect(WIFI_SSID, WIFI_PASSWORD, WIFI_CONNECT_TIMEOUT_MS);
   
-  if (WiFi.status() == WL_CONNECTED) {
-    Serial.println("\nWiFi: Connected!");
-    return true;
+  if (ok) {
+    phaseTimer.stop(PHASE_DHCP, millis());
+    Serial.println("WiFi: Connected!");
   } else {
-    Serial.println("\nWiFi: Failed!");
-    return false;
+    Serial.println("WiFi: Failed!");
   }
+  fastWiFi.printReport();
+  return ok;
 }
 
 void disconnectWiFi() {
-  WiFi.disconnect(true);
-  WiFi.mode(WIFI_OFF);
+  fastWiFi.disconnect();
   Serial.println("WiFi: Disconnected");
 }
 
@@ -147,7 +221,20 @@ bool initFirebase() {
   ssl_client1.setInsecure();
   ssl_client2.setInsecure();
   
-  initializeApp(async_client1, app, getAuth(user_auth), processData, "authTask");
+  phaseTimer.start(PHASE_AUTH, millis());
+  
+  // Reuse the ID token from an earlier wake-up while it is still valid;
+  // otherwise do a full email/password sign-in and cache the result.
+  bool cached = authCache.valid(journalClockMs(), AUTH_TOKEN_MARGIN_MS);
+  if (cached) {
+    Serial.printf("Firebase: Using cached ID token (%u s left)\n", authCache.remainingSec(journalClockMs()));
+    // Built per call from the current cache: initializeApp() copies it
+    IDToken id_token(FIREBASE_API_KEY, authCache.idToken(), authCache.remainingSec(journalClockMs()),
+                     authCache.refreshToken());
+    initializeApp(async_client1, app, getAuth(id_token), processData, "authTask");
+  } else {
+    initializeApp(async_client1, app, getAuth(user_auth), processData, "authTask");
+  }
   app.getApp<RealtimeDatabase>(Database);
   Database.url(FIREBASE_RTDB_URL);
   
@@ -158,232 +245,134 @@ bool initFirebase() {
   }
   
   if (app.ready()) {
+    phaseTimer.stop(PHASE_AUTH, millis());
+    if (!cached && !authCache.store(app.getToken().c_str(), app.getRefreshToken().c_str(), app.ttl(), journalClockMs())) {
+      Serial.println("Firebase: Token too large to cache");
+    }
     Serial.println("Firebase: Ready!");
     return true;
   } else {
+    authCache.clear();  // a stale or rejected token must not be retried
     Serial.println("Firebase: Timeout!");
     return false;
   }
 }
 
-void enterDeepSleep(uint32_t durationMs) {
-  Serial.printf("Entering deep sleep for %u seconds\n", durationMs / 1000);
-  Serial.flush();
-  
-  esp_sleep_enable_timer_wakeup((uint64_t)durationMs * 1000ULL);
-  esp_deep_sleep_start();
+void printPhaseTimes() {
+  phaseTimer.accumulate(g_phase_totals);
+  Serial.println("--- Upload phase times (this wake | average) ---");
+  for (int i = 0; i < PHASE_COUNT; i++) {
+    UploadPhase p = (UploadPhase)i;
+    uint32_t n = g_phase_totals.samples[i];
+    Serial.printf("  %-10s %6u ms | %6u ms\n", PhaseTimer::name(p),
+                  phaseTimer.done(p) ? phaseTimer.ms(p) : 0, n ? g_phase_totals.totalMs[i] / n : 0);
+  }
 }
 
-void updateBaseline(float distance) {
-  if (distance > 0) {
-    g_baseline_distance = distance;
-    g_last_baseline_update = millis();
-    Serial.printf("Baseline updated: %.2f cm\n", g_baseline_distance);
+// Upload one multi-location update and wait until the server acknowledges it
+bool uploadBatch(const char* json) {
+  g_upload_done = false;
+  g_upload_ok = false;
+  uint32_t sendStart = millis();
+  phaseTimer.start(PHASE_WRITE, sendStart);
+  Database.update(async_client1, "/motion_detection", object_t(json), onUploadResult, "upload_event");
+
+  // Wait only until the server acknowledges (or the timeout hits)
+  while (!g_upload_done && millis() - sendStart < UPLOAD_TIMEOUT_MS) {
+    app.loop();
+    delay(10);
   }
-}
 
-bool detectMotion(float currentDistance) {
-  if (g_baseline_distance < 0 || currentDistance < 0) {
+  if (!g_upload_done || !g_upload_ok) {
+    Serial.println(g_upload_done ? "Upload failed" : "Upload timeout");
     return false;
   }
-  
-  float change = abs(currentDistance - g_baseline_distance);
-  return (change > MOTION_THRESHOLD_CM);
+  phaseTimer.stop(PHASE_WRITE, millis());
+  Serial.printf("Upload acknowledged in %u ms\n", millis() - sendStart);
+  return true;
 }
 
 // ============================================
-// STATE: QUICK CHECK
+// HARDWARE ABSTRACTION (Arduino)
 // ============================================
+// The state machine itself lives in lib/MotionMonitor and is shared with
+// the native simulator (sim/); this binds it to the board.
 
-void stateQuickCheck() {
-  Serial.println("\n=== STATE: QUICK CHECK ===");
-  Serial.printf("Boot #%u | Uptime: %u ms\n", g_boot_count, millis());
-  
-  // Read sensor
-  float distance = readUltrasonicDistance();
-  
-  if (distance < 0) {
-    Serial.println("Sensor read failed, returning to sleep");
-    g_state = STATE_DEEP_SLEEP;
-    return;
-  }
-  
-  Serial.printf("Distance: %.2f cm | Baseline: %.2f cm\n", distance, g_baseline_distance);
-  
-  // Initialize baseline on first boot
-  if (g_baseline_distance < 0) {
-    updateBaseline(distance);
-    g_state = STATE_DEEP_SLEEP;
-    return;
-  }
-  
-  // Update baseline periodically if stable
-  if ((millis() - g_last_baseline_update) > BASELINE_UPDATE_INTERVAL_MS && !g_motion_active) {
-    updateBaseline(distance);
-  }
-  
-  // Check for motion
-  if (detectMotion(distance)) {
-    Serial.println(">>> MOTION DETECTED! <<<");
-    g_motion_active = true;
-    g_last_motion_time = millis();
-    g_motion_event_count++;
-    g_state = STATE_ACTIVE_MONITOR;
-  } else {
-    Serial.println("No motion detected");
-    
-    // Check if quiet period (no motion for 5+ minutes)
-    if (g_last_motion_time > 0 && (millis() - g_last_motion_time) > QUIET_PERIOD_THRESHOLD_MS) {
-      Serial.println("Quiet period detected - entering extended sleep");
-      enterDeepSleep(DEEP_SLEEP_EXTENDED_MS);
-    } else {
-      enterDeepSleep(DEEP_SLEEP_NORMAL_MS);
-    }
-  }
+static void onTimeSynced(struct timeval* tv) {
+  SchedulerIdle::wake();
 }
 
-// ============================================
-// STATE: ACTIVE MONITOR
-// ============================================
+class ArduinoMotionHal : public MotionHal {
+public:
+  uint32_t uptimeMs() override { return millis(); }
+  void delayMs(uint32_t ms) override { delay(ms); }
+  float readDistanceCm() override { return readUltrasonicDistance(); }
+  RangeBurst readBurst(uint8_t pings) override { return ranger.burst(pings); }
+
+  void lightSleepMs(uint32_t ms) override {
+    Serial.flush();
+    esp_sleep_enable_timer_wakeup((uint64_t)ms * 1000ULL);
+    esp_light_sleep_start();
+  }
 
-void stateActiveMonitor() {
-  Serial.println("\n=== STATE: ACTIVE MONITOR ===");
-  Serial.println("Monitoring for 30 seconds with 2-second intervals");
-  
-  uint32_t startTime = millis();
-  float lastDistance = -1.0;
-  bool motionConfirmed = false;
-  uint32_t stableMotionStart = 0;
-  
-  while (millis() - startTime < ACTIVE_MONITOR_DURATION_MS) {
-    float distance = readUltrasonicDistance();
-    
-    if (distance > 0) {
-      Serial.printf("[%.1fs] Distance: %.2f cm", (millis() - startTime) / 1000.0, distance);
-      
-      bool motion = detectMotion(distance);
-      
-      if (motion) {
-        Serial.println(" - MOTION");
-        
-        // Check if motion is stable (same for 2+ seconds)
-        if (lastDistance > 0 && abs(distance - lastDistance) < 5.0) {
-          if (stableMotionStart == 0) {
-            stableMotionStart = millis();
-          } else if (millis() - stableMotionStart >= MOTION_CONFIRM_TIME_MS) {
-            if (!motionConfirmed) {
-              motionConfirmed = true;
-              Serial.println(">>> MOTION CONFIRMED! <<<");
-            }
-          }
-        } else {
-          stableMotionStart = 0;
-        }
-      } else {
-        Serial.println(" - No motion");
-        stableMotionStart = 0;
-      }
-      
-      lastDistance = distance;
-    } else {
-      Serial.println("Sensor read failed");
-    }
-    
-    delay(ACTIVE_MONITOR_INTERVAL_MS);
+  bool connectNetwork() override {
+    phaseTimer.reset();
+    return connectWiFi();
   }
-  
-  // Decision: Upload or return to sleep
-  if (motionConfirmed) {
-    Serial.println("Motion event confirmed - proceeding to upload");
-    
-    // Check if enough time has passed since last upload
-    if ((millis() - g_last_upload_time) >= MIN_UPLOAD_INTERVAL_MS) {
-      g_state = STATE_UPLOAD_EVENT;
-    } else {
-      Serial.println("Upload rate limit - skipping upload");
-      g_motion_active = false;
-      enterDeepSleep(DEEP_SLEEP_NORMAL_MS);
-    }
-  } else {
-    Serial.println("Motion not confirmed - false alarm");
-    g_motion_active = false;
-    enterDeepSleep(DEEP_SLEEP_NORMAL_MS);
+
+  void disconnectNetwork() override {
+    disconnectWiFi();
+    printPhaseTimes();
   }
-}
 
-// ============================================
-// STATE: UPLOAD EVENT
-// ============================================
+  bool initDatabase() override { return initFirebase(); }
+  bool uploadBatch(const char* json) override { return ::uploadBatch(json); }
+
+  bool syncTime(uint64_t& epochMs) override {
+    // System time survives deep sleep on its own, so wait for a fresh
+    // SNTP answer rather than just a plausible gettimeofday()
+    sntp_set_sync_status(SNTP_SYNC_STATUS_RESET);
+    sntp_set_time_sync_notification_cb(onTimeSynced);
+    configTime(0, 0, NTP_SERVER);
+
+    uint32_t start = millis();
+    while (sntp_get_sync_status() != SNTP_SYNC_STATUS_COMPLETED) {
+      uint32_t waited = millis() - start;
+      if (waited > NTP_TIMEOUT_MS) return false;
+      SchedulerIdle::wait(NTP_TIMEOUT_MS - waited + 1);  // the sync callback ends it early
+    }
 
-void stateUploadEvent() {
-  Serial.println("\n=== STATE: UPLOAD EVENT ===");
-  
-  uint32_t uploadStartTime = millis();
-  
-  // Connect WiFi
-  if (!connectWiFi()) {
-    Serial.println("WiFi connection failed - aborting upload");
-    g_motion_active = false;
-    enterDeepSleep(DEEP_SLEEP_NORMAL_MS);
-    return;
+    struct timeval tv;
+    gettimeofday(&tv, nullptr);
+    epochMs = (uint64_t)tv.tv_sec * 1000ULL + tv.tv_usec / 1000;
+    return true;
   }
-  
-  // Initialize Firebase
-  if (!initFirebase()) {
-    Serial.println("Firebase initialization failed - aborting upload");
-    disconnectWiFi();
-    g_motion_active = false;
-    enterDeepSleep(DEEP_SLEEP_NORMAL_MS);
-    return;
+
+#if MOTION_WAKE_STUB
+  bool enableWakeStub(bool on) override {
+    esp_set_deep_sleep_wake_stub(on ? &motionWakeStub : nullptr);
+    return true;
   }
-  
-  // Read final distance
-  float distance = readUltrasonicDistance();
-  uint32_t timestamp = millis();
-  
-  // Upload event data
-  Serial.println("Uploading motion event to Firebase...");
-  
-  String eventPath = "/motion_detection/events/event_" + String(g_total_uploads);
-  
-  Database.set<float>(async_client1, eventPath + "/distance_cm", distance, processData, "upload_distance");
-  Database.set<uint32_t>(async_client1, eventPath + "/timestamp_ms", timestamp, dbResult);
-  Database.set<uint32_t>(async_client1, eventPath + "/boot_count", g_boot_count, dbResult);
-  Database.set<bool>(async_client1, eventPath + "/motion_detected", true, dbResult);
-  
-  // Update statistics
-  Database.set<uint32_t>(async_client1, "/motion_detection/stats/total_events", g_total_uploads + 1, dbResult);
-  Database.set<uint32_t>(async_client1, "/motion_detection/stats/last_event_time", timestamp, dbResult);
-  Database.set<float>(async_client1, "/motion_detection/stats/last_distance", distance, dbResult);
-  
-  // Wait for upload to complete
-  uint32_t waitStart = millis();
-  while (millis() - waitStart < UPLOAD_TIMEOUT_MS) {
-    app.loop();
-    processData(dbResult);
-    delay(50);
+#endif
+
+  void deepSleep(uint32_t ms) override {
+    Serial.flush();
+    esp_sleep_enable_timer_wakeup((uint64_t)ms * 1000ULL);
+    esp_deep_sleep_start();
   }
-  
-  uint32_t uploadDuration = millis() - uploadStartTime;
-  Serial.printf("Upload complete in %u ms\n", uploadDuration);
-  
-  // Disconnect WiFi immediately
-  disconnectWiFi();
-  
-  // Update counters
-  g_total_uploads++;
-  g_last_upload_time = millis();
-  g_motion_active = false;
-  
-  // Print statistics
-  Serial.println("\n--- Statistics ---");
-  Serial.printf("Total Uploads: %u\n", g_total_uploads);
-  Serial.printf("Motion Events: %u\n", g_motion_event_count);
-  Serial.printf("Boot Count: %u\n", g_boot_count);
-  
-  // Return to deep sleep
-  enterDeepSleep(DEEP_SLEEP_NORMAL_MS);
-}
+
+  void log(const char* fmt, ...) override {
+    char line[256];
+    va_list args;
+    va_start(args, fmt);
+    vsnprintf(line, sizeof(line), fmt, args);
+    va_end(args);
+    Serial.print(line);
+  }
+};
+
+ArduinoMotionHal hal;
+MotionMonitor monitor(hal, g_rtc, journal, energyLedger, timeService);
 
 // ============================================
 // ARDUINO SETUP
@@ -392,20 +381,24 @@ void stateUploadEvent() {
 void setup() {
   Serial.begin(115200);
   delay(500);
+  SchedulerIdle::begin(false);  // radio waits only; MotionMonitor light-sleeps itself
+  
+  esp_sleep_wakeup_cause_t wakeReason = esp_sleep_get_wakeup_cause();
   
-  g_boot_count++;
+  ranger.begin();
+  monitor.onBoot(wakeReason == ESP_SLEEP_WAKEUP_TIMER);
+  fastWiFi.begin();
   
   Serial.println("\n\n");
   Serial.println("==========================================");
   Serial.println("  Smart Motion Detection System");
   Serial.println("  24-Hour Battery Operation");
   Serial.println("==========================================");
-  Serial.printf("Boot #%u\n", g_boot_count);
-  Serial.printf("Total Uploads: %u\n", g_total_uploads);
-  Serial.printf("Motion Events: %u\n", g_motion_event_count);
+  Serial.printf("Boot #%u\n", g_rtc.boot_count);
+  Serial.printf("Total Uploads: %u\n", g_rtc.total_uploads);
+  Serial.printf("Motion Events: %u (%u confirmed)\n", g_rtc.motion_event_count, g_rtc.confirmed_count);
   
   // Display wake reason
-  esp_sleep_wakeup_cause_t wakeReason = esp_sleep_get_wakeup_cause();
   Serial.print("Wake Reason: ");
   
   switch (wakeReason) {
@@ -414,7 +407,6 @@ void setup() {
       break;
     default:
       Serial.println("Power On / Reset");
-      g_state = STATE_QUICK_CHECK;
       break;
   }
   
@@ -426,26 +418,7 @@ void setup() {
 // ============================================
 
 void loop() {
-  switch (g_state) {
-    case STATE_QUICK_CHECK:
-      stateQuickCheck();
-      break;
-      
-    case STATE_ACTIVE_MONITOR:
-      stateActiveMonitor();
-      break;
-      
-    case STATE_UPLOAD_EVENT:
-      stateUploadEvent();
-      break;
-      
-    default:
-      Serial.println("Unknown state - resetting to QUICK_CHECK");
-      g_state = STATE_QUICK_CHECK;
-      break;
-  }
-  
-  // This point is only reached if not entering deep sleep
-  // Should not normally happen
-  delay(1000);
-}
\ No newline at end of file
+  // Each step runs one state; the last one of a wake enters deep sleep
+  // and never returns
+  monitor.step();
+}
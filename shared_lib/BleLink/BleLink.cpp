@@ -0,0 +1,207 @@
+#include "BleLink.h"
+
+#include <stdio.h>
+#include <string.h>
+
+const char* linkProfileName(LinkProfile p) {
+  return p == LINK_STREAMING ? "streaming" : "low-power";
+}
+
+uint32_t linkCapacityBytesPerSec(const LinkParams& params, uint16_t mtu) {
+  if (mtu <= 3 || params.maxInterval == 0) return 0;
+  return (uint32_t)(mtu - 3) * 800 / params.maxInterval;  // 1000 ms / (1.25 ms units)
+}
+
+void LinkProfileSelector::reset(uint32_t nowMs, LinkProfile p) {
+  profile_ = p;
+  windowStartMs_ = nowMs;
+  switchedMs_ = nowMs;
+  bytes_ = 0;
+  rate_ = 0;
+  measured_ = false;
+}
+
+bool LinkProfileSelector::update(uint32_t nowMs, uint32_t backlogBytes) {
+  uint32_t elapsed = nowMs - windowStartMs_;
+  if (elapsed >= cfg_.windowMs) {
+    float rate = bytes_ * 1000.0f / elapsed;
+    rate_ = measured_ ? rate_ + 0.5f * (rate - rate_) : rate;
+    measured_ = true;
+    bytes_ = 0;
+    windowStartMs_ = nowMs;
+  }
+
+  LinkProfile want = profile_;
+  if (backlogBytes >= cfg_.backlogBytes || (measured_ && rate_ >= cfg_.upBytesPerSec)) {
+    want = LINK_STREAMING;
+  } else if (measured_ && rate_ <= cfg_.downBytesPerSec && backlogBytes == 0) {
+    want = LINK_LOW_POWER;
+  }
+
+  if (want == profile_) return false;
+  if (want == LINK_LOW_POWER && nowMs - switchedMs_ < cfg_.minDwellMs) return false;
+  profile_ = want;
+  switchedMs_ = nowMs;
+  switches_++;
+  return true;
+}
+
+float RateMeter::sample(uint32_t nowMs) {
+  uint32_t total = this->total();
+  float rate = 0;
+  if (started_ && nowMs != lastMs_) rate = (total - lastTotal_) * 1000.0f / (nowMs - lastMs_);
+  started_ = true;
+  lastTotal_ = total;
+  lastMs_ = nowMs;
+  return rate;
+}
+
+static const char* phyName(uint8_t phy) {
+  switch (phy) {
+    case 1: return "1M";
+    case 2: return "2M";
+    case 3: return "coded";
+    default: return "?";
+  }
+}
+
+size_t describeLink(const LinkStatus& s, char* out, size_t size) {
+  int n;
+  if (s.interval) {
+    n = snprintf(out, size, "interval %.2f ms latency %u timeout %u ms", s.intervalMs(), s.latency, s.timeout * 10u);
+  } else {
+    n = snprintf(out, size, "interval ?");
+  }
+  if (n < 0 || (size_t)n >= size) return n < 0 ? 0 : size - 1;
+
+  int m = snprintf(out + n, size - n, " | MTU %u | PHY %s/%s | LL %u B", s.mtu, phyName(s.txPhy), phyName(s.rxPhy),
+                   s.txOctets ? s.txOctets : 27u);
+  if (m < 0) return n;
+  return (size_t)(n + m) < size ? n + m : size - 1;
+}
+
+#ifdef ARDUINO
+
+#include <Arduino.h>
+#include <BLEDevice.h>
+
+LinkStatus BleLink::links_[BLE_LINK_SLOTS];
+
+// The data length event carries no address: credit the last request
+static LinkStatus* lengthPending = nullptr;
+
+void BleLink::begin() {
+  BLEDevice::setCustomGapHandler(gapEvent);
+}
+
+LinkStatus* BleLink::find(const uint8_t* addr) {
+  for (uint8_t i = 0; i < BLE_LINK_SLOTS; i++) {
+    if (links_[i].open && memcmp(links_[i].addr, addr, 6) == 0) return &links_[i];
+  }
+  return nullptr;
+}
+
+void BleLink::opened(const uint8_t* addr, uint16_t mtu) {
+  LinkStatus* s = find(addr);
+  for (uint8_t i = 0; s == nullptr && i < BLE_LINK_SLOTS; i++) {
+    if (!links_[i].open) s = &links_[i];
+  }
+  if (s == nullptr) return;
+
+  memset(s, 0, sizeof(*s));
+  memcpy(s->addr, addr, 6);
+  s->mtu = mtu;
+  s->open = true;
+#ifdef CONFIG_BT_BLE_50_FEATURES_SUPPORTED
+  esp_ble_gap_read_phy(const_cast<uint8_t*>(addr));
+#else
+  s->txPhy = s->rxPhy = 1;
+#endif
+}
+
+void BleLink::closed(const uint8_t* addr) {
+  LinkStatus* s = find(addr);
+  if (s == nullptr) return;
+  if (lengthPending == s) lengthPending = nullptr;
+  s->open = false;
+}
+
+void BleLink::setMtu(const uint8_t* addr, uint16_t mtu) {
+  LinkStatus* s = find(addr);
+  if (s) s->mtu = mtu;
+}
+
+bool BleLink::status(const uint8_t* addr, LinkStatus& out) {
+  LinkStatus* s = find(addr);
+  if (s == nullptr) return false;
+  out = *s;
+  return true;
+}
+
+bool BleLink::apply(const uint8_t* addr, LinkProfile profile) {
+  LinkStatus* s = find(addr);
+  if (s == nullptr) return false;
+  const LinkParams& p = LINK_PROFILES[profile];
+  uint8_t* bda = const_cast<uint8_t*>(addr);
+
+  esp_ble_conn_update_params_t conn = {};
+  memcpy(conn.bda, addr, 6);
+  conn.min_int = p.minInterval;
+  conn.max_int = p.maxInterval;
+  conn.latency = p.latency;
+  conn.timeout = p.timeout;
+  bool ok = esp_ble_gap_update_conn_params(&conn) == ESP_OK;
+
+  lengthPending = s;
+  ok = esp_ble_gap_set_pkt_data_len(bda, p.txOctets) == ESP_OK && ok;
+
+#ifdef CONFIG_BT_BLE_50_FEATURES_SUPPORTED
+  esp_ble_gap_phy_mask_t phy = p.phy2m ? ESP_BLE_GAP_PHY_2M_PREF_MASK : ESP_BLE_GAP_PHY_1M_PREF_MASK;
+  ok = esp_ble_gap_set_preferred_phy(bda, 0, phy, phy, ESP_BLE_GAP_PHY_OPTIONS_NO_PREF) == ESP_OK && ok;
+#endif
+  return ok;
+}
+
+void BleLink::gapEvent(esp_gap_ble_cb_event_t event, esp_ble_gap_cb_param_t* param) {
+  LinkStatus* s;
+  switch (event) {
+    case ESP_GAP_BLE_UPDATE_CONN_PARAMS_EVT:
+      s = find(param->update_conn_params.bda);
+      if (s && param->update_conn_params.status == ESP_BT_STATUS_SUCCESS) {
+        s->interval = param->update_conn_params.conn_int;
+        s->latency = param->update_conn_params.latency;
+        s->timeout = param->update_conn_params.timeout;
+      }
+      break;
+
+    case ESP_GAP_BLE_SET_PKT_LENGTH_COMPLETE_EVT:
+      if (lengthPending && param->pkt_data_length_cmpl.status == ESP_BT_STATUS_SUCCESS) {
+        lengthPending->txOctets = param->pkt_data_length_cmpl.params.tx_len;
+      }
+      lengthPending = nullptr;
+      break;
+
+#ifdef CONFIG_BT_BLE_50_FEATURES_SUPPORTED
+    case ESP_GAP_BLE_READ_PHY_COMPLETE_EVT:
+      s = find(param->read_phy.bda);
+      if (s && param->read_phy.status == ESP_BT_STATUS_SUCCESS) {
+        s->txPhy = param->read_phy.tx_phy;
+        s->rxPhy = param->read_phy.rx_phy;
+      }
+      break;
+
+    case ESP_GAP_BLE_PHY_UPDATE_COMPLETE_EVT:
+      s = find(param->phy_update.bda);
+      if (s && param->phy_update.status == ESP_BT_STATUS_SUCCESS) {
+        s->txPhy = param->phy_update.tx_phy;
+        s->rxPhy = param->phy_update.rx_phy;
+      }
+      break;
+#endif
+
+    default:
+      break;
+  }
+}
+
+#endif
@@ -0,0 +1,151 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+
+// ====================== Link profiles ======================
+// Build-flag selectors, e.g. build_flags = -D BLE_LINK_PROFILE=LINK_PROFILE_STREAMING
+#define LINK_PROFILE_AUTO      0
+#define LINK_PROFILE_STREAMING 1
+#define LINK_PROFILE_LOW_POWER 2
+
+#ifndef BLE_LINK_PROFILE
+#define BLE_LINK_PROFILE LINK_PROFILE_AUTO
+#endif
+
+enum LinkProfile : uint8_t {
+  LINK_STREAMING,  // short interval, no latency, long LL packets, 2M PHY
+  LINK_LOW_POWER,  // long interval, the peripheral skips idle events
+};
+
+struct LinkParams {
+  uint16_t minInterval;  // 1.25 ms units
+  uint16_t maxInterval;
+  uint16_t latency;      // connection events the peripheral may skip
+  uint16_t timeout;      // supervision timeout, 10 ms units
+  uint16_t txOctets;     // LL payload: 27 = no data length extension, 251 = max
+  bool phy2m;
+};
+
+// Supervision timeout covers (1 + latency) * interval twice over, as the
+// spec requires, with room for a few lost events.
+static const LinkParams LINK_PROFILES[] = {
+  {   6,  12, 0, 400, 251, true  },  // 7.5-15 ms
+  { 320, 400, 4, 600,  27, false },  // 400-500 ms, effective 2.5 s when idle
+};
+
+const char* linkProfileName(LinkProfile p);
+
+// Upper bound on notification payload for a profile: one MTU-sized
+// notification per connection event. Latency does not slow a peripheral
+// that has data queued, so it is not part of the figure.
+uint32_t linkCapacityBytesPerSec(const LinkParams& params, uint16_t mtu);
+
+// ====================== Profile selection ======================
+// Hardware-free: the server reports the payload it hands the link and the
+// backlog it is holding, and update() says when the link should change
+// profile. Going up is immediate, on the rate or on a backlog; coming back
+// down waits for the lower rate and a dwell time since the last switch, so a
+// rate near the threshold does not renegotiate every window.
+struct LinkSelectorConfig {
+  uint32_t upBytesPerSec = 256;    // streaming at or above this
+  uint32_t downBytesPerSec = 64;   // low power at or below this
+  uint32_t backlogBytes = 1024;    // queued this much: streaming now
+  uint32_t windowMs = 1000;        // rate measurement window
+  uint32_t minDwellMs = 10000;     // in streaming before dropping back
+};
+
+class LinkProfileSelector {
+public:
+  explicit LinkProfileSelector(const LinkSelectorConfig& cfg = LinkSelectorConfig()) : cfg_(cfg) {}
+
+  // On connect: start measuring, in profile p.
+  void reset(uint32_t nowMs, LinkProfile p);
+
+  void produced(size_t bytes) { bytes_ += bytes; }
+
+  // Call at least once per window. True when profile() just changed.
+  bool update(uint32_t nowMs, uint32_t backlogBytes = 0);
+
+  LinkProfile profile() const { return profile_; }
+  float bytesPerSec() const { return rate_; }
+  uint32_t switches() const { return switches_; }
+
+private:
+  LinkSelectorConfig cfg_;
+  LinkProfile profile_ = LINK_STREAMING;
+  uint32_t windowStartMs_ = 0;
+  uint32_t switchedMs_ = 0;
+  uint32_t bytes_ = 0;
+  float rate_ = 0;
+  bool measured_ = false;
+  uint32_t switches_ = 0;
+};
+
+// ====================== Telemetry ======================
+// Events per second between two samples. add() is safe from a BLE callback
+// while another task samples.
+class RateMeter {
+public:
+  void add(uint32_t n = 1) { total_.fetch_add(n, std::memory_order_relaxed); }
+
+  // Rate since the previous sample() (0 on the first).
+  float sample(uint32_t nowMs);
+  uint32_t total() const { return total_.load(std::memory_order_relaxed); }
+
+private:
+  std::atomic<uint32_t> total_{0};
+  uint32_t lastTotal_ = 0;
+  uint32_t lastMs_ = 0;
+  bool started_ = false;
+};
+
+// What the controller actually agreed to; 0 = not reported yet.
+struct LinkStatus {
+  uint8_t addr[6];
+  bool open;
+  uint16_t interval;  // 1.25 ms units
+  uint16_t latency;
+  uint16_t timeout;   // 10 ms units
+  uint16_t mtu;
+  uint8_t txPhy;      // 1 = 1M, 2 = 2M, 3 = coded
+  uint8_t rxPhy;
+  uint16_t txOctets;
+
+  float intervalMs() const { return interval * 1.25f; }
+};
+
+// "interval 7.5 ms latency 0 timeout 4000 ms | MTU 517 | PHY 2M/2M | LL 251 B"
+size_t describeLink(const LinkStatus& s, char* out, size_t size);
+
+#ifdef ARDUINO
+#include <esp_gap_ble_api.h>
+
+// ====================== Bluedroid link control ======================
+// Requests a profile on an open connection and tracks what the controller
+// agreed to from the GAP events. Works from either role: a peripheral's
+// parameter request goes through L2CAP, a central applies it directly.
+// 2M PHY needs a stack built with BLE 5.0 features; without them the link
+// stays on 1M.
+static const uint8_t BLE_LINK_SLOTS = 4;
+
+class BleLink {
+public:
+  // After BLEDevice::init(); takes BLEDevice's custom GAP handler.
+  static void begin();
+
+  static void opened(const uint8_t* addr, uint16_t mtu = 23);
+  static void closed(const uint8_t* addr);
+  static void setMtu(const uint8_t* addr, uint16_t mtu);
+
+  static bool apply(const uint8_t* addr, LinkProfile profile);
+  static bool status(const uint8_t* addr, LinkStatus& out);
+
+private:
+  static void gapEvent(esp_gap_ble_cb_event_t event, esp_ble_gap_cb_param_t* param);
+  static LinkStatus* find(const uint8_t* addr);
+
+  static LinkStatus links_[BLE_LINK_SLOTS];
+};
+#endif
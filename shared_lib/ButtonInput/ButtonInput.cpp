@@ -0,0 +1,163 @@
+#include "ButtonInput.h"
+
+static const uint32_t BUTTON_WAIT_FOREVER = 0xFFFFFFFFu;
+
+void ButtonDecoder::begin(bool pressed, uint32_t nowMs, bool wokeByPress) {
+  settling_ = false;
+  clickPending_ = false;
+  secondPress_ = false;
+
+  if (!wokeByPress) {
+    // Held at power-on: adopt the level, no events until it is let go
+    pressed_ = pressed;
+    longFired_ = pressed;
+    pressedAtMs_ = nowMs;
+    return;
+  }
+
+  pressed_ = false;
+  longFired_ = false;
+  if (pressed) {
+    edge(0);  // boot time is part of the latency
+  } else {
+    // Pressed and released while the board was booting
+    onPress(nowMs, 0);
+    onRelease(nowMs, 0);
+  }
+}
+
+void ButtonDecoder::edge(uint32_t edgeMs) {
+  if (!settling_) burstStartMs_ = edgeMs;
+  settling_ = true;
+  lastEdgeMs_ = edgeMs;
+}
+
+void ButtonDecoder::emit(ButtonEventType type, uint32_t nowMs, uint32_t edgeMs) {
+  events_.push(ButtonEvent{type, nowMs, edgeMs});
+}
+
+void ButtonDecoder::onPress(uint32_t nowMs, uint32_t edgeMs) {
+  pressed_ = true;
+  pressedAtMs_ = nowMs;
+  longFired_ = false;
+  emit(BUTTON_PRESS, nowMs, edgeMs);
+
+  if (clickPending_) {
+    clickPending_ = false;
+    if (nowMs - releasedAtMs_ < cfg_.doubleClickMs) {
+      secondPress_ = true;
+      emit(BUTTON_DOUBLE_CLICK, nowMs, edgeMs);
+    } else {
+      // The window ran out before anyone polled
+      emit(BUTTON_CLICK, releasedAtMs_ + cfg_.doubleClickMs, releasedAtMs_);
+    }
+  }
+}
+
+void ButtonDecoder::onRelease(uint32_t nowMs, uint32_t edgeMs) {
+  pressed_ = false;
+  emit(BUTTON_RELEASE, nowMs, edgeMs);
+
+  if (longFired_ || secondPress_) {
+    secondPress_ = false;
+    return;
+  }
+  if (cfg_.doubleClickMs == 0) {
+    emit(BUTTON_CLICK, nowMs, edgeMs);
+    return;
+  }
+  clickPending_ = true;
+  releasedAtMs_ = nowMs;
+}
+
+uint32_t ButtonDecoder::poll(bool pressed, uint32_t nowMs) {
+  // A level change with no edge seen: the interrupt missed it (light sleep)
+  if (!settling_ && pressed != pressed_) edge(nowMs);
+
+  uint32_t wait = BUTTON_WAIT_FOREVER;
+  if (settling_) {
+    uint32_t still = nowMs - lastEdgeMs_;
+    if (still < cfg_.settleMs) {
+      wait = cfg_.settleMs - still;
+    } else {
+      settling_ = false;
+      if (pressed != pressed_) {
+        if (pressed) onPress(nowMs, burstStartMs_);
+        else onRelease(nowMs, burstStartMs_);
+      }
+    }
+  }
+
+  if (pressed_ && !longFired_) {
+    uint32_t held = nowMs - pressedAtMs_;
+    if (held >= cfg_.longPressMs) {
+      longFired_ = true;
+      emit(BUTTON_LONG_PRESS, nowMs, pressedAtMs_);
+    } else if (cfg_.longPressMs - held < wait) {
+      wait = cfg_.longPressMs - held;
+    }
+  }
+
+  if (clickPending_) {
+    uint32_t since = nowMs - releasedAtMs_;
+    if (since >= cfg_.doubleClickMs) {
+      clickPending_ = false;
+      emit(BUTTON_CLICK, nowMs, releasedAtMs_);
+    } else if (cfg_.doubleClickMs - since < wait) {
+      wait = cfg_.doubleClickMs - since;
+    }
+  }
+  return wait;
+}
+
+#ifdef ARDUINO
+
+#include <Arduino.h>
+#include <esp_sleep.h>
+
+InterruptButton::InterruptButton(int pin, bool activeLow, const ButtonConfig& cfg)
+  : pin_(pin), activeLow_(activeLow), decoder_(cfg) {}
+
+void InterruptButton::begin(EdgeFn onEdge, bool wokeByPress) {
+  onEdge_ = onEdge;
+  pinMode(pin_, activeLow_ ? INPUT_PULLUP : INPUT_PULLDOWN);
+  decoder_.begin(readPressed(), millis(), wokeByPress);
+  attachInterruptArg(digitalPinToInterrupt(pin_), edgeIsr, this, CHANGE);
+}
+
+void InterruptButton::end() {
+  detachInterrupt(digitalPinToInterrupt(pin_));
+}
+
+bool InterruptButton::readPressed() const {
+  return (digitalRead(pin_) == LOW) == activeLow_;
+}
+
+void IRAM_ATTR InterruptButton::edgeIsr(void* arg) {
+  InterruptButton* self = static_cast<InterruptButton*>(arg);
+  uint32_t now = millis();
+  if (self->edges_.load(std::memory_order_relaxed) == self->seenEdges_) self->firstEdgeMs_ = now;
+  self->lastEdgeMs_ = now;
+  self->edges_.fetch_add(1, std::memory_order_release);
+  if (self->onEdge_) self->onEdge_();
+}
+
+uint32_t InterruptButton::service() {
+  uint32_t edges = edges_.load(std::memory_order_acquire);
+  if (edges != seenEdges_) {
+    decoder_.edge(firstEdgeMs_);
+    decoder_.edge(lastEdgeMs_);
+    seenEdges_ = edges;
+  }
+  return decoder_.poll(readPressed(), millis());
+}
+
+int InterruptButton::wakeLevel() const {
+  return digitalRead(pin_) == HIGH ? LOW : HIGH;
+}
+
+void InterruptButton::enableDeepSleepWake() {
+  esp_deep_sleep_enable_gpio_wakeup(1ULL << pin_, activeLow_ ? ESP_GPIO_WAKEUP_GPIO_LOW : ESP_GPIO_WAKEUP_GPIO_HIGH);
+}
+
+#endif
@@ -0,0 +1,120 @@
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+#include <SpscRing.h>
+
+#ifndef IRAM_ATTR
+#define IRAM_ATTR
+#endif
+
+enum ButtonEventType : uint8_t {
+  BUTTON_PRESS,         // debounced press, reported as soon as it settles
+  BUTTON_RELEASE,
+  BUTTON_CLICK,         // short press with no second one inside the double-click window
+  BUTTON_DOUBLE_CLICK,  // reported on the second press
+  BUTTON_LONG_PRESS     // still held after longPressMs
+};
+
+struct ButtonEvent {
+  ButtonEventType type;
+  uint32_t tMs;      // when it was decided
+  uint32_t edgeMs;   // first edge of the bounce burst behind it (press/release)
+
+  uint32_t latencyMs() const { return tMs - edgeMs; }
+};
+
+struct ButtonConfig {
+  uint16_t settleMs = 8;         // the contact must sit still this long; bounce is typically < 5 ms
+  uint16_t longPressMs = 800;
+  uint16_t doubleClickMs = 300;  // 0: report CLICK on release, no double clicks
+};
+
+// ====================== Debounce + gesture decoder ======================
+// Hardware-free core, fed with edge times and pin samples so the same logic
+// runs behind a GPIO interrupt on the board and behind synthetic edges on
+// host. Timer-based debounce: an edge only opens a settle window, and the
+// level sampled once the contact has been still for settleMs decides. A
+// burst of bounces costs one decision, and a glitch shorter than the window
+// is ignored. Press latency is the bounce time plus settleMs.
+class ButtonDecoder {
+public:
+  explicit ButtonDecoder(const ButtonConfig& cfg = ButtonConfig()) : cfg_(cfg) {}
+
+  // pressed: level at start-up. wokeByPress: the press woke the board from
+  // deep sleep; if it is already over by now, it still counts as a click.
+  void begin(bool pressed, uint32_t nowMs, bool wokeByPress = false);
+
+  // Any edge on the pin (from the ISR's timestamp).
+  void edge(uint32_t edgeMs);
+
+  // Samples the pin at nowMs and decides whatever is due. Returns the ms
+  // until it needs calling again, 0xFFFFFFFF when only an edge matters.
+  uint32_t poll(bool pressed, uint32_t nowMs);
+
+  bool next(ButtonEvent& out) { return events_.pop(out); }
+
+  bool pressed() const { return pressed_; }
+  bool idle() const { return !settling_ && !pressed_ && !clickPending_; }
+  uint32_t dropped() const { return events_.dropped(); }
+
+private:
+  void emit(ButtonEventType type, uint32_t nowMs, uint32_t edgeMs);
+  void onPress(uint32_t nowMs, uint32_t edgeMs);
+  void onRelease(uint32_t nowMs, uint32_t edgeMs);
+
+  ButtonConfig cfg_;
+  bool pressed_ = false;      // debounced level
+  bool settling_ = false;
+  uint32_t burstStartMs_ = 0; // first edge since the level last settled
+  uint32_t lastEdgeMs_ = 0;
+  uint32_t pressedAtMs_ = 0;
+  bool longFired_ = false;
+  bool secondPress_ = false;  // this press already was the double click
+  bool clickPending_ = false;
+  uint32_t releasedAtMs_ = 0;
+  SpscRing<ButtonEvent, 8> events_;
+};
+
+#ifdef ARDUINO
+// ====================== Interrupt button ======================
+// The pin's CHANGE interrupt timestamps the edge and calls onEdge (post the
+// task that calls service()); nothing polls while the button is untouched.
+// For light sleep, make the pin a wake source at wakeLevel(), the level it
+// is not at, so a held button does not keep waking the board. For deep
+// sleep, enableDeepSleepWake() arms a wake on press (RTC-capable pins only:
+// GPIO0-5 on the C3).
+class InterruptButton {
+public:
+  typedef void (*EdgeFn)();
+
+  InterruptButton(int pin, bool activeLow = true, const ButtonConfig& cfg = ButtonConfig());
+
+  void begin(EdgeFn onEdge = nullptr, bool wokeByPress = false);
+  void end();
+
+  // Handles the edges since the last call; returns ms until it needs
+  // calling again (0xFFFFFFFF: wait for the next edge).
+  uint32_t service();
+  bool next(ButtonEvent& out) { return decoder_.next(out); }
+
+  bool pressed() const { return decoder_.pressed(); }
+  bool idle() const { return decoder_.idle(); }
+
+  int wakeLevel() const;
+  void enableDeepSleepWake();
+
+private:
+  static void IRAM_ATTR edgeIsr(void* arg);
+  bool readPressed() const;
+
+  int pin_;
+  bool activeLow_;
+  EdgeFn onEdge_ = nullptr;
+  ButtonDecoder decoder_;
+  std::atomic<uint32_t> edges_{0};
+  volatile uint32_t firstEdgeMs_ = 0;  // first edge since the last service()
+  volatile uint32_t lastEdgeMs_ = 0;
+  volatile uint32_t seenEdges_ = 0;
+};
+#endif
@@ -0,0 +1,69 @@
+#include "CoopScheduler.h"
+
+#ifdef ARDUINO
+
+#include <Arduino.h>
+#include <driver/gpio.h>
+#include <esp_sleep.h>
+
+void* SchedulerIdle::task_ = nullptr;
+bool SchedulerIdle::lightSleep_ = SCHED_LIGHT_SLEEP;
+bool SchedulerIdle::wakePins_ = false;
+void (*SchedulerIdle::pinWake_)() = nullptr;
+uint32_t SchedulerIdle::lightSleeps_ = 0;
+uint64_t SchedulerIdle::lightSleptMs_ = 0;
+
+void SchedulerIdle::begin(bool lightSleep) {
+  task_ = xTaskGetCurrentTaskHandle();
+  lightSleep_ = lightSleep;
+}
+
+void SchedulerIdle::wakeOnPin(int pin, int level) {
+  gpio_wakeup_enable((gpio_num_t)pin, level ? GPIO_INTR_HIGH_LEVEL : GPIO_INTR_LOW_LEVEL);
+  esp_sleep_enable_gpio_wakeup();
+  wakePins_ = true;
+}
+
+void SchedulerIdle::wait(uint32_t ms) {
+  if (ms == 0 || task_ == nullptr) return;
+
+  // A post that arrived since runReady() started must not wait out the sleep
+  if (ulTaskNotifyTake(pdTRUE, 0)) return;
+
+  bool forever = ms == SCHED_IDLE_FOREVER;
+  if (lightSleep_ && ms >= SCHED_LIGHT_SLEEP_MIN_MS && (!forever || wakePins_)) {
+    Serial.flush();
+    if (forever) esp_sleep_disable_wakeup_source(ESP_SLEEP_WAKEUP_TIMER);
+    else esp_sleep_enable_timer_wakeup((uint64_t)ms * 1000ULL);
+
+    uint32_t start = millis();
+    if (esp_light_sleep_start() == ESP_OK) {
+      lightSleeps_++;
+      lightSleptMs_ += millis() - start;
+      if (pinWake_ && esp_sleep_get_wakeup_cause() == ESP_SLEEP_WAKEUP_GPIO) pinWake_();
+      return;
+    }
+    // Rejected (a wake source was already pending); fall back to blocking
+  }
+
+  TickType_t ticks = forever ? portMAX_DELAY : pdMS_TO_TICKS(ms);
+  ulTaskNotifyTake(pdTRUE, ticks ? ticks : 1);
+}
+
+void IRAM_ATTR SchedulerIdle::wake() {
+  TaskHandle_t task = (TaskHandle_t)task_;
+  if (task == nullptr) return;
+  if (xPortInIsrContext()) {
+    BaseType_t woken = pdFALSE;
+    vTaskNotifyGiveFromISR(task, &woken);
+    if (woken) portYIELD_FROM_ISR();
+  } else {
+    xTaskNotifyGive(task);
+  }
+}
+
+uint32_t SchedulerIdle::millisClock() {
+  return millis();
+}
+
+#endif
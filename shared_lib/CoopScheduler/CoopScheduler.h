@@ -0,0 +1,249 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+
+#ifndef IRAM_ATTR
+#define IRAM_ATTR
+#endif
+
+typedef void (*TaskFn)(void* arg);
+typedef int8_t TaskId;
+
+static const TaskId NO_TASK = -1;
+static const uint32_t SCHED_IDLE_FOREVER = 0xFFFFFFFFu;  // nothing armed, wait for an event
+static const uint32_t SCHED_LIGHT_SLEEP_MIN_MS = 5;       // shorter idles: light sleep entry/exit costs more than it saves
+
+// Timing of one task, for tuning and the host bench.
+struct TaskStats {
+  uint32_t runs;
+  uint32_t skipped;      // periods dropped because the loop fell more than a period behind
+  uint32_t maxLateMs;    // worst start after the deadline
+  uint64_t totalLateMs;  // mean lateness = totalLateMs / runs (deadline runs only)
+};
+
+// ====================== Cooperative scheduler ======================
+// Replaces the delay() at the bottom of loop(). Tasks are plain callbacks
+// in a fixed table of N slots, created in setup():
+//   - every(): periodic. Deadlines advance by whole periods from the first
+//     one, so a late run does not drift the ones after it.
+//   - after(): one-shot deadline; disarms itself when it fires and can be
+//     re-armed or pushed back with restart().
+//   - onEvent(): runs only when posted.
+// post() marks any task to run on the next pass and is safe from an ISR or
+// another task (one atomic OR). runReady() runs what is due and returns how
+// long the caller may sleep; on the board SchedulerIdle does the sleeping:
+//
+//   void loop() { SchedulerIdle::wait(scheduler.runReady()); }
+//
+// Hardware-free: the clock is injected, so the native bench drives it with
+// a virtual one. Add, cancel and restart only from the thread that calls
+// runReady().
+template <size_t N>
+class CoopScheduler {
+  static_assert(N >= 1 && N <= 32, "posted events are one 32-bit mask");
+
+public:
+  typedef uint32_t (*Clock)();
+  typedef void (*WakeFn)();
+
+  explicit CoopScheduler(Clock clock) : clock_(clock) {}
+
+  // Called by post() so a waiting loop notices the event; must be ISR-safe.
+  void onPost(WakeFn wake) { wake_ = wake; }
+
+  // firstMs: delay before the first run (0 = on the next pass).
+  TaskId every(uint32_t periodMs, TaskFn fn, void* arg = nullptr, uint32_t firstMs = 0) {
+    if (periodMs == 0) return NO_TASK;
+    return add(PERIODIC, periodMs, fn, arg, true, firstMs);
+  }
+
+  TaskId after(uint32_t delayMs, TaskFn fn, void* arg = nullptr) {
+    return add(ONE_SHOT, 0, fn, arg, true, delayMs);
+  }
+
+  // A one-shot that starts disarmed, for deadlines armed later by restart().
+  TaskId timer(TaskFn fn, void* arg = nullptr) {
+    return add(ONE_SHOT, 0, fn, arg, false, 0);
+  }
+
+  TaskId onEvent(TaskFn fn, void* arg = nullptr) {
+    return add(EVENT, 0, fn, arg, false, 0);
+  }
+
+  void IRAM_ATTR post(TaskId id) {
+    if (id < 0 || (size_t)id >= N) return;
+    pending_.fetch_or(1u << id, std::memory_order_release);
+    if (wake_) wake_();
+  }
+
+  // (Re)arms a deadline delayMs from now; a periodic task restarts its
+  // phase there.
+  bool restart(TaskId id, uint32_t delayMs) {
+    if (!valid(id) || tasks_[id].kind == EVENT) return false;
+    tasks_[id].dueMs = clock_() + delayMs;
+    tasks_[id].armed = true;
+    return true;
+  }
+
+  // New period for a periodic task, first run periodMs from now.
+  bool setPeriod(TaskId id, uint32_t periodMs) {
+    if (!valid(id) || tasks_[id].kind != PERIODIC || periodMs == 0) return false;
+    tasks_[id].periodMs = periodMs;
+    return restart(id, periodMs);
+  }
+
+  // Disarms the deadline and drops a pending post; the slot stays allocated.
+  bool cancel(TaskId id) {
+    if (!valid(id)) return false;
+    tasks_[id].armed = false;
+    pending_.fetch_and(~(1u << id), std::memory_order_relaxed);
+    return true;
+  }
+
+  bool armed(TaskId id) const { return valid(id) && tasks_[id].armed; }
+
+  // Milliseconds until the task is due (0 if overdue), SCHED_IDLE_FOREVER if disarmed.
+  uint32_t dueIn(TaskId id) const {
+    if (!armed(id)) return SCHED_IDLE_FOREVER;
+    int32_t d = (int32_t)(tasks_[id].dueMs - clock_());
+    return d > 0 ? (uint32_t)d : 0;
+  }
+
+  const TaskStats& stats(TaskId id) const { return tasks_[valid(id) ? id : 0].stats; }
+  size_t size() const { return count_; }
+
+  // Runs posted tasks, then every task whose deadline has passed, each at
+  // most once. Returns the milliseconds until the next deadline: 0 if
+  // something is already due or posted, SCHED_IDLE_FOREVER if only an
+  // event can wake the loop.
+  uint32_t runReady() {
+    uint32_t posted = pending_.exchange(0, std::memory_order_acquire);
+    for (size_t i = 0; posted && i < count_; i++) {
+      if (!(posted & (1u << i))) continue;
+      posted &= ~(1u << i);
+      tasks_[i].stats.runs++;
+      tasks_[i].fn(tasks_[i].arg);
+    }
+
+    for (size_t i = 0; i < count_; i++) {
+      Task& t = tasks_[i];
+      if (!t.armed) continue;
+      uint32_t now = clock_();
+      if ((int32_t)(now - t.dueMs) < 0) continue;
+
+      uint32_t late = now - t.dueMs;
+      if (t.kind == PERIODIC) {
+        uint32_t behind = late / t.periodMs;  // whole periods missed
+        t.stats.skipped += behind;
+        t.dueMs += (behind + 1) * t.periodMs;
+      } else {
+        t.armed = false;  // before the call, so the task may re-arm itself
+      }
+      t.stats.runs++;
+      t.stats.totalLateMs += late;
+      if (late > t.stats.maxLateMs) t.stats.maxLateMs = late;
+      t.fn(t.arg);
+    }
+
+    if (pending_.load(std::memory_order_acquire)) return 0;
+    uint32_t now = clock_();
+    uint32_t wait = SCHED_IDLE_FOREVER;
+    for (size_t i = 0; i < count_; i++) {
+      if (!tasks_[i].armed) continue;
+      int32_t d = (int32_t)(tasks_[i].dueMs - now);
+      if (d <= 0) return 0;
+      if ((uint32_t)d < wait) wait = (uint32_t)d;
+    }
+    return wait;
+  }
+
+private:
+  enum Kind : uint8_t { PERIODIC, ONE_SHOT, EVENT };
+
+  struct Task {
+    TaskFn fn;
+    void* arg;
+    uint32_t dueMs;
+    uint32_t periodMs;
+    Kind kind;
+    bool armed;
+    TaskStats stats;
+  };
+
+  bool valid(TaskId id) const { return id >= 0 && (size_t)id < count_; }
+
+  TaskId add(Kind kind, uint32_t periodMs, TaskFn fn, void* arg, bool armed, uint32_t delayMs) {
+    if (count_ >= N || fn == nullptr) return NO_TASK;
+    Task& t = tasks_[count_];
+    t.fn = fn;
+    t.arg = arg;
+    t.kind = kind;
+    t.periodMs = periodMs;
+    t.armed = armed;
+    t.dueMs = clock_() + delayMs;
+    t.stats = TaskStats{0, 0, 0, 0};
+    return (TaskId)count_++;
+  }
+
+  Clock clock_;
+  WakeFn wake_ = nullptr;
+  Task tasks_[N];
+  size_t count_ = 0;
+  std::atomic<uint32_t> pending_{0};
+};
+
+#ifdef ARDUINO
+// ====================== Idle between tasks ======================
+// Waits for the delay runReady() returned, or until wake(). Waits of at
+// least SCHED_LIGHT_SLEEP_MIN_MS go into light sleep (CPU and most
+// peripherals stopped, RAM kept, millis() keeps counting) unless it is
+// switched off; shorter ones, and every wait while light sleep is off, block
+// the calling task until the deadline or a post, so the loop no longer wakes
+// on every pass of a fixed delay() to find nothing to do.
+//
+// Turn light sleep off wherever a radio link has to stay up: BLE
+// connections and WiFi associations do not survive it. The USB-CDC serial
+// port of the C3/S3 also detaches while asleep; build with
+// -D SCHED_LIGHT_SLEEP=0 to keep a serial monitor attached.
+//
+// Posts do not interrupt a light sleep, only the timer and the wake pins
+// end it: give any interrupt that posts a task a wakeOnPin(). The pin's
+// edge interrupt is not guaranteed to fire for the level that woke the
+// board, so onPinWake() gets a call after every pin wake.
+#ifndef SCHED_LIGHT_SLEEP
+#define SCHED_LIGHT_SLEEP 1
+#endif
+
+class SchedulerIdle {
+public:
+  // Call from the task that runs the scheduler (setup() for loop()).
+  static void begin(bool lightSleep = SCHED_LIGHT_SLEEP);
+  static void lightSleep(bool enabled) { lightSleep_ = enabled; }
+  static bool lightSleepEnabled() { return lightSleep_; }
+
+  // Ends a light sleep while the pin sits at level; the pin's own interrupt
+  // still has to post the work.
+  static void wakeOnPin(int pin, int level);
+  static void onPinWake(void (*hook)()) { pinWake_ = hook; }
+
+  static void wait(uint32_t ms);
+
+  // From an ISR or another task; hand it to CoopScheduler::onPost().
+  static void IRAM_ATTR wake();
+
+  static uint32_t millisClock();  // CoopScheduler::Clock over millis()
+
+  static uint32_t lightSleeps() { return lightSleeps_; }
+  static uint64_t lightSleptMs() { return lightSleptMs_; }
+
+private:
+  static void* task_;
+  static bool lightSleep_;
+  static bool wakePins_;
+  static void (*pinWake_)();
+  static uint32_t lightSleeps_;
+  static uint64_t lightSleptMs_;
+};
+#endif
@@ -0,0 +1,185 @@
+#include "DistanceFrame.h"
+
+#include <math.h>
+#include <string.h>
+
+static void putU16(uint8_t* p, uint16_t v) {
+  p[0] = (uint8_t)v;
+  p[1] = (uint8_t)(v >> 8);
+}
+
+static void putU32(uint8_t* p, uint32_t v) {
+  putU16(p, (uint16_t)v);
+  putU16(p + 2, (uint16_t)(v >> 16));
+}
+
+static uint16_t getU16(const uint8_t* p) {
+  return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static uint32_t getU32(const uint8_t* p) {
+  return (uint32_t)getU16(p) | ((uint32_t)getU16(p + 2) << 16);
+}
+
+static uint32_t zigzag(int32_t v) {
+  return ((uint32_t)v << 1) ^ (uint32_t)(v >> 31);
+}
+
+static int32_t unzigzag(uint32_t v) {
+  return (int32_t)(v >> 1) ^ -(int32_t)(v & 1);
+}
+
+// LEB128; returns the bytes written
+static size_t putVarint(uint8_t* p, uint32_t v) {
+  size_t n = 0;
+  while (v >= 0x80) {
+    p[n++] = (uint8_t)(v | 0x80);
+    v >>= 7;
+  }
+  p[n++] = (uint8_t)v;
+  return n;
+}
+
+// False if the varint runs past end or past 3 bytes (all this format uses)
+static bool getVarint(const uint8_t*& p, const uint8_t* end, uint32_t& v) {
+  v = 0;
+  for (int shift = 0; shift < 21; shift += 7) {
+    if (p == end) return false;
+    uint8_t b = *p++;
+    v |= (uint32_t)(b & 0x7F) << shift;
+    if (!(b & 0x80)) return true;
+  }
+  return false;
+}
+
+static int16_t toFixed(float cm) {
+  if (isnan(cm)) return DISTANCE_FRAME_NO_READING;
+  float v = roundf(cm * DISTANCE_FRAME_CM_SCALE);
+  if (v > INT16_MAX) return INT16_MAX;
+  if (v <= INT16_MIN) return INT16_MIN + 1;
+  return (int16_t)v;
+}
+
+void DistanceFrameEncoder::setMtu(uint16_t mtu) {
+  size_t payload = mtu > 3 ? mtu - 3 : 0;
+  if (payload > DISTANCE_FRAME_MAX_SIZE) payload = DISTANCE_FRAME_MAX_SIZE;
+  payload_ = payload;
+
+  capacity_ = payload > DISTANCE_FRAME_HEADER_SIZE
+    ? (payload - DISTANCE_FRAME_HEADER_SIZE) / DISTANCE_FRAME_SAMPLE_SIZE
+    : 0;
+  if (capacity_ > 255) capacity_ = 255;  // count is one byte
+}
+
+void DistanceFrameEncoder::header(uint16_t seq, uint32_t tMs) {
+  buf_[0] = DISTANCE_FRAME_VERSION | flags_ | (delta_ ? DISTANCE_FRAME_DELTA : 0);
+  buf_[1] = (uint8_t)count_;
+  putU16(buf_ + 2, seq);
+  putU32(buf_ + 4, tMs);
+  firstMs_ = tMs;
+  lastMs_ = tMs;
+  lastRaw_ = 0;
+  lastDt_ = 0;
+}
+
+bool DistanceFrameEncoder::addDelta(int16_t raw, uint32_t dt) {
+  uint8_t sample[DISTANCE_FRAME_DELTA_SAMPLE_MAX];
+  uint32_t value = 0;
+  if (raw != DISTANCE_FRAME_NO_READING) value = zigzag((int32_t)raw - lastRaw_) + 1;
+  size_t n = putVarint(sample, value);
+  n += putVarint(sample + n, zigzag((int32_t)dt - (int32_t)lastDt_));
+  if (size_ + n > payload_) return false;
+
+  memcpy(buf_ + size_, sample, n);
+  size_ += n;
+  if (raw != DISTANCE_FRAME_NO_READING) lastRaw_ = raw;
+  lastDt_ = dt;
+  return true;
+}
+
+bool DistanceFrameEncoder::add(uint16_t seq, uint32_t tMs, float cm) {
+  if (full()) return false;
+
+  if (count_ == 0) header(seq, tMs);
+
+  uint32_t dt = tMs - lastMs_;
+  if (dt > UINT16_MAX) return false;  // gap too long for this frame
+
+  if (delta_) {
+    if (!addDelta(toFixed(cm), dt)) return false;
+  } else {
+    uint8_t* p = buf_ + size_;
+    putU16(p, (uint16_t)toFixed(cm));
+    putU16(p + 2, (uint16_t)dt);
+    size_ += DISTANCE_FRAME_SAMPLE_SIZE;
+  }
+  lastMs_ = tMs;
+
+  count_++;
+  buf_[1] = (uint8_t)count_;
+  return true;
+}
+
+int decodeDistanceFrame(const uint8_t* data, size_t length, FrameSample* out, size_t maxOut,
+                        DistanceFrameInfo* info) {
+  if (data == nullptr || length < DISTANCE_FRAME_HEADER_SIZE) return -1;
+  const uint8_t flagMask = DISTANCE_FRAME_BACKFILL | DISTANCE_FRAME_RESTART | DISTANCE_FRAME_DELTA;
+  if ((data[0] & ~flagMask) != DISTANCE_FRAME_VERSION) return -1;
+  bool delta = data[0] & DISTANCE_FRAME_DELTA;
+
+  size_t count = data[1];
+  if (!delta && length != DISTANCE_FRAME_HEADER_SIZE + count * DISTANCE_FRAME_SAMPLE_SIZE) return -1;
+
+  uint16_t seq = getU16(data + 2);
+  uint32_t t = getU32(data + 4);
+  const uint8_t* p = data + DISTANCE_FRAME_HEADER_SIZE;
+  const uint8_t* end = data + length;
+
+  // Delta samples are walked to the end even past maxOut: the length only
+  // checks out once every varint has been read
+  int32_t raw = 0;
+  int32_t dt = 0;
+  size_t n = count < maxOut ? count : maxOut;
+  for (size_t i = 0; i < count; i++) {
+    int32_t value;
+    if (delta) {
+      uint32_t v, d;
+      if (!getVarint(p, end, v) || !getVarint(p, end, d)) return -1;
+      dt += unzigzag(d);
+      if (dt < 0 || dt > UINT16_MAX) return -1;
+      if (v != 0) {
+        raw += unzigzag(v - 1);
+        if (raw <= INT16_MIN || raw > INT16_MAX) return -1;
+      }
+      value = v == 0 ? DISTANCE_FRAME_NO_READING : raw;
+    } else {
+      value = (int16_t)getU16(p);
+      dt = getU16(p + 2);
+      p += DISTANCE_FRAME_SAMPLE_SIZE;
+    }
+
+    t += dt;
+    if (i >= n) continue;
+    out[i].seq = (uint16_t)(seq + i);
+    out[i].t_ms = t;
+    out[i].cm = value == DISTANCE_FRAME_NO_READING ? NAN : value / DISTANCE_FRAME_CM_SCALE;
+  }
+  if (p != end) return -1;
+
+  if (info) *info = DistanceFrameInfo{(uint8_t)(data[0] & flagMask), (uint8_t)count, seq, getU32(data + 4)};
+  return (int)n;
+}
+
+size_t encodeDistanceControl(const DistanceControl& c, uint8_t* out) {
+  out[0] = c.op;
+  putU16(out + 1, c.seq);
+  return DISTANCE_CONTROL_SIZE;
+}
+
+bool decodeDistanceControl(const uint8_t* data, size_t length, DistanceControl& out) {
+  if (data == nullptr || length != DISTANCE_CONTROL_SIZE) return false;
+  if (data[0] != DISTANCE_CTRL_BACKFILL && data[0] != DISTANCE_CTRL_ACK) return false;
+  out.op = data[0];
+  out.seq = getU16(data + 1);
+  return true;
+}
@@ -0,0 +1,137 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Binary BLE notification format shared by the distance server and client.
+//
+//   offset  size  field
+//   0       1     version (DISTANCE_FRAME_VERSION) | flags
+//   1       1     sample count n
+//   2       2     sequence number of the first sample
+//   4       4     timestamp of the first sample (ms, sender clock)
+//   8       4*n   samples: int16 distance (0.1 cm), uint16 dt since previous (ms)
+//
+// All fields are little-endian. A distance of DISTANCE_FRAME_NO_READING
+// means the sensor had no echo for that slot. DISTANCE_FRAME_BACKFILL marks
+// samples replayed from the server's history after a reconnect. A backfill
+// frame with no samples says nothing before its sequence number is coming,
+// and with DISTANCE_FRAME_RESTART that the server's numbering restarted
+// there (see shared_lib/SampleBackfill).
+//
+// DISTANCE_FRAME_DELTA replaces the fixed 4-byte samples with two varints
+// (LEB128) each, relative to the previous sample in the same frame:
+//
+//   value  0 = no reading, else zigzag(distance - last distance) + 1
+//   time   zigzag(dt - previous dt)
+//
+// Distances start from 0 and dt from 0 in every frame, so a frame decodes on
+// its own. A steady ping period and a slowly moving target take 2 bytes per
+// sample; the worst case is DISTANCE_FRAME_DELTA_SAMPLE_MAX.
+
+static const uint8_t DISTANCE_FRAME_VERSION = 1;
+static const uint8_t DISTANCE_FRAME_BACKFILL = 0x80;  // flags in the version byte
+static const uint8_t DISTANCE_FRAME_RESTART = 0x40;
+static const uint8_t DISTANCE_FRAME_DELTA = 0x20;
+static const size_t DISTANCE_FRAME_HEADER_SIZE = 8;
+static const size_t DISTANCE_FRAME_SAMPLE_SIZE = 4;
+static const size_t DISTANCE_FRAME_DELTA_SAMPLE_MAX = 6;  // two 3-byte varints
+static const size_t DISTANCE_FRAME_MAX_SIZE = 512;   // ATT value limit
+static const size_t DISTANCE_FRAME_MAX_SAMPLES = 255;  // count is one byte
+static const int16_t DISTANCE_FRAME_NO_READING = INT16_MIN;
+static const float DISTANCE_FRAME_CM_SCALE = 10.0f;  // fixed point: 0.1 cm
+
+struct FrameSample {
+  uint16_t seq;
+  uint32_t t_ms;
+  float cm;  // NaN for DISTANCE_FRAME_NO_READING
+};
+
+// ====================== Encoder ======================
+// Packs samples until the frame fills the notification payload
+// (negotiated MTU - 3 bytes of ATT header).
+class DistanceFrameEncoder {
+public:
+  DistanceFrameEncoder() { setMtu(23); }
+
+  void setMtu(uint16_t mtu);
+  // Delta-encode the frames started from now on; kept across reset().
+  void setDelta(bool on) { delta_ = on; }
+  bool delta() const { return delta_; }
+  // Returns false if the frame is full; the caller should send and reset.
+  bool add(uint16_t seq, uint32_t tMs, float cm);
+  void reset(uint8_t flags = 0) {
+    count_ = 0;
+    size_ = DISTANCE_FRAME_HEADER_SIZE;
+    flags_ = flags;
+  }
+  // Header alone: a frame of no samples that still carries seq.
+  void header(uint16_t seq, uint32_t tMs);
+
+  bool empty() const { return count_ == 0; }
+  // A delta frame is full once the worst-case sample might not fit
+  bool full() const {
+    return delta_ ? count_ >= DISTANCE_FRAME_MAX_SAMPLES || size_ + DISTANCE_FRAME_DELTA_SAMPLE_MAX > payload_
+                  : count_ >= capacity_;
+  }
+  size_t count() const { return count_; }
+  size_t capacity() const { return capacity_; }  // fixed-size samples
+  uint32_t firstTimeMs() const { return firstMs_; }
+
+  const uint8_t* data() const { return buf_; }
+  size_t size() const { return size_; }
+
+private:
+  bool addDelta(int16_t raw, uint32_t dt);
+
+  uint8_t buf_[DISTANCE_FRAME_MAX_SIZE];
+  size_t payload_ = 0;
+  size_t capacity_ = 0;
+  size_t count_ = 0;
+  size_t size_ = DISTANCE_FRAME_HEADER_SIZE;
+  uint8_t flags_ = 0;
+  bool delta_ = false;
+  uint32_t firstMs_ = 0;
+  uint32_t lastMs_ = 0;
+  int16_t lastRaw_ = 0;  // delta state, per frame
+  uint32_t lastDt_ = 0;
+};
+
+// ====================== Decoder ======================
+// Validates version and length, then unpacks up to maxOut samples.
+// Returns the number of samples decoded, or -1 for a malformed frame.
+struct DistanceFrameInfo {
+  uint8_t flags;
+  uint8_t count;
+  uint16_t seq;  // of the first sample
+  uint32_t t_ms;
+};
+
+int decodeDistanceFrame(const uint8_t* data, size_t length, FrameSample* out, size_t maxOut,
+                        DistanceFrameInfo* info = nullptr);
+
+// ====================== Control writes ======================
+// Client -> server, written to the same characteristic.
+//
+//   offset  size  field
+//   0       1     opcode (DistanceControlOp)
+//   1       2     sequence number
+//
+// BACKFILL asks for every sample from seq on that the server still holds;
+// ACK says the client has everything before seq, which opens the server's
+// window for more backfill frames.
+enum DistanceControlOp : uint8_t {
+  DISTANCE_CTRL_BACKFILL = 1,
+  DISTANCE_CTRL_ACK = 2,
+};
+
+static const size_t DISTANCE_CONTROL_SIZE = 3;
+
+struct DistanceControl {
+  uint8_t op;
+  uint16_t seq;
+};
+
+// Returns DISTANCE_CONTROL_SIZE.
+size_t encodeDistanceControl(const DistanceControl& c, uint8_t* out);
+bool decodeDistanceControl(const uint8_t* data, size_t length, DistanceControl& out);
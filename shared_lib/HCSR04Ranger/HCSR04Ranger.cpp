@@ -0,0 +1,113 @@
+#include "HCSR04Ranger.h"
+
+#include <math.h>
+
+static void sortSmall(float* v, uint8_t n) {
+  for (uint8_t i = 1; i < n; i++) {
+    float x = v[i];
+    uint8_t j = i;
+    while (j > 0 && v[j - 1] > x) { v[j] = v[j - 1]; j--; }
+    v[j] = x;
+  }
+}
+
+static float medianOfSorted(const float* v, uint8_t n) {
+  return (n & 1) ? v[n / 2] : 0.5f * (v[n / 2 - 1] + v[n / 2]);
+}
+
+// Median and scaled MAD of n values; sorts v
+static void medianSpread(float* v, uint8_t n, float& median, float& spread) {
+  float dev[RANGE_BURST_MAX];
+  sortSmall(v, n);
+  median = medianOfSorted(v, n);
+  for (uint8_t i = 0; i < n; i++) dev[i] = fabsf(v[i] - median);
+  sortSmall(dev, n);
+  spread = medianOfSorted(dev, n) * 1.4826f;
+}
+
+RangeBurst voteRange(const float* cm, uint8_t n) {
+  if (n > RANGE_BURST_MAX) n = RANGE_BURST_MAX;
+  RangeBurst b = { -1.0f, 0.0f, n, 0, 0 };
+
+  float v[RANGE_BURST_MAX];
+  for (uint8_t i = 0; i < n; i++) {
+    if (cm[i] >= 2.0f && cm[i] <= 400.0f) v[b.valid++] = cm[i];
+  }
+  if (b.valid == 0) return b;
+
+  float median, spread;
+  medianSpread(v, b.valid, median, spread);
+
+  float limit = 3.0f * spread > RANGE_VOTE_MIN_CM ? 3.0f * spread : RANGE_VOTE_MIN_CM;
+  float kept[RANGE_BURST_MAX];
+  for (uint8_t i = 0; i < b.valid; i++) {
+    if (fabsf(v[i] - median) <= limit) kept[b.kept++] = v[i];
+  }
+  medianSpread(kept, b.kept, b.cm, b.spreadCm);
+  return b;
+}
+
+#ifdef ARDUINO
+
+#include <Arduino.h>
+
+HCSR04Ranger::HCSR04Ranger(int trigPin, int echoPin, uint32_t timeoutUs)
+  : trigPin_(trigPin), echoPin_(echoPin), timer_(timeoutUs) {}
+
+void HCSR04Ranger::begin() {
+  pinMode(trigPin_, OUTPUT);
+  pinMode(echoPin_, INPUT);
+  digitalWrite(trigPin_, LOW);
+  attachInterruptArg(digitalPinToInterrupt(echoPin_), echoIsr, this, CHANGE);
+}
+
+void HCSR04Ranger::end() {
+  detachInterrupt(digitalPinToInterrupt(echoPin_));
+}
+
+void IRAM_ATTR HCSR04Ranger::echoIsr(void* arg) {
+  HCSR04Ranger* self = static_cast<HCSR04Ranger*>(arg);
+  self->timer_.onEdge(digitalRead(self->echoPin_) == HIGH, micros());
+}
+
+bool HCSR04Ranger::trigger() {
+  if (!timer_.arm(micros())) return false;
+
+  digitalWrite(trigPin_, LOW);
+  delayMicroseconds(2);
+  digitalWrite(trigPin_, HIGH);
+  delayMicroseconds(10);
+  digitalWrite(trigPin_, LOW);
+  return true;
+}
+
+bool HCSR04Ranger::poll(RangeSample& out) {
+  return timer_.poll(micros(), out);
+}
+
+RangeSample HCSR04Ranger::measure() {
+  RangeSample s{micros(), 0};
+  if (!trigger()) return s;
+  while (!poll(s)) {
+    delay(1);
+  }
+  return s;
+}
+
+RangeBurst HCSR04Ranger::burst(uint8_t pings, uint32_t spacingMs) {
+  float cm[RANGE_BURST_MAX];
+  if (pings > RANGE_BURST_MAX) pings = RANGE_BURST_MAX;
+
+  for (uint8_t i = 0; i < pings; i++) {
+    uint32_t start = millis();
+    RangeSample s = measure();
+    cm[i] = s.valid() ? s.cm() : -1.0f;
+    if (i + 1 < pings) {
+      uint32_t spent = millis() - start;
+      if (spent < spacingMs) delay(spacingMs - spent);
+    }
+  }
+  return voteRange(cm, pings);
+}
+
+#endif
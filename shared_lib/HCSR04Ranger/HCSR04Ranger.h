@@ -0,0 +1,138 @@
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+#include <SpscRing.h>
+
+#ifndef IRAM_ATTR
+#define IRAM_ATTR
+#endif
+
+// One finished ping. echo_us == 0 means the echo never came back in time.
+struct RangeSample {
+  uint32_t t_us;     // trigger time (micros())
+  uint32_t echo_us;  // echo pulse width
+
+  bool valid() const { return echo_us != 0; }
+  // Distance(cm) = duration(us) * 0.0343 / 2
+  float cm() const { return echo_us * 0.01715f; }
+};
+
+// ====================== Echo edge state machine ======================
+// Hardware-free core: the caller feeds it edges and timestamps, so the same
+// logic runs from a GPIO interrupt on the board and from a fake GPIO on host.
+class EchoTimer {
+public:
+  static const uint32_t DEFAULT_TIMEOUT_US = 30000;
+
+  explicit EchoTimer(uint32_t timeoutUs = DEFAULT_TIMEOUT_US) : timeoutUs_(timeoutUs) {}
+
+  // Call just before the trigger pulse. Returns false if a ping is in flight.
+  // Only the consumer moves the state out of IDLE, so no CAS is needed here.
+  bool arm(uint32_t nowUs) {
+    if (state_.load() != IDLE) return false;
+    triggerUs_ = nowUs;
+    state_.store(ARMED);
+    return true;
+  }
+
+  // Call from the echo pin CHANGE interrupt.
+  void IRAM_ATTR onEdge(bool level, uint32_t nowUs) {
+    if (level) {
+      uint8_t expected = ARMED;
+      if (state_.compare_exchange_strong(expected, ECHO_HIGH)) riseUs_ = nowUs;
+    } else {
+      uint8_t expected = ECHO_HIGH;
+      if (state_.compare_exchange_strong(expected, IDLE)) {
+        uint32_t width = nowUs - riseUs_;
+        ready_.push(RangeSample{triggerUs_, width == 0 ? 1u : width});
+      }
+    }
+  }
+
+  // Consumer side: returns the next finished sample, or a timeout sample once
+  // the ping has been outstanding for longer than the timeout.
+  bool poll(uint32_t nowUs, RangeSample& out) {
+    if (ready_.pop(out)) return true;
+
+    uint8_t s = state_.load();
+    if (s != IDLE && (nowUs - triggerUs_) >= timeoutUs_) {
+      // Only one of the ISR or the consumer may retire a ping.
+      if (state_.compare_exchange_strong(s, IDLE)) {
+        timeouts_++;
+        out = RangeSample{triggerUs_, 0};
+        return true;
+      }
+      return ready_.pop(out);
+    }
+    return false;
+  }
+
+  bool busy() const { return state_.load() != IDLE; }
+  uint32_t timeouts() const { return timeouts_; }
+  uint32_t dropped() const { return ready_.dropped(); }
+
+private:
+  enum : uint8_t { IDLE, ARMED, ECHO_HIGH };
+
+  uint32_t timeoutUs_;
+  volatile uint32_t triggerUs_ = 0;
+  volatile uint32_t riseUs_ = 0;
+  std::atomic<uint8_t> state_{IDLE};
+  uint32_t timeouts_ = 0;
+  SpscRing<RangeSample, 8> ready_;
+};
+
+// ====================== Multi-echo voting ======================
+// A burst of pings at the sensor's measurement cycle, reduced to one
+// distance. Echoes outside 2-400 cm are dropped, then anything further from
+// the median than max(3 x spread, RANGE_VOTE_MIN_CM); what is left gives the
+// median and its spread (scaled MAD).
+static const uint8_t RANGE_BURST_MAX = 8;
+static const uint32_t RANGE_MIN_SPACING_MS = 60;  // HC-SR04 cycle: any closer and the last ping's echo comes back
+static const float RANGE_VOTE_MIN_CM = 2.0f;
+
+struct RangeBurst {
+  float cm;        // median of the kept pings, -1 if none
+  float spreadCm;  // scaled MAD of the kept pings
+  uint8_t pings;   // fired
+  uint8_t valid;   // echoes inside the range window
+  uint8_t kept;    // survived the vote
+
+  bool ok() const { return kept > 0; }
+};
+
+// cm[i] < 0 marks a failed ping.
+RangeBurst voteRange(const float* cm, uint8_t n);
+
+#ifdef ARDUINO
+// ====================== HC-SR04 driver ======================
+// Fires the trigger pulse and timestamps the echo edges in a GPIO interrupt,
+// so the CPU is free (or asleep) while the sound is in flight.
+class HCSR04Ranger {
+public:
+  HCSR04Ranger(int trigPin, int echoPin, uint32_t timeoutUs = EchoTimer::DEFAULT_TIMEOUT_US);
+
+  void begin();
+  void end();
+
+  // Start a ping. Returns false if the previous one has not finished yet.
+  bool trigger();
+  // Fetch a finished (or timed out) ping without blocking.
+  bool poll(RangeSample& out);
+  // Trigger and wait for the result, yielding to other tasks meanwhile.
+  RangeSample measure();
+  // Up to RANGE_BURST_MAX pings, one per spacingMs, voted.
+  RangeBurst burst(uint8_t pings, uint32_t spacingMs = RANGE_MIN_SPACING_MS);
+
+  bool busy() const { return timer_.busy(); }
+  uint32_t timeouts() const { return timer_.timeouts(); }
+
+private:
+  static void IRAM_ATTR echoIsr(void* arg);
+
+  int trigPin_;
+  int echoPin_;
+  EchoTimer timer_;
+};
+#endif
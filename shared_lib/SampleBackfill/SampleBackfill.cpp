@@ -0,0 +1,173 @@
+#include "SampleBackfill.h"
+
+#include <string.h>
+
+static int32_t seqDiff(uint16_t a, uint16_t b) {
+  return (int16_t)(a - b);
+}
+
+// ====================== SampleHistory ======================
+void SampleHistory::begin(HistoryEntry* storage, size_t capacity) {
+  buf_ = storage;
+  cap_ = storage ? (capacity < SAMPLE_HISTORY_MAX ? capacity : SAMPLE_HISTORY_MAX) : 0;
+  head_ = 0;
+  count_ = 0;
+}
+
+void SampleHistory::add(uint16_t seq, uint32_t tMs, float cm) {
+  if (count_ > 0 && seq != next_) {
+    head_ = 0;
+    count_ = 0;
+  }
+  next_ = (uint16_t)(seq + 1);
+  if (cap_ == 0) return;
+
+  buf_[head_] = HistoryEntry{tMs, cm};
+  head_ = (head_ + 1) % cap_;
+  if (count_ < cap_) count_++;
+}
+
+bool SampleHistory::get(uint16_t seq, FrameSample& out) const {
+  size_t d = (uint16_t)(seq - oldestSeq());
+  if (d >= count_) return false;
+  const HistoryEntry& e = buf_[(head_ + cap_ - count_ + d) % cap_];
+  out = FrameSample{seq, e.t_ms, e.cm};
+  return true;
+}
+
+// ====================== BackfillSender ======================
+void BackfillSender::start(uint16_t fromSeq, uint16_t untilSeq, uint32_t nowMs) {
+  until_ = untilSeq;
+  inFlight_ = 0;
+  progressMs_ = nowMs;
+  active_ = fromSeq != untilSeq;
+
+  // The client is ahead of anything sent: this server has rebooted since
+  restart_ = seqDiff(untilSeq, fromSeq) < 0;
+  cursor_ = acked_ = restart_ ? untilSeq : fromSeq;
+}
+
+void BackfillSender::ack(uint16_t nextSeq, uint32_t nowMs) {
+  if (!active_ || restart_) return;  // after a restart the client asks again instead
+  if (seqDiff(nextSeq, acked_) <= 0) return;
+  if (seqDiff(nextSeq, until_) > 0) nextSeq = until_;  // it holds live samples past the replay too
+
+  acked_ = nextSeq;
+  if (seqDiff(acked_, cursor_) > 0) cursor_ = acked_;  // already held, no need to send
+  progressMs_ = nowMs;
+
+  uint8_t kept = 0;
+  for (uint8_t i = 0; i < inFlight_; i++) {
+    if (seqDiff(ends_[i], acked_) > 0) ends_[kept++] = ends_[i];
+  }
+  inFlight_ = kept;
+  if (acked_ == until_) active_ = false;
+}
+
+bool BackfillSender::next(DistanceFrameEncoder& enc, const SampleHistory& h, uint32_t nowMs) {
+  if (!active_) return false;
+  uint16_t floor = seqDiff(until_, h.oldestSeq()) < 0 ? until_ : h.oldestSeq();
+  if (inFlight_ > 0 && nowMs - progressMs_ >= BACKFILL_ACK_TIMEOUT_MS) {
+    cursor_ = acked_;
+    inFlight_ = 0;
+    rewinds_++;
+  }
+  if (inFlight_ >= BACKFILL_WINDOW) return false;
+
+  if (restart_) {
+    if (inFlight_ > 0) return false;
+    enc.reset(DISTANCE_FRAME_BACKFILL | DISTANCE_FRAME_RESTART);
+    enc.header(floor, 0);
+  } else {
+    if (cursor_ == until_) return false;  // all sent, waiting for ACKs
+
+    enc.reset(DISTANCE_FRAME_BACKFILL);
+    if (seqDiff(cursor_, floor) < 0) {
+      // Overwritten before it could be sent
+      cursor_ = floor;
+      enc.header(floor, 0);
+    } else {
+      FrameSample s;
+      while (cursor_ != until_ && h.get(cursor_, s) && enc.add(cursor_, s.t_ms, s.cm)) cursor_++;
+      if (enc.empty()) return false;
+      frames_++;
+    }
+  }
+
+  if (inFlight_ == 0) progressMs_ = nowMs;
+  ends_[inFlight_++] = restart_ ? until_ : cursor_;
+  return true;
+}
+
+uint32_t BackfillSender::wait(uint32_t nowMs) const {
+  if (!active_) return 0xFFFFFFFFu;
+  bool more = restart_ ? inFlight_ == 0 : cursor_ != until_;
+  if (more && inFlight_ < BACKFILL_WINDOW) return 0;
+  if (inFlight_ == 0) return 0xFFFFFFFFu;
+  uint32_t waited = nowMs - progressMs_;
+  return waited >= BACKFILL_ACK_TIMEOUT_MS ? 0 : BACKFILL_ACK_TIMEOUT_MS - waited;
+}
+
+// ====================== BackfillReceiver ======================
+void BackfillReceiver::reset() {
+  memset(bits_, 0, sizeof(bits_));
+  started_ = false;
+  next_ = 0;
+  high_ = 0;
+  lost_ = 0;
+  duplicates_ = 0;
+  restarts_ = 0;
+}
+
+void BackfillReceiver::set(uint16_t seq, bool on) {
+  uint32_t& word = bits_[(seq % BACKFILL_TRACK) / 32];
+  uint32_t bit = 1u << (seq % 32);
+  word = on ? word | bit : word & ~bit;
+}
+
+void BackfillReceiver::advance() {
+  while (has(next_)) {
+    set(next_, false);
+    next_++;
+  }
+}
+
+bool BackfillReceiver::accept(uint16_t seq) {
+  if (!started_) {
+    started_ = true;
+    next_ = high_ = seq;
+  }
+
+  int32_t d = seqDiff(seq, next_);
+  if (d < 0 || has(seq)) {
+    duplicates_++;
+    return false;
+  }
+  if (d >= (int32_t)BACKFILL_TRACK) skipTo((uint16_t)(seq - BACKFILL_TRACK + 1));
+
+  set(seq, true);
+  if (seqDiff(seq, high_) >= 0) high_ = (uint16_t)(seq + 1);
+  advance();
+  return true;
+}
+
+void BackfillReceiver::skipTo(uint16_t seq) {
+  while (seqDiff(seq, next_) > 0) {
+    if (has(next_)) set(next_, false);
+    else lost_++;
+    next_++;
+  }
+  if (seqDiff(next_, high_) > 0) high_ = next_;
+  advance();
+}
+
+void BackfillReceiver::restartAt(uint16_t seq) {
+  memset(bits_, 0, sizeof(bits_));
+  started_ = true;
+  next_ = high_ = seq;
+  restarts_++;
+}
+
+bool BackfillReceiver::liveGap(uint16_t firstSeq) const {
+  return started_ && seqDiff(firstSeq, high_) > 0;
+}
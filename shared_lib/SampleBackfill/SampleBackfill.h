@@ -0,0 +1,145 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <DistanceFrame.h>
+
+// Catch-up after a reconnect. The server keeps every sample it numbers in a
+// SampleHistory, connected or not; a client that comes back asks for
+// everything from the sequence number it last held contiguously, and the
+// server replays that range as DISTANCE_FRAME_BACKFILL frames next to the
+// live ones. Hardware-free on both ends.
+//
+// Sequence numbers are uint16 and wrap; both ends compare them as signed
+// distances, which is why history and tracking stay well inside half the
+// space.
+static const size_t SAMPLE_HISTORY_MAX = 16384;
+
+// ====================== Server: history ======================
+struct HistoryEntry {
+  uint32_t t_ms;
+  float cm;
+};
+
+class SampleHistory {
+public:
+  // Storage is the caller's, sized from the heap at run time (capped at
+  // SAMPLE_HISTORY_MAX); capacity 0 keeps no history.
+  void begin(HistoryEntry* storage, size_t capacity);
+
+  // seq must follow the previous one; anything else starts over. The oldest
+  // sample is overwritten when full.
+  void add(uint16_t seq, uint32_t tMs, float cm);
+  bool get(uint16_t seq, FrameSample& out) const;
+
+  size_t size() const { return count_; }
+  size_t capacity() const { return cap_; }
+  uint16_t oldestSeq() const { return (uint16_t)(next_ - count_); }
+  uint16_t nextSeq() const { return next_; }
+
+private:
+  HistoryEntry* buf_ = nullptr;
+  size_t cap_ = 0;
+  size_t head_ = 0;  // next write
+  size_t count_ = 0;
+  uint16_t next_ = 0;
+};
+
+// ====================== Server: replay ======================
+// Go-back-N over notifications: at most BACKFILL_WINDOW frames wait for the
+// client's ACK; without progress for BACKFILL_ACK_TIMEOUT_MS the replay
+// rewinds to the last ACK. A header-only backfill frame tells the client
+// nothing before its seq is left (the history overwrote it), or, with
+// DISTANCE_FRAME_RESTART, that the server's numbering started over and seq
+// is the oldest sample of the new one; the client then asks again from there.
+//
+// A reboot shows only as a request for samples the server has not numbered
+// yet. A server that rebooted and has since numbered past the client's
+// position replays the new numbering's samples under the old one's, so the
+// client gets those as if they were the ones it missed.
+static const uint8_t BACKFILL_WINDOW = 4;
+static const uint32_t BACKFILL_ACK_TIMEOUT_MS = 2000;
+
+class BackfillSender {
+public:
+  // fromSeq: the client's request. untilSeq: where the live stream takes
+  // over, the first sample not yet sent live on this connection (or the
+  // first one sent live, on connect). A new request replaces the old one.
+  void start(uint16_t fromSeq, uint16_t untilSeq, uint32_t nowMs);
+  void stop() { active_ = false; }
+
+  // The client holds everything before nextSeq.
+  void ack(uint16_t nextSeq, uint32_t nowMs);
+
+  // Fills enc (MTU already set) with the next frame when the window has
+  // room; false when there is nothing to send yet.
+  bool next(DistanceFrameEncoder& enc, const SampleHistory& h, uint32_t nowMs);
+
+  // ms until next() can make progress without an ACK: 0 = now.
+  uint32_t wait(uint32_t nowMs) const;
+
+  bool active() const { return active_; }
+  uint32_t remaining() const { return active_ ? (uint16_t)(until_ - acked_) : 0; }  // samples not acked
+  uint32_t frames() const { return frames_; }
+  uint32_t rewinds() const { return rewinds_; }
+
+private:
+  bool active_ = false;
+  bool restart_ = false;
+  uint16_t until_ = 0;
+  uint16_t cursor_ = 0;  // next seq to send
+  uint16_t acked_ = 0;
+  uint16_t ends_[BACKFILL_WINDOW];  // seq after each frame in flight
+  uint8_t inFlight_ = 0;
+  uint32_t progressMs_ = 0;
+  uint32_t frames_ = 0;
+  uint32_t rewinds_ = 0;
+};
+
+// ====================== Client: tracking ======================
+// Which sequence numbers a client holds from one server: everything before
+// ackSeq(), and a bitmap of what arrived past it (live samples while the
+// replay is still catching up). accept() is the one gate for live and
+// backfill samples, so a replayed duplicate is never counted twice. A lost
+// live notification shows as a gap before the next live frame; the client
+// asks for a backfill then too, rather than waiting for the next reconnect.
+static const size_t BACKFILL_TRACK = SAMPLE_HISTORY_MAX;
+
+class BackfillReceiver {
+public:
+  // Forget everything, the counters too, e.g. for a new server.
+  void reset();
+
+  // True for a sample not held before. A sample further ahead than the
+  // tracking window pushes the window on; what it passes is lost, as the
+  // server's history cannot hold it either.
+  bool accept(uint16_t seq);
+
+  // Header-only backfill frame: nothing before seq is coming.
+  void skipTo(uint16_t seq);
+  // Server numbering restarted at seq.
+  void restartAt(uint16_t seq);
+
+  // Before accepting a live frame: true when it starts past everything
+  // held, i.e. live frames went missing or were sent while disconnected.
+  bool liveGap(uint16_t firstSeq) const;
+
+  bool started() const { return started_; }
+  uint16_t ackSeq() const { return next_; }  // held contiguously before this
+  uint32_t lost() const { return lost_; }
+  uint32_t duplicates() const { return duplicates_; }
+  uint32_t restarts() const { return restarts_; }
+
+private:
+  bool has(uint16_t seq) const { return bits_[(seq % BACKFILL_TRACK) / 32] & (1u << (seq % 32)); }
+  void set(uint16_t seq, bool on);
+  void advance();  // over held samples
+
+  uint32_t bits_[BACKFILL_TRACK / 32] = {};
+  bool started_ = false;
+  uint16_t next_ = 0;
+  uint16_t high_ = 0;  // one past the newest sample held
+  uint32_t lost_ = 0;
+  uint32_t duplicates_ = 0;
+  uint32_t restarts_ = 0;
+};
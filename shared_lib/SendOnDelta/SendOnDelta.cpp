@@ -0,0 +1,56 @@
+#include "SendOnDelta.h"
+
+const char* reportDecisionName(ReportDecision d) {
+  switch (d) {
+    case REPORT_SKIP_NO_READING: return "no reading";
+    case REPORT_SKIP_RANGE: return "beyond threshold";
+    case REPORT_SKIP_UNCHANGED: return "no change";
+    case REPORT_SAMPLE: return "sample";
+    case REPORT_CHANGE: return "change";
+    case REPORT_RANGE: return "range";
+    case REPORT_HEARTBEAT: return "heartbeat";
+    default: return "?";
+  }
+}
+
+void DeltaReporter::configure(const SensorConfig& c) {
+  mode_ = c.mode;
+  thresholdMm_ = c.thresholdMm;
+  deadbandMm_ = c.deadbandMm;
+  heartbeatMs_ = c.heartbeatMs;
+  started_ = false;
+}
+
+ReportDecision DeltaReporter::update(uint32_t tMs, float cm, float& value) {
+  readings_++;
+  bool in = inRange(cm);
+
+  ReportDecision d;
+  if (mode_ == SEND_PERIODIC) {
+    if (isnan(cm)) return REPORT_SKIP_NO_READING;
+    if (!in) return REPORT_SKIP_RANGE;
+    d = REPORT_SAMPLE;
+  } else {
+    float v = in ? cm : NAN;
+    if (!started_) {
+      d = REPORT_CHANGE;
+    } else if (isnan(v) != isnan(last_)) {
+      d = REPORT_RANGE;
+    } else if (!isnan(v) && fabsf(v - last_) * 10.0f > deadbandMm_) {
+      d = REPORT_CHANGE;
+    } else if (heartbeatMs_ && tMs - lastMs_ >= heartbeatMs_) {
+      d = REPORT_HEARTBEAT;
+      heartbeats_++;
+    } else {
+      return isnan(cm) ? REPORT_SKIP_NO_READING : !in ? REPORT_SKIP_RANGE : REPORT_SKIP_UNCHANGED;
+    }
+    cm = v;
+  }
+
+  started_ = true;
+  last_ = cm;
+  lastMs_ = tMs;
+  sent_++;
+  value = cm;
+  return d;
+}
@@ -0,0 +1,130 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <math.h>
+#include <SensorConfig.h>
+
+// Report-on-change for a sampled distance. The server decides per denoised
+// reading whether it goes out; the client fills the readings that did not
+// back in. Hardware-free.
+//
+// In SEND_ON_CHANGE a reading is sent when it moved more than the deadband
+// from the last one sent, when it enters or leaves the reporting range (a
+// NaN marks "nothing in range"), or when nothing went out for a heartbeat.
+// Every reading held back is therefore within the deadband of the last one
+// sent, and the client gets that back by holding the last value until the
+// next one. The heartbeat bounds how long a hold can last, which is also how
+// the client tells "unchanged" from "gone quiet".
+
+// ====================== Server: what to send ======================
+enum ReportDecision : uint8_t {
+  REPORT_SKIP_NO_READING,  // nothing sent: no echo
+  REPORT_SKIP_RANGE,       // nothing sent: beyond the threshold
+  REPORT_SKIP_UNCHANGED,   // nothing sent: within the deadband
+  REPORT_SAMPLE,           // periodic mode: every reading in range
+  REPORT_CHANGE,           // moved past the deadband, or the first reading
+  REPORT_RANGE,            // entered or left the range
+  REPORT_HEARTBEAT,        // quiet for heartbeatMs
+};
+
+inline bool reportSends(ReportDecision d) {
+  return d >= REPORT_SAMPLE;
+}
+
+const char* reportDecisionName(ReportDecision d);
+
+class DeltaReporter {
+public:
+  // Takes the send policy from c (mode, threshold, deadband, heartbeat)
+  // and starts over: the next reading is always sent.
+  void configure(const SensorConfig& c);
+  void restart() { started_ = false; }
+
+  // One denoised reading (NaN = no echo) taken at tMs. When the decision
+  // sends, value is what to send: the reading, or NaN once it is out of
+  // range in SEND_ON_CHANGE.
+  ReportDecision update(uint32_t tMs, float cm, float& value);
+
+  uint32_t readings() const { return readings_; }
+  uint32_t sent() const { return sent_; }
+  uint32_t heartbeats() const { return heartbeats_; }
+
+private:
+  bool inRange(float cm) const { return !isnan(cm) && (thresholdMm_ == 0 || cm * 10.0f < thresholdMm_); }
+
+  uint8_t mode_ = SEND_PERIODIC;
+  uint16_t thresholdMm_ = 0;
+  uint16_t deadbandMm_ = 0;
+  uint16_t heartbeatMs_ = 0;
+
+  bool started_ = false;
+  float last_ = NAN;  // last value sent
+  uint32_t lastMs_ = 0;
+
+  uint32_t readings_ = 0;
+  uint32_t sent_ = 0;
+  uint32_t heartbeats_ = 0;
+};
+
+// ====================== Client: fill the holds back in ======================
+// Fed the samples of one server in time order; for every ping the server
+// held back since the previous sample it calls fill(tMs, cm) with the held
+// value, on the server's ping grid. A gap longer than a heartbeat (plus a
+// ping of slack) is not a hold, as the server would have sent something:
+// the link or the sensor went quiet and nothing is filled in.
+class SeriesReconstructor {
+public:
+  // intervalMs 0 turns filling off (a periodic server: gaps are out of
+  // range, not unchanged). heartbeatMs 0: the server has no heartbeat, so
+  // every gap is taken for a hold.
+  void begin(uint32_t intervalMs, uint32_t heartbeatMs) {
+    intervalMs_ = intervalMs;
+    heartbeatMs_ = heartbeatMs;
+    reset();
+  }
+
+  // Forget the held value, e.g. on a new connection.
+  void reset() {
+    started_ = false;
+    held_ = NAN;
+  }
+
+  // Returns the number of readings filled in. Samples older than the last
+  // one are ignored.
+  template <typename Fill>
+  size_t add(uint32_t tMs, float cm, Fill fill) {
+    size_t n = 0;
+    if (started_) {
+      int32_t gap = (int32_t)(tMs - lastMs_);
+      if (gap < 0) return 0;
+      bool hold = intervalMs_ > 0 && (heartbeatMs_ == 0 || (uint32_t)gap <= heartbeatMs_ + intervalMs_ * 3 / 2);
+      if (!hold && intervalMs_ > 0) gaps_++;
+
+      // A ping due at least half an interval before this sample was held back
+      for (uint32_t t = lastMs_ + intervalMs_; hold && (int32_t)(tMs - t) >= (int32_t)(intervalMs_ / 2);
+           t += intervalMs_) {
+        fill(t, held_);
+        n++;
+      }
+    }
+    started_ = true;
+    lastMs_ = tMs;
+    held_ = cm;
+    filled_ += n;
+    return n;
+  }
+
+  uint32_t filled() const { return filled_; }
+  uint32_t gaps() const { return gaps_; }  // silences too long to be holds
+  uint32_t intervalMs() const { return intervalMs_; }
+
+private:
+  uint32_t intervalMs_ = 0;
+  uint32_t heartbeatMs_ = 0;
+  bool started_ = false;
+  uint32_t lastMs_ = 0;
+  float held_ = NAN;
+  uint32_t filled_ = 0;
+  uint32_t gaps_ = 0;
+};
@@ -0,0 +1,214 @@
+#include "SensorConfig.h"
+
+#include <stdio.h>
+
+static void putU16(uint8_t* p, uint16_t v) {
+  p[0] = (uint8_t)v;
+  p[1] = (uint8_t)(v >> 8);
+}
+
+static uint16_t getU16(const uint8_t* p) {
+  return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+const char* configStatusName(ConfigStatus s) {
+  switch (s) {
+    case CONFIG_OK: return "ok";
+    case CONFIG_ERR_EMPTY: return "empty";
+    case CONFIG_ERR_OPCODE: return "unknown command";
+    case CONFIG_ERR_TRUNCATED: return "truncated";
+    case CONFIG_ERR_RANGE: return "out of range";
+    default: return "?";
+  }
+}
+
+static const char* filterName(uint8_t filter) {
+  switch (filter) {
+    case DSP_FILTER_MOVING_AVERAGE: return "moving average";
+    case DSP_FILTER_EMA: return "EMA";
+    case DSP_FILTER_MEDIAN: return "median";
+    case DSP_FILTER_KALMAN: return "Kalman";
+    default: return "?";
+  }
+}
+
+bool validateConfig(const SensorConfig& c) {
+  return c.intervalMs >= CONFIG_INTERVAL_MIN_MS && c.intervalMs <= CONFIG_INTERVAL_MAX_MS &&
+         c.filter <= DSP_FILTER_KALMAN && c.window >= 1 && c.window <= CONFIG_WINDOW_MAX &&
+         c.thresholdMm <= CONFIG_DISTANCE_MAX_MM && c.deadbandMm <= CONFIG_DISTANCE_MAX_MM &&
+         c.mode <= SEND_ON_CHANGE && c.heartbeatMs <= CONFIG_HEARTBEAT_MAX_MS;
+}
+
+size_t describeConfig(const SensorConfig& c, char* out, size_t size) {
+  char limit[16] = "any distance";
+  if (c.thresholdMm) snprintf(limit, sizeof(limit), "< %u mm", c.thresholdMm);
+  char mode[48] = "periodic";
+  if (c.mode == SEND_ON_CHANGE && c.heartbeatMs) {
+    snprintf(mode, sizeof(mode), "on change > %u mm, heartbeat %u ms", c.deadbandMm, c.heartbeatMs);
+  } else if (c.mode == SEND_ON_CHANGE) {
+    snprintf(mode, sizeof(mode), "on change > %u mm", c.deadbandMm);
+  }
+
+  int n = snprintf(out, size, "interval %u ms | %s x%u | %s | %s", c.intervalMs, filterName(c.filter), c.window,
+                   limit, mode);
+  if (n < 0) return 0;
+  return (size_t)n < size ? n : size - 1;
+}
+
+// ====================== Commands ======================
+// Argument bytes after each opcode; -1 for an unknown one
+static int argBytes(uint8_t op) {
+  switch (op) {
+    case CONFIG_SET_INTERVAL: return 2;
+    case CONFIG_SET_FILTER: return 2;
+    case CONFIG_SET_THRESHOLD: return 2;
+    case CONFIG_SET_DEADBAND: return 2;
+    case CONFIG_SET_MODE: return 1;
+    case CONFIG_SET_HEARTBEAT: return 2;
+    case CONFIG_DEFAULTS: return 0;
+    default: return -1;
+  }
+}
+
+ConfigStatus applyConfigCommands(const uint8_t* data, size_t length, const SensorConfig& defaults,
+                                 SensorConfig& cfg) {
+  if (data == nullptr || length == 0) return CONFIG_ERR_EMPTY;
+  if (length > CONFIG_WRITE_MAX) return CONFIG_ERR_TRUNCATED;
+
+  // Into a copy, so a bad command anywhere leaves cfg alone
+  SensorConfig next = cfg;
+  size_t i = 0;
+  while (i < length) {
+    uint8_t op = data[i++];
+    int n = argBytes(op);
+    if (n < 0) return CONFIG_ERR_OPCODE;
+    if (i + n > length) return CONFIG_ERR_TRUNCATED;
+    const uint8_t* a = data + i;
+    i += n;
+
+    switch (op) {
+      case CONFIG_SET_INTERVAL: next.intervalMs = getU16(a); break;
+      case CONFIG_SET_FILTER:
+        next.filter = a[0];
+        next.window = a[1];
+        break;
+      case CONFIG_SET_THRESHOLD: next.thresholdMm = getU16(a); break;
+      case CONFIG_SET_DEADBAND: next.deadbandMm = getU16(a); break;
+      case CONFIG_SET_MODE: next.mode = a[0]; break;
+      case CONFIG_SET_HEARTBEAT: next.heartbeatMs = getU16(a); break;
+      case CONFIG_DEFAULTS: next = defaults; break;
+    }
+    // Checked per command, so the error does not depend on what follows
+    if (!validateConfig(next)) return CONFIG_ERR_RANGE;
+  }
+
+  cfg = next;
+  return CONFIG_OK;
+}
+
+void ConfigCommandBuilder::put(const uint8_t* bytes, size_t n) {
+  if (overflow_ || len_ + n > CONFIG_WRITE_MAX) {
+    overflow_ = true;
+    return;
+  }
+  for (size_t i = 0; i < n; i++) buf_[len_++] = bytes[i];
+}
+
+ConfigCommandBuilder& ConfigCommandBuilder::interval(uint16_t ms) {
+  uint8_t b[3] = {CONFIG_SET_INTERVAL};
+  putU16(b + 1, ms);
+  put(b, sizeof(b));
+  return *this;
+}
+
+ConfigCommandBuilder& ConfigCommandBuilder::filter(uint8_t kernel, uint8_t window) {
+  uint8_t b[3] = {CONFIG_SET_FILTER, kernel, window};
+  put(b, sizeof(b));
+  return *this;
+}
+
+ConfigCommandBuilder& ConfigCommandBuilder::threshold(uint16_t mm) {
+  uint8_t b[3] = {CONFIG_SET_THRESHOLD};
+  putU16(b + 1, mm);
+  put(b, sizeof(b));
+  return *this;
+}
+
+ConfigCommandBuilder& ConfigCommandBuilder::deadband(uint16_t mm) {
+  uint8_t b[3] = {CONFIG_SET_DEADBAND};
+  putU16(b + 1, mm);
+  put(b, sizeof(b));
+  return *this;
+}
+
+ConfigCommandBuilder& ConfigCommandBuilder::mode(SendMode m) {
+  uint8_t b[2] = {CONFIG_SET_MODE, m};
+  put(b, sizeof(b));
+  return *this;
+}
+
+ConfigCommandBuilder& ConfigCommandBuilder::heartbeat(uint16_t ms) {
+  uint8_t b[3] = {CONFIG_SET_HEARTBEAT};
+  putU16(b + 1, ms);
+  put(b, sizeof(b));
+  return *this;
+}
+
+ConfigCommandBuilder& ConfigCommandBuilder::defaults() {
+  uint8_t b[1] = {CONFIG_DEFAULTS};
+  put(b, sizeof(b));
+  return *this;
+}
+
+// ====================== Blob ======================
+size_t encodeConfigBlob(const SensorConfig& c, ConfigStatus last, uint8_t* out) {
+  out[0] = CONFIG_BLOB_VERSION;
+  out[1] = last;
+  putU16(out + 2, c.intervalMs);
+  out[4] = c.filter;
+  out[5] = c.window;
+  putU16(out + 6, c.thresholdMm);
+  putU16(out + 8, c.deadbandMm);
+  out[10] = c.mode;
+  putU16(out + 11, c.heartbeatMs);
+  return CONFIG_BLOB_SIZE;
+}
+
+bool decodeConfigBlob(const uint8_t* data, size_t length, SensorConfig& out, ConfigStatus* last) {
+  if (data == nullptr || length != CONFIG_BLOB_SIZE || data[0] != CONFIG_BLOB_VERSION) return false;
+
+  SensorConfig c;
+  c.intervalMs = getU16(data + 2);
+  c.filter = data[4];
+  c.window = data[5];
+  c.thresholdMm = getU16(data + 6);
+  c.deadbandMm = getU16(data + 8);
+  c.mode = data[10];
+  c.heartbeatMs = getU16(data + 11);
+  if (!validateConfig(c)) return false;
+
+  out = c;
+  if (last) *last = (ConfigStatus)data[1];
+  return true;
+}
+
+#ifdef ARDUINO
+
+bool ConfigStore::load(SensorConfig& out) {
+  uint8_t blob[CONFIG_BLOB_SIZE];
+  prefs_.begin(ns_, true);
+  size_t n = prefs_.isKey("config") ? prefs_.getBytes("config", blob, sizeof(blob)) : 0;
+  prefs_.end();
+  return decodeConfigBlob(blob, n, out);
+}
+
+bool ConfigStore::save(const SensorConfig& c) {
+  uint8_t blob[CONFIG_BLOB_SIZE];
+  size_t n = encodeConfigBlob(c, CONFIG_OK, blob);
+  prefs_.begin(ns_, false);
+  bool ok = prefs_.putBytes("config", blob, n) == n;
+  prefs_.end();
+  return ok;
+}
+
+#endif
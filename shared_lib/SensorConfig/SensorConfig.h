@@ -0,0 +1,158 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <HCSR04Ranger.h>
+#include <StreamFilters.h>
+
+// Run-time settings of a distance sensor server: how often it pings, how it
+// filters, and which denoised readings it sends. A client changes them by
+// writing commands to the server's control characteristic; the server keeps
+// them in NVS, so they survive a reset. Hardware-free apart from the store.
+
+// ====================== Settings ======================
+enum SendMode : uint8_t {
+  SEND_PERIODIC,   // every reading under the threshold
+  SEND_ON_CHANGE,  // only readings that moved more than the deadband since the last one sent,
+                   // plus a heartbeat (shared_lib/SendOnDelta)
+};
+
+struct SensorConfig {
+  uint16_t intervalMs;   // ping period
+  uint8_t filter;        // DSP_FILTER_* (StreamFilters.h)
+  uint8_t window;        // filter window, samples
+  uint16_t thresholdMm;  // send only readings closer than this; 0 = any distance
+  uint16_t deadbandMm;   // SEND_ON_CHANGE: smallest change worth a notification
+  uint8_t mode;          // SendMode
+  uint16_t heartbeatMs;  // SEND_ON_CHANGE: longest silence before the value is sent anyway; 0 = never
+};
+
+// Field by field: the struct has padding, so memcmp() would compare that too
+inline bool operator==(const SensorConfig& a, const SensorConfig& b) {
+  return a.intervalMs == b.intervalMs && a.filter == b.filter && a.window == b.window &&
+         a.thresholdMm == b.thresholdMm && a.deadbandMm == b.deadbandMm && a.mode == b.mode &&
+         a.heartbeatMs == b.heartbeatMs;
+}
+inline bool operator!=(const SensorConfig& a, const SensorConfig& b) { return !(a == b); }
+
+// Limits every command is checked against. The shortest interval is the
+// HC-SR04's measurement cycle, so a ping never hears the last one's echo;
+// distances cover its 4 m.
+static const uint16_t CONFIG_INTERVAL_MIN_MS = RANGE_MIN_SPACING_MS;
+static const uint16_t CONFIG_INTERVAL_MAX_MS = 60000;
+static const uint8_t CONFIG_WINDOW_MAX = DSP_WINDOW_MAX;
+static const uint16_t CONFIG_DISTANCE_MAX_MM = 4000;
+static const uint16_t CONFIG_HEARTBEAT_MAX_MS = 60000;
+
+enum ConfigStatus : uint8_t {
+  CONFIG_OK,
+  CONFIG_ERR_EMPTY,      // no command in the write
+  CONFIG_ERR_OPCODE,     // unknown command
+  CONFIG_ERR_TRUNCATED,  // command cut short
+  CONFIG_ERR_RANGE,      // value outside the limits above
+};
+
+const char* configStatusName(ConfigStatus s);
+
+// Every field within limits.
+bool validateConfig(const SensorConfig& c);
+
+// "interval 1000 ms | moving average x5 | < 300 mm | on change > 5 mm, heartbeat 10000 ms"
+size_t describeConfig(const SensorConfig& c, char* out, size_t size);
+
+// ====================== Command protocol ======================
+// A write holds one or more commands back to back, all little-endian:
+//
+//   opcode                    args         meaning
+//   0x01 CONFIG_SET_INTERVAL  u16 ms       ping period
+//   0x02 CONFIG_SET_FILTER    u8, u8       kernel (DSP_FILTER_*), window
+//   0x03 CONFIG_SET_THRESHOLD u16 mm       send below this, 0 = always
+//   0x04 CONFIG_SET_DEADBAND  u16 mm       on-change deadband
+//   0x05 CONFIG_SET_MODE      u8           SendMode
+//   0x06 CONFIG_SET_HEARTBEAT u16 ms       on-change heartbeat, 0 = none
+//   0x7F CONFIG_DEFAULTS      -            back to the built-in settings
+//
+// A write is applied whole or not at all: one bad command rejects the lot
+// and leaves the settings as they were. E.g. 01 c8 00 05 01 = ping every
+// 200 ms, report on change.
+enum ConfigOpcode : uint8_t {
+  CONFIG_SET_INTERVAL = 0x01,
+  CONFIG_SET_FILTER = 0x02,
+  CONFIG_SET_THRESHOLD = 0x03,
+  CONFIG_SET_DEADBAND = 0x04,
+  CONFIG_SET_MODE = 0x05,
+  CONFIG_SET_HEARTBEAT = 0x06,
+  CONFIG_DEFAULTS = 0x7F,
+};
+
+static const size_t CONFIG_WRITE_MAX = 32;  // longer writes are rejected as truncated
+
+// Applies the commands in data to cfg. defaults is what CONFIG_DEFAULTS
+// restores.
+ConfigStatus applyConfigCommands(const uint8_t* data, size_t length, const SensorConfig& defaults,
+                                 SensorConfig& cfg);
+
+// Client side: builds one write.
+class ConfigCommandBuilder {
+public:
+  ConfigCommandBuilder& interval(uint16_t ms);
+  ConfigCommandBuilder& filter(uint8_t kernel, uint8_t window);
+  ConfigCommandBuilder& threshold(uint16_t mm);
+  ConfigCommandBuilder& deadband(uint16_t mm);
+  ConfigCommandBuilder& mode(SendMode m);
+  ConfigCommandBuilder& heartbeat(uint16_t ms);
+  ConfigCommandBuilder& defaults();
+
+  const uint8_t* data() const { return buf_; }
+  size_t size() const { return len_; }
+  bool overflow() const { return overflow_; }  // ran past CONFIG_WRITE_MAX; size() stops before it
+
+private:
+  void put(const uint8_t* bytes, size_t n);
+
+  uint8_t buf_[CONFIG_WRITE_MAX];
+  size_t len_ = 0;
+  bool overflow_ = false;
+};
+
+// ====================== Stored form ======================
+// What NVS holds and what a read of the control characteristic returns:
+//
+//   offset  size  field
+//   0       1     CONFIG_BLOB_VERSION
+//   1       1     status of the last write (ConfigStatus)
+//   2       2     intervalMs
+//   4       1     filter
+//   5       1     window
+//   6       2     thresholdMm
+//   8       2     deadbandMm
+//   10      1     mode
+//   11      2     heartbeatMs (version 2)
+//
+// A blob of another version or that fails validation is rejected, so a
+// layout change falls back to the defaults instead of misreading old bytes.
+static const uint8_t CONFIG_BLOB_VERSION = 2;
+static const size_t CONFIG_BLOB_SIZE = 13;
+
+size_t encodeConfigBlob(const SensorConfig& c, ConfigStatus last, uint8_t* out);
+bool decodeConfigBlob(const uint8_t* data, size_t length, SensorConfig& out, ConfigStatus* last = nullptr);
+
+#ifdef ARDUINO
+#include <Preferences.h>
+
+// ====================== NVS ======================
+// One blob under one key. Writes only happen when a client changes
+// something, so flash wear is not a concern.
+class ConfigStore {
+public:
+  explicit ConfigStore(const char* ns = "sensorcfg") : ns_(ns) {}
+
+  // False (out untouched) when nothing valid is stored.
+  bool load(SensorConfig& out);
+  bool save(const SensorConfig& c);
+
+private:
+  const char* ns_;
+  Preferences prefs_;
+};
+#endif
@@ -0,0 +1,276 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <math.h>
+#include <string.h>
+
+// Streaming filter kernels for sensor data. Every kernel is allocation-free,
+// takes one sample per update() and returns the filtered value (NaN while it
+// has nothing to report). A NaN input marks a missed sample: windowed kernels
+// evict their oldest value so a long gap drains the window instead of
+// repeating stale data forever.
+
+// Build-flag selectors, e.g. build_flags = -D DSP_FILTER=DSP_FILTER_MEDIAN
+#define DSP_FILTER_MOVING_AVERAGE 0
+#define DSP_FILTER_EMA            1
+#define DSP_FILTER_MEDIAN         2
+#define DSP_FILTER_KALMAN         3
+
+// Sorted-window helpers shared by the median kernels: a binary search plus
+// a memmove of at most the window
+static inline size_t dspLowerBound(const float* sorted, size_t n, float x) {
+  size_t lo = 0, hi = n;
+  while (lo < hi) {
+    size_t mid = (lo + hi) / 2;
+    if (sorted[mid] < x) lo = mid + 1;
+    else hi = mid;
+  }
+  return lo;
+}
+
+static inline void dspInsertSorted(float* sorted, size_t& n, float x) {
+  size_t i = dspLowerBound(sorted, n, x);
+  memmove(&sorted[i + 1], &sorted[i], (n - i) * sizeof(float));
+  sorted[i] = x;
+  n++;
+}
+
+static inline void dspEraseSorted(float* sorted, size_t& n, float x) {
+  size_t i = dspLowerBound(sorted, n, x);
+  memmove(&sorted[i], &sorted[i + 1], (n - i - 1) * sizeof(float));
+  n--;
+}
+
+static inline float dspMedianOfSorted(const float* sorted, size_t n) {
+  if (n == 0) return NAN;
+  if (n & 1) return sorted[n / 2];
+  return 0.5f * (sorted[n / 2 - 1] + sorted[n / 2]);
+}
+
+// ====================== Moving average (running sum) ======================
+template <size_t N>
+class MovingAverageFilter {
+  static_assert(N > 0, "window must not be empty");
+
+public:
+  static constexpr size_t window() { return N; }
+
+  float update(float x) {
+    if (isnan(x)) {
+      if (count_ > 0) {
+        sum_ -= buf_[oldest()];
+        count_--;
+      }
+    } else {
+      if (count_ == N) {
+        sum_ -= buf_[head_];
+      } else {
+        count_++;
+      }
+      buf_[head_] = x;
+      sum_ += x;
+      head_ = (head_ + 1) % N;
+    }
+    return value();
+  }
+
+  float value() const { return count_ > 0 ? (float)(sum_ / count_) : NAN; }
+  size_t count() const { return count_; }
+  void reset() { head_ = 0; count_ = 0; sum_ = 0.0; }
+
+private:
+  size_t oldest() const { return (head_ + N - count_) % N; }
+
+  float buf_[N] = {};
+  size_t head_ = 0;
+  size_t count_ = 0;
+  double sum_ = 0.0;  // double keeps the add/subtract drift negligible
+};
+
+// ====================== Exponential moving average ======================
+class EmaFilter {
+public:
+  constexpr explicit EmaFilter(float alpha = 0.3f) : alpha_(alpha) {}
+
+  float update(float x) {
+    if (isnan(x)) return value_;
+    value_ = isnan(value_) ? x : value_ + alpha_ * (x - value_);
+    return value_;
+  }
+
+  float value() const { return value_; }
+  void reset() { value_ = NAN; }
+
+private:
+  float alpha_;
+  float value_ = NAN;
+};
+
+// ====================== Median of N (sorted ring) ======================
+// Keeps the window twice: in arrival order (to know what to evict) and sorted
+// (so the median is a lookup). Each update is one binary search plus a
+// memmove of at most N floats.
+template <size_t N>
+class MedianFilter {
+  static_assert(N > 0, "window must not be empty");
+
+public:
+  static constexpr size_t window() { return N; }
+
+  float update(float x) {
+    if (isnan(x)) {
+      if (count_ > 0) {
+        dspEraseSorted(sorted_, sortedLen_, ring_[oldest()]);
+        count_--;
+      }
+    } else {
+      if (count_ == N) {
+        dspEraseSorted(sorted_, sortedLen_, ring_[head_]);
+      } else {
+        count_++;
+      }
+      ring_[head_] = x;
+      dspInsertSorted(sorted_, sortedLen_, x);
+      head_ = (head_ + 1) % N;
+    }
+    return value();
+  }
+
+  float value() const { return dspMedianOfSorted(sorted_, count_); }
+
+  size_t count() const { return count_; }
+  void reset() { head_ = 0; count_ = 0; sortedLen_ = 0; }
+
+private:
+  size_t oldest() const { return (head_ + N - count_) % N; }
+
+  float ring_[N] = {};
+  float sorted_[N] = {};
+  size_t head_ = 0;
+  size_t count_ = 0;
+  size_t sortedLen_ = 0;
+};
+
+// ====================== 1-D Kalman filter ======================
+// Constant-position model: q is process noise (how fast the target may move),
+// r is measurement noise (sensor variance), both in cm^2.
+class KalmanFilter1D {
+public:
+  constexpr KalmanFilter1D(float q = 0.05f, float r = 4.0f) : q_(q), r_(r) {}
+
+  float update(float x) {
+    if (isnan(value_)) {
+      if (!isnan(x)) { value_ = x; p_ = r_; }
+      return value_;
+    }
+
+    p_ += q_;  // predict
+    if (!isnan(x)) {
+      float k = p_ / (p_ + r_);
+      value_ += k * (x - value_);
+      p_ *= (1.0f - k);
+    }
+    return value_;
+  }
+
+  float value() const { return value_; }
+  float variance() const { return p_; }
+  void reset() { value_ = NAN; p_ = 0.0f; }
+
+private:
+  float q_;
+  float r_;
+  float value_ = NAN;
+  float p_ = 0.0f;
+};
+
+// ====================== Kernel picked at run time ======================
+// The four kernels behind one object, for firmware that takes its filter
+// from stored settings instead of a build flag. The window is 1..
+// DSP_WINDOW_MAX samples: the moving average and median run over it, the
+// EMA uses the equivalent alpha = 2 / (window + 1), and the Kalman filter
+// keeps its own noise model and ignores it. configure() starts over.
+// DSP_WINDOW_MAX is the largest window the settings carry (one byte). The
+// median keeps its window sorted, as MedianFilter does, so a wide window
+// costs a binary search and a memmove per sample rather than a sort.
+static const size_t DSP_WINDOW_MAX = 255;
+
+class ConfigurableFilter {
+public:
+  ConfigurableFilter(uint8_t kernel = DSP_FILTER_MOVING_AVERAGE, size_t window = 5) { configure(kernel, window); }
+
+  // False (and no change) for an unknown kernel or a window out of range.
+  bool configure(uint8_t kernel, size_t window) {
+    if (kernel > DSP_FILTER_KALMAN || window < 1 || window > DSP_WINDOW_MAX) return false;
+    kernel_ = kernel;
+    window_ = window;
+    ema_ = EmaFilter(2.0f / (window + 1));
+    reset();
+    return true;
+  }
+
+  float update(float x) {
+    switch (kernel_) {
+      case DSP_FILTER_EMA: return ema_.update(x);
+      case DSP_FILTER_KALMAN: return kalman_.update(x);
+      default: break;
+    }
+
+    bool median = kernel_ == DSP_FILTER_MEDIAN;
+    if (isnan(x)) {
+      if (count_ > 0) {
+        sum_ -= ring_[oldest()];
+        if (median) dspEraseSorted(sorted_, sortedLen_, ring_[oldest()]);
+        count_--;
+      }
+    } else {
+      if (count_ == window_) {
+        sum_ -= ring_[head_];
+        if (median) dspEraseSorted(sorted_, sortedLen_, ring_[head_]);
+      } else {
+        count_++;
+      }
+      ring_[head_] = x;
+      sum_ += x;
+      if (median) dspInsertSorted(sorted_, sortedLen_, x);
+      head_ = (head_ + 1) % window_;
+    }
+    return value();
+  }
+
+  float value() const {
+    switch (kernel_) {
+      case DSP_FILTER_EMA: return ema_.value();
+      case DSP_FILTER_KALMAN: return kalman_.value();
+      case DSP_FILTER_MEDIAN: return dspMedianOfSorted(sorted_, sortedLen_);
+      default: return count_ > 0 ? (float)(sum_ / count_) : NAN;
+    }
+  }
+
+  uint8_t kernel() const { return kernel_; }
+  size_t window() const { return window_; }
+
+  void reset() {
+    head_ = 0;
+    count_ = 0;
+    sortedLen_ = 0;
+    sum_ = 0.0;
+    ema_.reset();
+    kalman_.reset();
+  }
+
+private:
+  size_t oldest() const { return (head_ + window_ - count_) % window_; }
+
+  uint8_t kernel_ = DSP_FILTER_MOVING_AVERAGE;
+  size_t window_ = 1;
+  float ring_[DSP_WINDOW_MAX] = {};
+  float sorted_[DSP_WINDOW_MAX] = {};  // the median's window, sorted
+  size_t sortedLen_ = 0;
+  size_t head_ = 0;
+  size_t count_ = 0;
+  double sum_ = 0.0;
+  EmaFilter ema_;
+  KalmanFilter1D kalman_{0.05f, 4.0f};
+};
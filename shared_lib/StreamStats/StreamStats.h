@@ -0,0 +1,215 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <math.h>
+
+// ====================== P² quantile estimator ======================
+// Jain & Chlamtac's P² algorithm: tracks one quantile with five markers,
+// O(1) per update and no stored samples.
+class P2Quantile {
+public:
+  explicit P2Quantile(float p = 0.5f) : p_(p) { reset(); }
+
+  void reset() {
+    n_ = 0;
+    for (int i = 0; i < 5; i++) pos_[i] = (float)(i + 1);
+    want_[0] = 1.0f;
+    want_[1] = 1.0f + 2.0f * p_;
+    want_[2] = 1.0f + 4.0f * p_;
+    want_[3] = 3.0f + 2.0f * p_;
+    want_[4] = 5.0f;
+    step_[0] = 0.0f;
+    step_[1] = p_ / 2.0f;
+    step_[2] = p_;
+    step_[3] = (1.0f + p_) / 2.0f;
+    step_[4] = 1.0f;
+  }
+
+  void add(float x) {
+    if (n_ < 5) {
+      // Insertion sort of the first five samples
+      int i = n_++;
+      while (i > 0 && q_[i - 1] > x) { q_[i] = q_[i - 1]; i--; }
+      q_[i] = x;
+      return;
+    }
+    n_++;
+
+    int k;
+    if (x < q_[0]) { q_[0] = x; k = 0; }
+    else if (x >= q_[4]) { q_[4] = x; k = 3; }
+    else { k = 0; while (x >= q_[k + 1]) k++; }
+
+    for (int i = k + 1; i < 5; i++) pos_[i] += 1.0f;
+    for (int i = 0; i < 5; i++) want_[i] += step_[i];
+
+    for (int i = 1; i < 4; i++) {
+      float d = want_[i] - pos_[i];
+      if ((d >= 1.0f && pos_[i + 1] - pos_[i] > 1.0f) ||
+          (d <= -1.0f && pos_[i - 1] - pos_[i] < -1.0f)) {
+        float s = d >= 0.0f ? 1.0f : -1.0f;
+        float qp = parabolic(i, s);
+        q_[i] = (q_[i - 1] < qp && qp < q_[i + 1]) ? qp : linear(i, s);
+        pos_[i] += s;
+      }
+    }
+  }
+
+  float value() const {
+    if (n_ == 0) return NAN;
+    if (n_ < 5) {
+      // Too few samples for markers: nearest rank on the sorted prefix
+      int idx = (int)(p_ * (n_ - 1) + 0.5f);
+      return q_[idx];
+    }
+    return q_[2];
+  }
+
+  uint32_t count() const { return n_; }
+
+private:
+  float parabolic(int i, float s) const {
+    return q_[i] + s / (pos_[i + 1] - pos_[i - 1]) *
+      ((pos_[i] - pos_[i - 1] + s) * (q_[i + 1] - q_[i]) / (pos_[i + 1] - pos_[i]) +
+       (pos_[i + 1] - pos_[i] - s) * (q_[i] - q_[i - 1]) / (pos_[i] - pos_[i - 1]));
+  }
+
+  float linear(int i, float s) const {
+    int j = i + (int)s;
+    return q_[i] + s * (q_[j] - q_[i]) / (pos_[j] - pos_[i]);
+  }
+
+  float p_;
+  uint32_t n_;
+  float q_[5];
+  float pos_[5];
+  float want_[5];
+  float step_[5];
+};
+
+// ====================== Streaming statistics ======================
+// Constant-memory accumulator: count, min/max, Welford mean/variance, a
+// fixed-bucket histogram over [lo, hi) and P² estimates of p50/p95/p99.
+// merge() combines accumulators (across reconnects or servers). P² markers
+// cannot be merged, so a merged accumulator answers percentiles from the
+// histogram instead, interpolated within the bucket.
+template <size_t BINS>
+class StreamStats {
+  static_assert(BINS > 0, "need at least one histogram bucket");
+
+public:
+  StreamStats(float lo, float hi) : lo_(lo), hi_(hi) { reset(); }
+
+  void reset() {
+    n_ = 0;
+    mean_ = 0.0;
+    m2_ = 0.0;
+    min_ = INFINITY;
+    max_ = -INFINITY;
+    underflow_ = overflow_ = 0;
+    for (size_t i = 0; i < BINS; i++) bins_[i] = 0;
+    p50_.reset();
+    p95_.reset();
+    p99_.reset();
+    merged_ = false;
+  }
+
+  void add(float x) {
+    if (isnan(x)) return;
+
+    n_++;
+    double d = x - mean_;
+    mean_ += d / n_;
+    m2_ += d * (x - mean_);
+    if (x < min_) min_ = x;
+    if (x > max_) max_ = x;
+
+    if (x < lo_) underflow_++;
+    else if (x >= hi_) overflow_++;
+    else bins_[bucketOf(x)]++;
+
+    p50_.add(x);
+    p95_.add(x);
+    p99_.add(x);
+  }
+
+  // Chan et al. pairwise combination of mean/M2, plus histogram sums.
+  // Both accumulators must share the same bucket layout.
+  void merge(const StreamStats& o) {
+    if (o.n_ == 0) return;
+    if (n_ == 0) {
+      *this = o;
+      merged_ = true;
+      return;
+    }
+
+    uint32_t n = n_ + o.n_;
+    double d = o.mean_ - mean_;
+    mean_ += d * o.n_ / n;
+    m2_ += o.m2_ + d * d * ((double)n_ * o.n_ / n);
+    n_ = n;
+    if (o.min_ < min_) min_ = o.min_;
+    if (o.max_ > max_) max_ = o.max_;
+    underflow_ += o.underflow_;
+    overflow_ += o.overflow_;
+    for (size_t i = 0; i < BINS; i++) bins_[i] += o.bins_[i];
+    merged_ = true;
+  }
+
+  uint32_t count() const { return n_; }
+  float min() const { return n_ ? min_ : NAN; }
+  float max() const { return n_ ? max_ : NAN; }
+  float mean() const { return n_ ? (float)mean_ : NAN; }
+  float variance() const { return n_ > 1 ? (float)(m2_ / (n_ - 1)) : NAN; }
+  float stddev() const { return sqrtf(variance()); }
+
+  float p50() const { return merged_ ? percentile(0.50f) : p50_.value(); }
+  float p95() const { return merged_ ? percentile(0.95f) : p95_.value(); }
+  float p99() const { return merged_ ? percentile(0.99f) : p99_.value(); }
+
+  // Histogram percentile, linear within the bucket and clamped to min/max.
+  float percentile(float p) const {
+    if (n_ == 0) return NAN;
+    float target = p * n_;
+    float seen = (float)underflow_;
+    if (target <= seen) return min_;
+
+    const float width = (hi_ - lo_) / BINS;
+    for (size_t i = 0; i < BINS; i++) {
+      if (bins_[i] > 0 && seen + bins_[i] >= target) {
+        float v = lo_ + width * (i + (target - seen) / bins_[i]);
+        return v < min_ ? min_ : (v > max_ ? max_ : v);
+      }
+      seen += bins_[i];
+    }
+    return max_;
+  }
+
+  static constexpr size_t buckets() { return BINS; }
+  uint32_t bucket(size_t i) const { return bins_[i]; }
+  float bucketLow(size_t i) const { return lo_ + (hi_ - lo_) * i / BINS; }
+  uint32_t underflow() const { return underflow_; }
+  uint32_t overflow() const { return overflow_; }
+
+private:
+  size_t bucketOf(float x) const {
+    size_t i = (size_t)((x - lo_) * BINS / (hi_ - lo_));
+    return i < BINS ? i : BINS - 1;
+  }
+
+  float lo_;
+  float hi_;
+  uint32_t n_;
+  double mean_;
+  double m2_;
+  float min_;
+  float max_;
+  uint32_t underflow_;
+  uint32_t overflow_;
+  uint32_t bins_[BINS];
+  P2Quantile p50_{0.50f};
+  P2Quantile p95_{0.95f};
+  P2Quantile p99_{0.99f};
+  bool merged_;
+};